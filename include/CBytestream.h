@@ -23,6 +23,7 @@
 #include <SDL.h> // for SInt16
 #include <string>
 #include <set>
+#include <algorithm>
 #include "olx-types.h"
 #include "Networking.h"
 #include "SmartPointer.h"
@@ -33,33 +34,78 @@ struct Logger;
 struct PrintOutFct;
 struct CustomVar;
 
+/*
+	Small data stays in the std::string itself. When a stream grows beyond
+	that, it takes a buffer from a pool, and gives it back in the destructor,
+	so temporary bytestreams (we have a lot of them, e.g. one per packet)
+	usually don't allocate anything.
+
+	The *View() functions don't copy the data; the returned View points into
+	the stream and is valid only as long as the stream is not changed.
+*/
 class CBytestream {
 public:
-	CBytestream() : pos(0), bitPos(0), Data("") {}
-	CBytestream(const std::string& rawData) : pos(0), bitPos(0), Data(rawData) {}
+	struct View {
+		const char* ptr;
+		size_t size;
+		View() : ptr(NULL), size(0) {}
+		View(const char* p, size_t s) : ptr(p), size(s) {}
+		bool empty() const { return size == 0; }
+		std::string str() const { return std::string(ptr, size); }
+	};
+
+	CBytestream() : pos(0), bitPos(0) {}
+	CBytestream(const std::string& rawData) : pos(0), bitPos(0) { writeData(rawData); }
+	CBytestream(const View& rawData) : pos(0), bitPos(0) { writeData(rawData); }
 	
-	CBytestream(const CBytestream& bs) {
+	CBytestream(const CBytestream& bs) : pos(0), bitPos(0) {
 		operator=(bs);
 	}
 	
+	// takes the buffer of bs, bs is empty afterwards
+	CBytestream(CBytestream&& bs) : pos(bs.pos), bitPos(bs.bitPos) {
+		Data.swap(bs.Data);
+		bs.pos = bs.bitPos = 0;
+	}
+	
+	~CBytestream() { releaseBuffer(); }
+	
 	CBytestream& operator=(const CBytestream& bs) {
+		if(this == &bs) return *this;
+		Data.clear();
+		writeRaw(bs.Data.data(), bs.Data.size());
 		pos = bs.pos;
-		Data = bs.Data;
 		bitPos = bs.bitPos;
 		return *this;
 	}
 	
+	CBytestream& operator=(CBytestream&& bs) {
+		if(this == &bs) return *this;
+		pos = bs.pos; bitPos = bs.bitPos;
+		Data.swap(bs.Data);
+		bs.Clear();
+		return *this;
+	}
+	
 private:
 	// Attributes
 	size_t pos;
 	size_t bitPos;
 	std::string Data;
 
+	void releaseBuffer();
+	// makes space for n more bytes, growing in bigger steps than std::string does
+	void reserveAhead(size_t n) { if(Data.size() + n > Data.capacity()) growBuffer(n); }
+	void growBuffer(size_t n);
+	bool writeRaw(const void* p, size_t n) { reserveAhead(n); Data.append((const char*)p, n); return true; }
+
 public:
 	// Methods
 
 	// Debug
 	void		Test();
+	// builds S2C_UPDATEWORMS-like packets for all clients and reports the speed
+	static void	Benchmark(int clients, int worms);
 
 
 	// Generic data
@@ -72,16 +118,19 @@ public:
 	void		revertByte()		{ assert(pos > 0); pos--; }
 	void		flushOld()			{ Data.erase(0, pos); pos = 0; }
 	std::string	getRawData(size_t start, size_t end) { assert(start <= end); return Data.substr(start, end - start + 1); } 
+	View		getRawDataView(size_t start, size_t end) const { assert(start <= end && start <= Data.size()); return View(Data.data() + start, std::min(end - start + 1, Data.size() - start)); }
+	void		reserve(size_t size) { if(size > Data.capacity()) Data.reserve(size); }
 	
 	void		Clear();
 	void		Append(CBytestream *bs);
+	void		Append(CBytestream&& bs); // bs is empty afterwards
 	
 	// Note: marks positions are relative to start; start=0 means from the very beginning of the stream (not from pos)
     void        Dump(const PrintOutFct& printer, const std::set<size_t>& marks = std::set<size_t>(), size_t start = 0, size_t count = (size_t)-1);
 	void		Dump();
 
 	// Writes
-	bool		writeByte(uchar byte);
+	bool		writeByte(uchar byte) { reserveAhead(1); Data += (char)byte; return true; }
 	bool		writeBool(bool value);
 	bool		writeInt(int value, uchar numbytes);
 	bool		writeInt16(Sint16 value);
@@ -91,7 +140,9 @@ public:
 	bool		write2Int12(short x, short y);
 	bool		write2Int4(short x, short y);
 	bool		writeBit(bool bit);
+	bool		writeBits(Uint32 value, int bits); // up to 32 bits, the lowest first like writeBit()
 	bool		writeData(const std::string& value);	// Do not append '\0' at the end, writes just the raw data
+	bool		writeData(const View& value)	{ return writeRaw(value.ptr, value.size); }
 	bool		writeVar(const ScriptVar_t& var, const CustomVar* diffToOld = NULL);
 	
 	// Reads
@@ -106,12 +157,16 @@ public:
 	void		read2Int12(short& x, short& y);
 	void		read2Int4(short& x, short& y);
 	bool		readBit();
+	Uint32		readBits(int bits);
 	std::string	readData( size_t size = (size_t)(-1) );
+	View		readDataView( size_t size = (size_t)(-1) );
+	View		readStringView(); // without the terminating '\0'
 	bool		readVar(ScriptVar_t& var);
 
 	// Peeks
 	uchar		peekByte() const;
 	std::string	peekData(size_t len) const;
+	View		peekDataView(size_t len) const;
 
 	const std::string& data() const { return Data; }
 	
@@ -124,6 +179,8 @@ public:
 	bool		SkipString();
 	void		SkipAll()		{ pos = Data.size(); }
 	bool	SkipRestBits() { if(isPosAtEnd()) return true; ResetBitPos(); pos++; return isPosAtEnd(); }
+	// continue reading at the next byte if we are in the middle of one
+	void	AlignReadToByte() { if(bitPos != 0) { bitPos = 0; pos++; } }
 	bool SkipVar();
 
 	// Networking stuff
@@ -18,6 +18,7 @@
 #define __CCHANNEL_H__
 
 #include <list>
+#include <deque>
 #include "CBytestream.h"
 #include "olx-types.h"
 #include "Networking.h"
@@ -144,6 +145,8 @@ public:
 	// It should return empty data from time to time when channel is inactive, so clients won't timeout.
 	virtual bool	Process( CBytestream *bs ) = 0;
 	virtual void	AddReliablePacketToSend(CBytestream& bs); // Common for CChannel_056b and CChannel2
+	// Same, but the channel may take the data instead of copying it; bs is empty afterwards then
+	virtual void	AddReliablePacketToSend(CBytestream&& bs) { AddReliablePacketToSend(bs); }
 	
 	size_t			getPacketLoss()		{ return iPacketsDropped; }
 	AbsTime			getLastReceived()	{ return fLastPckRecvd; }
@@ -349,11 +352,102 @@ public:
 	bool		getBufferEmpty()	{ return ReliableOut.empty(); };
 	bool		getBufferFull()		{ return (int)ReliableOut.size() >= MaxNonAcknowledgedPackets; };
 
+	using CChannel::AddReliablePacketToSend;
 	void		AddReliablePacketToSend(CBytestream& bs); // The same as in CChannel but without error msg
 
 	friend void TestCChannelRobustness();
 };
 
+// Sliding window CChannel: selective acknowledges, retransmission timeouts from the
+// measured round trip time and a congestion window instead of a fixed amount of
+// packets in flight. See CChannel.cpp for the packet format.
+class CChannel4: public CChannel {
+	
+private:
+	struct OutPacket
+	{
+		int seq;
+		std::list<CBytestream>::iterator msg;	// The data is not copied, we send it right from the message
+		size_t offset, size;					// The part of the message in this packet
+		bool fragmented;						// More parts of the message follow
+		bool sacked;							// Other side has it, but misses some before it
+		bool lost;								// Has to be sent again
+		int transmissions;
+		AbsTime lastSent;
+	};
+	struct InPacket
+	{
+		bool received;
+		bool fragmented;
+		CBytestream data;
+		InPacket(): received(false), fragmented(false) { };
+	};
+
+	std::list<CBytestream>	OutMessages;	// The messages in ReliableOut
+	std::deque<OutPacket>	ReliableOut;	// Not acknowledged packets, ReliableOut[i] has the index LastReliableOut + 1 + i
+	int				LastReliableOut;		// Last packet acknowledged in sequence by the other side
+	int				LastAddedToOut;			// Index of ReliableOut.back()
+	int				LastSentOut;			// Highest packet index sent so far
+
+	std::deque<InPacket>	ReliableIn;		// Packets after a missing one, ReliableIn[i] has the index LastReliableIn + 1 + i
+	std::list<InPacket>		ReliableInReady;	// Packets in sequence, waiting for Process()
+	int				LastReliableIn;			// Last packet received in sequence
+	bool			AckNeeded;				// We got reliable data since the last packet we sent
+
+	// Round trip time estimation, sec
+	float			SmoothedRTT;			// 0 until we have the first sample
+	float			RTTVariance;
+	float			RetransmitTimeout;
+	AbsTime			NewestAckedSent;		// When the most recently sent acknowledged packet was sent
+	AbsTime			LastAckTime;			// When we got the last new acknowledge
+
+	// Congestion control, in packets
+	float			CongestionWindow;
+	float			SlowStartThreshold;
+	int				RecoverySequence;		// The window is not reduced again until this one is acknowledged, -1 if not recovering
+
+	// How much to wait before sending another empty keep-alive packet, sec.
+	float			KeepAlivePacketTimeout;
+
+	size_t			iRetransmissions;
+	size_t			iTimeouts;
+
+	void			FillWindow();
+	void			UpdateRTT(float sample);
+	void			DetectLostPackets();
+	void			WriteAcks(CBytestream *bs);
+	bool			GetPacketFromBuffer(CBytestream *bs);
+
+public:
+
+	// Constructor
+	CChannel4() { Clear(); }
+	
+	// Methods
+	void		Create(const NetworkAddr& _adr, const SmartPointer<NetworkSocket>& _sock);
+	// This may send several net packets if the congestion window allows it
+	void		Transmit( CBytestream *bs );
+	// Same as CChannel3::Process()
+	bool		Process( CBytestream *bs );
+	void		Clear();
+
+	bool		getBufferEmpty()	{ return ReliableOut.empty(); };
+	bool		getBufferFull();
+
+	void		AddReliablePacketToSend(CBytestream& bs); // The same as in CChannel but without error msg, big messages are fragmented
+	void		AddReliablePacketToSend(CBytestream&& bs); // Takes the data without copying it
+
+	size_t		getRetransmissions() const	{ return iRetransmissions; }
+	size_t		getTimeouts() const			{ return iTimeouts; }
+	float		getCongestionWindow() const	{ return CongestionWindow; }
+	float		getRetransmitTimeout() const	{ return RetransmitTimeout; }
+
+	friend void TestCChannelRobustness();
+};
+
 void TestCChannelRobustness();
+// Throughput and latency of CChannel3 and CChannel4 over a simulated link.
+// packetLoss and reorder are in percent, reordered packets get an additional delay of lagMax.
+void TestCChannelLossyLink(int packetLoss, int lagMin, int lagMax, int reorder);
 
 #endif  //  __CCHANNEL_H__
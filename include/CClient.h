@@ -34,7 +34,7 @@
 #include "CWpnRest.h"
 #include "Consts.h"
 #include "CViewport.h"
-#include "SafeVector.h"
+#include "ProjectileGrid.h"
 #include "game/GameMode.h"
 #include "game/EngineSettings.h"
 
@@ -216,24 +216,10 @@ private:
 	// Projectiles
 	typedef FastVector<CProjectile,MAX_PROJECTILES> Projectiles;
 	Projectiles	cProjectiles;
-	Projectiles	NewNet_SavedProjectiles;
+	ProjectileSimData cProjectileSimData;
 	
 public:
-	struct MapPosIndex {
-		static const int GRIDW = 20, GRIDH = 20;
-		int x, y;
-		MapPosIndex(int _x = 0, int _y = 0) : x(_x), y(_y) {}
-		MapPosIndex(const VectorD2<int>& v) { x = v.x / GRIDW; y = v.y / GRIDH; }
-		
-		bool operator==(const MapPosIndex& i) const { return x == i.x && y == i.y; }
-		bool operator!=(const MapPosIndex& i) const { return !(*this == i); }
-		bool operator<(const MapPosIndex& i) const { return y < i.y || (y == i.y && x < i.x); }
-		
-		long index(const CMap* m) const;
-	};
-	typedef std::set<CProjectile*> ProjectileSet;
-	typedef SafeVector<ProjectileSet> ProjectilePosMap;
-	ProjectilePosMap projPosMap;
+	ProjectileGrid projPosMap;
 	
 private:	
 	// Game
@@ -450,8 +436,9 @@ public:
 	void		DrawPlayerWaiting(SDL_Surface * bmpDest);
 	void		DrawBox(SDL_Surface * dst, int x, int y, int w);
 	void		Draw(const SmartPointer<SDL_Surface>& bmpDest);
-	void		DrawViewport(const SmartPointer<SDL_Surface>& bmpDest, int viewport_index);
-	void		DrawViewport_Game(const SmartPointer<SDL_Surface>& bmpDest, CViewport* v);
+	void		DrawViewport(const SmartPointer<SDL_Surface>& bmpDest, int viewport_index, bool mapDrawn = false);
+	void		DrawViewport_Game(const SmartPointer<SDL_Surface>& bmpDest, CViewport* v, bool mapDrawn = false);
+	bool		DrawViewports_Parallel(const SmartPointer<SDL_Surface>& bmpDest);
 	void		DrawProjectiles(SDL_Surface * bmpDest, CViewport *v);
     void        DrawProjectileShadows(SDL_Surface * bmpDest, CViewport *v);
 	void		InitializeGameMenu();
@@ -619,9 +606,10 @@ public:
 	void		setOnMapDlFinished(DownloadFinishedCB f)  { tMapDlCallback = f; }
 	void		setOnModDlFinished(DownloadFinishedCB f)  { tModDlCallback = f; }
 	
-	void		NewNet_SaveProjectiles();
-	void		NewNet_LoadProjectiles();
+	void		NewNet_SaveProjectiles(GameStateArena& arena);
+	bool		NewNet_LoadProjectiles(GameStateArena::Reader& r);
 	Projectiles & getProjectiles()		{ return cProjectiles; }
+	ProjectileSimData & getProjectileSimData()	{ return cProjectileSimData; }
 	
 	void		DumpGameState(CmdLineIntf* caller);
 	
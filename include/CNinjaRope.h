@@ -18,6 +18,7 @@
 #define __CNINJAROPE_H__
 
 #include "game/CGameObject.h"
+#include "GameStateArena.h"
 #include "gusanos/events.h"
 #include "CVec.h"
 #include "util/angle.h"
@@ -75,6 +76,8 @@ public:
 
 	void		write(CBytestream *bs) const;
 	void		read(CBytestream *bs, int owner);
+	void		NewNet_SaveState(GameStateArena& arena) const;
+	bool		NewNet_LoadState(GameStateArena::Reader& r);
 
     CVec getHookPos() const       { return getPos(); }
     bool   isAttached() const       { return HookAttached; }
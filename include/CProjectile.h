@@ -25,6 +25,7 @@
 #include "Color.h"
 #include "Consts.h"
 #include "game/CGameObject.h"
+#include "GameStateArena.h"
 
 struct SDL_Surface;
 class CWorm;
@@ -203,6 +204,10 @@ public:
 	
 	void	updateCollMapInfo(const VectorD2<int>* oldPos = NULL, const VectorD2<int>* oldRadius = NULL);
 	
+	// The simulation state for the NewNet rollback; the projectile must be used
+	void	NewNet_SaveState(GameStateArena& arena) const;
+	bool	NewNet_LoadState(GameStateArena::Reader& r);
+	
 	// HINT: saves the current time of the simulation
 	// we need to save this also per projectile as they can have different
 	// simulation times (different times of spawning or remote projectiles)
@@ -212,4 +217,26 @@ public:
 };
 
 
+/*
+	Per-slot physics parameters of the projectiles, in one contiguous array each.
+	The slot is the index in the projectile FastVector of CClient.
+	These are derived from proj_t/radius at spawn time (and updated when the
+	radius changes), so the per-step physics code doesn't need to chase the
+	proj_t pointer or calculate a sqrt each time.
+*/
+struct ProjectileSimData {
+	float gravity[MAX_PROJECTILES]; // without the FT_ProjGravityFactor
+	float dampening[MAX_PROJECTILES];
+	float frictionSize[MAX_PROJECTILES];
+	float frictionMass[MAX_PROJECTILES];
+	unsigned int generation[MAX_PROJECTILES]; // increased on each spawn into the slot
+
+	void set(int slot, const proj_t* info, const VectorD2<int>& radius);
+	void setRadius(int slot, const VectorD2<int>& radius) {
+		frictionSize[slot] = (radius.x + radius.y) * 0.5f;
+		frictionMass[slot] = radius.GetLength();
+	}
+};
+
+
 #endif  //  __CPROJECTILE_H__
@@ -18,6 +18,7 @@
 #define	__CSERVER_H__
 
 #include <string>
+#include <unordered_map>
 #include "Networking.h"
 #include "SmartPointer.h"
 #include "CBonus.h"
@@ -71,8 +72,9 @@ public:
 		NetworkAddr		tAddress;
 		AbsTime			fLastUsed;
 		bool			bClientConnected;
+		bool			bRemoved; // erased from tNatClients in CheckTimeouts
 		
-		NatConnection() : bClientConnected(false) { tTraverseSocket = new NetworkSocket(); tConnectHereSocket = new NetworkSocket(); }
+		NatConnection() : bClientConnected(false), bRemoved(false) { tTraverseSocket = new NetworkSocket(); tConnectHereSocket = new NetworkSocket(); }
 	};
 
 private:
@@ -100,8 +102,11 @@ private:
 	int				nPort;
 	typedef std::list< SmartPointer<NatConnection> > NatConnList;
 	NatConnList	tNatClients;
+	typedef std::unordered_map<Uint64, int> ClientAddrMap;
+	ClientAddrMap	m_clientsByAddr; // GetNetAddrKey of the channel address -> index in cClients
 	challenge_t		tChallenges[MAX_CHALLENGES]; // TODO: use std::list or vector
 	CShootList		cShootList;
+	Event<CHttp::HttpEventData> onHttpFinished; // tHttp/tHttp2 finished, in the main thread; keep it before them
 	CHttp			tHttp;
 	CHttp			tHttp2;
 	bool			bLocalClientConnected;
@@ -111,6 +116,7 @@ private:
 	AbsTime		fLastUpdateSent;
 
 	bool		bServerRegistered;
+	bool		bRegistering; // tHttp is used by the registration (and not the de-registration)
 	AbsTime		fLastRegister;
 	std::string sCurrentUrl;
 	std::list<std::string>::iterator	tCurrentMasterServer;
@@ -166,6 +172,9 @@ public:
 	void		SendPackets(bool sendPendingOnly = false);
 
 	bool		ReadPacketsFromSocket(const SmartPointer<NetworkSocket>& sock);
+	void		addClientAddr(CServerConnection* cl);
+	void		removeClientAddr(CServerConnection* cl);
+	CServerConnection* clientByAddr(const NetworkAddr& addr);
 
 	int			getPort() { return nPort; }
 	bool		checkBandwidth(CServerConnection *cl);
@@ -175,7 +184,11 @@ public:
 	void		ProcessGetExternalIP();
 	void		RegisterServer();
 	void		RegisterServerUdp();
+	void		RegisterServerUdp(uint f, NetworkAddr addr);
 	void		ProcessRegister();
+	void		Http_onFinished(CHttp::HttpEventData d);
+	void		Http_onFinishedMainThread(CHttp::HttpEventData d);
+	void		Dns_onReady(DnsEventData d);
 	void		CheckRegister();
 	bool		DeRegisterServer();
 	void		DeRegisterServerUdp();
@@ -27,6 +27,8 @@
 #include "Version.h"
 #include "FileDownload.h"
 #include "IpToCountryDB.h"
+#include "WormUpdateScheduler.h"
+#include "InterestManager.h"
 
 class CChannel;
 class CWorm;
@@ -82,6 +84,8 @@ private:
 	CBytestream	bsUnreliable;
 
 	CShootList	cShootList;
+	WormUpdateScheduler cWormUpdates;
+	ClientInterest	cInterest;
 public:
 	GameState*	gameState;
 private:
@@ -149,6 +153,8 @@ public:
 	void		setNetSpeed(int _n)			{ iNetSpeed = _n; }
 
 	CShootList	*getShootList()				{ return &cShootList; }
+	WormUpdateScheduler *getWormUpdates()	{ return &cWormUpdates; }
+	ClientInterest *getInterest()			{ return &cInterest; }
 
     void        setZombieTime(const AbsTime& z)      { fZombieTime = z; }
     AbsTime       getZombieTime()      	   { return fZombieTime; }
@@ -201,6 +201,12 @@ public:
 	
 	void setDestination(int w, int h);
 	void gusRender(const SmartPointer<SDL_Surface>& bmpDest);
+	
+	// gusRender in three steps. Only gusRenderMap may run in another thread
+	// (for each viewport in its own, see CClient::DrawViewports_Parallel).
+	void gusRenderPrepare(const SmartPointer<SDL_Surface>& bmpDest);
+	void gusRenderMap();
+	void gusRenderObjects(const SmartPointer<SDL_Surface>& bmpDest);
 		
 	void drawLight(IVec const& v); // TEMP
 	
@@ -16,8 +16,12 @@
 #include "game/CWorm.h"
 #include "game/WormInputHandler.h"
 
-class searchpath_base;
-struct NEW_ai_node_t;
+// a node of the bot path; the nodes are in one array, linked in both directions
+struct NEW_ai_node_t {
+	float fX, fY;
+	NEW_ai_node_t *psPrev, *psNext;
+	NEW_ai_node_t() : fX(0), fY(0), psPrev(NULL), psNext(NULL) {}
+};
 
 class CWormBotInputHandler : public CWormInputHandler {
 public:
@@ -78,14 +82,15 @@ protected:
 	
     // Path Finding
 	AbsTime       fLastPathUpdate;
-	bool		bPathFinished;
-	AbsTime		fSearchStartTime;
-	
-	searchpath_base*	pathSearcher;
 	
+	std::vector<NEW_ai_node_t> NEW_pathNodes;
 	NEW_ai_node_t	*NEW_psPath;
 	NEW_ai_node_t	*NEW_psCurrentNode;
 	NEW_ai_node_t	*NEW_psLastNode;
+
+	Uint32		iPathSearch; // NavSearchPool ticket of the running search, 0 if none
+	float		fPathBudget; // for the searches, in NavGraph::Search::work() units
+	AbsTime		fLastPathBudget;
 	
 	
 public:
@@ -108,8 +113,8 @@ public:
     void        AI_SimpleMove(bool bHaveTarget=true);
 	//    void        AI_PreciseMove();
 	
-    void		AI_splitUpNodes(NEW_ai_node_t* start, NEW_ai_node_t* end);
-    void		AI_storeNodes(NEW_ai_node_t* start, NEW_ai_node_t* end);
+    void		AI_SetPath(const std::vector<CVec>& points, size_t current = 0);
+    void		AI_AppendPathNode(CVec p);
 	
     int         AI_FindClearingWeapon();
     bool        AI_Shoot();
@@ -135,6 +140,8 @@ public:
 	bool		AI_IsInAir(CVec pos, int area_a=3);
 	CVec		AI_FindClosestFreeSpotDir(CVec vPoint, CVec vDirection, int Direction);
 	int			AI_CreatePath(bool force_break = false);
+	bool		AI_CheckPathSearch();
+	void		AI_CancelPathSearch();
 	void		AI_MoveToTarget();
 	void		AI_Carve();
 	bool		AI_Jump();
@@ -101,6 +101,12 @@ public:
 		}
 	}
 
+	// call this when you manually have made an obj used (e.g. restored a saved state into it)
+	void refreshUsedObj(int index) {
+		if(index > m_lastUsed) m_lastUsed = index;
+		if(index == m_firstUnused) findNewFirstUnused();
+	}
+
 	class Iterator : public ::Iterator<_Obj*> {
 	private:
 		int m_index;
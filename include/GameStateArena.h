@@ -0,0 +1,102 @@
+/*
+ *  GameStateArena.h
+ *  OpenLieroX
+ *
+ *  ring buffer of serialized game states for the NewNet rollback
+ *
+ *  code under LGPL
+ *
+ */
+
+#ifndef __OLX__GAMESTATEARENA_H__
+#define __OLX__GAMESTATEARENA_H__
+
+#include <vector>
+#include <cstddef>
+#include <cstring>
+#include <SDL.h>
+
+/*
+	Keeps the simulation state of the last N ticks. Every tick is one
+	contiguous block in a preallocated buffer; the objects append their
+	plain state data to it (see CProjectile::NewNet_SaveState() and
+	CWorm::NewNet_SaveState()) and read it back in the same order.
+
+	The terrain is not stored here, CMap keeps the changed tiles per tick
+	(TerrainHistory) in sync with this.
+
+	Saving a tick never allocates, except when a block becomes bigger than
+	the slot size; then all slots are grown.
+*/
+class GameStateArena {
+public:
+	class Reader {
+	public:
+		Reader() : m_pos(NULL), m_end(NULL) {}
+		Reader(const char* data, size_t size) : m_pos(data), m_end(data + size) {}
+
+		bool read(void* dst, size_t size) {
+			if(size > (size_t)(m_end - m_pos)) { m_pos = m_end; return false; }
+			memcpy(dst, m_pos, size);
+			m_pos += size;
+			return true;
+		}
+		template<typename T> bool read(T& v) { return read(&v, sizeof(T)); }
+		bool skip(size_t size) {
+			if(size > (size_t)(m_end - m_pos)) { m_pos = m_end; return false; }
+			m_pos += size;
+			return true;
+		}
+		bool isEmpty() const { return m_pos >= m_end; }
+		size_t left() const { return m_end - m_pos; }
+
+	private:
+		const char* m_pos;
+		const char* m_end;
+	};
+
+	GameStateArena();
+
+	void init(size_t historyLen, size_t slotSize = 64 * 1024);
+	void clear();
+	size_t historyLen() const { return m_historyLen; }
+	size_t count() const { return m_count; }
+
+	// Starts a new tick block; the oldest one is dropped if the history is full
+	void beginTick(Uint64 tick);
+	void write(const void* data, size_t size);
+	template<typename T> void write(const T& v) { write(&v, sizeof(T)); }
+	// Current offset in the tick block, and overwriting data written before
+	size_t tell() const;
+	void patch(size_t pos, const void* data, size_t size);
+
+	// age 0 is the newest tick
+	Reader reader(size_t age) const;
+	Uint64 tickAt(size_t age) const;
+	// after a rollback the newer states are computed again
+	void dropNewest(size_t n);
+
+	size_t memorySize() const { return m_data.capacity(); }
+
+	// simulates a projectile swarm with terrain carving and rolls back by the given depths every frame
+	static void stressTest(int numObjs);
+
+private:
+	struct SlotHeader {
+		Uint64 tick;
+		size_t size;
+	};
+
+	std::vector<char> m_data;
+	size_t m_slotSize; // including the header
+	size_t m_historyLen;
+	size_t m_newest;
+	size_t m_count;
+
+	size_t ringIndex(size_t age) const { return (m_newest + m_historyLen - age) % m_historyLen; }
+	SlotHeader* header(size_t ring) { return (SlotHeader*)&m_data[ring * m_slotSize]; }
+	const SlotHeader* header(size_t ring) const { return (const SlotHeader*)&m_data[ring * m_slotSize]; }
+	void grow(size_t minSlotSize);
+};
+
+#endif
@@ -0,0 +1,91 @@
+/*
+ *  InterestManager.h
+ *  OpenLieroX
+ *
+ *  which objects a client needs to get updates about, and how often
+ *
+ *  code under LGPL
+ *
+ */
+
+#ifndef __OLX__INTERESTMANAGER_H__
+#define __OLX__INTERESTMANAGER_H__
+
+#include <vector>
+#include <map>
+#include "CVec.h"
+#include "olx-types.h"
+
+/*
+	The server replicates the objects which are far away from everything a
+	client sees less often: the GameState attribute updates
+	(GameServer::SendGameStateUpdates) and the gusanos node updates
+	(Net_Control::olxSendNodeUpdates). The viewers of a client are the
+	positions of its living worms; spectators (no viewers) get everything.
+
+	How often an object is updated is decided by the InterestPolicy, which can
+	be replaced (setInterestPolicy). Objects without a position are always
+	updated. Updates are only delayed, never dropped: a GameState attribute
+	differs from the client state until it is sent, and a delayed node update
+	stays queued, with the newer updates of the node merged into it.
+	Disabled by default (Advanced.InterestManagement).
+*/
+class InterestPolicy {
+public:
+	virtual ~InterestPolicy() {}
+	// minimal time in seconds between two updates of an object at pos; 0 is every frame
+	virtual float updateInterval(const CVec& pos, const std::vector<CVec>& viewers) const = 0;
+};
+
+// everything in the view of a viewer every frame, the rest less often by the distance
+class DistanceInterestPolicy : public InterestPolicy {
+public:
+	float viewRangeX, viewRangeY; // half of the visible area, with some margin
+	float farRange; // in pixels; from here on, we have farInterval
+	float farInterval; // in seconds
+
+	DistanceInterestPolicy() : viewRangeX(240), viewRangeY(180), farRange(1000), farInterval(0.5f) {}
+	float updateInterval(const CVec& pos, const std::vector<CVec>& viewers) const;
+};
+
+// NULL resets it to the default DistanceInterestPolicy. The policy is not deleted.
+void setInterestPolicy(InterestPolicy* policy);
+InterestPolicy* interestPolicy();
+
+// the interest state of one client
+class ClientInterest {
+public:
+	struct Stats {
+		Uint64 sent; // updates sent every frame
+		Uint64 lowered; // updates sent with a lower frequency
+		Uint64 deferred; // updates delayed for later
+		Stats() : sent(0), lowered(0), deferred(0) {}
+	};
+
+	// separate key spaces for the different replicated things
+	enum KeyType { KEY_GAMESTATE = 0, KEY_NETNODE = 1 };
+	static Uint64 key(KeyType type, Uint32 classId, Uint32 objId) { return ((Uint64)type << 62) | ((Uint64)classId << 32) | objId; }
+
+	ClientInterest() {}
+	void reset();
+
+	// call this each frame before shouldUpdate()
+	void setViewers(const std::vector<CVec>& viewers, const AbsTime& now);
+	const std::vector<CVec>& viewers() const { return m_viewers; }
+
+	// true if the object should be updated now; it stays true for the rest of the frame
+	bool shouldUpdate(Uint64 key, const CVec& pos, const AbsTime& now);
+
+	const Stats& stats() const { return m_stats; }
+
+private:
+	std::vector<CVec> m_viewers;
+	std::map<Uint64, AbsTime> m_lastUpdate;
+	AbsTime m_lastPrune;
+	Stats m_stats;
+};
+
+// false if the interest management is disabled (Advanced.InterestManagement)
+bool interestManagementEnabled();
+
+#endif
@@ -0,0 +1,49 @@
+/*
+ *  LoadTest.h
+ *  OpenLieroX
+ *
+ *  headless load test clients for a local server
+ *
+ *  code under LGPL
+ *
+ */
+
+#ifndef __OLX__LOADTEST_H__
+#define __OLX__LOADTEST_H__
+
+#include <string>
+
+/*
+	The load test connects N headless clients over the loopback to the server
+	of this process and measures the server while the game is played:
+	the frame time percentiles, the received bytes and packets per client and
+	the retransmissions of the reliable channels. When all load clients are
+	connected, the game is started.
+
+	The load clients join without worms (like spectators, the server allows
+	that for 127.0.0.1) and only run the channel, they don't parse the game
+	packets. The worms are normal bots of the server (CWormBotInputHandler),
+	so the scenario is set up with the usual commands, e.g.
+
+	openlierox -dedicated -exec 'map "Dirt Level.lxl"' -exec 'mod Classic'
+		-exec 'setVar GameOptions.GameInfo.GameType "Death Match"'
+		-exec startLobby -exec 'addBots 8' -exec 'loadTest 16 60 loadtest.txt quit'
+
+	(the full OLX game state is global, so a second CClient cannot live in
+	the same process).
+*/
+namespace LoadTest {
+	// Starts numClients load clients. The measurement begins when the game is
+	// played and stops after the given seconds (0: until stop()). The report is
+	// printed and, if reportFile is set, written there as key=value lines.
+	bool start(int numClients, float seconds, const std::string& reportFile, bool quitWhenDone);
+	void stop();
+	bool isRunning();
+	void printStatus();
+
+	// called by Game::frame around each frame
+	void beginFrame();
+	void endFrame();
+}
+
+#endif
@@ -0,0 +1,91 @@
+/*
+ *  MapRenderCache.h
+ *  OpenLieroX
+ *
+ *  tiled cache of the drawn map layers
+ *
+ *  code under LGPL
+ *
+ */
+
+#ifndef __OLX__MAPRENDERCACHE_H__
+#define __OLX__MAPRENDERCACHE_H__
+
+#include <vector>
+#include <SDL.h>
+#include "SmartPointer.h"
+#include "Mutex.h"
+
+/*
+	Used by CMap::gusDraw for maps with a foreground layer.
+
+	Without the cache, each viewport blits the map image and then blends the
+	foreground over it, every frame. The cache keeps both flattened into tiles,
+	so a viewport needs only one blit per visible tile.
+
+	Terrain changes call invalidate(), which only sets the dirty flag of the
+	tiles in the area. A dirty tile is rebuilt when it is drawn the next time;
+	tiles which are not visible in any viewport are not built at all, or stay
+	stale until they are visible again. So the drawing cost depends on the
+	viewport size, not on the map size, and a big explosion somewhere else on
+	the map costs nothing.
+
+	If the map image is opaque, the tiles have the format of the image and are
+	built with the image copy + the blended foreground, i.e. the same pixels as
+	without the cache. Otherwise (colorkey or alpha, the parallax shines through)
+	the tiles are ARGB, and the foreground is composited over the image.
+
+	Drawing can be done from several threads (see Video.ParallelViewports).
+	invalidate() must not be called while drawing, which is the case as the
+	terrain is only changed by the game simulation.
+*/
+class MapRenderCache {
+public:
+	enum { TILE_SIZE = 256 }; // in image pixels, i.e. 128 material pixels
+
+	struct Stats {
+		Uint64 draws, tilesDrawn, tilesBuilt, invalidations;
+		Stats() : draws(0), tilesDrawn(0), tilesBuilt(0), invalidations(0) {}
+	};
+
+	MapRenderCache();
+
+	// drops all tiles
+	void clear();
+	// the area is in material pixels
+	void invalidate(int x, int y, int w, int h);
+	void invalidateAll();
+
+#ifndef DEDICATED_ONLY
+	// Draws the part (viewX, viewY, w, h) of image + foreground to dest at
+	// (destX, destY). Returns false if the cache isn't used for these layers;
+	// the caller draws them itself then.
+	bool draw(SDL_Surface* dest, SDL_Surface* image, SDL_Surface* foreground, int viewX, int viewY, int destX, int destY, int w, int h);
+#endif
+
+	size_t builtTileCount() const;
+	size_t memorySize() const;
+
+	static bool enabled();
+	static const Stats& stats() { return m_stats; }
+
+private:
+#ifndef DEDICATED_ONLY
+	bool init(SDL_Surface* image, SDL_Surface* foreground);
+	void buildTile(int tx, int ty);
+#endif
+
+	// the layers the tiles were built from
+	SDL_Surface* m_image;
+	SDL_Surface* m_foreground;
+	bool m_opaque;
+
+	int m_tilesX, m_tilesY;
+	std::vector< SmartPointer<SDL_Surface> > m_tiles;
+	std::vector<unsigned char> m_dirty;
+
+	Mutex m_mutex;
+	static Stats m_stats;
+};
+
+#endif
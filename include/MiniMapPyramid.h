@@ -0,0 +1,84 @@
+/*
+ *  MiniMapPyramid.h
+ *  OpenLieroX
+ *
+ *  downsampled mip pyramid of the map for the minimap
+ *
+ *  code under LGPL
+ *
+ */
+
+#ifndef __OLX__MINIMAPPYRAMID_H__
+#define __OLX__MINIMAPPYRAMID_H__
+
+#include <vector>
+#include <SDL.h>
+#include "Color.h"
+
+/*
+	Used by CMap for the minimap.
+
+	The map (parallax, image and foreground drawn over each other) is kept as a
+	pyramid of averaged colors. The base level has cells of 2^k x 2^k image
+	pixels, with k as big as possible while the base still has at least the
+	biggest minimap size (MAX_MINIMAP_W x MAX_MINIMAP_H); each cell is the
+	average of SAMPLES x SAMPLES pixels spread over it. Each further level
+	averages 2x2 cells of the level below.
+
+	A minimap pixel is the average of the few cells of the coarsest level whose
+	cells are not bigger than the pixel, so any minimap size is a cheap lookup
+	and the result doesn't flicker like point sampling when the terrain changes.
+
+	After a terrain change, update() only recomputes the base cells of the area
+	and their parents, and draw() only the minimap pixels over it. A full build
+	is only needed when the map layers are replaced.
+*/
+class MiniMapPyramid {
+public:
+	enum { MAX_MINIMAP_W = 320, MAX_MINIMAP_H = 240, SAMPLES = 2 };
+
+	struct Stats {
+		Uint64 builds, updates, updatedCells, drawnPixels;
+		Stats() : builds(0), updates(0), updatedCells(0), drawnPixels(0) {}
+	};
+
+	MiniMapPyramid();
+
+	void clear();
+	bool isBuiltFor(SDL_Surface* image, SDL_Surface* foreground, SDL_Surface* parallax) const;
+
+#ifndef DEDICATED_ONLY
+	// computes all levels; foreground and parallax may be NULL
+	void build(SDL_Surface* image, SDL_Surface* foreground, SDL_Surface* parallax);
+	// recomputes the cells of the area; all areas are in image pixels
+	void update(int x, int y, int w, int h);
+	// draws the minimap pixels which show the area
+	void draw(SDL_Surface* minimap, int x, int y, int w, int h) const;
+#endif
+
+	size_t memorySize() const;
+	static const Stats& stats() { return m_stats; }
+
+private:
+	struct Level {
+		int w, h;
+		int cellSize; // in image pixels
+		std::vector<Color> cells;
+	};
+
+#ifndef DEDICATED_ONLY
+	void recompute(int x, int y, int w, int h);
+	Color sampleCell(int cx, int cy) const;
+	void updateCell(size_t level, int cx, int cy);
+	Color average(const Level& l, int x1, int y1, int x2, int y2) const;
+#endif
+
+	SDL_Surface* m_image;
+	SDL_Surface* m_foreground;
+	SDL_Surface* m_parallax;
+	std::vector<Level> m_levels;
+
+	static Stats m_stats;
+};
+
+#endif
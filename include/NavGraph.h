@@ -0,0 +1,182 @@
+/*
+ *  NavGraph.h
+ *  OpenLieroX
+ *
+ *  hierarchical navigation graph for the bot pathfinding
+ *
+ *  code under LGPL
+ *
+ */
+
+#ifndef __OLX__NAVGRAPH_H__
+#define __OLX__NAVGRAPH_H__
+
+#include <vector>
+#include <cstddef>
+#include <SDL.h>
+#include "CVec.h"
+#include "Mutex.h"
+#include "SmartPointer.h"
+
+/*
+	The map is divided into cells of CELL_SIZE pixels. A cell is blocked if
+	there is rock in it or within CELL_MARGIN pixels around it (so a path of
+	free cells is wide enough for a worm); dirt makes it more expensive.
+
+	The cells are grouped into clusters of CLUSTER_SIZE x CLUSTER_SIZE cells.
+	Where two clusters touch with free cells on both sides, we have a portal
+	pair. The costs between the portals of one cluster are precomputed, so a
+	search first runs over the portals only (the abstract graph) and then
+	refines each piece inside its cluster (HPA*).
+
+	Terrain changes only mark the area dirty; update() recomputes the affected
+	cells and clusters. Found paths are kept in a small cache, shared by all
+	bots (and all copies of the graph): a path is reused for a search from
+	the same cluster to the same target cell.
+
+	The graph doesn't read the map pixels while searching, only while building
+	and updating. findPath() doesn't change the graph, so any number of threads
+	can search on it at the same time, each with its own Search state. To
+	update a graph which is still searched on, copy it (see CMap::navGraph()).
+
+	Everything is in flat arrays indexed by cell, portal or cluster number.
+*/
+class NavGraph {
+public:
+	enum {
+		CELL_SIZE = 4, // in pixels
+		CELL_MARGIN = 2, // in pixels
+		CLUSTER_SIZE = 32 // in cells
+	};
+
+	// the pixel classes, by material index
+	enum { PIX_FREE = 0, PIX_DIRT = 1, PIX_ROCK = 2 };
+
+	struct Stats {
+		Uint64 queries, cacheHits, failed, aborted;
+		Uint64 expandedPortals, expandedCells;
+		Uint64 updatedCells, updatedClusters, portalRebuilds;
+		Stats() : queries(0), cacheHits(0), failed(0), aborted(0), expandedPortals(0), expandedCells(0),
+			updatedCells(0), updatedClusters(0), portalRebuilds(0) {}
+		void add(const Stats& s);
+	};
+
+	// the working memory of one searching thread
+	class Search {
+	public:
+		Search() : m_searchId(0), m_absSearchId(0), m_workLimit(0), m_aborted(false) {}
+		// expanded cells and portals of the last findPath(), as a measure of the CPU time
+		Uint32 work() const { return (Uint32)(m_stats.expandedCells + m_stats.expandedPortals); }
+		bool aborted() const { return m_aborted; }
+		size_t memorySize() const;
+
+	private:
+		friend class NavGraph;
+		struct HeapItem {
+			float f, g;
+			int node;
+			bool operator<(const HeapItem& o) const { return f > o.f; } // for a min-heap
+		};
+
+		std::vector<float> m_g;
+		std::vector<int> m_parent;
+		std::vector<Uint32> m_visited; // the state is reset by increasing the search id
+		Uint32 m_searchId;
+		std::vector<float> m_absG;
+		std::vector<int> m_absParent;
+		std::vector<Uint32> m_absVisited;
+		Uint32 m_absSearchId;
+		std::vector<HeapItem> m_heap;
+		std::vector<float> m_startCost, m_goalCost;
+		std::vector<int> m_cells, m_nodes;
+		Uint32 m_workLimit;
+		bool m_aborted;
+		Stats m_stats;
+	};
+
+	NavGraph();
+
+	// lines must stay valid as long as the graph is built (it reads them again in update())
+	void build(const unsigned char* const* lines, int mapW, int mapH, const Uint8 pixelClass[256], Search& search);
+	void clear();
+	bool isBuilt() const { return m_lines != NULL; }
+
+	// the pixels in this area have changed
+	void markDirty(int x, int y, int w, int h);
+	bool isDirty() const { return !m_dirtyRects.empty(); }
+	// lock the map flags for reading while calling this
+	void update(Search& search);
+
+	// path from start to target in map pixels, both included; false if there is none.
+	// The search gives up after maxWork expanded nodes (0 is no limit).
+	bool findPath(const VectorD2<int>& start, const VectorD2<int>& target, std::vector< VectorD2<int> >& path,
+		Search& search, Uint32 maxWork = 0) const;
+
+	Stats stats() const;
+	size_t memorySize() const;
+
+	// builds the graph for a random cave map and runs random queries
+	static void benchmark(int numQueries);
+
+private:
+	struct Portal {
+		int cell;
+		int partner; // portal on the other side
+		int cluster;
+	};
+
+	struct CacheEntry {
+		int startCluster;
+		int goalCell;
+		Uint32 topology;
+		Uint32 lastUse;
+		std::vector< VectorD2<int> > path; // without the start point
+	};
+
+	// shared by the copies of the graph
+	struct PathCache {
+		Mutex mutex;
+		std::vector<CacheEntry> entries;
+		Uint32 useCounter;
+		Stats stats;
+		PathCache() : useCounter(0) {}
+	};
+
+	const unsigned char* const* m_lines;
+	Uint8 m_pixelClass[256];
+	int m_mapW, m_mapH;
+	int m_w, m_h; // in cells
+	int m_clW, m_clH; // in clusters
+
+	std::vector<Uint8> m_cost; // per cell, 0 is blocked
+	std::vector<Portal> m_portals; // sorted by cluster
+	std::vector<int> m_clusterPortals; // first portal of each cluster, plus the end
+	std::vector<int> m_intraOffset; // per cluster into m_intraCost
+	std::vector<float> m_intraCost; // n*n per cluster, < 0 is unreachable
+	std::vector<Uint8> m_clusterDirty;
+	std::vector<int> m_dirtyRects; // x1,y1,x2,y2 in cells
+	Uint32 m_topology; // increased when the portals change
+	SmartPointer<PathCache> m_cache;
+
+	int cluster(int cell) const { return ((cell % m_w) / CLUSTER_SIZE) + ((cell / m_w) / CLUSTER_SIZE) * m_clW; }
+	void clusterBounds(int c, int& x1, int& y1, int& x2, int& y2) const;
+	Uint8 computeCost(int cx, int cy) const;
+	void buildPortals();
+	void buildIntraCosts(int c, Search& s);
+
+	void prepare(Search& s) const;
+	Uint32 nextSearchId(std::vector<Uint32>& visited, Uint32& id) const;
+	bool outOfWork(Search& s) const;
+	// A* (or Dijkstra if to < 0) over the cells inside the given bounds
+	bool searchCells(Search& s, int from, int to, int x1, int y1, int x2, int y2) const;
+	bool appendCellPath(Search& s, int from, int to, int c) const;
+	void relaxAbstract(Search& s, int node, int parent, float g, int cell, int goalCell, Uint32 id) const;
+	bool searchAbstract(Search& s, int startCell, int goalCell) const;
+	int nearestFreeCell(int x, int y) const;
+	bool lineFree(int a, int b, float maxCost) const;
+	void smoothPath(const std::vector<int>& cells, std::vector< VectorD2<int> >& path) const;
+	bool findCached(int startCluster, int goalCell, int startCell, const VectorD2<int>& start, const VectorD2<int>& target, std::vector< VectorD2<int> >& path) const;
+	void addToCache(int startCluster, int goalCell, const std::vector< VectorD2<int> >& path) const;
+};
+
+#endif
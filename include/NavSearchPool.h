@@ -0,0 +1,101 @@
+/*
+ *  NavSearchPool.h
+ *  OpenLieroX
+ *
+ *  worker threads for the bot path searches
+ *
+ *  code under LGPL
+ *
+ */
+
+#ifndef __OLX__NAVSEARCHPOOL_H__
+#define __OLX__NAVSEARCHPOOL_H__
+
+#include <vector>
+#include <list>
+#include <map>
+#include <set>
+#include "NavGraph.h"
+#include "Mutex.h"
+#include "Condition.h"
+#include "SmartPointer.h"
+#include "CodeAttributes.h"
+
+struct ThreadPoolItem;
+
+/*
+	The bots submit their path searches here and fetch the result later (in
+	their next AI_Think). A fixed number of threads (Advanced.BotPathThreads,
+	read when the first search is submitted) works on a bounded queue, so many
+	bots cannot start more threads or spike the frame time. With 0 threads,
+	the search runs directly in submit().
+
+	A job holds a reference to the NavGraph it searches on; CMap::navGraph()
+	copies the graph instead of updating it while it is referenced, so the
+	searches always see a consistent terrain.
+*/
+class NavSearchPool : DontCopyTag {
+public:
+	typedef Uint32 Ticket; // 0 is invalid
+
+	struct Result {
+		bool found;
+		bool aborted;
+		Uint32 work; // see NavGraph::Search::work()
+		std::vector< VectorD2<int> > path;
+		Result() : found(false), aborted(false), work(0) {}
+	};
+
+	struct Stats {
+		Uint64 submitted, rejected, cancelled, finished;
+		Uint64 work;
+		Stats() : submitted(0), rejected(0), cancelled(0), finished(0), work(0) {}
+	};
+
+	enum { MAX_QUEUED = 64, MAX_THREADS = 8 };
+
+	NavSearchPool();
+	~NavSearchPool(); // waits for the running searches
+
+	// returns 0 if the queue is full; try again later then
+	Ticket submit(const SmartPointer<NavGraph>& graph, const VectorD2<int>& start, const VectorD2<int>& target, Uint32 maxWork);
+	// true if the search is finished; the ticket is invalid afterwards
+	bool fetch(Ticket ticket, Result& res);
+	bool isDone(Ticket ticket) const;
+	// the result is thrown away
+	void cancel(Ticket ticket);
+
+	Stats stats() const;
+
+private:
+	struct Job {
+		Ticket ticket;
+		SmartPointer<NavGraph> graph;
+		VectorD2<int> start, target;
+		Uint32 maxWork;
+	};
+	struct Worker;
+
+	mutable Mutex m_mutex;
+	Condition m_newJob;
+	std::list<Job> m_queue;
+	std::set<Ticket> m_running;
+	std::map<Ticket, Result> m_done;
+	Ticket m_lastTicket;
+	bool m_quit;
+	bool m_started;
+	std::vector<ThreadPoolItem*> m_threads;
+	NavGraph::Search m_search; // for the searches without threads
+	Stats m_stats;
+
+	void startThreads();
+	static void run(const Job& job, NavGraph::Search& search, Result& res);
+	void finish(Ticket ticket, Result& res);
+};
+
+extern NavSearchPool* navSearchPool;
+
+void InitNavSearchPool();
+void UnInitNavSearchPool();
+
+#endif
@@ -0,0 +1,79 @@
+/*
+ *  NetEmulator.h
+ *  OpenLieroX
+ *
+ *  network condition emulation and packet capture/replay for the UDP sockets
+ *
+ *  code under LGPL
+ *
+ */
+
+#ifndef __OLX__NETEMULATOR_H__
+#define __OLX__NETEMULATOR_H__
+
+#include <string>
+#include "Networking.h"
+#include "olx-types.h"
+
+/*
+	This sits in NetworkSocket::Read/Write of the UDP sockets and is only used
+	while something of it is enabled (NetEmulator::isActive()).
+
+	Conditions: the datagrams we receive are delayed (latency + random jitter),
+	dropped, duplicated or reordered, depending on the address they come from
+	(setConditions). As it works on the receiving side, a local server and
+	client in the same process get both directions emulated.
+
+	Capture: all datagrams which the game reads (after the emulation) and writes
+	are recorded to a file (startCapture).
+
+	Replay: the received datagrams of a capture are fed into the UDP socket
+	with the captured local port, with the same order and timing (relative to
+	the first read of that socket). The real incoming data of that socket is
+	ignored and everything written to it is dropped (and compared with the
+	capture). Like this, a captured session can be replayed into a dedicated
+	server without any client.
+*/
+
+struct NetConditions {
+	int latency; // ms, one way
+	int jitter; // ms, the latency is randomly up to this higher
+	float loss; // in percent
+	float duplicate; // in percent
+	float reorder; // in percent, these get MAX(jitter, 50) ms extra delay
+	NetConditions() : latency(0), jitter(0), loss(0), duplicate(0), reorder(0) {}
+	bool isNone() const { return latency <= 0 && jitter <= 0 && loss <= 0 && duplicate <= 0 && reorder <= 0; }
+	std::string toString() const;
+};
+
+class NetEmulator {
+public:
+	// addr is "ip:port" or "ip"; "" or "*" sets the default for all addresses.
+	// Conditions which are none (see NetConditions::isNone) remove the entry.
+	static void setConditions(const std::string& addr, const NetConditions& cond);
+	static void resetConditions();
+	static void printStatus();
+
+	static Result startCapture(const std::string& filename);
+	static void stopCapture();
+
+	// port 0 takes the local port of the first captured datagram
+	static Result startReplay(const std::string& filename, NetworkSocket::Port port = 0);
+	static void stopReplay();
+
+	// prints the datagrams and bandwidth per direction and address of a capture
+	static void captureStats(const std::string& filename);
+
+	// true if conditions are set or a capture or replay is running
+	static bool isActive();
+
+	// The hooks for NetworkSocket; sock identifies the socket.
+	static void incoming(const void* sock, NetworkSocket::Port localPort, const NetworkAddr& from, const char* data, int size);
+	// returns the size of the next datagram which is due, or -1 if there is none
+	static int nextIncoming(const void* sock, NetworkSocket::Port localPort, NetworkAddr& from, void* buffer, int nbytes);
+	// returns false if the datagram must not be sent
+	static bool outgoing(const void* sock, NetworkSocket::Port localPort, const NetworkAddr& to, const void* data, int size);
+	static void socketClosed(const void* sock);
+};
+
+#endif
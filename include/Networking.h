@@ -68,10 +68,20 @@ std::string NetAddrToString(const NetworkAddr& addr);
 unsigned short GetNetAddrPort(const NetworkAddr& addr);
 Result	SetNetAddrPort(NetworkAddr& addr, unsigned short port, std::string* errorStr = NULL);
 bool	AreNetAddrEqual(const NetworkAddr& addr1, const NetworkAddr& addr2);
+Uint64	GetNetAddrKey(const NetworkAddr& addr); // IP and port in one number, 0 for an invalid address
 bool	GetNetAddrFromNameAsync(const std::string& name, NetworkAddr& addr);
 void	AddToDnsCache(const std::string& name, const NetworkAddr& addr, TimeDiff expireTime = TimeDiff(600.0f));
 bool	GetFromDnsCache(const std::string& name, NetworkAddr& addr);
 
+// Pushed to the main queue when a lookup of GetNetAddrFromNameAsync has finished,
+// so the caller doesn't have to poll the cache. On success, the address is in the DNS cache.
+struct DnsEventData : EventData {
+	DnsEventData(const std::string& n = "", bool s = false) : name(n), success(s) {}
+	std::string name;
+	bool success;
+};
+extern Event<DnsEventData> onDnsReady;
+
 
 
 // general networking
@@ -112,6 +122,9 @@ private:
 	friend struct InternSocket;
 	struct EventHandler; friend struct EventHandler;
 	void checkEventHandling();
+	void sendWriteBatch();
+	int readRaw(void* buffer, int nbytes);
+	int readEmulated(void* buffer, int nbytes);
 	
 	// Don't copy instances of this class! Use SmartPointer if you want to have multiple references to a socket.
 	// You can swap two NetworkSockets though.
@@ -151,6 +164,14 @@ public:
 	int Write(const std::string& buffer) { return Write(buffer.data(), (int)buffer.size()); }
 	int Read(void* buffer, int nbytes);
 	
+	// For unconnected UDP sockets, Read() receives many datagrams at once if possible (Advanced.BatchedNetIO).
+	// Between these calls, Write() only queues the datagrams (with the current remote address);
+	// they are sent together in flushWriteBatch() or when the batch is full.
+	void beginWriteBatch();
+	void flushWriteBatch();
+	
+	// For UDP sockets, Read() and Write() go through the NetEmulator while it is active.
+	
 	bool isDataAvailable(); // Slow!
 
 	// WARNING: Don't use!
@@ -169,5 +190,8 @@ std::string	GetLastErrorStr();
 bool	IsMessageEndSocketErrorNr(int errnr);
 void	ResetSocketError();
 
+// sends packets between two UDP sockets on the loopback, with and without the batched I/O
+void	BenchmarkNetworkIO(int packets, int packetSize);
+
 
 #endif  //  __NETWORKING_H__
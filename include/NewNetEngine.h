@@ -133,13 +133,16 @@ bool Active();
 
 // ------ Internal functions - do not use them from OLX ------
 
-// SaveState() should save all current game physics data,
+// SaveState() saves all current game physics data,
 // such as positions and velocities of worms and projectiles, and pattern of destroyed dirt, and all in-game timers.
-// RestoreState() should do the opposite.
-// These functions will be called quite often, so please optimize your dirt-save and restore routines, 
-// so they won't use plain memcpy() on 1Mb memory array, but something like saving small parts that are changed.
+// The last saved ticks are kept (see GameStateArena), the dirt is saved as the changed tiles per tick.
+// RestoreState() goes back to the state of the newest save, or ticksBack saves before it;
+// the newer saves are dropped.
 void SaveState();
-void RestoreState();
+void RestoreState( size_t ticksBack = 0 );
+// Saves a worm and a projectile, changes all their synced attributes and loads them again;
+// false if something is not restored
+bool TestStateRoundTrip();
 
 
 void ReCalculateSavedState();
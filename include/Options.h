@@ -222,6 +222,8 @@ public:
 	bool	bOpenGL;
 	std::string	sResolution;
 	int		iColourDepth;
+	bool	bParallelViewports;		// Draw the map layer of the viewports in several threads
+	bool	bMapTileCache;			// Keep the map image and foreground flattened in tiles (see MapRenderCache)
 
 	// Network
 	int		iNetworkPort;
@@ -322,6 +324,12 @@ public:
 	bool	bMatchLogging;			// Save screenshot of every game final score
 	bool	bRecoverAfterCrash;		// If we should try to recover after segfault etc, or generate coredump and quit
 	bool	bCheckForUpdates;		// Check for new development version on sourceforge.net
+	bool	bInterestManagement;	// Send updates of objects far away from a client less often (Gusanos objects)
+	bool	bParallelProjectiles;	// Simulate the LX56 projectiles in several threads
+	int		iProjectileThreads;
+	int		iBotPathBudget;			// Work units per second and bot for the path searches (see NavGraph::Search::work())
+	int		iBotPathThreads;		// Threads for the bot path searches
+	bool	bBatchedNetIO;			// Receive and send many UDP datagrams with one syscall (Linux only)
 
 	// Misc.
 	bool    bLogConvos;
@@ -339,7 +339,7 @@
 #include "gusanos/blitters/colors.h"
 #include "gusanos/blitters/context.h"
 #include "gusanos/blitters/macros.h"
-#include "gusanos/blitters/mmx.h"
+#include "gusanos/blitters/simd.h"
 #include "gusanos/blitters/types.h"
 #include "gusanos/console/alias.h"
 #include "gusanos/console/bindings.h"
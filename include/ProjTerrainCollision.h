@@ -0,0 +1,72 @@
+/*
+ *  ProjTerrainCollision.h
+ *  OpenLieroX
+ *
+ *  batch kernel for the projectile <-> terrain pixel check
+ *
+ *  code under LGPL
+ *
+ */
+
+#ifndef __OLX__PROJTERRAINCOLLISION_H__
+#define __OLX__PROJTERRAINCOLLISION_H__
+
+#include <cstddef>
+
+struct Material;
+
+/*
+	Counts the solid material pixels in the rectangular footprint of projectiles,
+	exactly like handlePixelFlag() in PhysicsLX56_Projectiles.cpp does it pixel
+	by pixel. The result feeds CProjectile::HandleCollision.
+
+	The material indices are first mapped through a 256 byte class table (build it
+	once per frame from the map materials), then the rows are counted with SSE2 if
+	available, or with the plain scalar loop otherwise.
+
+	Only the non-wraparound rectangle case is handled here; the caller must
+	ensure that the footprint is completely inside the material bitmap.
+*/
+namespace ProjTerrainColl {
+
+	enum {
+		CLS_SOLID = 1, // !particle_pass
+		CLS_HARD = 2 // solid and not destroyable
+	};
+
+	struct ClassTable {
+		unsigned char cls[256];
+		ClassTable();
+		void build(const Material* materials /* 256 entries */);
+	};
+
+	struct Footprint {
+		int px, py; // center
+		int rx, ry; // radius
+	};
+
+	struct Result {
+		int left, right, top, bottom;
+		bool collided;
+		bool onlyDirt;
+	};
+
+	enum Kernel { K_Auto, K_Scalar, K_SSE2 };
+
+	bool haveSSE2();
+
+	// checks n footprints; lines[y] is the material index row y
+	void checkRects(const unsigned char* const* lines, const ClassTable& table, const Footprint* fps, Result* res, size_t n, Kernel k = K_Auto);
+
+	inline Result checkRect(const unsigned char* const* lines, const ClassTable& table, const Footprint& fp) {
+		Result r;
+		checkRects(lines, table, &fp, &r, 1);
+		return r;
+	}
+
+	// compares all kernels against the pixel-by-pixel reference on recorded
+	// projectile traces over a random map; returns true if all are identical
+	bool test(int numProjs);
+}
+
+#endif
@@ -0,0 +1,118 @@
+/*
+ *  ProjectileGrid.h
+ *  OpenLieroX
+ *
+ *  uniform grid broadphase for projectile-projectile hit checks
+ *
+ *  code under LGPL
+ *
+ */
+
+#ifndef __OLX__PROJECTILEGRID_H__
+#define __OLX__PROJECTILEGRID_H__
+
+#include <vector>
+#include "CVec.h"
+
+/*
+	Each projectile is registered in all grid cells which are touched by its
+	bounding rect. Projectiles are identified by their index in the
+	projectile FastVector of CClient.
+
+	All cells share one flat item array. Every cell owns a sorted slice of it
+	(begin, count, capacity); if a slice is full, it is moved to the end of the
+	array with more capacity. Thus, inserts/removes never allocate in the
+	common case and a query just walks a few short contiguous arrays.
+	Once per physics frame, the item array is rebuilt (compacted) if too much
+	of it became unused because of such moves.
+
+	The items of a cell are sorted by index - the same order as the former
+	std::set<CProjectile*> per cell (FastVector is one array) - so hit events
+	behave exactly as before.
+*/
+class ProjectileGrid {
+public:
+	typedef unsigned short Index;
+	static const int GRIDW = 20, GRIDH = 20;
+
+	struct CellRect {
+		int x1, y1, x2, y2; // inclusive
+		CellRect() : x1(0), y1(0), x2(-1), y2(-1) {}
+		CellRect(const VectorD2<int>& p, const VectorD2<int>& r)
+		: x1((p.x - r.x) / GRIDW), y1((p.y - r.y) / GRIDH), x2((p.x + r.x) / GRIDW), y2((p.y + r.y) / GRIDH) {}
+		bool operator==(const CellRect& r) const { return x1 == r.x1 && y1 == r.y1 && x2 == r.x2 && y2 == r.y2; }
+		bool operator!=(const CellRect& r) const { return !(*this == r); }
+	};
+
+	ProjectileGrid() : m_gridW(0), m_gridH(0), m_numCells(0), m_unusedItems(0) {}
+
+	// setup for a new map, drops all registrations
+	void reset(int mapW, int mapH, size_t maxObjs);
+	// drop everything, also the map dimensions
+	void clear();
+
+	// (re)register obj with its current bounding rect
+	void update(Index obj, const VectorD2<int>& pos, const VectorD2<int>& radius);
+	void remove(Index obj);
+	bool isRegistered(Index obj) const { return obj < m_objs.size() && m_objs[obj].registered; }
+
+	// compacts the item array if it got too fragmented; cheap, called once per frame
+	void rebuild();
+
+	/*
+		Calls f(Index) for all objects in all cells touched by the given rect.
+		Cells are walked in the same order as the old std::set code did (x outer, y inner).
+		An object in several cells is reported once per cell.
+		If f returns false, the iteration stops and false is returned.
+	*/
+	template<typename F>
+	bool forEachInRect(const VectorD2<int>& pos, const VectorD2<int>& radius, F& f) const {
+		const CellRect r(pos, radius);
+		for(int x = r.x1; x <= r.x2; ++x)
+			for(int y = r.y1; y <= r.y2; ++y) {
+				const long c = cellIndex(x, y);
+				if(c < 0) continue;
+				const Cell& cell = m_cells[c];
+				if(cell.count == 0) continue;
+				const Index* it = &m_items[cell.begin];
+				for(const Index* end = it + cell.count; it != end; ++it)
+					if(!f(*it)) return false;
+			}
+		return true;
+	}
+
+	// random set of moving objects, compares against std::set cells and reports ns per query
+	static void benchmark(int numObjs);
+
+private:
+	struct ObjInfo {
+		CellRect rect;
+		bool registered;
+		ObjInfo() : registered(false) {}
+	};
+
+	struct Cell {
+		unsigned int begin;
+		unsigned short count, capacity;
+		Cell() : begin(0), count(0), capacity(0) {}
+	};
+
+	int m_gridW, m_gridH;
+	long m_numCells;
+	size_t m_unusedItems; // slots in m_items not owned by any cell anymore
+	std::vector<ObjInfo> m_objs;
+	std::vector<Cell> m_cells;
+	std::vector<Index> m_items;
+
+	long cellIndex(int x, int y) const {
+		if(x < 0 || y < 0 || x >= m_gridW || y >= m_gridH) return -1;
+		const long i = (long)y * m_gridW + x;
+		if(i >= m_numCells) return -1;
+		return i;
+	}
+
+	void insertInCells(Index obj, const CellRect& r);
+	void removeFromCells(Index obj, const CellRect& r);
+};
+
+#endif
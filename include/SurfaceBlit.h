@@ -0,0 +1,58 @@
+/*
+ *  SurfaceBlit.h
+ *  OpenLieroX
+ *
+ *  format specialized blit kernels for DrawImageAdv
+ *
+ *  code under LGPL
+ *
+ */
+
+#ifndef __OLX__SURFACEBLIT_H__
+#define __OLX__SURFACEBLIT_H__
+
+#include <SDL.h>
+
+/*
+	Row kernels for the common source/destination format pairs of DrawImageAdv:
+
+		same format, not blended or keyed -> copy
+		ARGB8888 (blended)     -> XRGB8888, RGB565
+		8bit (colorkey or not) -> 8bit with the same palette, 32bit, 16bit
+
+	The blended kernels use the same integer math as the C blitters of SDL for
+	these pairs (BlitRGBtoRGBPixelAlpha, BlitARGBto565PixelAlpha). The rows are
+	done with SSE2 if available (4 or 16 pixels at a time), or with the plain
+	scalar loop otherwise; both give the same pixels.
+
+	The kernel (and for 8bit sources the palette lookup table) is picked once and
+	cached on the source surface (SDL_Surface::userdata). It is checked against
+	the destination format and the blend mode, alpha, color mod, colorkey and
+	palette of the source on each blit and picked again if anything changed.
+	Other than SDL_BlitSurface, which keeps its blit mapping in the source
+	surface, a source can be blitted from several threads at the same time.
+
+	Everything else (RLE surfaces, color/alpha mod, other formats) is left to
+	SDL_BlitSurface.
+*/
+namespace SurfaceBlit {
+
+	enum Kernel { K_Auto, K_Scalar, K_SSE2 };
+
+	bool haveSSE2();
+
+	// Clips and blits like SDL_BlitSurface (rDest gets the final rectangle).
+	// Returns false, without touching anything, if there is no kernel for this
+	// combination; the caller should use SDL_BlitSurface then.
+	bool blit(SDL_Surface* dst, SDL_Surface* src, SDL_Rect& rDest, const SDL_Rect& rSrc, Kernel k = K_Auto);
+
+	// called when the surface is freed
+	void freeCache(SDL_Surface* surf);
+
+	// Prints the time for SDL_BlitSurface, the scalar and the SSE2 kernels for
+	// each format pair, and checks that the SSE2 and scalar kernels give the
+	// same pixels. Returns false if they don't.
+	bool benchmark(int iterations);
+}
+
+#endif
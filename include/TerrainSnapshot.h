@@ -0,0 +1,112 @@
+/*
+ *  TerrainSnapshot.h
+ *  OpenLieroX
+ *
+ *  copy-on-write tiled snapshot of the map material + image
+ *
+ *  code under LGPL
+ *
+ */
+
+#ifndef __OLX__TERRAINSNAPSHOT_H__
+#define __OLX__TERRAINSNAPSHOT_H__
+
+#include <vector>
+#include <cstddef>
+#include <SDL.h>
+
+/*
+	Used by CMap for the NewNet save/restore of the terrain.
+
+	The map is divided into tiles. After begin(), each map change calls touch()
+	before it modifies the pixels; the first touch of a tile copies its material
+	and image data into the snapshot. restore() writes back only the touched tiles.
+
+	Whether a tile is already saved is a per-tile epoch number compared with the
+	current epoch, so touching is O(1) per tile and begin() doesn't need to clear
+	anything. The tile data is stored in flat arrays which are reused for the
+	next snapshot.
+*/
+class TerrainSnapshot {
+public:
+	enum { TILE_SIZE = 16 }; // in material pixels
+
+	// the pixel data we work on; image may be NULL
+	struct Planes {
+		unsigned char** matLines;
+		Uint8* image;
+		int imagePitch;
+	};
+
+	TerrainSnapshot();
+
+	// imageScale is the image size relative to the material (2 for the hi-res image),
+	// imageBpp the bytes per pixel of the image; both can be 0 if there is no image
+	void init(int mapW, int mapH, int imageScale, int imageBpp);
+	void clear();
+	bool isInitialised() const { return m_tilesX > 0; }
+
+	void begin();
+	bool isActive() const { return m_active; }
+	// call this before the area is modified
+	void touch(int x, int y, int w, int h, const Planes& src);
+	// writes back the touched tiles and ends the snapshot
+	void restore(const Planes& dst);
+
+	size_t touchedTileCount() const { return m_touched.size(); }
+	// area of the i-th touched tile, in material pixels
+	void touchedTileRect(size_t i, int& x, int& y, int& w, int& h) const;
+
+	size_t memorySize() const;
+
+	// carves random holes, saving/restoring once per NewNet tick, and reports the throughput
+	static void benchmark(int holesPerTick);
+
+private:
+	int m_mapW, m_mapH;
+	int m_tilesX, m_tilesY;
+	int m_imageScale, m_imageBpp;
+	size_t m_matTileBytes, m_imgTileBytes;
+	bool m_active;
+	Uint32 m_epoch;
+	std::vector<Uint32> m_tileEpoch; // tile is saved if equal to m_epoch
+	std::vector<Uint32> m_touched; // the saved tiles, in touch order
+	std::vector<unsigned char> m_matData;
+	std::vector<unsigned char> m_imgData;
+
+	void saveTile(Uint32 tile, const Planes& src);
+	void tileRect(Uint32 tile, int& x, int& y, int& w, int& h) const;
+};
+
+/*
+	A TerrainSnapshot per tick for the last N ticks, for rolling back more
+	than one tick (see GameStateArena). beginTick() starts recording the
+	changes of the next tick, rollback(n) undoes the newest n recorded ticks,
+	newest first, and continues recording into the tick before them.
+*/
+class TerrainHistory {
+public:
+	TerrainHistory() : m_newest(0), m_count(0) {}
+
+	void init(int mapW, int mapH, int imageScale, int imageBpp, size_t historyLen);
+	void clear();
+	bool isInitialised() const { return !m_ticks.empty(); }
+	size_t historyLen() const { return m_ticks.size(); }
+	size_t count() const { return m_count; }
+
+	void beginTick();
+	void touch(int x, int y, int w, int h, const TerrainSnapshot::Planes& src) {
+		if(m_count > 0) m_ticks[m_newest].touch(x, y, w, h, src);
+	}
+	// the areas of all restored tiles are added to updatedRects, as x,y,w,h
+	void rollback(size_t n, const TerrainSnapshot::Planes& dst, std::vector<int>& updatedRects);
+
+	size_t memorySize() const;
+
+private:
+	std::vector<TerrainSnapshot> m_ticks;
+	size_t m_newest;
+	size_t m_count;
+};
+
+#endif
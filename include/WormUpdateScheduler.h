@@ -0,0 +1,77 @@
+/*
+ *  WormUpdateScheduler.h
+ *  OpenLieroX
+ *
+ *  per client selection of the worm updates (S2C_UPDATEWORMS)
+ *
+ *  code under LGPL
+ *
+ */
+
+#ifndef __OLX__WORMUPDATESCHEDULER_H__
+#define __OLX__WORMUPDATESCHEDULER_H__
+
+#include <vector>
+#include <string>
+#include <cstddef>
+#include "CVec.h"
+#include "Consts.h"
+#include "olx-types.h"
+
+/*
+	The server doesn't send every worm to every client in every frame anymore.
+	For each client and worm, we keep the last update we have sent (the
+	baseline). An update which is equal to the baseline is not sent again once
+	it went out REDUNDANCY times (the unreliable data has no acks, so this is
+	our guess that it arrived), except every KEYFRAME_TIME as a refresh. The
+	packet format stays the same, old clients just keep the last state.
+
+	The remaining updates get a priority which grows with the time since the
+	last send, faster for worms near the worms of the client (i.e. the ones
+	they see). We send the updates with the highest priority while the byte
+	credit of the client (filled by its bandwidth rate) lasts; the top one is
+	always sent, so nothing starves.
+*/
+class WormUpdateScheduler {
+public:
+	enum { REDUNDANCY = 2 };
+	static const float KEYFRAME_TIME; // in seconds
+	static const float MAX_CREDIT_TIME; // how long the credit can be saved up, in seconds
+
+	struct Candidate {
+		int wormId;
+		CVec pos;
+		size_t offset, size; // the serialized update in the data given to select()
+		Candidate() : wormId(-1), offset(0), size(0) {}
+	};
+
+	WormUpdateScheduler() { reset(); }
+	void reset();
+
+	// Adds the indexes of the candidates to send now to selected, highest priority first.
+	// viewers are the positions of the worms of the client (empty for spectators),
+	// rate is in bytes/sec (<= 0 is unlimited).
+	void select(const std::vector<Candidate>& candidates, const char* data, const std::vector<CVec>& viewers,
+				const AbsTime& now, float rate, std::vector<size_t>& selected);
+
+	// Bandwidth and staleness of the old (all worms every frame) and the new
+	// scheme, in a synthetic match with numWorms players.
+	static void simulate(int numWorms, float rate);
+
+private:
+	struct WormState {
+		std::string baseline;
+		int sentCount;
+		AbsTime lastSent;
+		float priority;
+	};
+
+	WormState m_worms[MAX_WORMS];
+	AbsTime m_lastTime;
+	float m_credit;
+	std::vector< std::pair<float, size_t> > m_queue;
+
+	static float weight(const CVec& pos, const std::vector<CVec>& viewers);
+};
+
+#endif
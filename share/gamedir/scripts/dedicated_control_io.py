@@ -157,6 +157,13 @@ def getWormPing(iID):
 		return 0
 	return int(ret[0])
 
+# ( sent every frame, sent less often, delayed ) updates to the client of the worm
+def getWormInterestStats(iID):
+	ret = SendCommand( "getwormintereststats %i" % int(iID) )
+	if len(ret) < 3:
+		return ( 0, 0, 0 )
+	return ( int(ret[0]), int(ret[1]), int(ret[2]) )
+
 def getWormSkin(iID):
 	ret = SendCommand( "getwormskin %i" % int(iID) )
 	return ( int(ret[0]), ret[1].lower() )
@@ -1019,7 +1019,7 @@ void CClient::NewNet_Frame()
 	if( NewNet::ChecksumRecalculated() )
 		getNetEngine()->SendNewNetChecksum();
 
-	cNetChan->AddReliablePacketToSend(packet);
+	cNetChan->AddReliablePacketToSend(std::move(packet));
 }
 
 ///////////////////
@@ -2145,7 +2145,9 @@ CChannel * CClient::createChannel(const Version& v)
 {
 	if( cNetChan )
 		delete cNetChan;
-	if( v >= OLXBetaVersion(0,58,1) )
+	if( v >= OLXBetaVersion(0,59,12) )
+		cNetChan = new CChannel4();
+	else if( v >= OLXBetaVersion(0,58,1) )
 		cNetChan = new CChannel3();
 	else if( v >= OLXBetaVersion(0,57,6) )
 		cNetChan = new CChannel2();
@@ -2233,22 +2235,37 @@ void CClient::SetupGameInputs()
 
 }
 
-void CClient::NewNet_SaveProjectiles()
+void CClient::NewNet_SaveProjectiles(GameStateArena& arena)
 {
-//	NewNet_SavedProjectiles = cProjectiles;
+	const Uint32 count = (Uint32)cProjectiles.size();
+	arena.write(count);
+	for(int i = 0; i <= cProjectiles.lastUsed(); i++) {
+		if(!cProjectiles.isUsed(i)) continue;
+		const Uint16 slot = (Uint16)i;
+		arena.write(slot);
+		cProjectiles[i].NewNet_SaveState(arena);
+	}
 }
 
-void CClient::NewNet_LoadProjectiles()
+bool CClient::NewNet_LoadProjectiles(GameStateArena::Reader& r)
 {
-//	cProjectiles = NewNet_SavedProjectiles;
-}
+	for(int i = 0; i <= cProjectiles.lastUsed(); i++)
+		if(cProjectiles.isUsed(i))
+			projPosMap.remove((ProjectileGrid::Index)i);
+	cProjectiles.clear();
 
-long CClient::MapPosIndex::index(const CMap* m) const {
-	if(x < 0 || y < 0) return -1;
-	const int w = m->GetWidth() / GRIDW + 1;
-	const int h = m->GetHeight() / GRIDH + 1;
-	if(x >= w || y >= h) return -1;
-	return y * w + x;
+	Uint32 count = 0;
+	if(!r.read(count)) return false;
+	for(Uint32 c = 0; c < count; c++) {
+		Uint16 slot = 0;
+		if(!r.read(slot) || slot >= MAX_PROJECTILES) return false;
+		CProjectile& prj = cProjectiles[slot];
+		if(!prj.NewNet_LoadState(r)) return false;
+		cProjectiles.refreshUsedObj(slot);
+		cProjectileSimData.set(slot, prj.getProjInfo(), prj.getRadius());
+		prj.updateCollMapInfo();
+	}
+	return true;
 }
 
 
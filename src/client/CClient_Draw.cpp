@@ -62,6 +62,7 @@
 #include "CodeAttributes.h"
 #include "CGameScript.h"
 #include "CWormHuman.h"
+#include "ThreadPool.h"
 
 
 SmartPointer<SDL_Surface> bmpMenuButtons = NULL;
@@ -540,11 +541,13 @@ void CClient::Draw(const SmartPointer<SDL_Surface>& bmpDest)
 	if((game.state >= Game::S_Preparing) && !bWaitingForMap) {
 
 		// Draw the viewports
-		for( ushort i=0; i<NUM_VIEWPORTS; i++ ) {
-			if( cViewports[i].getUsed() )  {
-				if (game.gameMap() != NULL)
-					cViewports[i].Process(cViewports, game.gameMap()->GetWidth(), game.gameMap()->GetHeight(), getGeneralGameType());
-				DrawViewport(bmpDest, (byte)i);
+		if(!DrawViewports_Parallel(bmpDest)) {
+			for( ushort i=0; i<NUM_VIEWPORTS; i++ ) {
+				if( cViewports[i].getUsed() )  {
+					if (game.gameMap() != NULL)
+						cViewports[i].Process(cViewports, game.gameMap()->GetWidth(), game.gameMap()->GetHeight(), getGeneralGameType());
+					DrawViewport(bmpDest, (byte)i);
+				}
 			}
 		}
 
@@ -856,20 +859,129 @@ void CClient::DrawChatter(SDL_Surface * bmpDest)
 }
 
 
-void CClient::DrawViewport_Game(const SmartPointer<SDL_Surface>& bmpDest, CViewport* v) {
+void CClient::DrawViewport_Game(const SmartPointer<SDL_Surface>& bmpDest, CViewport* v, bool mapDrawn) {
 	if(!game.gameMap() || !game.gameMap()->isLoaded()) return;
 
 	// Set the clipping
 	SDL_Rect rect = v->getRect();
 	ScopedSurfaceClip clip(bmpDest.get(), rect);
 	
-	v->gusRender(bmpDest);
+	if(mapDrawn)
+		v->gusRenderObjects(bmpDest);
+	else
+		v->gusRender(bmpDest);
+}
+
+
+static float viewportSizeFactor() {
+	float sizeFactor = cClient->getGameLobby()[FT_SizeFactor];
+	if(sizeFactor == 0.0f) sizeFactor = 1.0f; // bad value, avoid crashes ...
+	if(sizeFactor < 0.5f) sizeFactor = 0.5f; // Gusanos does not support this. and it's anyway *very* slow, so put this limit here...
+	if(sizeFactor > 5.f) sizeFactor = 5.f; // just put some sane max limit. the code would support much more but it doesn't really make sense
+	return sizeFactor;
+}
+
+
+/*
+	Parallel viewport drawing
+
+	With several viewports (split screen, spectator views), the map layer of each
+	viewport is drawn in its own thread. That is the biggest part of the viewport
+	drawing (up to three full blits of the parallax, the map and the foreground).
+	Each thread draws through its own surface, which shares the pixels with the
+	screen but has its own clipping rect (the one of the viewport).
+
+	The rest is drawn afterwards in this thread and in the same order as in
+	DrawViewport. That part is not thread safe: it changes game state while
+	drawing (projectile frames, the muzzle flash of the worms, damage reports)
+	which the next viewport depends on, and it calls Lua. The game doesn't change
+	while we draw, so all threads see the same frame.
+
+	As the viewports don't overlap, the result is the same as when they are drawn
+	one after another.
+*/
+
+// screen surfaces with the clipping of the viewports
+static SmartPointer<SDL_Surface> viewportTargets[NUM_VIEWPORTS];
+
+static SmartPointer<SDL_Surface> viewportTarget(int i, SDL_Surface* screen, const SDL_Rect& clip) {
+	SmartPointer<SDL_Surface>& t = viewportTargets[i];
+	if(t.get() == NULL || t->pixels != screen->pixels || t->w != screen->w || t->h != screen->h ||
+	   t->pitch != screen->pitch || t->format->format != screen->format->format) {
+		SDL_PixelFormat* f = screen->format;
+		t = SDL_CreateRGBSurfaceFrom(screen->pixels, screen->w, screen->h, f->BitsPerPixel, screen->pitch, f->Rmask, f->Gmask, f->Bmask, f->Amask);
+	}
+	if(t.get())
+		SDL_SetClipRect(t.get(), &clip);
+	return t;
+}
+
+struct ViewportMapTask {
+	CViewport* v;
+	static Result run(void* p) {
+		((ViewportMapTask*)p)->v->gusRenderMap();
+		return true;
+	}
+};
+
+///////////////////
+// Draw all viewports, the maps in parallel. Returns false if it's not possible
+// or not enabled; the viewports are not touched then.
+bool CClient::DrawViewports_Parallel(const SmartPointer<SDL_Surface>& bmpDest)
+{
+	if(!tLXOptions->bParallelViewports || !threadPool) return false;
+	if(!game.gameMap() || !game.gameMap()->isLoaded()) return false;
+	if(SDL_MUSTLOCK(bmpDest.get())) return false;
+	// the resized viewports go through a temporary surface
+	if(viewportSizeFactor() != 1.0f) return false;
+
+	int num = 0;
+	for(int i = 0; i < NUM_VIEWPORTS; i++)
+		if(cViewports[i].getUsed()) num++;
+	if(num < 2) return false;
+
+	SmartPointer<SDL_Surface> targets[NUM_VIEWPORTS];
+	for(int i = 0; i < NUM_VIEWPORTS; i++) {
+		if(!cViewports[i].getUsed()) continue;
+		cViewports[i].Process(cViewports, game.gameMap()->GetWidth(), game.gameMap()->GetHeight(), getGeneralGameType());
+		targets[i] = viewportTarget(i, bmpDest.get(), cViewports[i].getRect());
+	}
+
+	bool parallel = true;
+	for(int i = 0; i < NUM_VIEWPORTS; i++)
+		if(cViewports[i].getUsed() && targets[i].get() == NULL)
+			parallel = false;
+
+	if(parallel) {
+		ViewportMapTask tasks[NUM_VIEWPORTS];
+		ThreadPoolItem* items[NUM_VIEWPORTS];
+		num = 0;
+		for(int i = 0; i < NUM_VIEWPORTS; i++) {
+			if(!cViewports[i].getUsed()) continue;
+			cViewports[i].gusRenderPrepare(targets[i]);
+			tasks[num++].v = &cViewports[i];
+		}
+
+		// the first one is done by ourself
+		for(int t = 1; t < num; t++)
+			items[t] = threadPool->start(&ViewportMapTask::run, &tasks[t], "viewport map drawing");
+		ViewportMapTask::run(&tasks[0]);
+		for(int t = 1; t < num; t++)
+			threadPool->wait(items[t]);
+	}
+
+	// the rest, in the usual order
+	for(int i = 0; i < NUM_VIEWPORTS; i++)
+		if(cViewports[i].getUsed())
+			DrawViewport(bmpDest, i, parallel);
+
+	return true;
 }
 
 
 ///////////////////
 // Draw a viewport
-void CClient::DrawViewport(const SmartPointer<SDL_Surface>& bmpDest, int viewport_index)
+void CClient::DrawViewport(const SmartPointer<SDL_Surface>& bmpDest, int viewport_index, bool mapDrawn)
 {	
 	// Check the parameters
 	if (viewport_index >= NUM_VIEWPORTS)
@@ -880,13 +992,10 @@ void CClient::DrawViewport(const SmartPointer<SDL_Surface>& bmpDest, int viewpor
 		return;
 	
 	{
-		float sizeFactor = cClient->getGameLobby()[FT_SizeFactor];
-		if(sizeFactor == 0.0f) sizeFactor = 1.0f; // bad value, avoid crashes ...
-		if(sizeFactor < 0.5f) sizeFactor = 0.5f; // Gusanos does not support this. and it's anyway *very* slow, so put this limit here...
-		if(sizeFactor > 5.f) sizeFactor = 5.f; // just put some sane max limit. the code would support much more but it doesn't really make sense
+		const float sizeFactor = viewportSizeFactor();
 
 		if(sizeFactor == 1.0f)
-			DrawViewport_Game(bmpDest, v);
+			DrawViewport_Game(bmpDest, v, mapDrawn);
 		else {			
 			// I have to admit, a bit hacky, but it will work for sure and we can perhaps make it better later on.
 			// I would highly vote for not implementing this for each game object (worms, projectiles, and all others)
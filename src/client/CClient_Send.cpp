@@ -405,7 +405,7 @@ void CClient::SendGameStateUpdates() {
 	{
 		CBytestream bs;
 		bs.writeByte(C2S_GAMEATTRUPDATE);
-		updates.writeToBs(&bs, state);
+		updates.writeToBs(&bs, state, getServerVersion());
 		cNetChan->AddReliablePacketToSend(bs);
 	}
 
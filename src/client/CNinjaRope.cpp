@@ -281,6 +281,42 @@ void CNinjaRope::checkForWormAttachment() {
 }
 
 
+///////////////////
+// Save the rope state for the NewNet rollback
+namespace {
+	struct RopeState {
+		bool released, hookShooting, hookAttached;
+		int playerAttached;
+		CVec pos, vel;
+	};
+}
+
+void CNinjaRope::NewNet_SaveState(GameStateArena& arena) const
+{
+	RopeState s;
+	s.released = Released;
+	s.hookShooting = HookShooting;
+	s.hookAttached = HookAttached;
+	s.playerAttached = PlayerAttached;
+	s.pos = vPos.get();
+	s.vel = vVelocity.get();
+	arena.write(s);
+}
+
+bool CNinjaRope::NewNet_LoadState(GameStateArena::Reader& r)
+{
+	RopeState s;
+	if(!r.read(s)) return false;
+	Released = s.released;
+	HookShooting = s.hookShooting;
+	HookAttached = s.hookAttached;
+	PlayerAttached = s.playerAttached;
+	vPos = s.pos;
+	vVelocity = s.vel;
+	return true;
+}
+
+
 ///////////////////
 // Write out the rope details to a bytestream
 void CNinjaRope::write(CBytestream *bs) const
@@ -47,6 +47,7 @@
 #include "CVec.h"
 #include "Cache.h"
 #include "CodeAttributes.h"
+#include "SurfaceBlit.h"
 
 
 
@@ -737,6 +738,10 @@ static void DrawRGBA(SDL_Surface * bmpDest, SDL_Surface * bmpSrc, SDL_Rect& rDes
 	assert(false);
 }
 
+// SDL keeps the blit mapping in the source surface, so SDL_BlitSurface must not
+// run in parallel (the viewports can be drawn in several threads)
+static Mutex sdlBlitMutex;
+
 /////////////////////
 // Draws the image
 void DrawImageAdv(SDL_Surface * bmpDest, SDL_Surface * bmpSrc, SDL_Rect& rDest, SDL_Rect& rSrc)
@@ -751,7 +756,11 @@ void DrawImageAdv(SDL_Surface * bmpDest, SDL_Surface * bmpSrc, SDL_Rect& rDest,
 		return;
 	}
 
-	SDL_BlitSurface(bmpSrc, &rSrc, bmpDest, &rDest);
+	// the common formats are done by our own kernels, SDL does the rest
+	if(!SurfaceBlit::blit(bmpDest, bmpSrc, rDest, rSrc)) {
+		Mutex::ScopedLock lock(sdlBlitMutex);
+		SDL_BlitSurface(bmpSrc, &rSrc, bmpDest, &rDest);
+	}
 
 	return; // XXX: for now. I hope that SDL2 is faster than our code... :P Also, I didn't checked our code with SDL2 yet
 	
@@ -3014,6 +3023,7 @@ template <> void SmartPointer_ObjectDeinit<SDL_Surface> ( SDL_Surface * obj )
 	//printf("SmartPointer_ObjectDeinit<SDL_Surface>() %p\n", obj);
 	#endif
 
+	SurfaceBlit::freeCache(obj);
 	SDL_FreeSurface(obj);
 }
 
@@ -144,6 +144,8 @@ bool GameOptions::Init() {
 #endif
 		( tLXOptions->iColourDepth, "Video.ColourDepth", 32 )
 		( tLXOptions->sResolution, "Video.Resolution", "" )
+		( tLXOptions->bParallelViewports, "Video.ParallelViewports", false )
+		( tLXOptions->bMapTileCache, "Video.MapTileCache", true )
 
 		( tLXOptions->iNetworkPort, "Network.Port", (int)LX_PORT )
 		( tLXOptions->iNetworkSpeed, "Network.Speed", (int)NST_LAN )
@@ -229,6 +231,12 @@ bool GameOptions::Init() {
 																		false )
 #endif
 		( tLXOptions->bCheckForUpdates, "Advanced.CheckForUpdates", true )
+		( tLXOptions->bInterestManagement, "Advanced.InterestManagement", false )
+		( tLXOptions->bParallelProjectiles, "Advanced.ParallelProjectiles", false )
+		( tLXOptions->iProjectileThreads, "Advanced.ProjectileThreads", 4 )
+		( tLXOptions->iBotPathBudget, "Advanced.BotPathBudget", 10000 )
+		( tLXOptions->iBotPathThreads, "Advanced.BotPathThreads", 2 )
+		( tLXOptions->bBatchedNetIO, "Advanced.BatchedNetIO", false )
 
 		( tLXOptions->bLogConvos, "Misc.LogConversations", false )
 		( tLXOptions->bShowPing, "Misc.ShowPing", true )
@@ -0,0 +1,631 @@
+/*
+ *  SurfaceBlit.cpp
+ *  OpenLieroX
+ *
+ *  format specialized blit kernels for DrawImageAdv
+ *
+ *  code under LGPL
+ *
+ */
+
+#ifndef DEDICATED_ONLY
+
+#include <cstring>
+#include <vector>
+#include "SurfaceBlit.h"
+#include "CodeAttributes.h"
+#include "MathLib.h"
+#include "Mutex.h"
+#include "ReadWriteLock.h"
+#include "Timer.h"
+#include "Debug.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SB_HAVE_SSE2
+#include <emmintrin.h>
+#endif
+
+
+namespace SurfaceBlit {
+
+bool haveSSE2() {
+#ifdef SB_HAVE_SSE2
+	return true;
+#else
+	return false;
+#endif
+}
+
+// Everything the choice of the kernel depends on. If any of it changes, the
+// kernel and the lookup table are set up again.
+struct State {
+	const SDL_PixelFormat* srcFormat;
+	const SDL_PixelFormat* dstFormat;
+	Uint32 dstFormatEnum;
+	const SDL_Palette* srcPalette;
+	Uint32 srcPaletteVersion;
+	const SDL_Palette* dstPalette;
+	Uint32 dstPaletteVersion;
+	SDL_BlendMode blendMode;
+	Uint8 alphaMod, r, g, b;
+	bool keyed;
+	Uint32 key;
+
+	State(const SDL_Surface* dst, SDL_Surface* src) {
+		srcFormat = src->format;
+		dstFormat = dst->format;
+		dstFormatEnum = dst->format->format;
+		srcPalette = src->format->palette;
+		srcPaletteVersion = srcPalette ? srcPalette->version : 0;
+		dstPalette = dst->format->palette;
+		dstPaletteVersion = dstPalette ? dstPalette->version : 0;
+		blendMode = SDL_BLENDMODE_NONE;
+		SDL_GetSurfaceBlendMode(src, &blendMode);
+		alphaMod = SDL_ALPHA_OPAQUE;
+		SDL_GetSurfaceAlphaMod(src, &alphaMod);
+		r = g = b = 255;
+		SDL_GetSurfaceColorMod(src, &r, &g, &b);
+		key = 0;
+		keyed = SDL_GetColorKey(src, &key) == 0;
+	}
+
+	bool operator==(const State& o) const {
+		return
+			srcFormat == o.srcFormat && dstFormat == o.dstFormat && dstFormatEnum == o.dstFormatEnum &&
+			srcPalette == o.srcPalette && srcPaletteVersion == o.srcPaletteVersion &&
+			dstPalette == o.dstPalette && dstPaletteVersion == o.dstPaletteVersion &&
+			blendMode == o.blendMode && alphaMod == o.alphaMod &&
+			r == o.r && g == o.g && b == o.b &&
+			keyed == o.keyed && key == o.key;
+	}
+};
+
+struct Cache;
+typedef void (*RowFunc)(Uint8* dst, const Uint8* src, int w, const Cache& c);
+
+enum Pair { P_None = 0, P_Copy, P_ARGB_XRGB, P_ARGB_565, P_8_8, P_8_32, P_8_16, P_Count };
+
+struct Cache {
+	// Blits read the cache, several at the same time (the viewports can be drawn
+	// from different threads). Setting it up again needs the write access.
+	ReadWriteLock lock;
+	State state;
+	Pair pair;
+	int bytesPerPixel;
+	Uint8 key;
+	bool keyed;
+	Uint32 map[256]; // palette index -> destination pixel, for 8bit sources
+
+	Cache(const State& s) : state(s), pair(P_None), bytesPerPixel(0), key(0), keyed(false) {}
+};
+
+// protects SDL_Surface::userdata
+static Mutex cacheMutex;
+
+
+// ------------------------------------------------------------------
+// Scalar kernels. The blended ones are the same as in SDL (SDL_blit_A.c).
+
+static INLINE Uint32 blendARGBtoXRGB(Uint32 s, Uint32 d) {
+	const Uint32 alpha = s >> 24;
+	if(alpha == 0) return d;
+	if(alpha == SDL_ALPHA_OPAQUE) return (s & 0xffffff) | (d & 0xff000000);
+
+	const Uint32 dalpha = d & 0xff000000;
+	const Uint32 s1 = s & 0xff00ff;
+	Uint32 d1 = d & 0xff00ff;
+	d1 = (d1 + ((s1 - d1) * alpha >> 8)) & 0xff00ff;
+	s &= 0xff00;
+	d &= 0xff00;
+	d = (d + ((s - d) * alpha >> 8)) & 0xff00;
+	return d1 | d | dalpha;
+}
+
+static INLINE Uint16 blendARGBto565(Uint32 s, Uint16 dst) {
+	const Uint32 alpha = s >> 27; // downscale alpha to 5 bits
+	if(alpha == 0) return dst;
+	if(alpha == (SDL_ALPHA_OPAQUE >> 3))
+		return (Uint16)(((s >> 8) & 0xf800) + ((s >> 5) & 0x7e0) + ((s >> 3) & 0x1f));
+
+	// RGB 565 is put into the 32bit layout -g--r-b- for the blending
+	Uint32 d = dst;
+	s = ((s & 0xfc00) << 11) + ((s >> 8) & 0xf800) + ((s >> 3) & 0x1f);
+	d = (d | (d << 16)) & 0x07e0f81f;
+	d += (s - d) * alpha >> 5;
+	d &= 0x07e0f81f;
+	return (Uint16)(d | (d >> 16));
+}
+
+static void rowCopy(Uint8* dst, const Uint8* src, int w, const Cache& c) {
+	memcpy(dst, src, w * c.bytesPerPixel);
+}
+
+static void rowARGBtoXRGB(Uint8* dst, const Uint8* src, int w, const Cache&) {
+	Uint32* d = (Uint32*)dst;
+	const Uint32* s = (const Uint32*)src;
+	for(int i = 0; i < w; ++i)
+		d[i] = blendARGBtoXRGB(s[i], d[i]);
+}
+
+static void rowARGBto565(Uint8* dst, const Uint8* src, int w, const Cache&) {
+	Uint16* d = (Uint16*)dst;
+	const Uint32* s = (const Uint32*)src;
+	for(int i = 0; i < w; ++i)
+		d[i] = blendARGBto565(s[i], d[i]);
+}
+
+static void row8to8(Uint8* dst, const Uint8* src, int w, const Cache& c) {
+	if(!c.keyed) {
+		memcpy(dst, src, w);
+		return;
+	}
+	const Uint8 key = c.key;
+	for(int i = 0; i < w; ++i)
+		if(src[i] != key) dst[i] = src[i];
+}
+
+template<typename T>
+static INLINE void row8toN(T* d, const Uint8* src, int w, const Cache& c) {
+	const Uint32* map = c.map;
+	if(!c.keyed) {
+		for(int i = 0; i < w; ++i)
+			d[i] = (T)map[src[i]];
+		return;
+	}
+	const Uint8 key = c.key;
+	for(int i = 0; i < w; ++i) {
+		const Uint8 p = src[i];
+		if(p != key) d[i] = (T)map[p];
+	}
+}
+
+static void row8to32(Uint8* dst, const Uint8* src, int w, const Cache& c) {
+	row8toN((Uint32*)dst, src, w, c);
+}
+
+static void row8to16(Uint8* dst, const Uint8* src, int w, const Cache& c) {
+	row8toN((Uint16*)dst, src, w, c);
+}
+
+
+// ------------------------------------------------------------------
+// SSE2 kernels. Same results as the scalar ones, the rest of a row is done by them.
+
+#ifdef SB_HAVE_SSE2
+
+static INLINE __m128i select(__m128i mask, __m128i a, __m128i b) {
+	return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+// 32bit multiplication (mod 2^32) of each lane with a 16bit factor, which
+// must be in both 16bit halves of the lane
+static INLINE __m128i mul32(__m128i a, __m128i f) {
+	return _mm_add_epi32(_mm_mullo_epi16(a, f), _mm_slli_epi32(_mm_mulhi_epu16(a, f), 16));
+}
+
+static void rowARGBtoXRGB_sse2(Uint8* dst, const Uint8* src, int w, const Cache& c) {
+	Uint32* d = (Uint32*)dst;
+	const Uint32* s = (const Uint32*)src;
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i opaque = _mm_set1_epi32(SDL_ALPHA_OPAQUE);
+	const __m128i maskRB = _mm_set1_epi32(0xff00ff);
+	const __m128i maskG = _mm_set1_epi32(0xff00);
+	const __m128i maskRGB = _mm_set1_epi32(0xffffff);
+	const __m128i maskA = _mm_set1_epi32(0xff000000);
+
+	int i = 0;
+	for(; i + 4 <= w; i += 4) {
+		const __m128i vs = _mm_loadu_si128((const __m128i*)(s + i));
+		const __m128i alpha = _mm_srli_epi32(vs, 24);
+		const __m128i isZero = _mm_cmpeq_epi32(alpha, zero);
+		if(_mm_movemask_epi8(isZero) == 0xffff) continue; // all transparent
+
+		const __m128i vd = _mm_loadu_si128((const __m128i*)(d + i));
+		const __m128i f = _mm_or_si128(alpha, _mm_slli_epi32(alpha, 16));
+		const __m128i dalpha = _mm_and_si128(vd, maskA);
+
+		__m128i d1 = _mm_and_si128(vd, maskRB);
+		d1 = _mm_add_epi32(d1, _mm_srli_epi32(mul32(_mm_sub_epi32(_mm_and_si128(vs, maskRB), d1), f), 8));
+		d1 = _mm_and_si128(d1, maskRB);
+		__m128i g = _mm_and_si128(vd, maskG);
+		g = _mm_add_epi32(g, _mm_srli_epi32(mul32(_mm_sub_epi32(_mm_and_si128(vs, maskG), g), f), 8));
+		g = _mm_and_si128(g, maskG);
+
+		__m128i r = _mm_or_si128(_mm_or_si128(d1, g), dalpha);
+		r = select(_mm_cmpeq_epi32(alpha, opaque), _mm_or_si128(_mm_and_si128(vs, maskRGB), dalpha), r);
+		r = select(isZero, vd, r);
+		_mm_storeu_si128((__m128i*)(d + i), r);
+	}
+	rowARGBtoXRGB(dst + i * 4, src + i * 4, w - i, c);
+}
+
+static void rowARGBto565_sse2(Uint8* dst, const Uint8* src, int w, const Cache& c) {
+	Uint16* d = (Uint16*)dst;
+	const Uint32* s = (const Uint32*)src;
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i opaque = _mm_set1_epi32(SDL_ALPHA_OPAQUE >> 3);
+	const __m128i mask565 = _mm_set1_epi32(0x07e0f81f);
+	const __m128i maskR = _mm_set1_epi32(0xf800);
+	const __m128i maskG = _mm_set1_epi32(0x7e0);
+	const __m128i maskB = _mm_set1_epi32(0x1f);
+	const __m128i maskG6 = _mm_set1_epi32(0xfc00);
+	const __m128i mask16 = _mm_set1_epi32(0xffff);
+
+	int i = 0;
+	for(; i + 4 <= w; i += 4) {
+		const __m128i vs = _mm_loadu_si128((const __m128i*)(s + i));
+		const __m128i alpha = _mm_srli_epi32(vs, 27);
+		const __m128i isZero = _mm_cmpeq_epi32(alpha, zero);
+		if(_mm_movemask_epi8(isZero) == 0xffff) continue; // all transparent
+
+		const __m128i vd = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i*)(d + i)), zero);
+		const __m128i f = _mm_or_si128(alpha, _mm_slli_epi32(alpha, 16));
+		const __m128i rb = _mm_add_epi32(_mm_and_si128(_mm_srli_epi32(vs, 8), maskR), _mm_and_si128(_mm_srli_epi32(vs, 3), maskB));
+		const __m128i solid = _mm_add_epi32(rb, _mm_and_si128(_mm_srli_epi32(vs, 5), maskG));
+
+		const __m128i sx = _mm_add_epi32(_mm_slli_epi32(_mm_and_si128(vs, maskG6), 11), rb);
+		__m128i dx = _mm_and_si128(_mm_or_si128(vd, _mm_slli_epi32(vd, 16)), mask565);
+		dx = _mm_add_epi32(dx, _mm_srli_epi32(mul32(_mm_sub_epi32(sx, dx), f), 5));
+		dx = _mm_and_si128(dx, mask565);
+
+		__m128i r = _mm_and_si128(_mm_or_si128(dx, _mm_srli_epi32(dx, 16)), mask16);
+		r = select(_mm_cmpeq_epi32(alpha, opaque), solid, r);
+		r = select(isZero, vd, r);
+		// sign extend, so that the saturating pack keeps the 16bit values
+		r = _mm_srai_epi32(_mm_slli_epi32(r, 16), 16);
+		_mm_storel_epi64((__m128i*)(d + i), _mm_packs_epi32(r, r));
+	}
+	rowARGBto565(dst + i * 2, src + i * 4, w - i, c);
+}
+
+static void row8to8_sse2(Uint8* dst, const Uint8* src, int w, const Cache& c) {
+	if(!c.keyed) {
+		memcpy(dst, src, w);
+		return;
+	}
+	const __m128i key = _mm_set1_epi8((char)c.key);
+	int i = 0;
+	for(; i + 16 <= w; i += 16) {
+		const __m128i vs = _mm_loadu_si128((const __m128i*)(src + i));
+		const __m128i isKey = _mm_cmpeq_epi8(vs, key);
+		const int m = _mm_movemask_epi8(isKey);
+		if(m == 0xffff) continue;
+		if(m == 0) {
+			_mm_storeu_si128((__m128i*)(dst + i), vs);
+			continue;
+		}
+		const __m128i vd = _mm_loadu_si128((const __m128i*)(dst + i));
+		_mm_storeu_si128((__m128i*)(dst + i), select(isKey, vd, vs));
+	}
+	row8to8(dst + i, src + i, w - i, c);
+}
+
+#else
+
+// no SSE2 here, the SSE2 kernel selection just gives the scalar ones
+#define rowARGBtoXRGB_sse2 rowARGBtoXRGB
+#define rowARGBto565_sse2 rowARGBto565
+#define row8to8_sse2 row8to8
+
+#endif
+
+// The lookups of the 8bit -> 16/32bit rows don't vectorize with SSE2 (no
+// gather), so both entries are the scalar table lookup.
+static const struct {
+	const char* name;
+	RowFunc scalar;
+	RowFunc sse2;
+} kernels[P_Count] = {
+	{ "none", NULL, NULL },
+	{ "copy", rowCopy, rowCopy },
+	{ "ARGB8888 -> XRGB8888", rowARGBtoXRGB, rowARGBtoXRGB_sse2 },
+	{ "ARGB8888 -> RGB565", rowARGBto565, rowARGBto565_sse2 },
+	{ "8bit -> 8bit", row8to8, row8to8_sse2 },
+	{ "8bit -> 32bit", row8to32, row8to32 },
+	{ "8bit -> 16bit", row8to16, row8to16 },
+};
+
+
+// ------------------------------------------------------------------
+// Kernel selection
+
+static bool hasMasks(const SDL_PixelFormat* f, int bpp, Uint32 r, Uint32 g, Uint32 b, Uint32 a) {
+	return f->BytesPerPixel == bpp && f->Rmask == r && f->Gmask == g && f->Bmask == b && f->Amask == a;
+}
+
+static bool samePalette(const SDL_Palette* a, const SDL_Palette* b) {
+	if(a == b) return true;
+	if(!a || !b || a->ncolors != b->ncolors) return false;
+	return memcmp(a->colors, b->colors, a->ncolors * sizeof(SDL_Color)) == 0;
+}
+
+static void setup(Cache& c, const SDL_Surface* dst, const SDL_Surface* src) {
+	const State& st = c.state;
+	const SDL_PixelFormat* sf = src->format;
+	const SDL_PixelFormat* df = dst->format;
+	c.pair = P_None;
+	c.bytesPerPixel = sf->BytesPerPixel;
+	c.keyed = st.keyed;
+	c.key = (Uint8)st.key;
+
+	// color and alpha modulation is left to SDL
+	if(st.r != 255 || st.g != 255 || st.b != 255 || st.alphaMod != SDL_ALPHA_OPAQUE)
+		return;
+
+	// same format without blending, like the map layers
+	if(sf->BytesPerPixel > 1 && st.blendMode == SDL_BLENDMODE_NONE && !st.keyed &&
+	   hasMasks(df, sf->BytesPerPixel, sf->Rmask, sf->Gmask, sf->Bmask, sf->Amask)) {
+		c.pair = P_Copy;
+	}
+	else if(hasMasks(sf, 4, 0xff0000, 0xff00, 0xff, 0xff000000)) {
+		if(st.blendMode != SDL_BLENDMODE_BLEND || st.keyed) return;
+		if(hasMasks(df, 4, 0xff0000, 0xff00, 0xff, 0))
+			c.pair = P_ARGB_XRGB;
+		else if(hasMasks(df, 2, 0xf800, 0x7e0, 0x1f, 0))
+			c.pair = P_ARGB_565;
+	}
+	else if(sf->BytesPerPixel == 1 && sf->palette) {
+		if(st.blendMode != SDL_BLENDMODE_NONE) return;
+		if(df->BytesPerPixel == 1) {
+			// with different palettes, SDL maps to the closest colors
+			if(samePalette(sf->palette, df->palette))
+				c.pair = P_8_8;
+		}
+		else if((df->BytesPerPixel == 2 || df->BytesPerPixel == 4) && df->Amask == 0) {
+			const SDL_Palette* pal = sf->palette;
+			for(int i = 0; i < 256; ++i) {
+				const SDL_Color col = (i < pal->ncolors) ? pal->colors[i] : SDL_Color();
+				c.map[i] = SDL_MapRGB(df, col.r, col.g, col.b);
+			}
+			c.pair = (df->BytesPerPixel == 4) ? P_8_32 : P_8_16;
+		}
+	}
+}
+
+static Cache* getCache(SDL_Surface* src, const State& st) {
+	Mutex::ScopedLock lock(cacheMutex);
+	Cache* c = (Cache*)src->userdata;
+	if(!c) {
+		c = new Cache(st);
+		c->state.srcFormat = NULL; // not set up yet
+		src->userdata = c;
+	}
+	return c;
+}
+
+void freeCache(SDL_Surface* surf) {
+	if(!surf) return;
+	Mutex::ScopedLock lock(cacheMutex);
+	delete (Cache*)surf->userdata;
+	surf->userdata = NULL;
+}
+
+
+// ------------------------------------------------------------------
+// Blitting
+
+// The same clipping as SDL_UpperBlit
+static bool clip(const SDL_Surface* dst, const SDL_Surface* src, SDL_Rect& rDest, const SDL_Rect& rSrc, int& sx, int& sy) {
+	int w = rSrc.w, h = rSrc.h;
+	sx = rSrc.x;
+	sy = rSrc.y;
+
+	// clip the source rectangle to the source surface
+	if(sx < 0) { w += sx; rDest.x -= sx; sx = 0; }
+	if(w > src->w - sx) w = src->w - sx;
+	if(sy < 0) { h += sy; rDest.y -= sy; sy = 0; }
+	if(h > src->h - sy) h = src->h - sy;
+
+	// clip the destination rectangle against the clip rectangle
+	const SDL_Rect& cr = dst->clip_rect;
+	int d = cr.x - rDest.x;
+	if(d > 0) { w -= d; rDest.x += d; sx += d; }
+	d = rDest.x + w - cr.x - cr.w;
+	if(d > 0) w -= d;
+	d = cr.y - rDest.y;
+	if(d > 0) { h -= d; rDest.y += d; sy += d; }
+	d = rDest.y + h - cr.y - cr.h;
+	if(d > 0) h -= d;
+
+	if(w > 0 && h > 0) {
+		rDest.w = w;
+		rDest.h = h;
+		return true;
+	}
+	rDest.w = rDest.h = 0;
+	return false;
+}
+
+static bool blitRows(SDL_Surface* dst, SDL_Surface* src, SDL_Rect& rDest, const SDL_Rect& rSrc, Kernel k, const Cache& c) {
+	if(c.pair == P_None) return false;
+
+	const RowFunc func = (k == K_Scalar || (k == K_Auto && !haveSSE2())) ? kernels[c.pair].scalar : kernels[c.pair].sse2;
+
+	int sx = 0, sy = 0;
+	if(!clip(dst, src, rDest, rSrc, sx, sy)) return true;
+
+	const int sbpp = src->format->BytesPerPixel;
+	const int dbpp = dst->format->BytesPerPixel;
+	const Uint8* s = (const Uint8*)src->pixels + sy * src->pitch + sx * sbpp;
+	Uint8* d = (Uint8*)dst->pixels + rDest.y * dst->pitch + rDest.x * dbpp;
+	for(int y = 0; y < rDest.h; ++y, s += src->pitch, d += dst->pitch)
+		(*func)(d, s, rDest.w, c);
+	return true;
+}
+
+bool blit(SDL_Surface* dst, SDL_Surface* src, SDL_Rect& rDest, const SDL_Rect& rSrc, Kernel k) {
+	if(!dst || !src || !dst->pixels || !src->pixels) return false;
+	if(SDL_MUSTLOCK(src) || SDL_MUSTLOCK(dst)) return false; // RLE
+	if(src == dst) return false; // SDL handles the overlapping
+
+	const State st(dst, src);
+	Cache* c = getCache(src, st);
+	for(;;) {
+		c->lock.startReadAccess();
+		if(c->state == st) break;
+		c->lock.endReadAccess();
+
+		c->lock.startWriteAccess();
+		if(!(c->state == st)) {
+			c->state = st;
+			setup(*c, dst, src);
+		}
+		c->lock.endWriteAccess();
+	}
+	const bool ret = blitRows(dst, src, rDest, rSrc, k, *c);
+	c->lock.endReadAccess();
+	return ret;
+}
+
+
+// ------------------------------------------------------------------
+// Benchmark
+
+static const int BENCH_W = 640, BENCH_H = 480, SPRITE_SIZE = 64, SPRITES_PER_PASS = 100;
+
+static void fillRandom(SDL_Surface* surf, SyncedRandom& rnd) {
+	for(int y = 0; y < surf->h; ++y) {
+		Uint8* p = (Uint8*)surf->pixels + y * surf->pitch;
+		for(int x = 0; x < surf->w * surf->format->BytesPerPixel; ++x)
+			p[x] = (Uint8)rnd.getInt();
+	}
+}
+
+// sprites with fully transparent, opaque and blended parts
+static void fillSprite(SDL_Surface* surf, SyncedRandom& rnd) {
+	fillRandom(surf, rnd);
+	for(int y = 0; y < surf->h; ++y) {
+		Uint8* p = (Uint8*)surf->pixels + y * surf->pitch;
+		for(int x = 0; x < surf->w; ++x) {
+			const bool transparent = (x - surf->w / 2) * (x - surf->w / 2) + (y - surf->h / 2) * (y - surf->h / 2) > surf->w * surf->w / 5;
+			if(surf->format->BytesPerPixel == 1) {
+				if(transparent) p[x] = 0;
+			}
+			else {
+				Uint32& px = ((Uint32*)p)[x];
+				if(transparent) px &= 0xffffff;
+				else if(rnd.getInt() % 2) px |= 0xff000000;
+			}
+		}
+	}
+}
+
+static int diffPixels(const SDL_Surface* a, const SDL_Surface* b) {
+	int n = 0;
+	const int bpp = a->format->BytesPerPixel;
+	for(int y = 0; y < a->h; ++y) {
+		const Uint8* pa = (const Uint8*)a->pixels + y * a->pitch;
+		const Uint8* pb = (const Uint8*)b->pixels + y * b->pitch;
+		for(int x = 0; x < a->w; ++x)
+			if(memcmp(pa + x * bpp, pb + x * bpp, bpp) != 0) ++n;
+	}
+	return n;
+}
+
+// mode 0: SDL_BlitSurface, otherwise our kernels
+static TimeDiff runBlits(SDL_Surface* dst, SDL_Surface* src, int iterations, int mode, bool& ok) {
+	SyncedRandom rnd(4321);
+	AbsTime start = GetTime();
+	for(int i = 0; i < iterations; ++i) {
+		for(int j = 0; j < SPRITES_PER_PASS; ++j) {
+			// some sprites are partly outside
+			SDL_Rect rDest = { (int)(rnd.getInt() % (BENCH_W + SPRITE_SIZE)) - SPRITE_SIZE / 2, (int)(rnd.getInt() % (BENCH_H + SPRITE_SIZE)) - SPRITE_SIZE / 2, 0, 0 };
+			SDL_Rect rSrc = { 0, 0, SPRITE_SIZE, SPRITE_SIZE };
+			if(mode == 0)
+				SDL_BlitSurface(src, &rSrc, dst, &rDest);
+			else if(!blit(dst, src, rDest, rSrc, (mode == 1) ? K_Scalar : K_SSE2))
+				ok = false;
+		}
+	}
+	return GetTime() - start;
+}
+
+bool benchmark(int iterations) {
+	if(iterations <= 0) iterations = 1;
+	notes << "SurfaceBlit benchmark: " << iterations << " x " << SPRITES_PER_PASS << " sprites (" << SPRITE_SIZE << "x" << SPRITE_SIZE << "), SSE2 " << (haveSSE2() ? "on" : "off") << endl;
+
+	SyncedRandom rnd(1234);
+	SDL_Color colors[256];
+	for(int i = 0; i < 256; ++i) {
+		colors[i].r = (Uint8)rnd.getInt(); colors[i].g = (Uint8)rnd.getInt(); colors[i].b = (Uint8)rnd.getInt();
+		colors[i].a = SDL_ALPHA_OPAQUE;
+	}
+
+	SDL_Surface* src32 = SDL_CreateRGBSurface(0, SPRITE_SIZE, SPRITE_SIZE, 32, 0xff0000, 0xff00, 0xff, 0xff000000);
+	SDL_Surface* src8 = SDL_CreateRGBSurface(0, SPRITE_SIZE, SPRITE_SIZE, 8, 0, 0, 0, 0);
+	if(!src32 || !src8) {
+		errors << "SurfaceBlit benchmark: cannot create surfaces: " << SDL_GetError() << endl;
+		if(src32) SDL_FreeSurface(src32);
+		if(src8) SDL_FreeSurface(src8);
+		return false;
+	}
+	fillSprite(src32, rnd);
+	SDL_SetSurfaceBlendMode(src32, SDL_BLENDMODE_BLEND);
+	SDL_SetPaletteColors(src8->format->palette, colors, 0, 256);
+	fillSprite(src8, rnd);
+	SDL_SetColorKey(src8, SDL_TRUE, 0);
+
+	struct Case { Pair pair; SDL_Surface* src; int bpp; Uint32 r, g, b; };
+	const Case cases[] = {
+		{ P_ARGB_XRGB, src32, 32, 0xff0000, 0xff00, 0xff },
+		{ P_ARGB_565, src32, 16, 0xf800, 0x7e0, 0x1f },
+		{ P_8_8, src8, 8, 0, 0, 0 },
+		{ P_8_32, src8, 32, 0xff0000, 0xff00, 0xff },
+		{ P_8_16, src8, 16, 0xf800, 0x7e0, 0x1f },
+	};
+
+	bool ok = true;
+	for(size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i) {
+		const Case& cs = cases[i];
+		SDL_Surface* dst[3];
+		for(int m = 0; m < 3; ++m) {
+			dst[m] = SDL_CreateRGBSurface(0, BENCH_W, BENCH_H, cs.bpp, cs.r, cs.g, cs.b, 0);
+			if(dst[m] && dst[m]->format->palette)
+				SDL_SetPaletteColors(dst[m]->format->palette, colors, 0, 256);
+		}
+		if(!dst[0] || !dst[1] || !dst[2]) {
+			errors << "SurfaceBlit benchmark: cannot create surfaces: " << SDL_GetError() << endl;
+			for(int m = 0; m < 3; ++m) if(dst[m]) SDL_FreeSurface(dst[m]);
+			ok = false;
+			break;
+		}
+		SyncedRandom bg(99);
+		fillRandom(dst[0], bg);
+		for(int m = 1; m < 3; ++m)
+			memcpy(dst[m]->pixels, dst[0]->pixels, dst[0]->pitch * dst[0]->h);
+
+		bool blitted = true;
+		TimeDiff t[3];
+		for(int m = 0; m < 3; ++m)
+			t[m] = runBlits(dst[m], cs.src, iterations, m, blitted);
+
+		const char* name = kernels[cs.pair].name;
+		notes << "SurfaceBlit " << name << ": SDL " << t[0].milliseconds() << "ms, ";
+		notes << "scalar " << t[1].milliseconds() << "ms, SSE2 " << t[2].milliseconds() << "ms";
+		notes << ", " << diffPixels(dst[0], dst[1]) << " pixels differ from SDL" << endl;
+
+		if(!blitted) {
+			errors << "SurfaceBlit " << name << ": no kernel was used" << endl;
+			ok = false;
+		}
+		const int n = diffPixels(dst[1], dst[2]);
+		if(n > 0) {
+			errors << "SurfaceBlit " << name << ": SSE2 and scalar differ in " << n << " pixels" << endl;
+			ok = false;
+		}
+
+		for(int m = 0; m < 3; ++m) SDL_FreeSurface(dst[m]);
+	}
+
+	freeCache(src32);
+	freeCache(src8);
+	SDL_FreeSurface(src32);
+	SDL_FreeSurface(src8);
+
+	if(ok) notes << "SurfaceBlit: SSE2 and scalar kernels identical" << endl;
+	return ok;
+}
+
+} // namespace SurfaceBlit
+
+#endif // DEDICATED_ONLY
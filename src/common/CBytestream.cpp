@@ -20,6 +20,7 @@
 #include <cassert>
 #include <stdarg.h>
 #include <iomanip>
+#include <vector>
 
 #include "CBytestream.h"
 #include "EndianSwap.h"
@@ -30,6 +31,67 @@
 #include "Iter.h"
 #include "Utils.h"
 #include "util/CustomVar.h"
+#include "Mutex.h"
+#include "Timer.h"
+#include "Protocol.h"
+
+
+// Buffers smaller than this are not worth keeping, bigger ones would waste memory
+static const size_t MIN_POOLED_CAPACITY = 256;
+static const size_t MAX_POOLED_CAPACITY = 16 * 1024;
+static const size_t MAX_POOLED_BUFFERS = 256;
+
+namespace {
+	struct BytestreamBufferPool {
+		Mutex mutex;
+		std::vector<std::string> buffers;
+		Uint64 reused, allocated;
+		BytestreamBufferPool() : reused(0), allocated(0) {}
+	};
+}
+
+// never deleted, the bytestreams of global objects can be destroyed late
+static BytestreamBufferPool& bufferPool() {
+	static BytestreamBufferPool* pool = new BytestreamBufferPool();
+	return *pool;
+}
+
+void CBytestream::releaseBuffer() {
+	if(Data.capacity() < MIN_POOLED_CAPACITY || Data.capacity() > MAX_POOLED_CAPACITY)
+		return;
+	BytestreamBufferPool& pool = bufferPool();
+	Mutex::ScopedLock lock(pool.mutex);
+	if(pool.buffers.size() >= MAX_POOLED_BUFFERS)
+		return;
+	Data.clear();
+	pool.buffers.push_back(std::string());
+	pool.buffers.back().swap(Data);
+}
+
+void CBytestream::growBuffer(size_t n) {
+	const size_t size = Data.size() + n;
+	if(Data.capacity() < MIN_POOLED_CAPACITY && size <= MAX_POOLED_CAPACITY) {
+		// we don't have a pooled buffer yet
+		std::string buffer;
+		{
+			BytestreamBufferPool& pool = bufferPool();
+			Mutex::ScopedLock lock(pool.mutex);
+			if(!pool.buffers.empty()) {
+				buffer.swap(pool.buffers.back());
+				pool.buffers.pop_back();
+				pool.reused++;
+			}
+			else
+				pool.allocated++;
+		}
+		if(buffer.capacity() < size)
+			buffer.reserve(MAX(size, MIN_POOLED_CAPACITY));
+		buffer.assign(Data);
+		Data.swap(buffer);
+		return;
+	}
+	Data.reserve(MAX(Data.capacity() * 2, size));
+}
 
 
 void CBytestream::Test()
@@ -236,8 +298,144 @@ void CBytestream::Test()
 
 }
 
+///////////////////
+// Benchmark of the server update packets (see GameServer::SendUpdate)
+
+namespace {
+	struct BenchWorm {
+		short x, y;
+		int angle;
+		uchar bits, weapon;
+		Sint16 vx, vy;
+	};
+
+	// the same as CWorm::writePacket() writes
+	static void writeBenchWorm(CBytestream& bs, const BenchWorm& w) {
+		bs.writeByte(w.bits & 0x1f); // the id
+		bs.write2Int12(w.x, w.y);
+		bs.writeInt(w.angle, 1);
+		bs.writeByte(w.bits);
+		bs.writeByte(w.weapon);
+		bs.writeInt16(w.vx);
+		bs.writeInt16(w.vy);
+	}
+
+	// how it was done before: std::string growing byte by byte, new strings for every packet
+	static void writeBenchWormString(std::string& s, const BenchWorm& w) {
+		s += (char)(w.bits & 0x1f);
+		s += (char)((ushort)w.x & 0xff);
+		s += (char)((((ushort)w.x & 0xf00) >> 8) + (((ushort)w.y & 0xf) << 4));
+		s += (char)(((ushort)w.y & 0xff0) >> 4);
+		s += (char)w.angle;
+		s += (char)w.bits;
+		s += (char)w.weapon;
+		s += (char)(w.vx >> 8); s += (char)w.vx;
+		s += (char)(w.vy >> 8); s += (char)w.vy;
+	}
+}
+
+void CBytestream::Benchmark(int clients, int worms) {
+	const int frames = 1000;
+	clients = CLAMP(clients, 1, 256);
+	worms = CLAMP(worms, 1, 256);
+
+	std::vector<BenchWorm> w(worms);
+	Uint32 r = 1;
+	for(int i = 0; i < worms; ++i) {
+		r = r * 1103515245 + 12345; w[i].x = (short)((r >> 8) % 2000); w[i].y = (short)((r >> 4) % 1500);
+		w[i].angle = (int)(r % 180); w[i].bits = (uchar)(r >> 16); w[i].weapon = (uchar)(r % 5);
+		w[i].vx = (Sint16)(r >> 20) % 100; w[i].vy = (Sint16)(r >> 12) % 100;
+	}
+
+	// we only check that all versions write the same
+	size_t checkString = 0, checkTemp = 0, checkDirect = 0;
+
+	AbsTime start = GetTime();
+	{
+		std::vector<std::string> unreliable(clients);
+		for(int f = 0; f < frames; ++f)
+			for(int c = 0; c < clients; ++c) {
+				std::string updatePackets;
+				for(int i = 0; i < worms; ++i) {
+					if(i == c) continue; // the worm of this client
+					std::string bytes;
+					writeBenchWormString(bytes, w[i]);
+					updatePackets += bytes;
+				}
+				unreliable[c] = "";
+				unreliable[c] += (char)S2C_UPDATEWORMS;
+				unreliable[c] += (char)(worms - 1);
+				unreliable[c] += updatePackets;
+				checkString += unreliable[c].size();
+			}
+	}
+	const TimeDiff stringTime = GetTime() - start;
+
+	Uint64 allocated = 0;
+	{
+		Mutex::ScopedLock lock(bufferPool().mutex);
+		allocated = bufferPool().allocated;
+	}
+	start = GetTime();
+	{
+		std::vector<CBytestream> unreliable(clients);
+		for(int f = 0; f < frames; ++f)
+			for(int c = 0; c < clients; ++c) {
+				CBytestream updatePackets;
+				for(int i = 0; i < worms; ++i) {
+					if(i == c) continue;
+					CBytestream bytes;
+					writeBenchWorm(bytes, w[i]);
+					updatePackets.Append(&bytes);
+				}
+				unreliable[c].Clear();
+				unreliable[c].writeByte(S2C_UPDATEWORMS);
+				unreliable[c].writeByte(worms - 1);
+				unreliable[c].Append(&updatePackets);
+				checkTemp += unreliable[c].GetLength();
+			}
+	}
+	const TimeDiff tempTime = GetTime() - start;
+
+	start = GetTime();
+	{
+		std::vector<CBytestream> unreliable(clients);
+		for(int f = 0; f < frames; ++f)
+			for(int c = 0; c < clients; ++c) {
+				CBytestream updatePackets;
+				for(int i = 0; i < worms; ++i) {
+					if(i == c) continue;
+					updatePackets.ResetBitPos();
+					writeBenchWorm(updatePackets, w[i]);
+				}
+				unreliable[c].Clear();
+				unreliable[c].writeByte(S2C_UPDATEWORMS);
+				unreliable[c].writeByte(worms - 1);
+				unreliable[c].Append(&updatePackets);
+				checkDirect += unreliable[c].GetLength();
+			}
+	}
+	const TimeDiff directTime = GetTime() - start;
+	size_t pooled = 0;
+	{
+		Mutex::ScopedLock lock(bufferPool().mutex);
+		allocated = bufferPool().allocated - allocated;
+		pooled = bufferPool().buffers.size();
+	}
+
+	const double perFrame = 1000.0 / frames; // in us, from the ms of all frames
+	notes << "CBytestream: " << clients << " clients x " << worms << " worms, " << frames << " frames:" << endl;
+	notes << "  std::string per packet: " << stringTime.milliseconds() * perFrame << " us per frame" << endl;
+	notes << "  bytestream per packet + Append: " << tempTime.milliseconds() * perFrame << " us per frame" << endl;
+	notes << "  writing directly: " << directTime.milliseconds() * perFrame << " us per frame" << endl;
+	notes << "  " << allocated << " bytestream buffers not from the pool, " << pooled << " pooled" << endl;
+	if(checkTemp != checkString || checkDirect != checkString)
+		errors << "CBytestream::Benchmark: the packets differ in size" << endl;
+}
+
+
 void CBytestream::Clear() {
-	Data = "";
+	Data.clear(); // keeps the buffer
 	pos = 0;
 	bitPos = 0;
 }
@@ -246,7 +444,16 @@ void CBytestream::Clear() {
 ///////////////////
 // Append another bytestream onto this one
 void CBytestream::Append(CBytestream *bs) {
-	Data += bs->Data;
+	writeRaw(bs->Data.data(), bs->Data.size());
+}
+
+void CBytestream::Append(CBytestream&& bs) {
+	// we can just take its buffer
+	if(Data.empty() && bs.Data.capacity() >= Data.capacity())
+		Data.swap(bs.Data);
+	else
+		writeRaw(bs.Data.data(), bs.Data.size());
+	bs.Clear();
 }
 
 
@@ -266,15 +473,6 @@ void CBytestream::Dump() {
 // Writes
 
 
-///////////////////
-// Writes a single byte
-bool CBytestream::writeByte(uchar byte)
-{
-	Data += byte;
-	return true;
-}
-
-
 ///////////////////
 // Writes a boolean value to the stream
 bool CBytestream::writeBool(bool value)
@@ -346,8 +544,10 @@ bool CBytestream::writeFloat(float value)
 
 
 bool CBytestream::writeString(const std::string& value) {
-	Data += value.c_str(); // convert it to a C-string because we don't want null-bytes in it
-	Data += (char)'\0';
+	// only up to the first null-byte, we don't want them in it
+	const size_t len = strlen(value.c_str());
+	reserveAhead(len + 1);
+	Data.append(value.c_str(), len + 1);
 	
 	return true;
 }
@@ -377,12 +577,28 @@ bool CBytestream::writeBit(bool bit)
 	return true;
 }
 
-bool CBytestream::writeData(const std::string& value)
+bool CBytestream::writeBits(Uint32 value, int bits)
 {
-	Data.append( value );
+	assert(bits >= 0 && bits <= 32);
+	while(bits > 0) {
+		if( bitPos == 0 )
+			writeByte( 0 );
+		const int n = MIN(bits, 8 - (int)bitPos);
+		uchar byte = Data[ Data.size() - 1 ];
+		byte |= (uchar)( ( value & ((1u << n) - 1) ) << bitPos );
+		Data[ Data.size() - 1 ] = byte;
+		value >>= n;
+		bits -= n;
+		bitPos = (bitPos + n) % 8;
+	}
 	return true;
 }
 
+bool CBytestream::writeData(const std::string& value)
+{
+	return writeRaw( value.data(), value.size() );
+}
+
 bool CBytestream::writeVar(const ScriptVar_t& var, const CustomVar* diffToOld) {
 	assert( var.type >= SVT_BOOL && var.type <= SVT_CustomWeakRefToStatic );
 	if(var.isCustomType()) {
@@ -520,10 +736,28 @@ float CBytestream::readFloat()
 
 
 std::string CBytestream::readString() {
-	std::string result = "";
-	uchar b;
-	while((b = readByte()) != 0) result += (char)b;
-	return result;
+	return readStringView().str();
+}
+
+CBytestream::View CBytestream::readStringView() {
+	if(isPosAtEnd()) {
+#ifndef FUZZY_ERROR_TESTING
+		errors <<"reading from stream behind end" << endl;
+#endif
+		return View();
+	}
+	const char* start = Data.data() + pos;
+	const char* end = (const char*)memchr(start, 0, Data.size() - pos);
+	if(!end) {
+		// like readByte(), we complain when we read behind the end
+#ifndef FUZZY_ERROR_TESTING
+		errors <<"reading from stream behind end" << endl;
+#endif
+		pos = Data.size();
+		return View(start, Data.data() + pos - start);
+	}
+	pos = end - Data.data() + 1;
+	return View(start, end - start);
 }
 
 std::string CBytestream::readString(size_t maxlen) {
@@ -579,14 +813,45 @@ bool CBytestream::readBit()
 	return ret;
 }
 
+Uint32 CBytestream::readBits(int bits)
+{
+	assert(bits >= 0 && bits <= 32);
+	Uint32 value = 0;
+	int shift = 0;
+	while(bits > 0) {
+		if( isPosAtEnd() )
+		{
+			errors << "reading from stream behind end" << endl;
+			return value;
+		}
+		const int n = MIN(bits, 8 - (int)bitPos);
+		value |= (Uint32)( ( (uchar)Data[pos] >> bitPos ) & ((1u << n) - 1) ) << shift;
+		shift += n;
+		bits -= n;
+		bitPos += n;
+		if( bitPos >= 8 )
+		{
+			bitPos = 0;
+			pos ++;
+		}
+	}
+	return value;
+}
+
 /////////////////////
 // Get data from the bytestream
 std::string CBytestream::readData( size_t size )
 {
+	return readDataView( size ).str();
+}
+
+CBytestream::View CBytestream::readDataView( size_t size )
+{
+	if( isPosAtEnd() ) return View();
 	size = MIN( size, GetLength() - pos );
 	size_t oldpos = pos;
 	pos += size;
-	return Data.substr( oldpos, size );
+	return View( Data.data() + oldpos, size );
 }
 
 bool CBytestream::readVar(ScriptVar_t& var) {
@@ -662,6 +927,13 @@ std::string CBytestream::peekData(size_t len) const
 	return "";
 }
 
+CBytestream::View CBytestream::peekDataView(size_t len) const 
+{
+	if (GetPos() + len <= GetLength())
+		return View(Data.data() + GetPos(), len);
+	return View();
+}
+
 
 // Skips a string, including the terminating character
 // Returns true if we're at the end of the stream after the skip
@@ -689,7 +961,7 @@ size_t CBytestream::Read(NetworkSocket* sock) {
 	char buf[4096];
 	int res = sock->Read(buf, sizeof(buf));
 	if(res > 0)
-		Data.append(buf, res);
+		writeRaw(buf, res);
 
 #ifdef DEBUG
 	// DEBUG: randomly drop packets to test network stability
@@ -524,7 +524,7 @@ bool CChannel2::Process(CBytestream *bs)
 		if( addPacket && SequenceDiff( seqList[f], LastReliableIn ) > 0 ) // Do not add packets from the past
 		{	// Packet not in buffer yet - add it
 			CBytestream bs1;
-			bs1.writeData( bs->readData(seqSizeList[f]) );
+			bs1.writeData( bs->readDataView(seqSizeList[f]) );
 			ReliableIn.push_back( std::make_pair( bs1, seqList[f] ) );
 		}
 		else	// Packet is in buffer already
@@ -894,6 +894,145 @@ void TestCChannelRobustness()
 	}
 }
 
+///////////////////
+// Throughput and latency test over a lossy link
+
+// Reads everything sent to sock, drops or delays it, and sends what is due back from sock
+static void lossyLinkForward(NetworkSocket* sock, std::multimap< int, CBytestream >& buf, int testtime,
+							 int packetLoss, int lagMin, int lagMax, int reorder)
+{
+	while( true )
+	{
+		CBytestream b;
+		if( b.Read(sock) == 0 )
+			break;
+		if( GetRandomInt(99) < packetLoss )
+			continue;
+		int lag = lagMin + GetRandomInt(lagMax - lagMin);
+		if( GetRandomInt(99) < reorder )
+			lag += lagMax;
+		buf.insert( std::make_pair( ((testtime + lag) / 10) * 10, b ) );
+	}
+
+	while( !buf.empty() && buf.begin()->first <= testtime )
+	{
+		buf.begin()->second.Send(sock);
+		buf.erase(buf.begin());
+	}
+}
+
+static void lossyLinkTimeoutTest(const std::string& name, CChannel3& c, int testtime) {}
+static void lossyLinkTimeoutTest(const std::string& name, CChannel4& c, int testtime);
+
+static std::string lossyLinkChannelInfo(const CChannel3& c) { return ""; }
+static std::string lossyLinkChannelInfo(const CChannel4& c)
+{
+	return ", retransmissions " + itoa(c.getRetransmissions()) + ", timeouts " + itoa(c.getTimeouts()) +
+		", window " + ftoa(c.getCongestionWindow()) + ", RTO " + ftoa(c.getRetransmitTimeout());
+}
+
+// c1 sends as much reliable data as it takes (like the file transfer), c2 only acknowledges
+template< typename Channel >
+static void lossyLinkTest(const std::string& name, int packetLoss, int lagMin, int lagMax, int reorder)
+{
+	const int testTime = 60000; // ms
+	const int messageSize = 200;
+	const int bigMessageSize = 3000; // Every 20th message, so we also test the fragmentation
+
+	Channel c1, c2;
+	SmartPointer<NetworkSocket> s1 = new NetworkSocket(); s1->OpenUnreliable(0);
+	SmartPointer<NetworkSocket> s2 = new NetworkSocket(); s2->OpenUnreliable(0);
+	SmartPointer<NetworkSocket> s1lag = new NetworkSocket(); s1lag->OpenUnreliable(0);
+	SmartPointer<NetworkSocket> s2lag = new NetworkSocket(); s2lag->OpenUnreliable(0);
+	c1.Create( s1lag->localAddress(), s1 );
+	c2.Create( s2lag->localAddress(), s2 );
+	s1lag->setRemoteAddress( s2->localAddress() );
+	s2lag->setRemoteAddress( s1->localAddress() );
+
+	std::multimap< int, CBytestream > s1buf, s2buf;
+	int sent = 0, received = 0, orderErrors = 0;
+	size_t receivedBytes = 0;
+	double latencySum = 0;
+	int latencyMax = 0;
+
+	for( int testtime = 0; testtime < testTime; testtime += 10 )
+	{
+		tLX->currentTime = AbsTime(testtime);
+
+		for( int f = 0; f < 16 && !c1.getBufferFull() && c1.Messages.size() < 16; f++, sent++ )
+		{
+			CBytestream b;
+			b.writeInt(sent, 4);
+			b.writeInt(testtime, 4);
+			const int size = (sent % 20 == 19) ? bigMessageSize : messageSize;
+			for( int i = 8; i < size; i++ )
+				b.writeByte(i);
+			c1.AddReliablePacketToSend(b);
+		}
+
+		CBytestream unreliable1, unreliable2;
+		c1.Transmit( &unreliable1 );
+		c2.Transmit( &unreliable2 );
+
+		lossyLinkForward( s1lag.get(), s1buf, testtime, packetLoss, lagMin, lagMax, reorder );
+		lossyLinkForward( s2lag.get(), s2buf, testtime, packetLoss, lagMin, lagMax, reorder );
+
+		while( true )
+		{
+			CBytestream b;
+			if( b.Read(s2.get()) == 0 )
+				break;
+			while( c2.Process( &b ) )
+			{
+				while( b.GetRestLen() >= 8 )
+				{
+					const int idx = b.readInt(4);
+					const int time = b.readInt(4);
+					if( idx != received )
+						orderErrors++;
+					received = idx + 1;
+					const int size = (idx % 20 == 19) ? bigMessageSize : messageSize;
+					receivedBytes += size;
+					latencySum += testtime - time;
+					latencyMax = MAX( latencyMax, testtime - time );
+					b.Skip( size - 8 );
+				}
+				b.Clear();
+			}
+		}
+
+		while( true )
+		{
+			CBytestream b;
+			if( b.Read(s1.get()) == 0 )
+				break;
+			while( c1.Process( &b ) )
+				b.Clear();
+		}
+	}
+
+	notes << name << ": " << (receivedBytes / (testTime / 1000)) << " bytes/sec, " << received << " of " << sent << " messages, "
+		<< "latency avg " << (received > 0 ? (int)(latencySum / received) : 0) << " ms, max " << latencyMax << " ms, "
+		<< orderErrors << " order errors, ping " << c1.getPing() << lossyLinkChannelInfo(c1) << endl;
+
+	lossyLinkTimeoutTest( name, c1, testTime );
+}
+
+void TestCChannelLossyLink(int packetLoss, int lagMin, int lagMax, int reorder)
+{
+	packetLoss = CLAMP(packetLoss, 0, 100);
+	lagMin = MAX(lagMin, 0);
+	lagMax = MAX(lagMax, lagMin);
+	reorder = CLAMP(reorder, 0, 100);
+	notes << "Testing CChannel over a link with " << packetLoss << "% loss, " << lagMin << "-" << lagMax << " ms lag, "
+		<< reorder << "% reordered" << endl;
+
+	const AbsTime oldTime = tLX->currentTime;
+	lossyLinkTest<CChannel3>( "CChannel3", packetLoss, lagMin, lagMax, reorder );
+	lossyLinkTest<CChannel4>( "CChannel4", packetLoss, lagMin, lagMax, reorder );
+	tLX->currentTime = oldTime;
+}
+
 /*
 The format for packet is the same as with CChannel2, but with CRC16 added at the beginning,
 and with indicator that packet is split into several smaller packets.
@@ -982,7 +1121,7 @@ bool CChannel3::Process(CBytestream *bs)
 	// CRC16 check
 	
 	unsigned crc = bs->readInt(2);
-	if( crc != crc16( bs->peekData( bs->GetRestLen() ).c_str(), bs->GetRestLen() ) )
+	if( crc != crc16( bs->peekDataView( bs->GetRestLen() ).ptr, bs->GetRestLen() ) )
 	{
 		iPacketsDropped++;	// Update statistics
 		return GetPacketFromBuffer(bs);	// Packet from the past or from too distant future - ignore it.
@@ -1061,7 +1200,7 @@ bool CChannel3::Process(CBytestream *bs)
 		if( addPacket && SequenceDiff( seqList[f], LastReliableIn ) > 0 ) // Do not add packets from the past
 		{	// Packet not in buffer yet - add it
 			CBytestream bs1;
-			bs1.writeData( bs->readData( seqSizeList[f] & ~ SEQUENCE_HIGHEST_BIT ) );
+			bs1.writeData( bs->readDataView( seqSizeList[f] & ~ SEQUENCE_HIGHEST_BIT ) );
 			ReliableIn.push_back( Packet_t( bs1, seqList[f], (seqSizeList[f] & SEQUENCE_HIGHEST_BIT) != 0 ) );
 		}
 		else	// Packet is in buffer already
@@ -1134,11 +1273,11 @@ void CChannel3::Transmit(CBytestream *unreliableData)
 			// Fragment the packet
 			Messages.front().ResetPosToBegin();
 			CBytestream bs;
-			bs.writeData( Messages.front().readData( MAX_FRAGMENTED_PACKET_SIZE ) );
+			bs.writeData( Messages.front().readDataView( MAX_FRAGMENTED_PACKET_SIZE ) );
 			ReliableOut.push_back( Packet_t( bs, LastAddedToOut, true ) );
 			bs.Clear();
-			bs.writeData( Messages.front().readData() );
-			Messages.front() = bs;
+			bs.writeData( Messages.front().readDataView() );
+			Messages.front() = std::move(bs);
 		}
 		else
 		{
@@ -1268,6 +1407,528 @@ void CChannel3::AddReliablePacketToSend(CBytestream& bs) // The same as in CChan
 }
 
 
+///////////////////
+// Sliding window CChannel with selective acknowledges.
+
+/*
+The net packet format is:
+	CRC16 - 2 bytes, of everything after it
+	Last Acknowledged Packet Index - 2 bytes, all packets up to this one are received
+	SACK Length - 1 byte, 0 to CHANNEL4_MAX_SACK_BYTES
+	SACK bitmap - SACK Length bytes, bit N (lowest bit of the first byte is bit 0) set means
+		that packet Last Acknowledged Packet Index + 2 + N is received
+	Packet Count - 1 byte
+	Packet Index 1 - 2 bytes
+	Packet Size 1 - 2 bytes, highest bit = 1 if more fragments of the same message follow
+	...
+	Packet Index N - 2 bytes
+	Packet Size N - 2 bytes
+	Packets data
+	Non-reliable packet data
+
+Like with CChannel3, the first four bytes can't be 0xFF because the
+acknowledged index is lower than 0x7FFF.
+
+The sender may have up to CHANNEL4_MAX_WINDOW packets after the last acknowledged
+one in the net. How many of them it really sends is limited by the congestion
+window, which grows with each acknowledged packet (quickly until the first loss,
+then by one packet per round trip) and is reduced to CHANNEL4_WINDOW_DECREASE
+(0.7) of it on a loss.
+
+A packet is lost if a packet sent after it got acknowledged, and it
+is older than the round trip time plus some reordering margin. If nothing
+is acknowledged for RetransmitTimeout (estimated from the round trip time as
+in TCP), all packets in flight are lost and the window drops to CHANNEL4_MIN_WINDOW.
+TCP starts again at one packet here; we keep the 3 packets in flight which CChannel3
+always has, as the game traffic would stall otherwise, and most losses in games are
+not from congestion anyway.
+Only packets which were sent once are used for the round trip time.
+*/
+
+enum {
+	CHANNEL4_MAX_WINDOW = 128,		// Max packets after the last acknowledged one, limited by the SACK bitmap
+	CHANNEL4_MAX_SACK_BYTES = CHANNEL4_MAX_WINDOW / 8,
+	CHANNEL4_FRAGMENT_SIZE = MAX_PACKET_SIZE - 40,	// Leaves space for the header with one packet
+	CHANNEL4_MAX_PACKETS_PER_TRANSMIT = 16,
+};
+
+static const float CHANNEL4_INITIAL_WINDOW = 4.0f;
+// We don't go below the 3 packets in flight of CChannel3. Most losses in games are
+// not from congestion, so we also reduce the window less than TCP does.
+static const float CHANNEL4_MIN_WINDOW = 3.0f;
+static const float CHANNEL4_WINDOW_DECREASE = 0.7f;
+static const float CHANNEL4_INITIAL_RTO = 1.0f;
+static const float CHANNEL4_MIN_RTO = 0.1f;
+static const float CHANNEL4_MAX_RTO = 4.0f;
+
+// The link goes down: nothing is acknowledged anymore until the retransmit timeout
+static void lossyLinkTimeoutTest(const std::string& name, CChannel4& c, int testtime)
+{
+	CBytestream b;
+	b.writeInt(0, 4);
+	c.AddReliablePacketToSend(b);
+
+	const size_t timeouts = c.getTimeouts();
+	const int endTime = testtime + (int)(CHANNEL4_MAX_RTO * 1000.0f) + 100;
+	for( ; testtime < endTime && c.getTimeouts() == timeouts; testtime += 10 )
+	{
+		tLX->currentTime = AbsTime(testtime);
+		CBytestream unreliable;
+		c.Transmit( &unreliable );
+	}
+
+	if( c.getTimeouts() == timeouts )
+		errors << name << ": no timeout without acknowledges" << endl;
+	else if( c.getCongestionWindow() != CHANNEL4_MIN_WINDOW )
+		errors << name << ": window " << c.getCongestionWindow() << " after a timeout, expected " << CHANNEL4_MIN_WINDOW << endl;
+	else
+		notes << name << ": window " << c.getCongestionWindow() << " after a timeout - good" << endl;
+}
+
+void CChannel4::Clear()
+{
+	CChannel::Clear();
+	Messages.clear();
+	OutMessages.clear();
+	ReliableOut.clear();
+	ReliableIn.clear();
+	ReliableInReady.clear();
+	LastReliableOut = 0;
+	LastAddedToOut = 0;
+	LastSentOut = 0;
+	LastReliableIn = 0;
+	AckNeeded = false;
+
+	SmoothedRTT = 0;
+	RTTVariance = 0;
+	RetransmitTimeout = CHANNEL4_INITIAL_RTO;
+	NewestAckedSent = AbsTime();
+	LastAckTime = AbsTime();
+
+	CongestionWindow = CHANNEL4_INITIAL_WINDOW;
+	SlowStartThreshold = CHANNEL4_MAX_WINDOW / 2;
+	RecoverySequence = -1;
+
+	KeepAlivePacketTimeout = KEEP_ALIVE_PACKET_TIMEOUT;
+
+	iRetransmissions = 0;
+	iTimeouts = 0;
+}
+
+void CChannel4::Create(const NetworkAddr& _adr, const SmartPointer<NetworkSocket>& _sock)
+{
+	Clear();
+	CChannel::Create( _adr, _sock );
+}
+
+// Full if the not yet sent data is enough for the congestion window
+bool CChannel4::getBufferFull()
+{
+	if( ReliableOut.size() >= CHANNEL4_MAX_WINDOW )
+		return true;
+	size_t queued = 0;
+	for( std::list<CBytestream>::const_iterator it = Messages.begin(); it != Messages.end(); it++ )
+		queued += it->GetLength();
+	for( size_t i = ReliableOut.size(); i > 0 && ReliableOut[i - 1].transmissions == 0; i-- )
+		queued += ReliableOut[i - 1].size;
+	return queued >= (size_t)CongestionWindow * CHANNEL4_FRAGMENT_SIZE;
+}
+
+void CChannel4::AddReliablePacketToSend(CBytestream& bs)
+{
+	if(bs.GetLength() == 0)
+		return;
+
+	Messages.push_back(bs);
+}
+
+void CChannel4::AddReliablePacketToSend(CBytestream&& bs)
+{
+	if(bs.GetLength() == 0)
+		return;
+
+	Messages.push_back(std::move(bs));
+}
+
+// Give the queued messages their packet indexes. Small messages are joined,
+// big ones are split into fragments which point into the message.
+void CChannel4::FillWindow()
+{
+	while( (int)ReliableOut.size() < CHANNEL4_MAX_WINDOW && !Messages.empty() )
+	{
+		OutMessages.push_back( std::move(Messages.front()) );
+		Messages.pop_front();
+		CBytestream& msg = OutMessages.back();
+		while( !Messages.empty() && msg.GetLength() + Messages.front().GetLength() <= CHANNEL4_FRAGMENT_SIZE )
+		{
+			msg.Append( & Messages.front() );
+			Messages.pop_front();
+		}
+
+		for( size_t offset = 0; offset < msg.GetLength(); )
+		{
+			LastAddedToOut ++;
+			if( LastAddedToOut >= SEQUENCE_WRAPAROUND )
+				LastAddedToOut = 0;
+
+			OutPacket p;
+			p.seq = LastAddedToOut;
+			p.msg = --OutMessages.end();
+			p.offset = offset;
+			p.size = MIN( (size_t)CHANNEL4_FRAGMENT_SIZE, msg.GetLength() - offset );
+			offset += p.size;
+			p.fragmented = offset < msg.GetLength();
+			p.sacked = false;
+			p.lost = false;
+			p.transmissions = 0;
+			ReliableOut.push_back(p);
+		}
+	}
+}
+
+void CChannel4::UpdateRTT(float sample)
+{
+	if( SmoothedRTT <= 0 )
+	{
+		SmoothedRTT = sample;
+		RTTVariance = sample / 2;
+	}
+	else
+	{
+		RTTVariance = 0.75f * RTTVariance + 0.25f * fabs( SmoothedRTT - sample );
+		SmoothedRTT = 0.875f * SmoothedRTT + 0.125f * sample;
+	}
+	RetransmitTimeout = CLAMP( SmoothedRTT + 4 * RTTVariance, CHANNEL4_MIN_RTO, CHANNEL4_MAX_RTO );
+	iPing = (int)( SmoothedRTT * 1000.0f );
+}
+
+void CChannel4::DetectLostPackets()
+{
+	bool lossDetected = false;
+
+	// Nothing acknowledged for too long - consider everything in flight lost.
+	// Like in TCP, the timer starts again with each acknowledge.
+	for( size_t i = 0; i < ReliableOut.size() && ReliableOut[i].transmissions > 0; i++ )
+	{
+		const OutPacket& p = ReliableOut[i];
+		if( p.sacked || p.lost )
+			continue;
+		if( tLX->currentTime - MAX( p.lastSent, LastAckTime ) >= RetransmitTimeout )
+		{
+			for( size_t f = 0; f < ReliableOut.size() && ReliableOut[f].transmissions > 0; f++ )
+				if( !ReliableOut[f].sacked )
+					ReliableOut[f].lost = true;
+			iTimeouts++;
+			SlowStartThreshold = MAX( CongestionWindow * CHANNEL4_WINDOW_DECREASE, CHANNEL4_MIN_WINDOW );
+			CongestionWindow = CHANNEL4_MIN_WINDOW;
+			RetransmitTimeout = MIN( RetransmitTimeout * 2, CHANNEL4_MAX_RTO );
+			RecoverySequence = LastSentOut;
+			return;
+		}
+	}
+
+	// Packets sent before an acknowledged one which don't come
+	if( NewestAckedSent == AbsTime() )
+		return;
+	const float reorderTime = SmoothedRTT * 1.25f;
+	for( size_t i = 0; i < ReliableOut.size() && ReliableOut[i].transmissions > 0; i++ )
+	{
+		OutPacket& p = ReliableOut[i];
+		if( p.sacked || p.lost )
+			continue;
+		if( p.lastSent < NewestAckedSent && tLX->currentTime - p.lastSent >= reorderTime )
+		{
+			p.lost = true;
+			lossDetected = true;
+		}
+	}
+
+	if( lossDetected && RecoverySequence == -1 )
+	{
+		SlowStartThreshold = MAX( CongestionWindow * CHANNEL4_WINDOW_DECREASE, CHANNEL4_MIN_WINDOW );
+		CongestionWindow = SlowStartThreshold;
+		RecoverySequence = LastSentOut;
+	}
+}
+
+void CChannel4::WriteAcks(CBytestream *bs)
+{
+	bs->writeInt( LastReliableIn, 2 );
+
+	// ReliableIn[0] is always missing
+	int sackBits = MIN( (int)ReliableIn.size() - 1, CHANNEL4_MAX_SACK_BYTES * 8 );
+	while( sackBits > 0 && !ReliableIn[sackBits].received )
+		sackBits--;
+	const int sackBytes = (sackBits + 7) / 8;
+	bs->writeByte( sackBytes );
+	for( int b = 0; b < sackBytes; b++ )
+	{
+		uchar byte = 0;
+		for( int f = 0; f < 8; f++ )
+		{
+			const size_t idx = 1 + b * 8 + f;
+			if( idx < ReliableIn.size() && ReliableIn[idx].received )
+				byte |= (uchar)(1 << f);
+		}
+		bs->writeByte( byte );
+	}
+}
+
+// Get reliable packet from local buffer (merge fragmented packet)
+bool CChannel4::GetPacketFromBuffer(CBytestream *bs)
+{
+	std::list<InPacket>::iterator last = ReliableInReady.begin();
+	while( last != ReliableInReady.end() && last->fragmented )
+		last++;
+	if( last == ReliableInReady.end() )
+		return false;
+	last++;
+
+	if( !ReliableInReady.front().fragmented )
+		*bs = std::move( ReliableInReady.front().data );
+	else
+	{
+		bs->Clear();
+		for( std::list<InPacket>::iterator it = ReliableInReady.begin(); it != last; it++ )
+			bs->Append( & it->data );
+	}
+	bs->ResetPosToBegin();
+	ReliableInReady.erase( ReliableInReady.begin(), last );
+	return true;
+}
+
+bool CChannel4::Process(CBytestream *bs)
+{
+	bs->ResetPosToBegin();
+	if( bs->GetLength() == 0 )
+		return GetPacketFromBuffer(bs);
+
+	UpdateReceiveStatistics( bs->GetLength() );
+
+	// CRC16 check
+	unsigned crc = bs->readInt(2);
+	if( crc != crc16( bs->peekDataView( bs->GetRestLen() ).ptr, bs->GetRestLen() ) )
+	{
+		iPacketsDropped++;
+		return GetPacketFromBuffer(bs);
+	}
+
+	// Acknowledges
+	const int ack = bs->readInt(2);
+	const int ackDiff = SequenceDiff( ack, LastReliableOut );
+	const int sackBytes = bs->readByte();
+	const CBytestream::View sack = bs->readDataView( sackBytes );
+	if( ackDiff > SequenceDiff( LastSentOut, LastReliableOut ) || sackBytes > CHANNEL4_MAX_SACK_BYTES || (int)sack.size != sackBytes )
+	{
+		iPacketsDropped++;	// Acknowledges packets we didn't send
+		return GetPacketFromBuffer(bs);
+	}
+
+	// Read packets info
+	const int count = bs->readByte();
+	std::vector< std::pair<int, int> > seqList;
+	size_t dataSize = 0;
+	for( int f = 0; f < count; f++ )
+	{
+		const int seq = bs->readInt(2);
+		const int size = bs->readInt(2);
+		seqList.push_back( std::make_pair( seq, size ) );
+		dataSize += size & ~ SEQUENCE_HIGHEST_BIT;
+	}
+	if( dataSize > bs->GetRestLen() )
+	{
+		iPacketsDropped++;
+		return GetPacketFromBuffer(bs);
+	}
+
+	iPacketsGood++;
+
+	if( ackDiff >= 0 ) // Otherwise it is an old reordered packet, newer acknowledges are already processed
+	{
+		int acked = 0;
+		float rttSample = -1;
+		for( int f = 0; f < ackDiff; f++ )
+		{
+			const OutPacket& p = ReliableOut.front();
+			if( !p.sacked )
+			{
+				acked++;
+				if( p.transmissions == 1 )
+					rttSample = (float)( tLX->currentTime - p.lastSent ).seconds();
+				if( NewestAckedSent < p.lastSent )
+					NewestAckedSent = p.lastSent;
+			}
+			if( !p.fragmented )
+				OutMessages.erase( p.msg );	// Last packet of the message
+			ReliableOut.pop_front();
+		}
+		LastReliableOut = ack;
+
+		for( int f = 0; f < sackBytes * 8; f++ )
+		{
+			const size_t idx = 1 + f;
+			if( idx >= ReliableOut.size() || ReliableOut[idx].transmissions == 0 )
+				break;
+			if( !( ((uchar)sack.ptr[f / 8] >> (f % 8)) & 1 ) )
+				continue;
+			OutPacket& p = ReliableOut[idx];
+			if( p.sacked )
+				continue;
+			p.sacked = true;
+			p.lost = false;
+			acked++;
+			if( p.transmissions == 1 )
+				rttSample = (float)( tLX->currentTime - p.lastSent ).seconds();
+			if( NewestAckedSent < p.lastSent )
+				NewestAckedSent = p.lastSent;
+		}
+
+		if( acked > 0 )
+			LastAckTime = tLX->currentTime;
+		if( rttSample >= 0 )
+			UpdateRTT( rttSample );
+
+		if( RecoverySequence != -1 && SequenceDiff( LastReliableOut, RecoverySequence ) >= 0 )
+			RecoverySequence = -1;
+
+		if( acked > 0 && RecoverySequence == -1 )
+		{
+			if( CongestionWindow < SlowStartThreshold )
+				CongestionWindow += acked;
+			else
+				CongestionWindow += acked / CongestionWindow;
+			CongestionWindow = MIN( CongestionWindow, (float)CHANNEL4_MAX_WINDOW );
+		}
+	}
+
+	// Put packets in buffer
+	for( size_t f = 0; f < seqList.size(); f++ )
+	{
+		const size_t size = seqList[f].second & ~ SEQUENCE_HIGHEST_BIT;
+		const int diff = SequenceDiff( seqList[f].first, LastReliableIn );
+		if( diff <= 0 || diff > CHANNEL4_MAX_WINDOW )
+		{
+			// Already have it - our acknowledge got lost, or it is sent again before it arrived
+			bs->Skip( size );
+			AckNeeded = true;
+			continue;
+		}
+		if( (int)ReliableIn.size() < diff )
+			ReliableIn.resize( diff );
+		InPacket& p = ReliableIn[ diff - 1 ];
+		if( p.received )
+		{
+			bs->Skip( size );
+			continue;
+		}
+		p.received = true;
+		p.fragmented = (seqList[f].second & SEQUENCE_HIGHEST_BIT) != 0;
+		p.data.Clear();
+		p.data.writeData( bs->readDataView( size ) );
+		AckNeeded = true;
+	}
+
+	// Move the packets in sequence to ReliableInReady
+	while( !ReliableIn.empty() && ReliableIn.front().received )
+	{
+		ReliableInReady.push_back( std::move( ReliableIn.front() ) );
+		ReliableIn.pop_front();
+		LastReliableIn ++;
+		if( LastReliableIn >= SEQUENCE_WRAPAROUND )
+			LastReliableIn = 0;
+	}
+
+	if( bs->GetRestLen() > 0 )	// Non-reliable data left in this packet
+		return true;	// Do not modify bs, allow user to read non-reliable data at the end of bs
+
+	if( GetPacketFromBuffer(bs) )	// We can return some reliable packet
+		return true;
+
+	// Valid empty packet, it is required to update server statistics, so clients that don't send packets won't timeout.
+	return true;
+}
+
+void CChannel4::Transmit(CBytestream *unreliableData)
+{
+	FillWindow();
+	DetectLostPackets();
+
+	int inFlight = 0;
+	for( size_t i = 0; i < ReliableOut.size() && ReliableOut[i].transmissions > 0; i++ )
+		if( !ReliableOut[i].sacked && !ReliableOut[i].lost )
+			inFlight++;
+
+	std::vector<size_t> packets;
+	for( int n = 0; n < CHANNEL4_MAX_PACKETS_PER_TRANSMIT; n++ )
+	{
+		CBytestream bs;
+		WriteAcks( &bs );
+
+		// The unreliable data goes into the first packet, if it fits with some reliable data
+		const size_t reserved = (n == 0) ? unreliableData->GetLength() : 0;
+		const size_t headerSize = 2 + bs.GetLength() + 1;	// + CRC16 and the packet count
+		size_t size = headerSize + reserved;
+		packets.clear();
+		for( size_t i = 0; i < ReliableOut.size() && i < (size_t)CHANNEL4_MAX_WINDOW; i++ )
+		{
+			const OutPacket& p = ReliableOut[i];
+			if( p.transmissions > 0 && !p.lost )
+				continue;
+			if( inFlight >= (int)CongestionWindow )
+				break;
+			if( size + 4 + p.size > MAX_PACKET_SIZE )
+				break;
+			size += 4 + p.size;
+			packets.push_back(i);
+			inFlight++;
+		}
+
+		if( n > 0 && packets.empty() )
+			break;
+		if( packets.empty() && unreliableData->GetLength() == 0 && !AckNeeded &&
+			tLX->currentTime - fLastSent < KeepAlivePacketTimeout )
+		{
+			// Nothing to send really, send one empty packet per second so we won't timeout
+			cOutgoingRate.addData( 0 );
+			return;
+		}
+
+		bs.writeByte( packets.size() );
+		for( size_t f = 0; f < packets.size(); f++ )
+		{
+			const OutPacket& p = ReliableOut[ packets[f] ];
+			bs.writeInt( p.seq, 2 );
+			bs.writeInt( p.size | ( p.fragmented ? SEQUENCE_HIGHEST_BIT : 0 ), 2 );
+		}
+		for( size_t f = 0; f < packets.size(); f++ )
+		{
+			OutPacket& p = ReliableOut[ packets[f] ];
+			bs.writeData( CBytestream::View( p.msg->data().data() + p.offset, p.size ) );
+			if( p.transmissions > 0 )
+				iRetransmissions++;
+			p.transmissions++;
+			p.lost = false;
+			p.lastSent = tLX->currentTime;
+			if( SequenceDiff( p.seq, LastSentOut ) > 0 )
+				LastSentOut = p.seq;
+		}
+
+		if( n == 0 )
+			bs.Append( unreliableData );
+
+		CBytestream bs1;
+		bs1.writeInt( crc16( bs.data().c_str(), bs.GetLength() ), 2 );
+		bs1.Append( &bs );
+
+		Socket->setRemoteAddress(RemoteAddr);
+		bs1.Send(Socket.get());
+		AckNeeded = false;
+
+		UpdateTransmitStatistics( bs1.GetLength() );
+	}
+}
+
+
 
 
 // CRC16 stolen from Linux kernel sources
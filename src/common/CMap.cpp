@@ -110,6 +110,7 @@ bool CMap::NewFrom(CMap* map)
 	bmpDebugImage = map->bmpDebugImage.get() ? GetCopiedImage(map->bmpDebugImage) : NULL;
 #endif
 	
+	map->flushDirtyRects();
 	CopySurface(bmpMiniMap.get(), map->bmpMiniMap, 0, 0, 0, 0, bmpMiniMap->w, bmpMiniMap->h);
 
 	if(Objects && map->Objects)
@@ -117,12 +118,8 @@ bool CMap::NewFrom(CMap* map)
 	
 	AdditionalData = map->AdditionalData;
 	
-	bMapSavingToMemory = false;
-	bmpSavedImage = NULL;
-	if( savedPixelFlags )
-		delete[] savedPixelFlags;
-	savedPixelFlags = NULL;
-	savedMapCoords.clear();
+	m_terrainHistory.clear();
+	m_navGraph = NULL;
 	
 	Created = true;
 
@@ -163,8 +160,12 @@ size_t CMap::GetMemorySize()
 #ifdef _AI_DEBUG
 	res += GetSurfaceMemorySize(bmpDebugImage.get());
 #endif
-	if( bmpSavedImage.get() != NULL )
-		res += GetSurfaceMemorySize(bmpSavedImage.get()) + Width * Height; // Saved pixel flags
+	res += m_terrainHistory.memorySize();
+	res += m_renderCache.memorySize();
+	res += m_miniMapPyramid.memorySize();
+	if( m_navGraph.get() )
+		res += m_navGraph->memorySize();
+	res += m_navUpdateSearch.memorySize();
 	if( bmpBackImageHiRes.get() )
 		res += GetSurfaceMemorySize(bmpBackImageHiRes.get());
 	return res;
@@ -221,6 +222,7 @@ bool CMap::Create(uint _width, uint _height, const std::string& _theme, uint _mi
 	m_config = LevelConfig();
 	NumObjects = 0;
 	nTotalDirtCount = 0;
+	m_navGraph = NULL;
 	Created = true;
 	return true;
 }
@@ -619,6 +621,8 @@ void CMap::UpdateArea(int x, int y, int w, int h, bool update_image)
 	if (!ClipRefRectWith(x, y, w, h, (SDLRect&)material->surf->clip_rect))
 		return;
 
+	m_renderCache.invalidate(x, y, w, h);
+
 	// Grid
 	lockFlags();
 
@@ -797,6 +801,7 @@ void CMap::TileMap()
     nTotalDirtCount = Width * Height;
 
 	bMiniMapDirty = true;
+	m_renderCache.invalidateAll();
 }
 
 
@@ -1039,6 +1044,8 @@ int CMap::CarveHole(int size, CVec pos, bool wrapAround)
 		return 0;
 			
 	SaveToMemoryInternal( map_x, map_y, w, h );
+	if( m_navGraph.get() )
+		m_navGraph->markDirty( map_x, map_y, w, h );
 
 	// Variables
 	byte bpp = hole.get()->format->BytesPerPixel;
@@ -1157,6 +1164,8 @@ int CMap::PlaceDirt(int size, CVec pos)
 	int hole_clip_x = -MIN(sx,(int)0);
 	
 	SaveToMemoryInternal( clip_x, clip_y, clip_w, clip_h );
+	if( m_navGraph.get() )
+		m_navGraph->markDirty( clip_x, clip_y, clip_w, clip_h );
 
 	lockFlags();
 
@@ -1269,6 +1278,8 @@ int CMap::PlaceGreenDirt(CVec pos)
 	int green_clip_x = -MIN(sx,(int)0);
 	
 	SaveToMemoryInternal( clip_x, clip_y, clip_w, clip_h );
+	if( m_navGraph.get() )
+		m_navGraph->markDirty( clip_x, clip_y, clip_w, clip_h );
 
 	short screenbpp = getMainPixelFormat()->BytesPerPixel;
 
@@ -1563,6 +1574,8 @@ void CMap::PlaceStone(int size, CVec pos)
 
 	UnlockSurface(stone);
 
+	if( m_navGraph.get() )
+		m_navGraph->markDirty( sx, sy, w, h );
 	UpdateArea(sx, sy, w, h);
 
     // Calculate the total dirt count
@@ -1655,7 +1668,10 @@ void CMap::PlaceMisc(int id, CVec pos)
 	UnlockSurface(bmpDrawImage);
 	UnlockSurface(misc);
 
-	bMiniMapDirty = true;
+	if( m_navGraph.get() )
+		m_navGraph->markDirty( sx, sy, w, h );
+	UpdateMiniMapRect(sx, sy, w, h);
+	m_renderCache.invalidate(sx, sy, w, h);
 }
 
 
@@ -1668,6 +1684,8 @@ void CMap::PutImagePixel(uint x, uint y, Color colour)
 	if(x >= Width || y >= Height)
 		return;
 
+	m_renderCache.invalidate(x, y, 1, 1);
+
 	x *= 2;
 	y *= 2;
 	DrawRectFill2x2_NoClip(bmpDrawImage.get(), x, y, colour);
@@ -1686,10 +1704,13 @@ void CMap::UpdateMiniMap(bool force)
 		return;
 	}
 	
+	// the whole map has changed, so also the pyramid
+	m_miniMapPyramid.clear();
 	gusUpdateMinimap(0, 0, Width, Height);
 
 	// Not dirty anymore
 	bMiniMapDirty = false;
+	m_dirtyRects.clear();
 }
 
 ///////////////////
@@ -1703,7 +1724,77 @@ void CMap::UpdateMiniMapRect(int x, int y, int w, int h)
 	if (bMiniMapDirty)
 		return;
 
-	gusUpdateMinimap(x, y, w, h);
+	addDirtyRect(x, y, w, h);
+}
+
+
+CMap::DirtyRectStats CMap::m_dirtyRectStats;
+
+static INLINE Uint64 rectArea(int w, int h) { return (Uint64)w * (Uint64)h; }
+
+///////////////////
+// Remember an area of the minimap for the next update
+// Overlapping areas are merged if this doesn't increase the updated pixel count.
+void CMap::addDirtyRect(int x, int y, int w, int h)
+{
+	if(w <= 0 || h <= 0) return;
+	m_dirtyRectStats.requests++;
+	m_dirtyRectStats.requestedPixels += rectArea(w, h);
+
+	DirtyRect r = { x, y, w, h };
+	for(size_t i = 0; i < m_dirtyRects.size(); ) {
+		const DirtyRect& o = m_dirtyRects[i];
+		const int x1 = MIN(r.x, o.x), y1 = MIN(r.y, o.y);
+		const int x2 = MAX(r.x + r.w, o.x + o.w), y2 = MAX(r.y + r.h, o.y + o.h);
+		if(rectArea(x2 - x1, y2 - y1) <= rectArea(r.w, r.h) + rectArea(o.w, o.h)) {
+			r.x = x1; r.y = y1; r.w = x2 - x1; r.h = y2 - y1;
+			m_dirtyRects[i] = m_dirtyRects.back();
+			m_dirtyRects.pop_back();
+			i = 0; // the bigger rect may now also cover others
+			continue;
+		}
+		++i;
+	}
+
+	if(m_dirtyRects.size() < MAX_DIRTY_RECTS) {
+		m_dirtyRects.push_back(r);
+		return;
+	}
+
+	// Too many; merge with the one which grows least
+	size_t best = 0;
+	Uint64 bestGrowth = (Uint64)-1;
+	for(size_t i = 0; i < m_dirtyRects.size(); ++i) {
+		const DirtyRect& o = m_dirtyRects[i];
+		const int x1 = MIN(r.x, o.x), y1 = MIN(r.y, o.y);
+		const int x2 = MAX(r.x + r.w, o.x + o.w), y2 = MAX(r.y + r.h, o.y + o.h);
+		const Uint64 growth = rectArea(x2 - x1, y2 - y1) - rectArea(o.w, o.h);
+		if(growth < bestGrowth) { bestGrowth = growth; best = i; }
+	}
+	DirtyRect& o = m_dirtyRects[best];
+	const int x1 = MIN(r.x, o.x), y1 = MIN(r.y, o.y);
+	o.w = MAX(r.x + r.w, o.x + o.w) - x1;
+	o.h = MAX(r.y + r.h, o.y + o.h) - y1;
+	o.x = x1; o.y = y1;
+}
+
+///////////////////
+// Do all collected minimap updates
+void CMap::flushDirtyRects()
+{
+	if(m_dirtyRects.empty()) return;
+	if(bDedicated || !bmpMiniMap.get() || bMiniMapDirty) {
+		m_dirtyRects.clear();
+		return;
+	}
+
+	m_dirtyRectStats.flushes++;
+	for(size_t i = 0; i < m_dirtyRects.size(); ++i) {
+		const DirtyRect& r = m_dirtyRects[i];
+		m_dirtyRectStats.updatedPixels += rectArea(r.w, r.h);
+		gusUpdateMinimap(r.x, r.y, r.w, r.h);
+	}
+	m_dirtyRects.clear();
 }
 
 
@@ -1781,6 +1872,7 @@ void CMap::DrawMiniMap(SDL_Surface * bmpDest, uint x, uint y, TimeDiff dt)
 	// Update the minimap (only if dirty)
 	if(bMiniMapDirty)
 		UpdateMiniMap();
+	flushDirtyRects();
 
 	SetPerSurfaceAlpha(bmpMiniMap.get(), 128);
 	DrawImage(bmpDest, bmpMiniMap, x, y);
@@ -1864,6 +1956,7 @@ Result CMap::Load(const std::string& filename)
 	}
 	
 	bMiniMapDirty = true;
+	m_renderCache.invalidateAll();
 	Created = true;
 	
     // Calculate the total dirt count
@@ -2060,136 +2153,108 @@ void CMap::DEBUG_DrawPixelFlags(int x, int y, int w, int h)
 }
 
 
-void CMap::NewNet_SaveToMemory()
+TerrainSnapshot::Planes CMap::snapshotPlanes()
 {
-	if( bMapSavingToMemory )
+	TerrainSnapshot::Planes p;
+	p.matLines = material->line;
+	// Only the hires image is saved, the lowres one is redrawn by UpdateArea()
+	p.image = bmpBackImageHiRes.get() ? (Uint8*)bmpDrawImage->pixels : NULL;
+	p.imagePitch = bmpBackImageHiRes.get() ? bmpDrawImage->pitch : 0;
+	return p;
+}
+
+SmartPointer<NavGraph> CMap::navGraph()
+{
+	if( !m_navGraph.get() && material )
 	{
-		errors("Error: calling CMap::SaveToMemory() twice\n");
-		return;
+		Uint8 classes[256];
+		for( int i = 0; i < 256; ++i )
+		{
+			const unsigned char flags = m_materialList[i].toLxFlags();
+			classes[i] = (flags & PX_ROCK) ? NavGraph::PIX_ROCK : (flags & PX_DIRT) ? NavGraph::PIX_DIRT : NavGraph::PIX_FREE;
+		}
+		m_navGraph = new NavGraph();
+		lockFlags(false);
+		m_navGraph->build(material->line, Width, Height, classes, m_navUpdateSearch);
+		unlockFlags(false);
 	}
-	bMapSavingToMemory = true;
-	if( bmpSavedImage.get() == NULL )
+	else if( m_navGraph.get() && m_navGraph->isDirty() )
+	{
+		// some searches are still running on the old one
+		if( m_navGraph.getRefCount() > 1 )
+			m_navGraph = new NavGraph( *m_navGraph.get() );
+		lockFlags(false);
+		m_navGraph->update(m_navUpdateSearch);
+		unlockFlags(false);
+	}
+	return m_navGraph;
+}
+
+void CMap::NewNet_SaveToMemory(size_t historyLen)
+{
+	if( !m_terrainHistory.isInitialised() || m_terrainHistory.historyLen() != MAX(historyLen, (size_t)1) )
 	{
 		if( bmpBackImageHiRes.get() )
-			bmpSavedImage = gfxCreateSurface(Width*2, Height*2);
+			m_terrainHistory.init(Width, Height, 2, bmpDrawImage->format->BytesPerPixel, MAX(historyLen, (size_t)1));
 		else
-			bmpSavedImage = gfxCreateSurface(Width, Height);
-			
-		if( bmpSavedImage.get() == NULL )
-		{
-			errors("Error: CMap::SaveToMemory(): cannot allocate GFX surface\n");
-			return;
-		}
-		savedPixelFlags = new uchar[Width * Height];
+			m_terrainHistory.init(Width, Height, 0, 0, MAX(historyLen, (size_t)1));
 	}
 	
-	savedMapCoords.clear();
+	m_terrainHistory.beginTick();
 }
 
-void CMap::NewNet_RestoreFromMemory()
+void CMap::NewNet_RestoreFromMemory(size_t ticks)
 {
-	if( ! bMapSavingToMemory )
-	{
-		errors("Error: calling CMap::RestoreFromMemory() twice\n");
-		return;
-	}
-	if( bmpSavedImage.get() == NULL || savedPixelFlags == NULL )
+	if( m_terrainHistory.count() == 0 )
 	{
-		errors("Error: CMap::RestoreFromMemory(): bmpSavedImage is NULL\n");
+		errors("Error: CMap::RestoreFromMemory(): nothing saved\n");
 		return;
 	}
 	
-	for( std::set< SavedMapCoord_t > :: iterator it = savedMapCoords.begin();
-			it != savedMapCoords.end(); it++ )
-	{
-		int startX = it->X*MAP_SAVE_CHUNK;
-		int sizeX = (int) MIN( MAP_SAVE_CHUNK, Width - startX );
-		int startY = it->Y*MAP_SAVE_CHUNK;
-		int sizeY = (int) MIN( MAP_SAVE_CHUNK, Height - startY  );
-
-		LOCK_OR_QUIT(bmpSavedImage);
-		lockFlags();
-	
-		if( bmpBackImageHiRes.get() )
-		{
-			LOCK_OR_QUIT(bmpDrawImage);
-			DrawImageAdv( bmpDrawImage.get(), bmpSavedImage, startX*2, startY*2, startX*2, startY*2, sizeX*2, sizeY*2 );
-			UnlockSurface(bmpDrawImage);
-		}
+	std::vector<int> rects;
+	if( bmpBackImageHiRes.get() )
+		LOCK_OR_QUIT(bmpDrawImage);
+	lockFlags();
+	m_terrainHistory.rollback(ticks, snapshotPlanes(), rects);
+	unlockFlags();
+	if( bmpBackImageHiRes.get() )
+		UnlockSurface(bmpDrawImage);
 
-		for( int y=startY; y<startY+sizeY; y++ )
-			memcpy( (char*)material->surf->pixels + y*material->surf->pitch + startX, savedPixelFlags + y*material->surf->pitch + startX, sizeX*sizeof(uchar) );
-	
-		unlockFlags();
-		UnlockSurface(bmpSavedImage);
+	for( size_t i = 0; i + 3 < rects.size(); i += 4 )
+	{
+		int startX = rects[i], startY = rects[i+1], sizeX = rects[i+2], sizeY = rects[i+3];
 		
+		if( m_navGraph.get() )
+			m_navGraph->markDirty( startX, startY, sizeX, sizeY );
 		if( tLXOptions->bShadows )
 		{
 			UpdateArea(startX, startY, sizeX, sizeY, true);
 		}
 		else
 		{
+			m_renderCache.invalidate(startX, startY, sizeX, sizeY);
 			UpdateMiniMapRect(startX-10, startY-10, sizeX+20, sizeY+20);
 		}
 	}
-
-	bMapSavingToMemory = false;
-	savedMapCoords.clear();
 }
 
 void CMap::NewNet_Deinit()
 {
-		bMapSavingToMemory = false;
-		bmpSavedImage = NULL;
-		if( savedPixelFlags )
-			delete[] savedPixelFlags;
-		savedPixelFlags = NULL;
-		savedMapCoords.clear();
+		m_terrainHistory.clear();
 }
 
 void CMap::SaveToMemoryInternal(int x, int y, int w, int h)
 {
-	if( ! bMapSavingToMemory )
+	if( m_terrainHistory.count() == 0 )
 		return;
-	if( bmpSavedImage.get() == NULL || savedPixelFlags == NULL )
-	{
-		errors("Error: CMap::SaveToMemoryInternal(): bmpSavedImage is NULL\n");
-		return;
-	}
 
-	int gridX = x / MAP_SAVE_CHUNK;
-	int gridMaxX = 1 + (x+w) / MAP_SAVE_CHUNK;
-	
-	int gridY = y / MAP_SAVE_CHUNK;
-	int gridMaxY = 1 + (y+h) / MAP_SAVE_CHUNK;
-
-	for( int fy = gridY; fy < gridMaxY; fy++ )
-		for( int fx = gridX; fx < gridMaxX; fx++ )
-			if( savedMapCoords.count( SavedMapCoord_t( fx, fy ) ) == 0 )
-			{
-				savedMapCoords.insert( SavedMapCoord_t( fx, fy ) );
-				
-				int startX = fx*MAP_SAVE_CHUNK;
-				int sizeX = (int) MIN( MAP_SAVE_CHUNK, Width - startX );
-				int startY = fy*MAP_SAVE_CHUNK;
-				int sizeY = (int) MIN( MAP_SAVE_CHUNK, Height - startY  );
-
-				LOCK_OR_QUIT(bmpSavedImage);
-				lockFlags();
-				
-				if( bmpBackImageHiRes.get() )
-				{
-					LOCK_OR_QUIT(bmpDrawImage);
-					DrawImageAdv( bmpSavedImage.get(), bmpDrawImage, startX*2, startY*2, startX*2, startY*2, sizeX*2, sizeY*2 );
-					UnlockSurface(bmpDrawImage);
-				}
-
-				for( int y=startY; y<startY+sizeY; y++ )
-					memcpy( savedPixelFlags + y*material->surf->pitch + startX, (char*)material->surf->pixels + y*material->surf->pitch + startX, sizeX*sizeof(uchar) );
-
-				unlockFlags();
-				UnlockSurface(bmpSavedImage);
-			}
+	if( bmpBackImageHiRes.get() )
+		LOCK_OR_QUIT(bmpDrawImage);
+	lockFlags();
+	m_terrainHistory.touch(x, y, w, h, snapshotPlanes());
+	unlockFlags();
+	if( bmpBackImageHiRes.get() )
+		UnlockSurface(bmpDrawImage);
 }
 
 
@@ -2198,6 +2263,10 @@ void CMap::SaveToMemoryInternal(int x, int y, int w, int h)
 void CMap::Shutdown()
 {
 	lockFlags();
+	
+	m_dirtyRects.clear();
+	m_renderCache.clear();
+	m_miniMapPyramid.clear();
 
 	if(Created) {
 
@@ -2216,12 +2285,8 @@ void CMap::Shutdown()
 		NumObjects = 0;
 		AdditionalData.clear();
 
-		bMapSavingToMemory = false;
-		bmpSavedImage = NULL;
-		if( savedPixelFlags )
-			delete[] savedPixelFlags;
-		savedPixelFlags = NULL;
-		savedMapCoords.clear();
+		m_terrainHistory.clear();
+		m_navGraph = NULL;
 	}
 	// Safety
 	else  {
@@ -2233,10 +2298,8 @@ void CMap::Shutdown()
 		bmpMiniMap = NULL;
 		Objects = NULL;
 		AdditionalData.clear();
-		bMapSavingToMemory = false;
-		bmpSavedImage = NULL;
-		savedPixelFlags = NULL;
-		savedMapCoords.clear();
+		m_terrainHistory.clear();
+		m_navGraph = NULL;
 	}
 
 	gusShutdown();
@@ -2453,13 +2516,17 @@ Color CMap::getColorAt(long x, long y) {
 }
 
 void CMap::putColorTo(long x, long y, Color c) {
-	if(bmpDrawImage.get())
+	if(bmpDrawImage.get()) {
 		DrawRectFill2x2(bmpDrawImage.get(), x*2, y*2, c);
+		m_renderCache.invalidate(x, y, 1, 1);
+	}
 }
 
 void CMap::putSurfaceTo(long x, long y, SDL_Surface* surf, int sx, int sy, int sw, int sh) {
-	if(bmpDrawImage.get())
+	if(bmpDrawImage.get()) {
 		DrawImageStretch2(bmpDrawImage.get(), surf, sx, sy, x*2, y*2, sw, sh);
+		m_renderCache.invalidate(x, y, sw, sh);
+	}
 }
 
 
@@ -73,6 +73,8 @@ void CProjectile::Spawn(proj_t *_proj, CVec _pos, CVec _vel, int _rot, int _owne
 	fSpeed = _vel.GetLength();
 	CalculateCheckSteps();
 
+	cClient->getProjectileSimData().set((int)(this - &cClient->getProjectiles()[0]), tProjInfo, radius);
+
 	fFrame = 0;
 	bFrameDelta = true;
 
@@ -112,6 +114,149 @@ void CProjectile::Spawn(proj_t *_proj, CVec _pos, CVec _vel, int _rot, int _owne
 }
 
 
+///////////////////
+// Cache the physics parameters of a newly spawned projectile
+void ProjectileSimData::set(int slot, const proj_t* info, const VectorD2<int>& radius)
+{
+	gravity[slot] = info->UseCustomGravity ? (float)info->Gravity : 100.0f;
+	dampening[slot] = info->Dampening;
+	setRadius(slot, radius);
+	generation[slot]++;
+}
+
+
+namespace {
+	// everything the simulation changes, as one plain block
+	struct ProjectileState {
+		int		type;
+		AbsTime	spawnTime;
+		float	life;
+		float	extra;
+		int		owner;
+		float	speed;
+		Color	colour;
+		AbsTime	ignoreWormCollBeforeTime;
+		AbsTime	lastTrailProj;
+		float	timeVarRandom;
+		proj_t*	projInfo;
+		CVec	pos, vel, oldPos;
+		float	rotation;
+		VectorD2<int> radius;
+		int		random;
+		int		maxCheckStep, minCheckStep, maxCheckStep2, minCheckStep2, avgCheckStep;
+		float	wallshootTime;
+		bool	changesSpeed;
+		int		checkSpeedLen;
+		int		collisionSide;
+		bool	frameDelta;
+		float	frame;
+		int		frameX;
+		bool	firstBounce;
+		AbsTime	lastSimulationTime;
+		float	health;
+		Uint32	numTimers;
+	};
+
+	struct ProjectileTimerState {
+		const Proj_TimerEvent* event;
+		ProjTimerState state;
+	};
+}
+
+void CProjectile::NewNet_SaveState(GameStateArena& arena) const
+{
+	ProjectileState s;
+	s.type = iType;
+	s.spawnTime = fSpawnTime;
+	s.life = fLife;
+	s.extra = fExtra;
+	s.owner = iOwner;
+	s.speed = fSpeed;
+	s.colour = iColour;
+	s.ignoreWormCollBeforeTime = fIgnoreWormCollBeforeTime;
+	s.lastTrailProj = fLastTrailProj;
+	s.timeVarRandom = fTimeVarRandom;
+	s.projInfo = tProjInfo;
+	s.pos = vPos.get();
+	s.vel = vVelocity.get();
+	s.oldPos = vOldPos;
+	s.rotation = fRotation;
+	s.radius = radius;
+	s.random = iRandom;
+	s.maxCheckStep = MAX_CHECKSTEP;
+	s.minCheckStep = MIN_CHECKSTEP;
+	s.maxCheckStep2 = MAX_CHECKSTEP2;
+	s.minCheckStep2 = MIN_CHECKSTEP2;
+	s.avgCheckStep = AVG_CHECKSTEP;
+	s.wallshootTime = fWallshootTime;
+	s.changesSpeed = bChangesSpeed;
+	s.checkSpeedLen = iCheckSpeedLen;
+	s.collisionSide = CollisionSide;
+	s.frameDelta = bFrameDelta;
+	s.frame = fFrame;
+	s.frameX = iFrameX;
+	s.firstBounce = firstbounce;
+	s.lastSimulationTime = fLastSimulationTime;
+	s.health = health;
+	s.numTimers = (Uint32)timerInfo.size();
+	arena.write(s);
+
+	for(ProjTimerInfo::const_iterator it = timerInfo.begin(); it != timerInfo.end(); ++it) {
+		ProjectileTimerState t;
+		t.event = it->first;
+		t.state = it->second;
+		arena.write(t);
+	}
+}
+
+bool CProjectile::NewNet_LoadState(GameStateArena::Reader& r)
+{
+	ProjectileState s;
+	if(!r.read(s)) return false;
+	bUsed = true;
+	iType = s.type;
+	fSpawnTime = s.spawnTime;
+	fLife = s.life;
+	fExtra = s.extra;
+	iOwner = s.owner;
+	fSpeed = s.speed;
+	iColour = s.colour;
+	fIgnoreWormCollBeforeTime = s.ignoreWormCollBeforeTime;
+	fLastTrailProj = s.lastTrailProj;
+	fTimeVarRandom = s.timeVarRandom;
+	tProjInfo = s.projInfo;
+	vPos = s.pos;
+	vVelocity = s.vel;
+	vOldPos = s.oldPos;
+	fRotation = s.rotation;
+	radius = s.radius;
+	iRandom = s.random;
+	MAX_CHECKSTEP = s.maxCheckStep;
+	MIN_CHECKSTEP = s.minCheckStep;
+	MAX_CHECKSTEP2 = s.maxCheckStep2;
+	MIN_CHECKSTEP2 = s.minCheckStep2;
+	AVG_CHECKSTEP = s.avgCheckStep;
+	fWallshootTime = s.wallshootTime;
+	bChangesSpeed = s.changesSpeed;
+	iCheckSpeedLen = s.checkSpeedLen;
+	CollisionSide = s.collisionSide;
+	bFrameDelta = s.frameDelta;
+	fFrame = s.frame;
+	iFrameX = s.frameX;
+	firstbounce = s.firstBounce;
+	fLastSimulationTime = s.lastSimulationTime;
+	health = s.health;
+
+	timerInfo.clear();
+	for(Uint32 i = 0; i < s.numTimers; ++i) {
+		ProjectileTimerState t;
+		if(!r.read(t)) return false;
+		timerInfo[t.event] = t.state;
+	}
+	return true;
+}
+
+
 ///////////////////
 // Gets a random float from a special list
 // TODO: how does this belong to projectiles? move it perhaps out here
@@ -432,48 +577,18 @@ void CProjectile::Bounce(float fCoeff)
 
 
 
-template<bool TOP, bool LEFT>
-static CClient::MapPosIndex MPI(const VectorD2<int>& p, const VectorD2<int>& r) {
-	return CClient::MapPosIndex( p + VectorD2<int>(LEFT ? -r.x : r.x, TOP ? -r.y : r.y) );
-}
-
-template<bool INSERT>
-static void updateMap(CProjectile* prj, const VectorD2<int>& p, const VectorD2<int>& r) {
-	for(int x = MPI<true,true>(p,r).x; x <= MPI<true,false>(p,r).x; ++x)
-		for(int y = MPI<true,true>(p,r).y; y <= MPI<false,true>(p,r).y; ++y) {
-			CClient::ProjectileSet* projs = cClient->projPosMap[CClient::MapPosIndex(x,y).index(game.gameMap())];
-			if(projs == NULL) continue;
-			if(INSERT)
-				projs->insert(prj);
-			else
-				projs->erase(prj);
-		}
-}
-
 void CProjectile::updateCollMapInfo(const VectorD2<int>* oldPos, const VectorD2<int>* oldRadius) {
 	if( !game.gameScript()->getNeedCollisionInfo() && 
 		!bool(cClient->getGameLobby()[FT_CollideProjectiles]) ) 
 		return;
 	
+	// The grid remembers the cells we are registered in, so oldPos/oldRadius are not needed anymore.
+	const ProjectileGrid::Index index = (ProjectileGrid::Index)(this - &cClient->getProjectiles()[0]);
+	
 	if(!isUsed()) { // not used anymore
-		if(oldPos && oldRadius)
-			updateMap<false>(this, *oldPos, *oldRadius);
+		cClient->projPosMap.remove(index);
 		return;
 	}
 	
-	if(oldPos && oldRadius) {
-		if(
-		(MPI<true,true>(*oldPos,*oldRadius) == MPI<true,true>(vPos.get(),radius)) &&
-		(MPI<true,false>(*oldPos,*oldRadius) == MPI<true,false>(vPos.get(),radius)) &&
-		(MPI<false,true>(*oldPos,*oldRadius) == MPI<false,true>(vPos.get(),radius)) &&
-		(MPI<false,false>(*oldPos,*oldRadius) == MPI<false,false>(vPos.get(),radius))) {
-			return; // nothing has changed
-		}
-		
-		// delete from all
-		updateMap<false>(this, *oldPos, *oldRadius);
-	}
-	
-	// add to all
-	updateMap<true>(this, vPos.get(), radius);
+	cClient->projPosMap.update(index, vPos.get(), radius);
 }
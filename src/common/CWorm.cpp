@@ -1680,6 +1680,134 @@ void CWorm::NewNet_CopyWormState(const CWorm & w)
 	#undef COPY
 };
 
+namespace {
+	struct WormState {
+		Uint8	state;
+		CVec	pos, vel, lastPos, drawPos;
+		bool	onGround;
+		AbsTime	lastInputTime, lastMoveTime;
+		TimeDiff	servertime;
+		AbsTime	lastCarve;
+		float	health;
+		bool	alive;
+		AbsTime	timeofDeath;
+		int		faceDirectionSide, moveDirectionSide;
+		bool	gotTarget;
+		float	angle, angleSpeed, moveSpeedX, frame;
+		AbsTime	spawnTime;
+		int		currentWeapon;
+		AbsTime	lastAirJumpTime;
+		NewNet::NetSyncedRandom random;
+		Uint32	numWeapons;
+		Uint32	numVisibleForWorm;
+	};
+
+	struct WeaponSlotState {
+		int		id;
+		float	charge;
+		bool	reloading;
+		float	lastFire;
+	};
+}
+
+void CWorm::NewNet_SaveState(GameStateArena& arena) const
+{
+	WormState s;
+	s.state = tState.get().asInt();
+	s.pos = vPos.get();
+	s.vel = vVelocity.get();
+	s.lastPos = vLastPos;
+	s.drawPos = vDrawPos;
+	s.onGround = bOnGround;
+	s.lastInputTime = fLastInputTime;
+	s.lastMoveTime = lastMoveTime;
+	s.servertime = fServertime;
+	s.lastCarve = fLastCarve;
+	s.health = health;
+	s.alive = bAlive;
+	s.timeofDeath = fTimeofDeath;
+	s.faceDirectionSide = iFaceDirectionSide;
+	s.moveDirectionSide = iMoveDirectionSide;
+	s.gotTarget = bGotTarget;
+	s.angle = fAngle;
+	s.angleSpeed = fAngleSpeed;
+	s.moveSpeedX = fMoveSpeedX;
+	s.frame = fFrame;
+	s.spawnTime = fSpawnTime;
+	s.currentWeapon = iCurrentWeapon;
+	s.lastAirJumpTime = fLastAirJumpTime;
+	s.random = NewNet_random;
+	s.numWeapons = (Uint32)tWeapons.size();
+	s.numVisibleForWorm = (Uint32)bVisibleForWorm.get().size();
+	arena.write(s);
+
+	for(size_t i = 0; i < tWeapons.size(); ++i) {
+		WeaponSlotState w;
+		w.id = tWeapons[i].WeaponId;
+		w.charge = tWeapons[i].Charge;
+		w.reloading = tWeapons[i].Reloading;
+		w.lastFire = tWeapons[i].LastFire;
+		arena.write(w);
+	}
+
+	for(size_t i = 0; i < bVisibleForWorm.get().size(); ++i)
+		arena.write((Uint8)bVisibleForWorm.get()[i]);
+
+	cNinjaRope.get().NewNet_SaveState(arena);
+}
+
+bool CWorm::NewNet_LoadState(GameStateArena::Reader& r)
+{
+	WormState s;
+	if(!r.read(s)) return false;
+	tState.write().fromInt(s.state);
+	vPos = s.pos;
+	vVelocity = s.vel;
+	vLastPos = s.lastPos;
+	vDrawPos = s.drawPos;
+	bOnGround = s.onGround;
+	fLastInputTime = s.lastInputTime;
+	lastMoveTime = s.lastMoveTime;
+	fServertime = s.servertime;
+	fLastCarve = s.lastCarve;
+	health = s.health;
+	bAlive = s.alive;
+	fTimeofDeath = s.timeofDeath;
+	iFaceDirectionSide = s.faceDirectionSide;
+	iMoveDirectionSide = s.moveDirectionSide;
+	bGotTarget = s.gotTarget;
+	fAngle = s.angle;
+	fAngleSpeed = s.angleSpeed;
+	fMoveSpeedX = s.moveSpeedX;
+	fFrame = s.frame;
+	fSpawnTime = s.spawnTime;
+	iCurrentWeapon = s.currentWeapon;
+	fLastAirJumpTime = s.lastAirJumpTime;
+	NewNet_random = s.random;
+
+	for(Uint32 i = 0; i < s.numWeapons; ++i) {
+		WeaponSlotState w;
+		if(!r.read(w)) return false;
+		if(i >= tWeapons.size()) continue;
+		wpnslot_t& slot = weaponSlots.write()[i];
+		slot.WeaponId = w.id;
+		slot.Charge = w.charge;
+		slot.Reloading = w.reloading;
+		slot.LastFire = w.lastFire;
+	}
+
+	if(bVisibleForWorm.get().size() != s.numVisibleForWorm)
+		bVisibleForWorm.write().resize(s.numVisibleForWorm);
+	for(Uint32 i = 0; i < s.numVisibleForWorm; ++i) {
+		Uint8 visible;
+		if(!r.read(visible)) return false;
+		if(bVisibleForWorm.get()[i] != (visible != 0))
+			bVisibleForWorm.write()[i] = (visible != 0);
+	}
+
+	return cNinjaRope.write().NewNet_LoadState(r);
+}
+
 void CWorm::NewNet_InitWormState(int seed)
 {
 	NewNet_random.seed(seed);
@@ -23,7 +23,6 @@
 #endif
 
 #include <cassert>
-#include <set>
 
 #include "CodeAttributes.h"
 #include "LieroX.h"
@@ -44,16 +43,14 @@
 #include "FlagInfo.h"
 #include "ProjectileDesc.h"
 #include "WeaponDesc.h"
-#include "Mutex.h"
 #include "game/Game.h"
 #include "gusanos/weapon.h"
 #include "game/Mod.h"
 #include "level/FastTraceLine.h"
 #include "CClientNetEngine.h"
-
-
-// used by searchpath algo
-static const unsigned short wormsize = 7;
+#include "NavGraph.h"
+#include "NavSearchPool.h"
+#include "Options.h"
 
 
 /*
@@ -92,792 +89,6 @@ enum GAM_AI_TYPE
 };
 
 
-struct NEW_ai_node_t {
-	float fX, fY;
-	NEW_ai_node_t *psPrev, *psNext;
-	NEW_ai_node_t() : fX(0), fY(0), psPrev(NULL), psNext(NULL) {}
-};
-
-NEW_ai_node_t* get_last_ai_node(NEW_ai_node_t* n);
-void delete_ai_nodes(NEW_ai_node_t* start);
-void delete_ai_nodes(NEW_ai_node_t* start, NEW_ai_node_t* end);
-float get_ai_nodes_length(NEW_ai_node_t* start);
-// this do the same as the fct above except that it don't do the sqrt
-float get_ai_nodes_length2(NEW_ai_node_t* start);
-
-
-
-// returns the biggest possible free rectangle with the given point inside
-// (not in every case, but in most it is the biggest; but it is ensured that the given rect is at least free)
-// the return-value of type SquareMatrix consists of the top-left and upper-right pixel
-// WARNING: if the given point is not in the map, the returned
-// area is also not in the map (but it will handle it correctly)
-SquareMatrix<int> getMaxFreeArea(VectorD2<int> p, uchar checkflag) {
-	uint map_w = game.gameMap()->GetWidth();
-	uint map_h = game.gameMap()->GetHeight();
-	uchar** pxflags = game.gameMap()->material->line;
-	boost::array<Material,256>& materials = game.gameMap()->materialArray();
-
-	SquareMatrix<int> ret;
-	ret.v1 = p; ret.v2 = p;
-
-	// just return if we are outside
-	if(p.x < 0 || (uint)p.x >= map_w
-	|| p.y < 0 || (uint)p.y >= map_h)
-		return ret;
-
-	enum { GO_RIGHT=1, GO_DOWN=2, GO_LEFT=4, GO_UP=8 }; short dir;
-	unsigned short col;
-	int x=0, y=0;
-
-	// loop over all directions until there is some obstacle
-	col = 0; dir = 1;
-	while(true) {
-		if(col == 0xF) // got we collisions in all directions?
-			break;
-
-		// change direction
-		do {
-			dir = dir << 1;
-			if(dir > 8) dir = 1;
-		} while(col & dir);
-
-		// set start pos
-		switch(dir) {
-		case GO_RIGHT: x=ret.v2.x+1; y=ret.v1.y; break;
-		case GO_DOWN: x=ret.v1.x; y=ret.v2.y+1; break;
-		case GO_LEFT: x=ret.v1.x-1; y=ret.v1.y; break;
-		case GO_UP: x=ret.v1.x; y=ret.v1.y-1; break;
-		}
-
-		// check if still inside the map (than nothing bad can happen)
-		if(x < 0 || (uint)x >= map_w
-		|| y < 0 || (uint)y >= map_h) {
-			col |= dir;
-			continue;
-		}
-
-		// loop over all pxflags of the aligned line and check for an obstacle
-		while(true) {
-			// break if ready
-			if(dir == GO_RIGHT || dir == GO_LEFT) {
-				if(y > ret.v2.y) break;
-			} else // GO_UP / GO_DOWN
-				if(x > ret.v2.x) break;
-
-			// is there some obstacle?
-			if(materials[pxflags[y][x]].toLxFlags() & checkflag) {
-				col |= dir;
-				break;
-			}
-
-			// inc the pos (trace the aligned line)
-			switch(dir) {
-			case GO_RIGHT: case GO_LEFT: y++; break;
-			case GO_DOWN: case GO_UP: x++; break;
-			}
-		}
-
-		if(!(col & dir)) {
-			// simple inc 1 pixel in the checked direction
-			switch(dir) {
-			case GO_RIGHT: ret.v2.x++; break;
-			case GO_DOWN: ret.v2.y++; break;
-			case GO_LEFT: ret.v1.x--; break;
-			case GO_UP: ret.v1.y--; break;
-			}
-		}
-
-	} // loop over directions
-
-	// cut the area if outer space...
-	if(ret.v1.x < 0) ret.v1.x = 0;
-	if(ret.v1.y < 0) ret.v1.y = 0;
-	if((uint)ret.v2.x >= map_w) ret.v2.x = map_w-1;
-	if((uint)ret.v2.y >= map_h) ret.v2.y = map_h-1;
-
-	return ret;
-}
-
-
-
-
-NEW_ai_node_t* createNewAiNode(float x, float y, NEW_ai_node_t* next = NULL, NEW_ai_node_t* prev = NULL) {
-	NEW_ai_node_t* tmp = new NEW_ai_node_t;
-	tmp->fX = x; tmp->fY = y;
-	tmp->psNext = next; tmp->psPrev = prev;
-	return tmp;
-}
-
-NEW_ai_node_t* createNewAiNode(NEW_ai_node_t* base) {
-	if(!base) return NULL;
-	NEW_ai_node_t* tmp = new NEW_ai_node_t;
-	tmp->fX = base->fX; tmp->fY = base->fY;
-	tmp->psNext = base->psNext; tmp->psPrev = base->psPrev;
-	return tmp;
-}
-
-NEW_ai_node_t* createNewAiNode(const VectorD2<int>& p) {
-	return createNewAiNode((float)p.x, (float)p.y);
-}
-
-// returns true, if the given line is free or not
-// these function will either go parallel to the x-axe or parallel to the y-axe
-// (depends on which of them is the absolute greatest)
-// HINT: don't lock the flags here (it's done in the caller)
-INLINE bool simpleTraceLine(VectorD2<int> start, VectorD2<int> dist, uchar checkflag) {
-	boost::array<Material,256>& materials = game.gameMap()->materialArray();
-	unsigned char** pxflags = game.gameMap()->material->line;
-	if (!pxflags)  {  // The map has been probably shut down
-		warnings << "simpleTraceLine with pxflags==NULL" << endl;
-		return false;
-	}
-	uint map_w = game.gameMap()->GetWidth();
-	uint map_h = game.gameMap()->GetHeight();
-
-	if(abs(dist.x) >= abs(dist.y)) {
-		if(dist.x < 0) { // avoid anoying checks
-			start.x += dist.x;
-			dist.x = -dist.x;
-		}
-		if(start.x < 0 || (uint)(start.x + dist.x) >= map_w || start.y < 0 || (uint)start.y >= map_h)
-			return false;
-		for(int x = 0; x <= dist.x; x++) {
-			if(materials[pxflags[start.y][start.x + x]].toLxFlags() & checkflag)
-				return false;
-		}
-	} else { // y is greater
-		if(dist.y < 0) { // avoid anoying checks
-			start.y += dist.y;
-			dist.y = -dist.y;
-		}
-		if(start.y < 0 || (uint)(start.y + dist.y) >= map_h || start.x < 0 || (uint)start.x >= map_w)
-			return false;
-		for(int y = 0; y <= dist.y; y++) {
-			if(materials[pxflags[start.y+y][start.x]].toLxFlags() & checkflag)
-				return false;
-		}
-	}
-	return true;
-}
-
-
-/*
-this class do the whole pathfinding (idea by AZ)
-you can use the findPath-function directly,
-or you can use the function StartThreadSearch, which
-start the search in an own thread; you can ask
-for the state with IsReady
-*/
-class searchpath_base {
-public:
-
-// this will define, if we should break the search on the first result
-// (we ensure in forEachChecklistItem, that it is not that bad)
-#define		BREAK_ON_FIRST	1
-
-	// this is one node in the map
-	class area_item {
-	public:
-
-		// needed for area_set (for area search function getArea(p))
-		struct area_v1__less {
-			// this is a well-defined transitive ordering after the v1-vector of the matrix
-			bool operator()(const area_item* a, const area_item* b) const {
-				if(!a || !b) return a < b; // this should never happen
-				return a->area.v1 < b->area.v1;
-			}
-		};
-
-		// needed for area_set (for area search function getBestArea)
-		struct expected_min_total_dist__less {
-			// this is a well-defined transitive ordering after the v1-vector of the matrix
-			bool operator()(const area_item* a, const area_item* b) const {
-				if(!a || !b) return a < b; // this should never happen
-				double dista = a->expected_min_total_dist();
-				double distb = b->expected_min_total_dist();
-				// In some rare cases (depending on optimisation and hardware, (a<b)&&(b<a) is true here.
-				// To make it a valid order, we have to make the additional check.
-				if(fabs(dista - distb) < 0.0001) return false;
-				return dista < distb;
-			}
-		};
-
-		searchpath_base* const base;
-
-		// this will save the state, if we still have to check a specific end
-		// at the rectangle or not
-		short checklistRows;
-		short checklistRowStart;
-		short checklistRowHeight;
-		short checklistCols;
-		short checklistColStart;
-		short checklistColWidth;
-
-		const SquareMatrix<int> area;
-		area_item* lastArea; // the area where we came from
-		double dist_from_source; // distance from startpoint
-
-		void initChecklists() {
-			VectorD2<int> size = area.v2 - area.v1;
-			// ensure here, that the starts are not 0
-			checklistCols = (size.x-3) / checklistColWidth + 1;
-			checklistRows = (size.y-3) / checklistRowHeight + 1;
-			checklistColStart = (size.x - (checklistCols-1)*checklistColWidth) / 2;
-			checklistRowStart = (size.y - (checklistRows-1)*checklistRowHeight) / 2;
-		}
-
-		// expected minimum total distance from startpoint to destination
-		double expected_min_total_dist() const {
-			return dist_from_source + (area.getCenter() - base->target).GetLength();
-		}
-
-		double expected_min_total_dist(area_item* lastArea) const {
-			return lastArea->dist_from_source + getDistToArea(lastArea) + (area.getCenter() - base->target).GetLength();
-		}
-
-		void setLastArea(area_item* theValue) {
-			lastArea = theValue;
-			if(lastArea == NULL)
-				dist_from_source = 0;
-			else
-				dist_from_source = lastArea->dist_from_source + getDistToArea(lastArea);
-		}
-
-		VectorD2<int> getConnectorPointForArea(area_item* otherArea) const {
-			if(otherArea == NULL) return area.getCenter();
-
-			SquareMatrix<int> intersection = area.getInsersectionWithArea(otherArea->area);
-			return intersection.getCenter();
-			/*
-			VectorD2<int> otherCenter = otherArea->area.getCenter();
-			if(area.v1.x <= otherCenter.x && otherCenter.x <= area.v2.x)
-				return VectorD2<int>(otherCenter.x, area.getCenter().y);
-			else
-				return VectorD2<int>(area.getCenter().x, otherCenter.y); */
-		}
-
-		double getDistToArea(area_item* otherArea) const {
-			VectorD2<int> conPoint = getConnectorPointForArea(otherArea);
-			return
-				(otherArea->area.getCenter() - conPoint).GetLength() +
-				(area.getCenter() - conPoint).GetLength();
-		}
-
-		area_item(searchpath_base* b, const SquareMatrix<int>& a) :
-			base(b),
-			checklistRows(0),
-			checklistRowStart(0),
-			checklistRowHeight(5),
-			checklistCols(0),
-			checklistColStart(0),
-			checklistColWidth(5),
-			area(a),
-			lastArea(NULL),
-			dist_from_source(0) {}
-
-		// iterates over all checklist points
-		// calls given action with 2 parameters:
-		//    VectorD2<int> p, VectorD2<int> dist
-		// p is the point inside of the area, dist the change to the target (p+dist is therefore the new position)
-		// if the returned value by the action is false, it will break
-		template<typename _action>
-		void forEachChecklistItem(_action action) {
-			int i;
-			VectorD2<int> p, dist;
-
-			// TODO: this sorting is not needed anymore here
-			typedef std::multiset< VectorD2<int>, VectorD2__absolute_less<int> > p_set;
-			// the set point here defines, where the 'best' point is (the sorting depends on it)
-			p_set points(VectorD2__absolute_less<int>( base->target )); // + getCenter()*2 - start) / 2));
-
-			// insert now the points to the list
-			// the list will sort itself
-
-			// left
-			p.x = area.v1.x;
-			dist.x = -checklistRowHeight; dist.y = 0;
-			for(i = 0; i < checklistRows; i++) {
-				p.y = area.v1.y + checklistRowStart + i*checklistRowHeight;
-				points.insert(p);
-			}
-
-			// right
-			p.x = area.v2.x;
-			dist.x = checklistRowHeight; dist.y = 0;
-			for(i = 0; i < checklistRows; i++) {
-				p.y = area.v1.y + checklistRowStart + i*checklistRowHeight;
-				points.insert(p);
-			}
-
-			// top
-			p.y = area.v1.y;
-			dist.x = 0; dist.y = -checklistColWidth;
-			for(i = 0; i < checklistCols; i++) {
-				p.x = area.v1.x + checklistColStart + i*checklistColWidth;
-				points.insert(p);
-			}
-
-			// bottom
-			p.y = area.v2.y;
-			dist.x = 0; dist.y = checklistColWidth;
-			for(i = 0; i < checklistCols; i++) {
-				p.x = area.v1.x + checklistColStart + i*checklistColWidth;
-				points.insert(p);
-			}
-
-			// the list is sorted, the closest (to the target) comes first
-			for(p_set::iterator it = points.begin(); it != points.end(); it++) {
-				if(it->x == area.v1.x) { // left
-					dist.x = -checklistRowHeight; dist.y = 0;
-				} else if(it->x == area.v2.x) { // right
-					dist.x = checklistRowHeight; dist.y = 0;
-				} else if(it->y == area.v1.y) { // top
-					dist.x = 0; dist.y = -checklistColWidth;
-				} else { // bottom
-					dist.x = 0; dist.y = checklistColWidth;
-				}
-				if(!action(*it, dist)) return;
-			}
-
-		}
-
-		class check_checkpoint {
-		public:
-			searchpath_base* base;
-			area_item* myArea;
-			float bestNodeLen; // this can be done better...
-
-			check_checkpoint(searchpath_base* b, area_item* a) :
-				base(b),
-				myArea(a),
-				bestNodeLen(-1) {}
-
-			// this will be called by forEachChecklistItem
-			// pt is the checkpoint and dist the change to the new target (it means we want from pt to pt+dist)
-			// it will search for the best node starting at the specific pos
-			bool operator() (VectorD2<int> pt, VectorD2<int> dist) {
-				bool trace = true;
-				VectorD2<int> dir, start;
-				unsigned short left, right;
-				if(abs(dist.x) >= abs(dist.y))
-					dir.y = 1;
-				else
-					dir.x = 1;
-				start = pt;
-				pt += dir;
-
-				// ensure, that the way has at least the width of wormsize
-				game.gameMap()->lockFlags(false);
-				trace = simpleTraceLine(pt, dist, PX_ROCK);
-				for(left = 0; trace && left < wormsize; pt += dir) {
-					trace = simpleTraceLine(pt, dist, PX_ROCK);
-					if(trace) left++;
-				}
-				pt = start - dir; trace = true;
-				for(right = 0; trace && right < (wormsize-left); right++, pt -= dir) {
-					trace = simpleTraceLine(pt, dist, PX_ROCK);
-					if(trace) right++;
-				}
-				game.gameMap()->unlockFlags(false);
-
-				// is there enough space?
-				if(left+right >= wormsize) {
-					base->addAreaNode( pt + dist, myArea );
-				}
-
-				// continue the search
-				return true;
-			}
-		}; // class check_checkpoint
-
-		void process() {
-			// add all successor-nodes to areas_stack
-			forEachChecklistItem( check_checkpoint(base, this) );
-		}
-
-	}; // class area_item
-
-	// area_set keeps track about all available areas. because there can be areas with the same area_v1, this must be a multiset.
-	typedef std::multiset< area_item*, area_item::area_v1__less > area_set;
-	// area_stack_set is the dynamic stack in the pathfinding algo
-	typedef std::set< area_item*, area_item::expected_min_total_dist__less > area_stack_set;
-	typedef std::set< NEW_ai_node_t* > node_set;
-
-	// these neccessary attributes have to be set manually
-	area_set areas; // set of all created areas
-	node_set nodes; // set of all created nodes
-	VectorD2<int> start, target;
-
-	area_stack_set areas_stack; // set of areas used by the searching algorithm
-
-	searchpath_base() :
-		resulted_path(NULL),
-		thread(NULL),
-		thread_is_ready(true),
-		break_thread_signal(0),
-		restart_thread_searching_signal(0) {
-		thread = threadPool->start(threadSearch, this, "AI worm pathfinding");
-		if(!thread)
-			errors << "could not create AI thread" << endl;
-	}
-
-	~searchpath_base() {
-		// thread cleaning up
-		breakThreadSignal();
-		if(thread) threadPool->wait(thread, NULL);
-		else warnings << "AI thread already uninitialized" << endl;
-		thread = NULL;
-		
-		clear();
-	}
-
-	void removePathFromList(NEW_ai_node_t* start) {
-		for(NEW_ai_node_t* node = start; node; node = node->psNext)
-			nodes.erase(node);
-	}
-
-private:
-	void clear() {
-		clear_areas();
-		clear_nodes();
-	}
-
-	void clear_areas() {
-		for(area_set::iterator it = areas.begin(); it != areas.end(); it++) {
-			delete *it;
-		}
-		areas.clear();
-	}
-
-	void clear_nodes() {
-		for(node_set::iterator it = nodes.begin(); it != nodes.end(); it++) {
-			delete *it;
-		}
-		nodes.clear();
-	}
-
-	// searches for an overleading area and returns the first
-	// returns NULL, if none found
-	area_item* getArea(VectorD2<int> p) {
-		// TODO: area_v1__less is not used here
-		// (take a look at pseudoless)
-		for(area_set::iterator it = areas.begin(); it != areas.end() && (*it)->area.v1 <= p; it++) {
-			if((*it)->area.isInDefinedArea(p))
-				return *it;
-		}
-
-#ifdef _AI_DEBUG
-/*		printf("getArea( %i, %i )\n", p.x, p.y);
-		printf("  don't find an underlying area\n");
-		printf("  areas = {\n");
-		for(area_set::iterator it = areas.begin(); it != areas.end(); it++) {
-			printf("		( %i, %i, %i, %i )%s,\n",
-				(*it)->area.v1.x, (*it)->area.v1.y,
-				(*it)->area.v2.x, (*it)->area.v2.y,
-				((*it)->area.v1 <= p) ? "" : " (*)");
-		}
-		printf("     }\n"); */
-#endif
-
-		return NULL;
-	}
-
-	area_item* getBestArea() {
-		// areas_stack is sorted and we have the best solution at the beginning
-		area_stack_set::iterator it = areas_stack.begin();
-		if(it == areas_stack.end()) return NULL;
-		return *it;
-	}
-
-	NEW_ai_node_t* buildPath(area_item* lastArea) {
-		NEW_ai_node_t* last_node = createNewAiNode(target);
-		nodes.insert(last_node);
-		area_item* a = lastArea;
-
-		while(a != NULL) {
-			NEW_ai_node_t* node = createNewAiNode(a->area.getCenter());
-			node->psNext = last_node;
-			last_node->psPrev = node;
-			nodes.insert(node);
-			last_node = node;
-
-			node = createNewAiNode(a->getConnectorPointForArea(a->lastArea));
-			node->psNext = last_node;
-			last_node->psPrev = node;
-			nodes.insert(node);
-			last_node = node;
-
-			a = a->lastArea;
-		}
-
-		return last_node;
-	}
-
-	// it searches for the path (dynamic algo, sort of A*)
-	NEW_ai_node_t* findPath(VectorD2<int> start) {
-		areas_stack.clear();
-		addAreaNode(start, NULL);
-
-		while(areas_stack.size() > 0) {
-			SDL_Delay(1); // lower priority to this thread
-			if(shouldBreakThread() || shouldRestartThread() || !game.gameMap()->getCreated()) return NULL;
-
-			area_item* a = getBestArea();
-			areas_stack.erase(a);
-
-			// can we just finish with the search?
-			game.gameMap()->lockFlags(false);
-			if(traceWormLine(target, a->area.getCenter())) {
-				game.gameMap()->unlockFlags(false);
-				// yippieh!
-				return buildPath(a);
-			}
-			game.gameMap()->unlockFlags(false);
-
-			a->process();
-		}
-
-		return NULL;
-	}
-
-public:
-
-	// add new area as a node to path
-	// start is location (so an area surrounding start is searched)
-	void addAreaNode(VectorD2<int> start, area_item* lastArea) {
-
-		// is the start inside of the map?
-		if(start.x < 0 || (uint)start.x >= game.gameMap()->GetWidth()
-		|| start.y < 0 || (uint)start.y >= game.gameMap()->GetHeight())
-			return;
-
-		// look around for an existing area here
-		area_item* a = getArea(start);
-		if(a) { // we found an area which includes this point
-			if(a->expected_min_total_dist() > a->expected_min_total_dist(lastArea)) {
-				areas_stack.erase(a);
-				a->setLastArea(lastArea);
-				areas_stack.insert(a);
-			}
-			return;
-		}
-
-		// get the max area (rectangle) around us
-		game.gameMap()->lockFlags(false);
-		SquareMatrix<int> area = getMaxFreeArea(start, PX_ROCK);
-		game.gameMap()->unlockFlags(false);
-		// add only if area is big enough
-		if(area.v2.x-area.v1.x >= wormsize && area.v2.y-area.v1.y >= wormsize) {
-			a = new area_item(this, area);
-			a->initChecklists();
-			a->setLastArea(lastArea);
-			areas.insert(a);
-			areas_stack.insert(a);
-			// and search
-		}
-	}
-
-	// this function will start the search, if it was not started right now
-	// WARNING: the searcher-thread will clear all current saved nodes
-	bool startThreadSearch() {
-		if(game.state < Game::S_Preparing) {
-			errors << "AI searchpath: cannot search yet, game not ready" << endl;
-			return false;
-		}
-		
-		// if we are still searching, do nothing
-		if(!isReady()) return false;
-
-		// this is the signal to start the search
-		setReady(false);
-		return true;
-	}
-
-private:
-	// main-function used by the thread
-	static Result threadSearch(void* b) {
-
-		searchpath_base* base = (searchpath_base*)b;
-		NEW_ai_node_t* ret;
-
-		while(true) {
-			// sleep a little bit while we have nothing to do...
-			while(base->isReady()) {
-				// was there a break-signal?
-				if(base->shouldBreakThread()) {
-					//printf("got break signal(1) for %i\n", (long)base);
-					return true;
-				}
-				SDL_Delay(100);
-			}
-
-			base->resulted_path = NULL;
-			base->clear(); // this is save and important here, else we would have invalid pointers
-
-			// start the main search
-			ret = base->findPath(base->start);
-
-			// finishing the result
-			base->completeNodesInfo(ret);
-			base->simplifyPath(ret);
-			base->splitUpNodes(ret, NULL);
-			base->resulted_path = ret;
-
-			if(base->shouldRestartThread()) {
-				// HINT: both locks (of shouldRestartThread and the following) are seperated
-				//       this don't make any trouble, because here is the only place where we
-				//       reset it and we have always restart_thread_searching_signal==true here
-				Mutex::ScopedLock lock(base->mutex);
-				base->restart_thread_searching_signal = 0;
-				base->start = base->restart_thread_searching_newdata.start;
-				base->target = base->restart_thread_searching_newdata.target;
-				continue;
-			}
-
-			// we are ready now
-			base->setReady(true);
-		}
-
-		return "should not happen";
-	}
-
-	
-	// HINT: threadSearch is the only function, who should set this to true again!
-	// a set to false means for threadSearch, that it should start the search now
-	void setReady(bool state) {
-		Mutex::ScopedLock lock(mutex);
-		thread_is_ready = state;
-	}
-	
-public:
-	bool isReady() {
-		Mutex::ScopedLock lock(mutex);
-		return thread_is_ready;
-	}
-
-	// WARNING: not thread safe; call isReady before
-	NEW_ai_node_t* resultedPath() {
-		return resulted_path;
-	}
-
-	void restartThreadSearch(VectorD2<int> newstart, VectorD2<int> newtarget) {
-		// set signal
-		Mutex::ScopedLock lock(mutex);
-		thread_is_ready = false;
-		restart_thread_searching_newdata.start = newstart;
-		restart_thread_searching_newdata.target = newtarget;
-		// HINT: the reading of this isn't synchronized
-		restart_thread_searching_signal = 1;
-	}
-
-private:
-	NEW_ai_node_t* resulted_path;
-	ThreadPoolItem* thread;
-	Mutex mutex;
-	bool thread_is_ready;
-	int break_thread_signal;
-	int restart_thread_searching_signal;
-	class start_target_pair { public:
-		VectorD2<int> start, target;
-	} restart_thread_searching_newdata;
-
-	void breakThreadSignal() {
-		// we don't need more thread-safety here, because this will not fail
-		break_thread_signal = 1;
-	}
-
-	bool shouldBreakThread() {
-		return (break_thread_signal != 0);
-	}
-
-public:
-	bool shouldRestartThread() {
-		return (restart_thread_searching_signal != 0);
-	}
-
-private:
-	void completeNodesInfo(NEW_ai_node_t* start) {
-		NEW_ai_node_t* last = NULL;
-		for(NEW_ai_node_t* n = start; n; n = n->psNext) {
-			n->psPrev = last;
-			last = n;
-		}
-	}
-
-	void splitUpNodes(NEW_ai_node_t* start, NEW_ai_node_t* end) {
-		NEW_ai_node_t* tmpnode = NULL;
-		short s1, s2;
-		static const unsigned short dist = 50;
-		for(NEW_ai_node_t* n = start; n && n->psNext && n != end; n = n->psNext) {
-			s1 = (n->fX > n->psNext->fX) ? 1 : -1;
-			s2 = (n->fY > n->psNext->fY) ? 1 : -1;
-			if(s1*(n->fX - n->psNext->fX) > dist || s2*(n->fY - n->psNext->fY) > dist) {
-				tmpnode = new NEW_ai_node_t;
-				if(tmpnode) {
-					nodes.insert(tmpnode);
-					if(s1*(n->fX - n->psNext->fX) >= s2*(n->fY - n->psNext->fY)) {
-						tmpnode->fX = n->fX - s1*dist;
-						tmpnode->fY = n->fY
-							- s1*dist*(n->fY - n->psNext->fY)/(n->fX - n->psNext->fX);
-					} else {
-						tmpnode->fY = n->fY - s2*dist;
-						tmpnode->fX = n->fX
-							- s2*dist*(n->fX - n->psNext->fX)/(n->fY - n->psNext->fY);
-					}
-					tmpnode->psNext = n->psNext;
-					tmpnode->psPrev = n;
-					n->psNext->psPrev = tmpnode;
-					n->psNext = tmpnode;
-				}
-			}
-		}
-	}
-
-
-	void simplifyPath(NEW_ai_node_t* start) {
-		NEW_ai_node_t* node = NULL;
-		NEW_ai_node_t* last_node = NULL;
-		NEW_ai_node_t* closest_node = NULL;
-		unsigned short count = 0;
-		float dist, len;
-
-		// short up
-		for(node = start; node; node = node->psNext)  {
-			len = 0;
-			last_node = node;
-			for(closest_node = node, count = 0; closest_node; closest_node = closest_node->psNext, count++) {
-				len += CVec(closest_node->fX - last_node->fX, closest_node->fY - last_node->fY).GetLength2();
-				dist = CVec(closest_node->fX - node->fX, closest_node->fY - node->fY).GetLength2();
-				if(count >= 3
-				&& dist < len
-				&& traceWormLine(CVec(closest_node->fX,closest_node->fY),CVec(node->fX,node->fY))) {
-					node->psNext = closest_node;
-					closest_node->psPrev = node;
-					len = dist;
-				}
-				last_node = closest_node;
-			}
-		}
-
-		// simplify
-		for(node = start; node; node = node->psNext) {
-			// While we see the two nodes, delete all nodes between them and skip to next node
-			count = 0;
-			while (closest_node && traceWormLine(CVec(closest_node->fX,closest_node->fY),CVec(node->fX,node->fY)))  {
-				if(count >= 2) {
-					node->psNext = closest_node;
-					closest_node->psPrev = node;
-				}
-				closest_node = closest_node->psNext;
-				count++;
-			}
-		}
-	}
-
-}; // class searchpath_base
-
-
 
 ///////////////////
 // Initialize the AI
@@ -897,8 +108,9 @@ bool CWormBotInputHandler::AI_Initialize() {
 	fLastJump = AbsTime();
 	fLastCreated = AbsTime();
 	fLastThink = AbsTime();
+	fPathBudget = (float)MAX(tLXOptions->iBotPathBudget, 100) * 2;
+	fLastPathBudget = tLX->currentTime;
     bStuck = false;
-	bPathFinished = true;
 	iAiGameType = GAM_OTHER;
 	nAITargetType = AIT_NONE;
 	nAIState = AI_THINK;
@@ -913,15 +125,6 @@ bool CWormBotInputHandler::AI_Initialize() {
 	fRopeAttachedTime = 0;
 	fRopeHookFallingTime = 0;
 
-	if(pathSearcher)
-		warnings << "pathSearcher is already initialized" << endl;
-	else
-		pathSearcher = new searchpath_base;
-	if(!pathSearcher) {
-		errors << "cannot initialize pathSearcher" << endl;
-		return false;
-	}
-
     return true;
 }
 
@@ -930,16 +133,8 @@ bool CWormBotInputHandler::AI_Initialize() {
 // Shutdown the AI stuff
 void CWormBotInputHandler::AI_Shutdown()
 {
-	if(pathSearcher)
-		delete pathSearcher;
-	pathSearcher = NULL;
-
-	// in every case, the nodes of the current path are not handled by pathSearcher
-	delete_ai_nodes(NEW_psPath);
-
-	NEW_psPath = NULL;
-	NEW_psCurrentNode = NULL;
-	NEW_psLastNode = NULL;
+	AI_CancelPathSearch();
+	AI_SetPath(std::vector<CVec>());
 }
 
 void CWormBotInputHandler::deleteThis() {
@@ -1052,8 +247,8 @@ void CWormBotInputHandler::getInput() {
     if(tLX->currentTime - fLastThink > thinkInterval && nAIState != AI_THINK)
         nAIState = AI_THINK;
 
-	// check more often if the path isn't finished yet
-	if(tLX->currentTime - fLastThink > 0.5 && !bPathFinished)
+	// Our path search has finished, AI_Think() takes the result
+	if(iPathSearch && navSearchPool && navSearchPool->isDone(iPathSearch))
 		nAIState = AI_THINK;
 
     // Make sure the worm is good
@@ -1439,6 +634,8 @@ void CWormBotInputHandler::AI_Think()
       While idling we can walk around to appear non-static, reload weapons or grab a bonus.
     */
 
+	AI_CheckPathSearch();
+
     // Clear the state
     nAITargetWormId = -1;
     psBonusTarget = NULL;
@@ -2877,85 +2074,148 @@ int CWormBotInputHandler::AI_CreatePath(bool force_break)
 	if (nAITargetWormId >= 0 && nAITargetType == AIT_WORM)
 		trg = AI_FindShootingSpot();  // If our target is an enemy, go to the best spot for shooting
 
-	if(force_break) {
-		bPathFinished = false;
-		fSearchStartTime = tLX->currentTime;
-		pathSearcher->restartThreadSearch(m_worm->vPos.get(), trg);
+	// the running search is for an older target
+	if(force_break)
+		AI_CancelPathSearch();
+	else if(AI_CheckPathSearch())
+		return NEW_psPath != NULL;
 
-		return false;
+	if(!force_break) {
+		// don't start a new search, if the current end-node still has direct access to it
+		// however, we have to have access somewhere to the path
+		if(NEW_psLastNode && traceWormLine(CVec(NEW_psLastNode->fX, NEW_psLastNode->fY), trg)) {
+			for(NEW_ai_node_t* node = NEW_psPath; node; node = node->psNext)
+				if(traceWormLine(CVec(node->fX,node->fY),m_worm->vPos,NULL)) {
+					NEW_psCurrentNode = node;
+					AI_AppendPathNode(trg);
+					return true;
+				}
+		}
+
+		// Don't create the path so often!
+		if (tLX->currentTime - fLastCreated <= 0.5f)  {
+			return NEW_psPath != NULL;
+		}
 	}
 
-	// bPathFinished also implicates, that there is currently no search
-	// if bPathFinished is set in the wrong way, this will result in multithreading errors!
-	// TODO: something has to be changed here, because the name bPathFinished doesn't indicates this
-	if(!bPathFinished) {
-		// have we finished a current search?
-		if(pathSearcher->isReady()) {
+	if(!navSearchPool)
+		return NEW_psPath != NULL;
 
-			bPathFinished = true;
-			NEW_ai_node_t* res = pathSearcher->resultedPath();
+	// we get some budget per second and pay for the work of the finished searches;
+	// if we are in debt, we keep the old path for now
+	const float budget = (float)MAX(tLXOptions->iBotPathBudget, 100);
+	if(tLX->currentTime > fLastPathBudget)
+		fPathBudget = MIN(fPathBudget + (tLX->currentTime - fLastPathBudget).seconds() * budget, budget * 2);
+	fLastPathBudget = tLX->currentTime;
+	if(fPathBudget <= 0)
+		return NEW_psPath != NULL;
 
-			// have we found something?
-			if(res) {
-				// in every case, the nodes of the current path are not handled by pathSearcher
-				// so we have to delete it here
-				delete_ai_nodes(NEW_psPath);
+	// the search runs on the worker threads, we get the result with the next AI_Think()
+	iPathSearch = navSearchPool->submit(game.gameMap()->navGraph(), VectorD2<int>(m_worm->vPos.get()),
+										VectorD2<int>((int)trg.x, (int)trg.y), (Uint32)(budget * 2));
+	fLastCreated = tLX->currentTime;
 
-				NEW_psPath = res;
-				NEW_psLastNode = get_last_ai_node(NEW_psPath);
-				NEW_psCurrentNode = NEW_psPath;
+	// without worker threads, it is already finished
+	AI_CheckPathSearch();
+	return NEW_psPath != NULL;
+}
 
-				// prevent it from deleting the current path (it will be deleted, when the new path is found)
-				pathSearcher->removePathFromList(NEW_psPath);
 
+///////////////////
+// Takes the result of our path search if it is finished; true if it is still running
+bool CWormBotInputHandler::AI_CheckPathSearch()
+{
+	if(!iPathSearch || !navSearchPool) return false;
 
-				fLastCreated = tLX->currentTime;
+	NavSearchPool::Result res;
+	if(!navSearchPool->fetch(iPathSearch, res))
+		return true;
+	iPathSearch = 0;
+	fPathBudget -= res.work;
 
-				return true;
+	// keep the old path if we don't find anything
+	if(!res.found)
+		return false;
+	const std::vector< VectorD2<int> >& waypoints = res.path;
+
+	// split up long lines, AI_MoveToTarget() needs some nodes on the way
+	static const float dist = 50;
+	std::vector<CVec> points;
+	points.reserve(waypoints.size() * 2);
+	for(size_t i = 0; i < waypoints.size(); ++i) {
+		CVec p((float)waypoints[i].x, (float)waypoints[i].y);
+		if(i > 0) {
+			const CVec next = p;
+			for(p = points.back(); fabs(next.x - p.x) > dist || fabs(next.y - p.y) > dist; points.push_back(p)) {
+				if(fabs(next.x - p.x) >= fabs(next.y - p.y))
+					p += (next - p) * (dist / fabs(next.x - p.x));
+				else
+					p += (next - p) * (dist / fabs(next.y - p.y));
 			}
-			// we don't find anything, so don't return here, but start a new search
+			p = next;
+		}
+		points.push_back(p);
+	}
 
-		} else { // the searcher is still searching ...
+	AI_SetPath(points);
+	return false;
+}
 
-			// restart search in some cases
-			if(!pathSearcher->shouldRestartThread() && (tLX->currentTime - fSearchStartTime >= 5.0f || !traceWormLine(m_worm->vPos, pathSearcher->start) || !traceWormLine(trg, pathSearcher->target))) {
-				fSearchStartTime = tLX->currentTime;
-				pathSearcher->restartThreadSearch(m_worm->vPos.get(), trg);
-			}
 
-			return false;
-		}
-	}
+void CWormBotInputHandler::AI_CancelPathSearch()
+{
+	if(iPathSearch && navSearchPool)
+		navSearchPool->cancel(iPathSearch);
+	iPathSearch = 0;
+}
 
-	// don't start a new search, if the current end-node still has direct access to it
-	// however, we have to have access somewhere to the path
-	if(NEW_psLastNode && traceWormLine(CVec(NEW_psLastNode->fX, NEW_psLastNode->fY), trg)) {
-		for(NEW_ai_node_t* node = NEW_psPath; node; node = node->psNext)
-			if(traceWormLine(CVec(node->fX,node->fY),m_worm->vPos,NULL)) {
-				NEW_psCurrentNode = node;
-				NEW_psLastNode->psNext = createNewAiNode(trg.x, trg.y, NULL, NEW_psLastNode);
-				NEW_psLastNode = NEW_psLastNode->psNext;
-				return true;
-			}
-	}
 
-	// Don't create the path so often!
-	if (tLX->currentTime - fLastCreated <= 0.5f)  {
-		return NEW_psPath != NULL;
+///////////////////
+// Sets the path; the nodes are in one array
+void CWormBotInputHandler::AI_SetPath(const std::vector<CVec>& points, size_t current)
+{
+	NEW_pathNodes.clear();
+	// some space for AI_AppendPathNode(), the node pointers must stay valid
+	NEW_pathNodes.reserve(points.size() + 16);
+	NEW_pathNodes.resize(points.size());
+	for(size_t i = 0; i < points.size(); ++i) {
+		NEW_pathNodes[i].fX = points[i].x;
+		NEW_pathNodes[i].fY = points[i].y;
+		NEW_pathNodes[i].psPrev = (i > 0) ? &NEW_pathNodes[i - 1] : NULL;
+		NEW_pathNodes[i].psNext = (i + 1 < points.size()) ? &NEW_pathNodes[i + 1] : NULL;
 	}
 
-	// if we are here, we want to start a new search
-	// the searcher-thread is currently ready
-	bPathFinished = false;
+	NEW_psPath = points.empty() ? NULL : &NEW_pathNodes.front();
+	NEW_psLastNode = points.empty() ? NULL : &NEW_pathNodes.back();
+	NEW_psCurrentNode = points.empty() ? NULL : &NEW_pathNodes[MIN(current, points.size() - 1)];
+}
 
-	// start a new search
-	fSearchStartTime = tLX->currentTime;
-	pathSearcher->target.x = (int)trg.x;
-	pathSearcher->target.y = (int)trg.y;
-	pathSearcher->start = VectorD2<int>(m_worm->vPos.get());
-	pathSearcher->startThreadSearch();
 
-	return false;
+///////////////////
+// Adds a node at the end of the path
+void CWormBotInputHandler::AI_AppendPathNode(CVec p)
+{
+	if(NEW_pathNodes.size() == NEW_pathNodes.capacity()) {
+		// no space left, move the path to a bigger array
+		std::vector<CVec> points;
+		points.reserve(NEW_pathNodes.size() + 1);
+		for(size_t i = 0; i < NEW_pathNodes.size(); ++i)
+			points.push_back(CVec(NEW_pathNodes[i].fX, NEW_pathNodes[i].fY));
+		points.push_back(p);
+		AI_SetPath(points, NEW_psCurrentNode ? (NEW_psCurrentNode - &NEW_pathNodes[0]) : 0);
+		return;
+	}
+
+	NEW_ai_node_t node;
+	node.fX = p.x;
+	node.fY = p.y;
+	node.psPrev = NEW_psLastNode;
+	NEW_pathNodes.push_back(node);
+	NEW_psLastNode = &NEW_pathNodes.back();
+	if(NEW_psLastNode->psPrev)
+		NEW_psLastNode->psPrev->psNext = NEW_psLastNode;
+	else
+		NEW_psPath = NEW_psCurrentNode = NEW_psLastNode;
 }
 
 
@@ -4039,52 +3299,6 @@ CVec CWormBotInputHandler::AI_FindShootingSpot()
 	return possible_pos;
 }
 
-NEW_ai_node_t* get_last_ai_node(NEW_ai_node_t* n) {
-	if(!n) return NULL;
-	for(;n->psNext;n=n->psNext) {}
-	return n;
-}
-
-void delete_ai_nodes(NEW_ai_node_t* start) {
-	if(!start) return;
-	delete_ai_nodes(start->psNext);
-	delete start;
-}
-
-void delete_ai_nodes(NEW_ai_node_t* start, NEW_ai_node_t* end) {
-	if(!start || start == end) return;
-	delete_ai_nodes(start->psNext, end);
-	delete start;
-}
-
-float get_ai_nodes_length(NEW_ai_node_t* start) {
-	float l,dx,dy;
-	for(l=0;start;start=start->psNext) {
-		if(start->psNext) {
-			dx = start->fX - start->psNext->fX;
-			dy = start->fY - start->psNext->fY;
-			l += sqrt(dx*dx + dy*dy);
-		} else
-			break;
-	}
-	return l;
-}
-
-float get_ai_nodes_length2(NEW_ai_node_t* start) {
-	float l,dx,dy;
-	for(l=0;start;start=start->psNext) {
-		if(start->psNext) {
-			dx = start->fX - start->psNext->fX;
-			dy = start->fY - start->psNext->fY;
-			l += dx*dx + dy*dy;
-		} else
-			break;
-	}
-	return l;
-}
-
-
-
 struct BotWormType : WormType {
 	CWormInputHandler* createInputHandler(CWorm* w) { return new CWormBotInputHandler(w); }
 	int toInt() { return 1; }
@@ -4093,11 +3307,11 @@ WormType* PRF_COMPUTER = &PRF_COMPUTER_instance;
 
 CWormBotInputHandler::CWormBotInputHandler(CWorm* w) : CWormInputHandler(w) {
 	nAIState = AI_THINK;
+	iPathSearch = 0;
     //fLastWeaponSwitch = AbsTime();
 	NEW_psPath = NULL;
 	NEW_psCurrentNode = NULL;
 	NEW_psLastNode = NULL;
-	pathSearcher = NULL;	
 	fLastFace = 0;
 	fBadAimTime = 0;
 	nAITargetWormId = -1;
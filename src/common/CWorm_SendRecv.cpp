@@ -92,7 +92,7 @@ void CWorm::writePacket(CBytestream *bs, bool fromServer, CServerConnection* rec
 
 	// Velocity
 	const Version& versionOfReceiver = fromServer ? receiver->getClientVersion() : cClient->getServerVersion();
-	if(tState.get().bShoot || versionOfReceiver >= OLXBetaVersion(0,57,5)) {
+	if(tState.get().bShoot || packetHasVelocity(versionOfReceiver)) {
 		CVec v = vVelocity;
 		bs->writeInt16( (Sint16)v.x );
 		bs->writeInt16( (Sint16)v.y );
@@ -55,6 +55,22 @@
 #include "EventQueue.h"
 #include "client/ClientConnectionRequestInfo.h"
 #include "gusanos/luaapi/context.h"
+#include "ProjectileGrid.h"
+#include "ProjTerrainCollision.h"
+#include "TerrainSnapshot.h"
+#include "GameStateArena.h"
+#include "NavGraph.h"
+#include "MapRenderCache.h"
+#include "MiniMapPyramid.h"
+#include "NavSearchPool.h"
+#include "WormUpdateScheduler.h"
+#include "NetEmulator.h"
+#include "LoadTest.h"
+#include "game/GameState.h"
+#ifndef DEDICATED_ONLY
+#include "gusanos/blitters/blitters.h"
+#include "SurfaceBlit.h"
+#endif
 
 
 CmdLineIntf& stdoutCLI() {
@@ -2109,6 +2125,21 @@ void Cmd_getWormPing::exec(CmdLineIntf* caller, const std::vector<std::string>&
 	caller->pushReturnArg(itoa(w->getClient()->getChannel()->getPing()));
 }
 
+COMMAND(getWormInterestStats, "get the replication stats of the worm's client: updates sent every frame, sent less often, delayed", "id", 1, 1);
+void Cmd_getWormInterestStats::exec(CmdLineIntf* caller, const std::vector<std::string>& params) {
+	CWorm* w = getWorm(caller, params[0]); if(!w) return;
+
+	if(!w->getClient()) {
+		caller->writeMsg("worm " + itoa(w->getID()) + " has no client");
+		return;
+	}
+
+	const ClientInterest::Stats& s = w->getClient()->getInterest()->stats();
+	caller->pushReturnArg(itoa(s.sent));
+	caller->pushReturnArg(itoa(s.lowered));
+	caller->pushReturnArg(itoa(s.deferred));
+}
+
 COMMAND(getWormSkin, "get worm skin", "id", 1, 1);
 void Cmd_getWormSkin::exec(CmdLineIntf* caller, const std::vector<std::string>& params) {
 	CWorm* w = getWorm(caller, params[0]); if(!w) return;
@@ -2296,7 +2327,162 @@ void Cmd_createDummyTask::exec(CmdLineIntf* caller, const std::vector<std::strin
 	};
 	taskManager->start(new DummyTask(), queue);
 }
+
+COMMAND(benchProjGrid, "benchmark projectile collision grid", "[#projectiles]", 0, 1);
+void Cmd_benchProjGrid::exec(CmdLineIntf* caller, const std::vector<std::string>& params) {
+	int num = 2000;
+	if(params.size() > 0) num = from_string<int>(params[0]);
+	ProjectileGrid::benchmark(num);
+}
+
+COMMAND(testProjTerrainColl, "compare the projectile terrain collision kernels", "[#projectiles]", 0, 1);
+void Cmd_testProjTerrainColl::exec(CmdLineIntf* caller, const std::vector<std::string>& params) {
+	int num = 2000;
+	if(params.size() > 0) num = from_string<int>(params[0]);
+	if(!ProjTerrainColl::test(num))
+		caller->writeMsg("ProjTerrainColl: kernels differ from reference!");
+}
+
+COMMAND(benchTerrainSnapshot, "benchmark the NewNet terrain save/restore", "[#holes per tick]", 0, 1);
+void Cmd_benchTerrainSnapshot::exec(CmdLineIntf* caller, const std::vector<std::string>& params) {
+	int num = 20;
+	if(params.size() > 0) num = from_string<int>(params[0]);
+	TerrainSnapshot::benchmark(num);
+}
+
+COMMAND(stressGameStateArena, "test the NewNet state save/load and measure rollback depth vs. frame time", "[#objects]", 0, 1);
+void Cmd_stressGameStateArena::exec(CmdLineIntf* caller, const std::vector<std::string>& params) {
+	int num = 2000;
+	if(params.size() > 0) num = from_string<int>(params[0]);
+	if(!NewNet::TestStateRoundTrip())
+		caller->writeMsg("NewNet: the saved state doesn't restore the game objects!");
+	GameStateArena::stressTest(num);
+}
+
+COMMAND(benchNavGraph, "benchmark the bot pathfinding graph", "[#queries]", 0, 1);
+void Cmd_benchNavGraph::exec(CmdLineIntf* caller, const std::vector<std::string>& params) {
+	int num = 2000;
+	if(params.size() > 0) num = from_string<int>(params[0]);
+	NavGraph::benchmark(num);
+}
+
+COMMAND(benchBytestream, "benchmark building the worm update packets of the server", "[#clients] [#worms]", 0, 2);
+void Cmd_benchBytestream::exec(CmdLineIntf* caller, const std::vector<std::string>& params) {
+	int clients = 32, worms = 32;
+	if(params.size() > 0) clients = from_string<int>(params[0]);
+	if(params.size() > 1) worms = from_string<int>(params[1]);
+	CBytestream::Benchmark(clients, worms);
+}
+
+COMMAND(benchNetIO, "benchmark sending datagrams over the loopback with the normal and the batched socket I/O", "[#packets] [packetsize]", 0, 2);
+void Cmd_benchNetIO::exec(CmdLineIntf* caller, const std::vector<std::string>& params) {
+	int packets = 100000, packetSize = 200;
+	if(params.size() > 0) packets = from_string<int>(params[0]);
+	if(params.size() > 1) packetSize = from_string<int>(params[1]);
+	BenchmarkNetworkIO(packets, packetSize);
+}
+
+COMMAND(simWormUpdates, "simulate the worm update bandwidth per client with and without the update scheduling", "[#players] [rate]", 0, 2);
+void Cmd_simWormUpdates::exec(CmdLineIntf* caller, const std::vector<std::string>& params) {
+	int players = 32;
+	float rate = 7500;
+	if(params.size() > 0) players = from_string<int>(params[0]);
+	if(params.size() > 1) rate = from_string<float>(params[1]);
+	WormUpdateScheduler::simulate(players, rate);
+}
+
+COMMAND(benchGameState, "benchmark the game state diff and its encoding for the current game", "[iterations]", 0, 1);
+void Cmd_benchGameState::exec(CmdLineIntf* caller, const std::vector<std::string>& params) {
+	int iterations = 1000;
+	if(params.size() > 0) iterations = from_string<int>(params[0]);
+	GameState::benchmark(iterations);
+}
+
+COMMAND(testChannelLossyLink, "compare the throughput and latency of the reliable channels over a simulated lossy link", "[loss%] [lagMin] [lagMax] [reorder%]", 0, 4);
+void Cmd_testChannelLossyLink::exec(CmdLineIntf* caller, const std::vector<std::string>& params) {
+	int loss = 10, lagMin = 50, lagMax = 200, reorder = 5;
+	if(params.size() > 0) loss = from_string<int>(params[0]);
+	if(params.size() > 1) lagMin = from_string<int>(params[1]);
+	if(params.size() > 2) lagMax = from_string<int>(params[2]);
+	if(params.size() > 3) reorder = from_string<int>(params[3]);
+	TestCChannelLossyLink(loss, lagMin, lagMax, reorder);
+}
+
+#ifndef DEDICATED_ONLY
+COMMAND(testBlitters, "compare the SSE2/AVX2 blitters with the C ones", "[iterations]", 0, 1);
+void Cmd_testBlitters::exec(CmdLineIntf* caller, const std::vector<std::string>& params) {
+	int iterations = 200;
+	if(params.size() > 0) iterations = from_string<int>(params[0]);
+	if(!Blitters::test(iterations))
+		caller->writeMsg("Blitters: SIMD blitters differ from C!");
+}
+
+COMMAND(benchBlitters, "benchmark the C, SSE2 and AVX2 blitters", "[iterations]", 0, 1);
+void Cmd_benchBlitters::exec(CmdLineIntf* caller, const std::vector<std::string>& params) {
+	int iterations = 100;
+	if(params.size() > 0) iterations = from_string<int>(params[0]);
+	Blitters::benchmark(iterations);
+}
+
+COMMAND(benchSurfaceBlit, "benchmark the DrawImageAdv kernels against SDL_BlitSurface", "[iterations]", 0, 1);
+void Cmd_benchSurfaceBlit::exec(CmdLineIntf* caller, const std::vector<std::string>& params) {
+	int iterations = 100;
+	if(params.size() > 0) iterations = from_string<int>(params[0]);
+	if(!SurfaceBlit::benchmark(iterations))
+		caller->writeMsg("SurfaceBlit: SSE2 kernels differ from scalar!");
+}
 #endif
+#endif
+
+COMMAND(mapDirtyRectStats, "show how many minimap update pixels were saved by merging terrain changes", "", 0, 0);
+void Cmd_mapDirtyRectStats::exec(CmdLineIntf* caller, const std::vector<std::string>& params) {
+	const CMap::DirtyRectStats& s = CMap::dirtyRectStats();
+	caller->writeMsg("requests: " + itoa(s.requests) + ", flushes: " + itoa(s.flushes));
+	caller->writeMsg("pixels requested: " + itoa(s.requestedPixels) + ", updated: " + itoa(s.updatedPixels)
+		+ ", saved: " + itoa(s.requestedPixels - MIN(s.requestedPixels, s.updatedPixels)));
+	const MiniMapPyramid::Stats& p = MiniMapPyramid::stats();
+	caller->writeMsg("pyramid builds: " + itoa(p.builds) + ", updates: " + itoa(p.updates)
+		+ ", updated cells: " + itoa(p.updatedCells) + ", drawn pixels: " + itoa(p.drawnPixels));
+}
+
+COMMAND(mapTileCacheStats, "show how many map tiles were drawn and rebuilt by the render cache", "", 0, 0);
+void Cmd_mapTileCacheStats::exec(CmdLineIntf* caller, const std::vector<std::string>& params) {
+	const MapRenderCache::Stats& s = MapRenderCache::stats();
+	caller->writeMsg(std::string("enabled: ") + (MapRenderCache::enabled() ? "yes" : "no") + ", draws: " + itoa(s.draws)
+		+ ", invalidations: " + itoa(s.invalidations));
+	caller->writeMsg("tiles drawn: " + itoa(s.tilesDrawn) + ", rebuilt: " + itoa(s.tilesBuilt));
+	if(game.gameMap() && game.gameMap()->isLoaded()) {
+		const MapRenderCache& c = game.gameMap()->renderCache();
+		caller->writeMsg("current map: " + itoa(c.builtTileCount()) + " tiles built, " + itoa(c.memorySize() / 1024) + " KB");
+	}
+}
+
+COMMAND(navGraphStats, "show the bot pathfinding statistics of the current map", "", 0, 0);
+void Cmd_navGraphStats::exec(CmdLineIntf* caller, const std::vector<std::string>& params) {
+	if(!game.gameMap() || !game.gameMap()->isLoaded()) {
+		caller->writeMsg("no map loaded");
+		return;
+	}
+	const NavGraph::Stats s = game.gameMap()->navGraph()->stats();
+	caller->writeMsg("queries: " + itoa(s.queries) + ", from cache: " + itoa(s.cacheHits) + ", failed: " + itoa(s.failed)
+		+ ", aborted: " + itoa(s.aborted));
+	caller->writeMsg("expanded portals: " + itoa(s.expandedPortals) + ", cells: " + itoa(s.expandedCells));
+	caller->writeMsg("updated cells: " + itoa(s.updatedCells) + ", clusters: " + itoa(s.updatedClusters)
+		+ ", portal rebuilds: " + itoa(s.portalRebuilds));
+	if(navSearchPool) {
+		const NavSearchPool::Stats p = navSearchPool->stats();
+		caller->writeMsg("searches submitted: " + itoa(p.submitted) + ", finished: " + itoa(p.finished)
+			+ ", cancelled: " + itoa(p.cancelled) + ", rejected: " + itoa(p.rejected) + ", work: " + itoa(p.work));
+	}
+}
+
+COMMAND(gameStateStats, "show the size of the sent game state updates compared to the old encoding", "", 0, 0);
+void Cmd_gameStateStats::exec(CmdLineIntf* caller, const std::vector<std::string>& params) {
+	const GameStateUpdates::Stats& s = GameStateUpdates::stats;
+	caller->writeMsg("updates: " + itoa(s.updates) + ", attribs: " + itoa(s.attrs));
+	caller->writeMsg("bytes: " + itoa(s.bytes) + ", with the old encoding: " + itoa(s.uncompressedBytes)
+		+ (s.uncompressedBytes > 0 ? " (" + itoa(s.bytes * 100 / s.uncompressedBytes) + "%)" : ""));
+}
 
 COMMAND(dumpConnections, "dump connections of server", "", 0, 0);
 void Cmd_dumpConnections::exec(CmdLineIntf* caller, const std::vector<std::string>& params) {
@@ -2309,6 +2495,70 @@ void Cmd_dumpGameSettings::exec(CmdLineIntf* caller, const std::vector<std::stri
 	gameSettings.dumpAllLayers();
 }
 
+COMMAND(netEmulate, "emulate latency, jitter, loss, duplication and reordering of the received UDP datagrams; without parameters it shows the status", "[addr|*|off] [latency] [jitter] [loss%] [duplicate%] [reorder%]", 0, 6);
+void Cmd_netEmulate::exec(CmdLineIntf* caller, const std::vector<std::string>& params) {
+	if(params.empty()) {
+		NetEmulator::printStatus();
+		return;
+	}
+	if(stringcaseequal(params[0], "off")) {
+		NetEmulator::resetConditions();
+		return;
+	}
+	NetConditions cond;
+	if(params.size() > 1) cond.latency = from_string<int>(params[1]);
+	if(params.size() > 2) cond.jitter = from_string<int>(params[2]);
+	if(params.size() > 3) cond.loss = from_string<float>(params[3]);
+	if(params.size() > 4) cond.duplicate = from_string<float>(params[4]);
+	if(params.size() > 5) cond.reorder = from_string<float>(params[5]);
+	NetEmulator::setConditions(params[0], cond);
+	caller->writeMsg(params[0] + ": " + (cond.isNone() ? "no conditions" : cond.toString()));
+}
+
+COMMAND(netCapture, "record all sent and received UDP datagrams to a file", "filename|stop", 1, 1);
+void Cmd_netCapture::exec(CmdLineIntf* caller, const std::vector<std::string>& params) {
+	if(stringcaseequal(params[0], "stop")) {
+		NetEmulator::stopCapture();
+		return;
+	}
+	Result res = NetEmulator::startCapture(params[0]);
+	if(!res) caller->writeMsg(res.humanErrorMsg);
+}
+
+COMMAND(netReplay, "replay the received datagrams of a capture into the UDP socket with the captured port", "filename|stop [port]", 1, 2);
+void Cmd_netReplay::exec(CmdLineIntf* caller, const std::vector<std::string>& params) {
+	if(stringcaseequal(params[0], "stop")) {
+		NetEmulator::stopReplay();
+		return;
+	}
+	int port = 0;
+	if(params.size() > 1) port = from_string<int>(params[1]);
+	Result res = NetEmulator::startReplay(params[0], (NetworkSocket::Port)port);
+	if(!res) caller->writeMsg(res.humanErrorMsg);
+}
+
+COMMAND(loadTest, "connect headless load test clients to our server and measure it while the game is played; without parameters it shows the status", "[#clients|stop] [seconds] [reportfile] [quit]", 0, 4);
+void Cmd_loadTest::exec(CmdLineIntf* caller, const std::vector<std::string>& params) {
+	if(params.empty()) {
+		LoadTest::printStatus();
+		return;
+	}
+	if(stringcaseequal(params[0], "stop")) {
+		LoadTest::stop();
+		return;
+	}
+	float seconds = 60;
+	if(params.size() > 1) seconds = from_string<float>(params[1]);
+	const bool quit = params.size() > 3 && stringcaseequal(params[3], "quit");
+	if(!LoadTest::start(from_string<int>(params[0]), seconds, (params.size() > 2) ? params[2] : "", quit))
+		caller->writeMsg("cannot start the load test", CNC_WARNING);
+}
+
+COMMAND(netCaptureStats, "show the datagrams and bandwidth per address of a capture", "filename", 1, 1);
+void Cmd_netCaptureStats::exec(CmdLineIntf* caller, const std::vector<std::string>& params) {
+	NetEmulator::captureStats(params[0]);
+}
+
 #ifdef MEMSTATS
 COMMAND(printMemStats, "print memory stats", "", 0, 0);
 void Cmd_printMemStats::exec(CmdLineIntf* caller, const std::vector<std::string>& params) {
@@ -610,7 +610,8 @@ bool CUdpFileDownloader::receive( CBytestream * bs )
 		return true;	// Receive finished (due to error)
 	};
 	//notes << "CFileDownloaderInGame::receive() chunk " << chunkSize << endl;
-	sData.append( bs->readData(chunkSize) );
+	const CBytestream::View chunk = bs->readDataView(chunkSize);
+	sData.append( chunk.ptr, chunk.size );
 	if( Finished )
 	{
 		tPrevState = tState;
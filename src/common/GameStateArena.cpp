@@ -0,0 +1,262 @@
+/*
+ *  GameStateArena.cpp
+ *  OpenLieroX
+ *
+ *  ring buffer of serialized game states for the NewNet rollback
+ *
+ *  code under LGPL
+ *
+ */
+
+#include "GameStateArena.h"
+#include "TerrainSnapshot.h"
+#include "NewNetEngine.h"
+#include "MathLib.h"
+#include "Timer.h"
+#include "Debug.h"
+
+
+GameStateArena::GameStateArena() : m_slotSize(0), m_historyLen(0), m_newest(0), m_count(0) {}
+
+void GameStateArena::init(size_t historyLen, size_t slotSize) {
+	clear();
+	if(historyLen == 0) return;
+	m_historyLen = historyLen;
+	m_slotSize = (MAX(slotSize, (size_t)1024) + sizeof(SlotHeader) + 15) & ~(size_t)15;
+	m_data.resize(m_historyLen * m_slotSize);
+}
+
+void GameStateArena::clear() {
+	m_data.clear();
+	m_slotSize = 0;
+	m_historyLen = 0;
+	m_newest = m_count = 0;
+}
+
+void GameStateArena::beginTick(Uint64 tick) {
+	if(m_historyLen == 0) {
+		errors << "GameStateArena::beginTick: not initialised" << endl;
+		return;
+	}
+	if(m_count > 0) {
+		m_newest = (m_newest + 1) % m_historyLen;
+		m_count = MIN(m_count + 1, m_historyLen);
+	}
+	else
+		m_count = 1;
+
+	SlotHeader* h = header(m_newest);
+	h->tick = tick;
+	h->size = 0;
+}
+
+void GameStateArena::write(const void* data, size_t size) {
+	if(m_count == 0) return;
+	SlotHeader* h = header(m_newest);
+	if(sizeof(SlotHeader) + h->size + size > m_slotSize) {
+		grow(sizeof(SlotHeader) + h->size + size);
+		h = header(m_newest);
+	}
+	memcpy(&m_data[m_newest * m_slotSize + sizeof(SlotHeader) + h->size], data, size);
+	h->size += size;
+}
+
+size_t GameStateArena::tell() const {
+	if(m_count == 0) return 0;
+	return header(m_newest)->size;
+}
+
+void GameStateArena::patch(size_t pos, const void* data, size_t size) {
+	if(m_count == 0 || pos + size > header(m_newest)->size) {
+		errors << "GameStateArena::patch: invalid position " << pos << endl;
+		return;
+	}
+	memcpy(&m_data[m_newest * m_slotSize + sizeof(SlotHeader) + pos], data, size);
+}
+
+void GameStateArena::grow(size_t minSlotSize) {
+	const size_t newSlotSize = (MAX(m_slotSize * 2, minSlotSize) + 15) & ~(size_t)15;
+	notes << "GameStateArena: growing slots to " << newSlotSize << " bytes" << endl;
+	std::vector<char> data(m_historyLen * newSlotSize);
+	for(size_t i = 0; i < m_historyLen; ++i)
+		memcpy(&data[i * newSlotSize], &m_data[i * m_slotSize], sizeof(SlotHeader) + header(i)->size);
+	m_data.swap(data);
+	m_slotSize = newSlotSize;
+}
+
+GameStateArena::Reader GameStateArena::reader(size_t age) const {
+	if(age >= m_count) {
+		errors << "GameStateArena::reader: tick " << age << " back is not saved" << endl;
+		return Reader();
+	}
+	const size_t ring = ringIndex(age);
+	return Reader(&m_data[ring * m_slotSize + sizeof(SlotHeader)], header(ring)->size);
+}
+
+Uint64 GameStateArena::tickAt(size_t age) const {
+	if(age >= m_count) return 0;
+	return header(ringIndex(age))->tick;
+}
+
+void GameStateArena::dropNewest(size_t n) {
+	n = MIN(n, m_count);
+	m_count -= n;
+	if(m_historyLen > 0)
+		m_newest = (m_newest + m_historyLen - n) % m_historyLen;
+}
+
+
+///////////////////
+// Stress test: rollback depth vs. frame time
+
+namespace {
+	struct StressObj {
+		float x, y, vx, vy;
+	};
+
+	struct StressWorld {
+		std::vector<StressObj> objs;
+		Uint32 random;
+		std::vector<unsigned char> material;
+		std::vector<unsigned char*> lines;
+		std::vector<Uint8> image;
+		int w, h, imageScale, bpp;
+		TerrainSnapshot::Planes planes;
+
+		Uint32 nextRandom() { random = random * 1103515245 + 12345; return random >> 8; }
+
+		void tick(TerrainHistory& terrain) {
+			const int hole = 6;
+			for(size_t i = 0; i < objs.size(); ++i) {
+				StressObj& o = objs[i];
+				o.vy += 0.05f;
+				o.x += o.vx; o.y += o.vy;
+				if(o.x < 0 || o.x >= w) { o.vx = -o.vx; o.x = CLAMP(o.x, 0.0f, (float)(w - 1)); }
+				if(o.y < 0 || o.y >= h) { o.vy = -o.vy * 0.9f; o.y = CLAMP(o.y, 0.0f, (float)(h - 1)); }
+				if(lines[(int)o.y][(int)o.x] == 0) continue;
+
+				// hit dirt: carve a hole and bounce off randomly
+				const int x1 = MAX((int)o.x - hole / 2, 0), y1 = MAX((int)o.y - hole / 2, 0);
+				const int x2 = MIN(x1 + hole, w), y2 = MIN(y1 + hole, h);
+				terrain.touch(x1, y1, x2 - x1, y2 - y1, planes);
+				for(int y = y1; y < y2; ++y) {
+					memset(lines[y] + x1, 0, x2 - x1);
+					for(int k = 0; k < imageScale; ++k)
+						memset(&image[((size_t)y * imageScale + k) * planes.imagePitch + (size_t)x1 * imageScale * bpp], 0, (x2 - x1) * imageScale * bpp);
+				}
+				o.vx = (float)(nextRandom() % 200) / 100.0f - 1.0f;
+				o.vy = -(float)(nextRandom() % 200) / 100.0f;
+			}
+		}
+
+		void save(GameStateArena& arena, Uint64 t) const {
+			arena.beginTick(t);
+			arena.write(random);
+			const Uint32 n = (Uint32)objs.size();
+			arena.write(n);
+			arena.write(&objs[0], n * sizeof(StressObj));
+		}
+
+		bool load(GameStateArena::Reader r) {
+			Uint32 n = 0;
+			if(!r.read(random) || !r.read(n)) return false;
+			objs.resize(n);
+			return r.read(&objs[0], n * sizeof(StressObj));
+		}
+
+		Uint32 checksum() const {
+			Uint32 c = random;
+			for(size_t i = 0; i < objs.size(); ++i)
+				c = c * 31 + (Uint32)(int)(objs[i].x * 16) + (Uint32)(int)(objs[i].y * 16) * 0x10000;
+			for(size_t i = 0; i < material.size(); i += 7)
+				c = c * 3 + material[i];
+			return c;
+		}
+	};
+}
+
+void GameStateArena::stressTest(int numObjs) {
+	const int frames = 300;
+	// 0 is the reference run without rollbacks
+	const int depths[] = { 0, 1, 2, 4, 8, 16, 32, 64 };
+	const size_t historyLen = 64;
+	numObjs = CLAMP(numObjs, 1, 100000);
+	notes << "GameStateArena stress test: " << numObjs << " objects, " << frames << " frames per rollback depth, tick "
+		<< NewNet::TICK_TIME << "ms" << endl;
+
+	TimeDiff baseTime;
+	for(size_t d = 0; d < sizeof(depths) / sizeof(depths[0]); ++d) {
+		const int depth = depths[d];
+
+		// new world for every run, so that all runs do the same work
+		StressWorld world;
+		world.w = 1024; world.h = 768; world.imageScale = 2; world.bpp = 4;
+		world.random = 1;
+		world.material.resize(world.w * world.h);
+		world.lines.resize(world.h);
+		for(int y = 0; y < world.h; ++y) {
+			world.lines[y] = &world.material[y * world.w];
+			for(int x = 0; x < world.w; ++x)
+				world.lines[y][x] = (y > world.h / 3 && ((x / 32 + y / 32) % 3) != 0) ? 1 : 0;
+		}
+		world.planes.matLines = &world.lines[0];
+		world.planes.imagePitch = world.w * world.imageScale * world.bpp;
+		world.image.resize((size_t)world.planes.imagePitch * world.h * world.imageScale, 0x55);
+		world.planes.image = &world.image[0];
+		world.objs.resize(numObjs);
+		for(int i = 0; i < numObjs; ++i) {
+			StressObj& o = world.objs[i];
+			o.x = (float)(world.nextRandom() % world.w); o.y = (float)(world.nextRandom() % (world.h / 3));
+			o.vx = (float)(world.nextRandom() % 400) / 100.0f - 2.0f; o.vy = 0;
+		}
+
+		GameStateArena arena;
+		arena.init(historyLen);
+		TerrainHistory terrain;
+		terrain.init(world.w, world.h, world.imageScale, world.bpp, historyLen);
+		std::vector<int> rects;
+		size_t mismatches = 0;
+		Uint64 t = 0;
+
+		const AbsTime start = GetTime();
+		for(int f = 0; f < frames; ++f) {
+			// normal tick
+			world.save(arena, t); terrain.beginTick();
+			world.tick(terrain);
+			t++;
+
+			if(depth == 0 || (int)arena.count() < depth) continue;
+
+			// late input arrived: go back depth ticks and simulate them again
+			const bool check = (f % 20) == 0;
+			const Uint32 before = check ? world.checksum() : 0;
+
+			rects.clear();
+			terrain.rollback(depth, world.planes, rects);
+			world.load(arena.reader(depth - 1));
+			arena.dropNewest(depth - 1);
+
+			for(int i = 0; i < depth; ++i) {
+				if(i > 0) { world.save(arena, t - depth + i); terrain.beginTick(); }
+				world.tick(terrain);
+			}
+
+			if(check && world.checksum() != before)
+				mismatches++;
+		}
+		const TimeDiff runTime = GetTime() - start;
+
+		if(depth == 0) {
+			baseTime = runTime;
+			notes << "GameStateArena: no rollback: " << (runTime.milliseconds() * 1000.0 / frames) << " us per frame" << endl;
+			continue;
+		}
+		if(mismatches)
+			errors << "GameStateArena: depth " << depth << ": " << mismatches << " re-simulations differ" << endl;
+		const double frameUs = runTime.milliseconds() * 1000.0 / frames;
+		const double overheadUs = ((double)runTime.milliseconds() - (double)baseTime.milliseconds()) * 1000.0 / frames;
+		notes << "GameStateArena: depth " << depth << ": " << frameUs << " us per frame, rollback + re-simulation "
+			<< overheadUs << " us (" << (overheadUs / (NewNet::TICK_TIME * 10.0)) << "% of a tick), "
+			<< ((arena.memorySize() + terrain.memorySize()) / 1024) << " KB history" << endl;
+	}
+}
@@ -0,0 +1,211 @@
+/*
+ *  MapRenderCache.cpp
+ *  OpenLieroX
+ *
+ *  tiled cache of the drawn map layers
+ *
+ *  code under LGPL
+ *
+ */
+
+#include "MapRenderCache.h"
+#include "MathLib.h"
+#include "Debug.h"
+#include "Options.h"
+#ifndef DEDICATED_ONLY
+#include "GfxPrimitives.h"
+#include "Color.h"
+#endif
+
+
+MapRenderCache::Stats MapRenderCache::m_stats;
+
+bool MapRenderCache::enabled() { return tLXOptions && tLXOptions->bMapTileCache; }
+
+MapRenderCache::MapRenderCache() :
+m_image(NULL), m_foreground(NULL), m_opaque(false), m_tilesX(0), m_tilesY(0) {}
+
+void MapRenderCache::clear() {
+	Mutex::ScopedLock lock(m_mutex);
+	m_image = m_foreground = NULL;
+	m_opaque = false;
+	m_tilesX = m_tilesY = 0;
+	m_tiles.clear();
+	m_dirty.clear();
+}
+
+void MapRenderCache::invalidate(int x, int y, int w, int h) {
+	if(m_tilesX == 0 || w <= 0 || h <= 0) return;
+	m_stats.invalidations++;
+
+	// material -> image pixels
+	const int x1 = MAX(x * 2 / TILE_SIZE, 0);
+	const int y1 = MAX(y * 2 / TILE_SIZE, 0);
+	const int x2 = MIN(((x + w) * 2 - 1) / TILE_SIZE, m_tilesX - 1);
+	const int y2 = MIN(((y + h) * 2 - 1) / TILE_SIZE, m_tilesY - 1);
+	for(int ty = y1; ty <= y2; ++ty)
+		for(int tx = x1; tx <= x2; ++tx)
+			m_dirty[ty * m_tilesX + tx] = 1;
+}
+
+void MapRenderCache::invalidateAll() {
+	if(m_tilesX == 0) return;
+	m_stats.invalidations++;
+	m_dirty.assign(m_dirty.size(), 1);
+}
+
+size_t MapRenderCache::builtTileCount() const {
+	size_t n = 0;
+	for(size_t i = 0; i < m_tiles.size(); ++i)
+		if(m_tiles[i].get()) n++;
+	return n;
+}
+
+size_t MapRenderCache::memorySize() const {
+	size_t s = sizeof(MapRenderCache) + m_dirty.size() + m_tiles.size() * sizeof(SmartPointer<SDL_Surface>);
+	for(size_t i = 0; i < m_tiles.size(); ++i)
+		if(m_tiles[i].get())
+			s += m_tiles[i]->pitch * m_tiles[i]->h;
+	return s;
+}
+
+
+#ifndef DEDICATED_ONLY
+
+// the color of the pixel as it is drawn, i.e. with alpha 0 for the colorkey
+// and alpha 255 if the surface isn't blended
+static INLINE Color drawnColor(SDL_Surface* surf, bool blended, bool keyed, Uint32 key, Uint32 pixel) {
+	Color c(surf->format, pixel);
+	if(!blended) c.a = SDL_ALPHA_OPAQUE;
+	if(keyed && EqualRGB(pixel, key, surf->format)) c.a = SDL_ALPHA_TRANSPARENT;
+	return c;
+}
+
+// f over b
+static INLINE Color compositeOver(const Color& f, const Color& b) {
+	if(f.a == SDL_ALPHA_OPAQUE || b.a == SDL_ALPHA_TRANSPARENT) return f;
+	if(f.a == SDL_ALPHA_TRANSPARENT) return b;
+	const int ba = b.a * (255 - f.a) / 255;
+	const int a = f.a + ba;
+	return Color(
+		Uint8((f.r * f.a + b.r * ba) / a),
+		Uint8((f.g * f.a + b.g * ba) / a),
+		Uint8((f.b * f.a + b.b * ba) / a),
+		Uint8(a));
+}
+
+bool MapRenderCache::init(SDL_Surface* image, SDL_Surface* foreground) {
+	if(image == m_image && foreground == m_foreground && m_tilesX > 0)
+		return true;
+
+	m_image = image;
+	m_foreground = foreground;
+	m_tiles.clear();
+	m_dirty.clear();
+	m_tilesX = m_tilesY = 0;
+
+	// 8bit images would need the foreground blended into the palette
+	if(image->format->BytesPerPixel < 2) return false;
+	if(image->w <= 0 || image->h <= 0) return false;
+
+	m_opaque = !Surface_HasBlendMode(image) && !Surface_HasColorKey(image);
+	m_tilesX = (image->w + TILE_SIZE - 1) / TILE_SIZE;
+	m_tilesY = (image->h + TILE_SIZE - 1) / TILE_SIZE;
+	m_tiles.resize(m_tilesX * m_tilesY);
+	m_dirty.resize(m_tilesX * m_tilesY, 1);
+	return true;
+}
+
+void MapRenderCache::buildTile(int tx, int ty) {
+	const int sx = tx * TILE_SIZE, sy = ty * TILE_SIZE;
+	const int w = MIN((int)TILE_SIZE, m_image->w - sx);
+	const int h = MIN((int)TILE_SIZE, m_image->h - sy);
+	SmartPointer<SDL_Surface>& tile = m_tiles[ty * m_tilesX + tx];
+	m_stats.tilesBuilt++;
+
+	if(m_opaque) {
+		if(!tile.get()) {
+			const SDL_PixelFormat* f = m_image->format;
+			tile = SDL_CreateRGBSurface(SDL_SWSURFACE, w, h, f->BitsPerPixel, f->Rmask, f->Gmask, f->Bmask, f->Amask);
+			if(!tile.get()) {
+				errors << "MapRenderCache: cannot create tile: " << SDL_GetError() << endl;
+				return;
+			}
+			SDL_SetSurfaceBlendMode(tile.get(), SDL_BLENDMODE_NONE);
+		}
+		DrawImageAdv(tile.get(), m_image, sx, sy, 0, 0, w, h);
+		DrawImageAdv(tile.get(), m_foreground, sx, sy, 0, 0, w, h);
+		return;
+	}
+
+	if(!tile.get()) {
+		tile = gfxCreateSurfaceAlpha(w, h, true);
+		if(!tile.get()) {
+			errors << "MapRenderCache: cannot create tile" << endl;
+			return;
+		}
+	}
+
+	LOCK_OR_QUIT(tile);
+	LOCK_OR_QUIT(m_image);
+	LOCK_OR_QUIT(m_foreground);
+
+	const bool imgBlended = Surface_HasBlendMode(m_image), imgKeyed = Surface_HasColorKey(m_image);
+	const bool fgBlended = Surface_HasBlendMode(m_foreground), fgKeyed = Surface_HasColorKey(m_foreground);
+	const Uint32 imgKey = Surface_GetColorKey(m_image), fgKey = Surface_GetColorKey(m_foreground);
+	const int fgW = MIN(w, m_foreground->w - sx), fgH = MIN(h, m_foreground->h - sy);
+
+	for(int y = 0; y < h; ++y) {
+		for(int x = 0; x < w; ++x) {
+			Color c = drawnColor(m_image, imgBlended, imgKeyed, imgKey, GetPixel(m_image, sx + x, sy + y));
+			if(x < fgW && y < fgH)
+				c = compositeOver(drawnColor(m_foreground, fgBlended, fgKeyed, fgKey, GetPixel(m_foreground, sx + x, sy + y)), c);
+			PutPixel(tile.get(), x, y, c.get(tile->format));
+		}
+	}
+
+	UnlockSurface(m_foreground);
+	UnlockSurface(m_image);
+	UnlockSurface(tile);
+}
+
+bool MapRenderCache::draw(SDL_Surface* dest, SDL_Surface* image, SDL_Surface* foreground, int viewX, int viewY, int destX, int destY, int w, int h) {
+	if(!enabled() || !dest || !image || !foreground) return false;
+
+	// visible tiles
+	const int x1 = MAX(viewX, 0), y1 = MAX(viewY, 0);
+	const int x2 = MIN(viewX + w, image->w), y2 = MIN(viewY + h, image->h);
+
+	{
+		Mutex::ScopedLock lock(m_mutex);
+		if(!init(image, foreground)) return false;
+		m_stats.draws++;
+		if(x1 >= x2 || y1 >= y2) return true;
+
+		for(int ty = y1 / TILE_SIZE; ty <= (y2 - 1) / TILE_SIZE; ++ty)
+			for(int tx = x1 / TILE_SIZE; tx <= (x2 - 1) / TILE_SIZE; ++tx) {
+				const int i = ty * m_tilesX + tx;
+				if(m_dirty[i] || !m_tiles[i].get()) {
+					buildTile(tx, ty);
+					m_dirty[i] = 0;
+				}
+				m_stats.tilesDrawn++;
+			}
+	}
+
+	// The visible tiles are not changed anymore while we draw (only another
+	// viewport could build tiles now, and it only builds dirty ones).
+	for(int ty = y1 / TILE_SIZE; ty <= (y2 - 1) / TILE_SIZE; ++ty)
+		for(int tx = x1 / TILE_SIZE; tx <= (x2 - 1) / TILE_SIZE; ++tx) {
+			SDL_Surface* tile = m_tiles[ty * m_tilesX + tx].get();
+			if(!tile) continue;
+			const int tileX = tx * TILE_SIZE, tileY = ty * TILE_SIZE;
+			const int sx = MAX(x1, tileX), sy = MAX(y1, tileY);
+			const int ex = MIN(x2, tileX + tile->w), ey = MIN(y2, tileY + tile->h);
+			DrawImageAdv(dest, tile, sx - tileX, sy - tileY, destX + sx - viewX, destY + sy - viewY, ex - sx, ey - sy);
+		}
+
+	return true;
+}
+
+#endif
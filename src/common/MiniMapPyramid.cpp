@@ -0,0 +1,212 @@
+/*
+ *  MiniMapPyramid.cpp
+ *  OpenLieroX
+ *
+ *  downsampled mip pyramid of the map for the minimap
+ *
+ *  code under LGPL
+ *
+ */
+
+#include "MiniMapPyramid.h"
+#include "MathLib.h"
+#include "Debug.h"
+#ifndef DEDICATED_ONLY
+#include "GfxPrimitives.h"
+#endif
+
+
+MiniMapPyramid::Stats MiniMapPyramid::m_stats;
+
+MiniMapPyramid::MiniMapPyramid() : m_image(NULL), m_foreground(NULL), m_parallax(NULL) {}
+
+void MiniMapPyramid::clear() {
+	m_image = m_foreground = m_parallax = NULL;
+	m_levels.clear();
+}
+
+bool MiniMapPyramid::isBuiltFor(SDL_Surface* image, SDL_Surface* foreground, SDL_Surface* parallax) const {
+	return !m_levels.empty() && image == m_image && foreground == m_foreground && parallax == m_parallax;
+}
+
+size_t MiniMapPyramid::memorySize() const {
+	size_t s = sizeof(MiniMapPyramid);
+	for(size_t i = 0; i < m_levels.size(); ++i)
+		s += sizeof(Level) + m_levels[i].cells.size() * sizeof(Color);
+	return s;
+}
+
+
+#ifndef DEDICATED_ONLY
+
+// Draws the pixel of the layer over c (which is opaque).
+static INLINE void drawPixelOver(Color& c, SDL_Surface* surf, bool blended, bool keyed, Uint32 key, int x, int y) {
+	const Uint32 pixel = GetPixel(surf, x, y);
+	if(keyed && EqualRGB(pixel, key, surf->format)) return;
+	const Color p(surf->format, pixel);
+	if(!blended || p.a == SDL_ALPHA_OPAQUE) { c = Color(p.r, p.g, p.b); return; }
+	c.r = Uint8((p.r * p.a + c.r * (255 - p.a)) / 255);
+	c.g = Uint8((p.g * p.a + c.g * (255 - p.a)) / 255);
+	c.b = Uint8((p.b * p.a + c.b * (255 - p.a)) / 255);
+}
+
+Color MiniMapPyramid::sampleCell(int cx, int cy) const {
+	const Level& base = m_levels[0];
+	const int x0 = cx * base.cellSize, y0 = cy * base.cellSize;
+	const int n = MIN((int)SAMPLES, base.cellSize);
+	const int step = base.cellSize / n;
+
+	const bool imgBlended = Surface_HasBlendMode(m_image), imgKeyed = Surface_HasColorKey(m_image);
+	const Uint32 imgKey = Surface_GetColorKey(m_image);
+	const bool fgBlended = m_foreground && Surface_HasBlendMode(m_foreground);
+	const bool fgKeyed = m_foreground && Surface_HasColorKey(m_foreground);
+	const Uint32 fgKey = m_foreground ? Surface_GetColorKey(m_foreground) : 0;
+
+	int r = 0, g = 0, b = 0, count = 0;
+	for(int sy = 0; sy < n; ++sy) {
+		const int y = y0 + sy * step + step / 2;
+		if(y >= m_image->h) break;
+		for(int sx = 0; sx < n; ++sx) {
+			const int x = x0 + sx * step + step / 2;
+			if(x >= m_image->w) break;
+
+			Color c(0, 0, 0);
+			if(m_parallax)
+				c = Color(m_parallax->format, GetPixel(m_parallax,
+					x * m_parallax->w / m_image->w, y * m_parallax->h / m_image->h));
+			drawPixelOver(c, m_image, imgBlended, imgKeyed, imgKey, x, y);
+			if(m_foreground && x < m_foreground->w && y < m_foreground->h)
+				drawPixelOver(c, m_foreground, fgBlended, fgKeyed, fgKey, x, y);
+
+			r += c.r; g += c.g; b += c.b;
+			count++;
+		}
+	}
+
+	if(count == 0) return Color(0, 0, 0);
+	return Color(Uint8(r / count), Uint8(g / count), Uint8(b / count));
+}
+
+void MiniMapPyramid::updateCell(size_t level, int cx, int cy) {
+	Level& l = m_levels[level];
+	m_stats.updatedCells++;
+	if(level == 0) {
+		l.cells[cy * l.w + cx] = sampleCell(cx, cy);
+		return;
+	}
+
+	const Level& c = m_levels[level - 1];
+	l.cells[cy * l.w + cx] = average(c, cx * 2, cy * 2, MIN(cx * 2 + 2, c.w), MIN(cy * 2 + 2, c.h));
+}
+
+// average of the cells [x1,x2) x [y1,y2)
+Color MiniMapPyramid::average(const Level& l, int x1, int y1, int x2, int y2) const {
+	int r = 0, g = 0, b = 0, count = 0;
+	for(int y = y1; y < y2; ++y)
+		for(int x = x1; x < x2; ++x) {
+			const Color& c = l.cells[y * l.w + x];
+			r += c.r; g += c.g; b += c.b;
+			count++;
+		}
+	if(count == 0) return Color(0, 0, 0);
+	return Color(Uint8(r / count), Uint8(g / count), Uint8(b / count));
+}
+
+void MiniMapPyramid::build(SDL_Surface* image, SDL_Surface* foreground, SDL_Surface* parallax) {
+	clear();
+	if(!image || image->w <= 0 || image->h <= 0) return;
+
+	m_image = image;
+	m_foreground = foreground;
+	m_parallax = parallax;
+	m_stats.builds++;
+
+	int cellSize = 1;
+	while((image->w + cellSize * 2 - 1) / (cellSize * 2) >= MAX_MINIMAP_W &&
+		  (image->h + cellSize * 2 - 1) / (cellSize * 2) >= MAX_MINIMAP_H)
+		cellSize *= 2;
+
+	for(int w = image->w, h = image->h; ; cellSize *= 2) {
+		Level l;
+		l.cellSize = cellSize;
+		l.w = (w + cellSize - 1) / cellSize;
+		l.h = (h + cellSize - 1) / cellSize;
+		l.cells.resize(l.w * l.h);
+		m_levels.push_back(l);
+		if(l.w == 1 && l.h == 1) break;
+	}
+
+	recompute(0, 0, image->w, image->h);
+}
+
+void MiniMapPyramid::update(int x, int y, int w, int h) {
+	if(m_levels.empty()) return;
+	if(!ClipRefRectWith(x, y, w, h, (SDLRect&)m_image->clip_rect)) return;
+	m_stats.updates++;
+	recompute(x, y, w, h);
+}
+
+void MiniMapPyramid::recompute(int x, int y, int w, int h) {
+	LOCK_OR_QUIT(m_image);
+	if(m_foreground && !LockSurface(m_foreground)) { UnlockSurface(m_image); return; }
+	if(m_parallax && !LockSurface(m_parallax)) {
+		if(m_foreground) UnlockSurface(m_foreground);
+		UnlockSurface(m_image);
+		return;
+	}
+
+	int x1 = x / m_levels[0].cellSize, y1 = y / m_levels[0].cellSize;
+	int x2 = (x + w - 1) / m_levels[0].cellSize, y2 = (y + h - 1) / m_levels[0].cellSize;
+	for(size_t i = 0; i < m_levels.size(); ++i) {
+		for(int cy = y1; cy <= y2; ++cy)
+			for(int cx = x1; cx <= x2; ++cx)
+				updateCell(i, cx, cy);
+		x1 /= 2; y1 /= 2; x2 /= 2; y2 /= 2;
+	}
+
+	if(m_parallax) UnlockSurface(m_parallax);
+	if(m_foreground) UnlockSurface(m_foreground);
+	UnlockSurface(m_image);
+}
+
+void MiniMapPyramid::draw(SDL_Surface* minimap, int x, int y, int w, int h) const {
+	if(m_levels.empty() || !minimap || minimap->w <= 0 || minimap->h <= 0) return;
+	const int imgW = m_image->w, imgH = m_image->h;
+	if(!ClipRefRectWith(x, y, w, h, (SDLRect&)m_image->clip_rect)) return;
+
+	// coarsest level with cells not bigger than a minimap pixel
+	size_t li = 0;
+	while(li + 1 < m_levels.size() &&
+		  m_levels[li + 1].cellSize * minimap->w <= imgW &&
+		  m_levels[li + 1].cellSize * minimap->h <= imgH)
+		++li;
+	const Level& l = m_levels[li];
+
+	// The changed cells can be bigger than the area, and all minimap pixels
+	// which use them must be drawn.
+	const int x1 = x / l.cellSize * l.cellSize, y1 = y / l.cellSize * l.cellSize;
+	const int x2 = (x + w + l.cellSize - 1) / l.cellSize * l.cellSize;
+	const int y2 = (y + h + l.cellSize - 1) / l.cellSize * l.cellSize;
+
+	// the minimap pixels which show the area
+	const int mx1 = x1 * minimap->w / imgW;
+	const int my1 = y1 * minimap->h / imgH;
+	const int mx2 = MIN(minimap->w, (x2 * minimap->w + imgW - 1) / imgW);
+	const int my2 = MIN(minimap->h, (y2 * minimap->h + imgH - 1) / imgH);
+	if(mx1 >= mx2 || my1 >= my2) return;
+
+	LOCK_OR_QUIT(minimap);
+	for(int my = my1; my < my2; ++my) {
+		const int cy1 = my * imgH / minimap->h / l.cellSize;
+		const int cy2 = MIN(l.h, MAX(cy1 + 1, ((my + 1) * imgH / minimap->h + l.cellSize - 1) / l.cellSize));
+		for(int mx = mx1; mx < mx2; ++mx) {
+			const int cx1 = mx * imgW / minimap->w / l.cellSize;
+			const int cx2 = MIN(l.w, MAX(cx1 + 1, ((mx + 1) * imgW / minimap->w + l.cellSize - 1) / l.cellSize));
+			PutPixel(minimap, mx, my, average(l, cx1, cy1, cx2, cy2).get(minimap->format));
+		}
+	}
+	UnlockSurface(minimap);
+	m_stats.drawnPixels += (mx2 - mx1) * (my2 - my1);
+}
+
+#endif
@@ -0,0 +1,736 @@
+/*
+ *  NavGraph.cpp
+ *  OpenLieroX
+ *
+ *  hierarchical navigation graph for the bot pathfinding
+ *
+ *  code under LGPL
+ *
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include "NavGraph.h"
+#include "CodeAttributes.h"
+#include "MathLib.h"
+#include "Timer.h"
+#include "Debug.h"
+
+
+static const float SQRT2 = 1.41421356f;
+// the number of remembered paths
+static const size_t CACHE_SIZE = 64;
+// max number of pending dirty areas before we merge them
+static const size_t MAX_DIRTY_RECTS = 256;
+// allowed path cost of the hierarchical search in the benchmark, relative to the flat one.
+// Short paths around a cluster corner can get much longer over the portals.
+static const double MAX_MEAN_COST_RATIO = 1.1;
+static const double MAX_COST_RATIO = 2.0;
+
+// lower bound of the path cost between two cells (the min cell cost is 1)
+static INLINE float octile(int dx, int dy) {
+	dx = abs(dx); dy = abs(dy);
+	return (dx > dy) ? (float)(dx - dy) + SQRT2 * dy : (float)(dy - dx) + SQRT2 * dx;
+}
+
+
+void NavGraph::Stats::add(const Stats& s) {
+	queries += s.queries; cacheHits += s.cacheHits; failed += s.failed; aborted += s.aborted;
+	expandedPortals += s.expandedPortals; expandedCells += s.expandedCells;
+	updatedCells += s.updatedCells; updatedClusters += s.updatedClusters; portalRebuilds += s.portalRebuilds;
+}
+
+size_t NavGraph::Search::memorySize() const {
+	return m_g.capacity() * sizeof(float) + m_parent.capacity() * sizeof(int) + m_visited.capacity() * sizeof(Uint32)
+		+ m_absG.capacity() * sizeof(float) + m_absParent.capacity() * sizeof(int) + m_absVisited.capacity() * sizeof(Uint32)
+		+ m_heap.capacity() * sizeof(HeapItem) + (m_cells.capacity() + m_nodes.capacity()) * sizeof(int);
+}
+
+
+NavGraph::NavGraph() :
+	m_lines(NULL), m_mapW(0), m_mapH(0), m_w(0), m_h(0), m_clW(0), m_clH(0),
+	m_topology(0), m_cache(new PathCache()) {
+	memset(m_pixelClass, 0, sizeof(m_pixelClass));
+}
+
+void NavGraph::clear() {
+	m_lines = NULL;
+	m_mapW = m_mapH = m_w = m_h = m_clW = m_clH = 0;
+	m_cost.clear();
+	m_portals.clear();
+	m_clusterPortals.clear();
+	m_intraOffset.clear();
+	m_intraCost.clear();
+	m_clusterDirty.clear();
+	m_dirtyRects.clear();
+	m_cache = new PathCache();
+}
+
+void NavGraph::build(const unsigned char* const* lines, int mapW, int mapH, const Uint8 pixelClass[256], Search& search) {
+	clear();
+	if(lines == NULL || mapW <= 0 || mapH <= 0) return;
+
+	m_lines = lines;
+	memcpy(m_pixelClass, pixelClass, sizeof(m_pixelClass));
+	m_mapW = mapW; m_mapH = mapH;
+	m_w = (mapW + CELL_SIZE - 1) / CELL_SIZE;
+	m_h = (mapH + CELL_SIZE - 1) / CELL_SIZE;
+	m_clW = (m_w + CLUSTER_SIZE - 1) / CLUSTER_SIZE;
+	m_clH = (m_h + CLUSTER_SIZE - 1) / CLUSTER_SIZE;
+
+	m_cost.resize(m_w * m_h);
+	for(int y = 0; y < m_h; ++y)
+		for(int x = 0; x < m_w; ++x)
+			m_cost[y * m_w + x] = computeCost(x, y);
+
+	m_clusterDirty.assign(m_clW * m_clH, 1);
+	buildPortals();
+	prepare(search);
+	for(int c = 0; c < m_clW * m_clH; ++c)
+		buildIntraCosts(c, search);
+}
+
+void NavGraph::clusterBounds(int c, int& x1, int& y1, int& x2, int& y2) const {
+	x1 = (c % m_clW) * CLUSTER_SIZE;
+	y1 = (c / m_clW) * CLUSTER_SIZE;
+	x2 = MIN(x1 + CLUSTER_SIZE, m_w) - 1;
+	y2 = MIN(y1 + CLUSTER_SIZE, m_h) - 1;
+}
+
+Uint8 NavGraph::computeCost(int cx, int cy) const {
+	const int x1 = cx * CELL_SIZE, y1 = cy * CELL_SIZE;
+	const int x2 = x1 + CELL_SIZE, y2 = y1 + CELL_SIZE;
+	int dirt = 0;
+	for(int y = MAX(y1 - CELL_MARGIN, 0); y < MIN(y2 + CELL_MARGIN, m_mapH); ++y) {
+		const unsigned char* line = m_lines[y];
+		for(int x = MAX(x1 - CELL_MARGIN, 0); x < MIN(x2 + CELL_MARGIN, m_mapW); ++x) {
+			const Uint8 cls = m_pixelClass[line[x]];
+			if(cls == PIX_ROCK) return 0;
+			if(cls == PIX_DIRT && x >= x1 && x < x2 && y >= y1 && y < y2) dirt++;
+		}
+	}
+	// we can go through dirt, but it is slower
+	return (Uint8)(1 + dirt * 4 / (CELL_SIZE * CELL_SIZE));
+}
+
+
+///////////////////
+// Abstract graph
+
+void NavGraph::buildPortals() {
+	const int numClusters = m_clW * m_clH;
+	std::vector<Portal> oldPortals; oldPortals.swap(m_portals);
+	std::vector<int> oldFirst; oldFirst.swap(m_clusterPortals);
+	std::vector<int> oldOffset; oldOffset.swap(m_intraOffset);
+	std::vector<float> oldCost; oldCost.swap(m_intraCost);
+
+	// free cell pairs across the cluster borders; one portal for short
+	// openings, one at each end for long ones
+	std::vector<int> pairs;
+	for(int vertical = 0; vertical < 2; ++vertical) {
+		const int borders = vertical ? m_clH - 1 : m_clW - 1;
+		const int len = vertical ? m_w : m_h;
+		for(int b = 0; b < borders; ++b) {
+			const int k = (b + 1) * CLUSTER_SIZE - 1; // the last cell row/col before the border
+			int runStart = -1;
+			for(int i = 0; i <= len; ++i) {
+				int a = -1, o = -1;
+				if(i < len) {
+					a = vertical ? (k * m_w + i) : (i * m_w + k);
+					o = vertical ? (a + m_w) : (a + 1);
+				}
+				// runs also end at the cluster ends
+				const bool open = i < len && m_cost[a] && m_cost[o] && !(runStart >= 0 && i % CLUSTER_SIZE == 0);
+				if(open && runStart < 0) runStart = i;
+				if(open || runStart < 0) continue;
+
+				const int runEnd = i - 1;
+				const int step = vertical ? 1 : m_w;
+				const int first = vertical ? (k * m_w + runStart) : (runStart * m_w + k);
+				const int next = vertical ? m_w : 1;
+				if(runEnd - runStart >= 6) {
+					pairs.push_back(first + step); pairs.push_back(first + step + next);
+					pairs.push_back(first + (runEnd - runStart - 1) * step); pairs.push_back(first + (runEnd - runStart - 1) * step + next);
+				} else {
+					const int mid = first + ((runEnd - runStart) / 2) * step;
+					pairs.push_back(mid); pairs.push_back(mid + next);
+				}
+				runStart = -1;
+				if(i < len && m_cost[a] && m_cost[o]) runStart = i; // split at the cluster end
+			}
+		}
+	}
+
+	// sort the portals by cluster
+	m_clusterPortals.assign(numClusters + 1, 0);
+	for(size_t i = 0; i < pairs.size(); ++i)
+		m_clusterPortals[cluster(pairs[i]) + 1]++;
+	for(int c = 0; c < numClusters; ++c)
+		m_clusterPortals[c + 1] += m_clusterPortals[c];
+	std::vector<int> next(m_clusterPortals.begin(), m_clusterPortals.end() - 1);
+	m_portals.resize(pairs.size());
+	for(size_t i = 0; i + 1 < pairs.size(); i += 2) {
+		const int ca = cluster(pairs[i]), cb = cluster(pairs[i + 1]);
+		const int pa = next[ca]++, pb = next[cb]++;
+		m_portals[pa].cell = pairs[i]; m_portals[pa].partner = pb; m_portals[pa].cluster = ca;
+		m_portals[pb].cell = pairs[i + 1]; m_portals[pb].partner = pa; m_portals[pb].cluster = cb;
+	}
+
+	// keep the costs of the clusters whose portals are the same as before
+	m_intraOffset.resize(numClusters);
+	size_t size = 0;
+	for(int c = 0; c < numClusters; ++c) {
+		m_intraOffset[c] = (int)size;
+		const size_t n = m_clusterPortals[c + 1] - m_clusterPortals[c];
+		size += n * n;
+	}
+	m_intraCost.assign(size, -1.0f);
+	for(int c = 0; c < numClusters; ++c) {
+		const int n = m_clusterPortals[c + 1] - m_clusterPortals[c];
+		bool same = !oldFirst.empty() && oldFirst[c + 1] - oldFirst[c] == n;
+		for(int i = 0; same && i < n; ++i)
+			same = oldPortals[oldFirst[c] + i].cell == m_portals[m_clusterPortals[c] + i].cell;
+		if(same && !m_clusterDirty[c])
+			std::copy(oldCost.begin() + oldOffset[c], oldCost.begin() + oldOffset[c] + n * n, m_intraCost.begin() + m_intraOffset[c]);
+		else
+			m_clusterDirty[c] = 1;
+	}
+
+	m_topology++;
+	Mutex::ScopedLock lock(m_cache->mutex);
+	m_cache->stats.portalRebuilds++;
+}
+
+void NavGraph::buildIntraCosts(int c, Search& s) {
+	m_clusterDirty[c] = 0;
+	const int first = m_clusterPortals[c], n = m_clusterPortals[c + 1] - first;
+	if(n == 0) return;
+	int x1, y1, x2, y2;
+	clusterBounds(c, x1, y1, x2, y2);
+	float* costs = &m_intraCost[m_intraOffset[c]];
+	s.m_workLimit = 0;
+	for(int i = 0; i < n; ++i) {
+		searchCells(s, m_portals[first + i].cell, -1, x1, y1, x2, y2);
+		for(int j = 0; j < n; ++j) {
+			const int cell = m_portals[first + j].cell;
+			costs[i * n + j] = (s.m_visited[cell] == s.m_searchId) ? s.m_g[cell] : -1.0f;
+		}
+	}
+}
+
+void NavGraph::markDirty(int x, int y, int w, int h) {
+	if(!isBuilt() || w <= 0 || h <= 0) return;
+	// all cells whose area including the margin overlaps
+	const int x1 = MAX((x - CELL_MARGIN) / CELL_SIZE, 0), y1 = MAX((y - CELL_MARGIN) / CELL_SIZE, 0);
+	const int x2 = MIN((x + w - 1 + CELL_MARGIN) / CELL_SIZE, m_w - 1), y2 = MIN((y + h - 1 + CELL_MARGIN) / CELL_SIZE, m_h - 1);
+	if(x1 > x2 || y1 > y2) return;
+
+	if(m_dirtyRects.size() >= MAX_DIRTY_RECTS * 4) {
+		// merge everything into one rect
+		int r[4] = { x1, y1, x2, y2 };
+		for(size_t i = 0; i < m_dirtyRects.size(); i += 4) {
+			r[0] = MIN(r[0], m_dirtyRects[i]); r[1] = MIN(r[1], m_dirtyRects[i + 1]);
+			r[2] = MAX(r[2], m_dirtyRects[i + 2]); r[3] = MAX(r[3], m_dirtyRects[i + 3]);
+		}
+		m_dirtyRects.assign(r, r + 4);
+		return;
+	}
+	m_dirtyRects.push_back(x1); m_dirtyRects.push_back(y1);
+	m_dirtyRects.push_back(x2); m_dirtyRects.push_back(y2);
+}
+
+void NavGraph::update(Search& search) {
+	if(m_dirtyRects.empty()) return;
+
+	Stats stats;
+	bool blockedChanged = false;
+	for(size_t i = 0; i + 3 < m_dirtyRects.size(); i += 4) {
+		for(int y = m_dirtyRects[i + 1]; y <= m_dirtyRects[i + 3]; ++y)
+			for(int x = m_dirtyRects[i]; x <= m_dirtyRects[i + 2]; ++x) {
+				const int cell = y * m_w + x;
+				const Uint8 cost = computeCost(x, y);
+				if(cost == m_cost[cell]) continue;
+				if((cost == 0) != (m_cost[cell] == 0)) blockedChanged = true;
+				m_cost[cell] = cost;
+				m_clusterDirty[cluster(cell)] = 1;
+				stats.updatedCells++;
+			}
+	}
+	m_dirtyRects.clear();
+
+	// if only the costs have changed, the cached paths stay valid
+	if(blockedChanged)
+		buildPortals();
+	prepare(search);
+	for(int c = 0; c < m_clW * m_clH; ++c)
+		if(m_clusterDirty[c]) {
+			buildIntraCosts(c, search);
+			stats.updatedClusters++;
+		}
+
+	Mutex::ScopedLock lock(m_cache->mutex);
+	m_cache->stats.add(stats);
+}
+
+
+///////////////////
+// Searching
+
+void NavGraph::prepare(Search& s) const {
+	if(s.m_g.size() != m_cost.size()) {
+		s.m_g.resize(m_cost.size());
+		s.m_parent.resize(m_cost.size());
+		s.m_visited.assign(m_cost.size(), 0);
+		s.m_searchId = 0;
+	}
+	if(s.m_absG.size() != m_portals.size() + 2) {
+		s.m_absG.resize(m_portals.size() + 2);
+		s.m_absParent.resize(m_portals.size() + 2);
+		s.m_absVisited.assign(m_portals.size() + 2, 0);
+		s.m_absSearchId = 0;
+	}
+}
+
+Uint32 NavGraph::nextSearchId(std::vector<Uint32>& visited, Uint32& id) const {
+	if(++id == 0) {
+		std::fill(visited.begin(), visited.end(), 0);
+		id = 1;
+	}
+	return id;
+}
+
+bool NavGraph::outOfWork(Search& s) const {
+	if(s.m_workLimit == 0 || s.work() < s.m_workLimit) return false;
+	s.m_aborted = true;
+	return true;
+}
+
+bool NavGraph::searchCells(Search& s, int from, int to, int x1, int y1, int x2, int y2) const {
+	static const int dx[8] = { 1, -1, 0, 0, 1, 1, -1, -1 };
+	static const int dy[8] = { 0, 0, 1, -1, 1, -1, 1, -1 };
+
+	const Uint32 id = nextSearchId(s.m_visited, s.m_searchId);
+	const int tx = (to >= 0) ? to % m_w : 0, ty = (to >= 0) ? to / m_w : 0;
+	s.m_heap.clear();
+	s.m_g[from] = 0; s.m_parent[from] = -1; s.m_visited[from] = id;
+	Search::HeapItem start = { 0, 0, from };
+	s.m_heap.push_back(start);
+
+	while(!s.m_heap.empty()) {
+		std::pop_heap(s.m_heap.begin(), s.m_heap.end());
+		const Search::HeapItem cur = s.m_heap.back();
+		s.m_heap.pop_back();
+		if(cur.g > s.m_g[cur.node]) continue; // outdated
+		if(cur.node == to) return true;
+		if(outOfWork(s)) return false;
+		s.m_stats.expandedCells++;
+
+		const int x = cur.node % m_w, y = cur.node / m_w;
+		for(int d = 0; d < 8; ++d) {
+			const int nx = x + dx[d], ny = y + dy[d];
+			if(nx < x1 || nx > x2 || ny < y1 || ny > y2) continue;
+			const int n = ny * m_w + nx;
+			if(!m_cost[n]) continue;
+			// no cutting of corners
+			if(d >= 4 && (!m_cost[y * m_w + nx] || !m_cost[ny * m_w + x])) continue;
+			const float g = cur.g + m_cost[n] * ((d >= 4) ? SQRT2 : 1.0f);
+			if(s.m_visited[n] == id && g >= s.m_g[n]) continue;
+			s.m_visited[n] = id; s.m_g[n] = g; s.m_parent[n] = cur.node;
+			Search::HeapItem item = { g + ((to >= 0) ? octile(tx - nx, ty - ny) : 0.0f), g, n };
+			s.m_heap.push_back(item);
+			std::push_heap(s.m_heap.begin(), s.m_heap.end());
+		}
+	}
+	return to < 0;
+}
+
+// searches inside the cluster and appends the cells to s.m_cells
+bool NavGraph::appendCellPath(Search& s, int from, int to, int c) const {
+	int x1, y1, x2, y2;
+	clusterBounds(c, x1, y1, x2, y2);
+	if(!searchCells(s, from, to, x1, y1, x2, y2)) return false;
+	const size_t oldSize = s.m_cells.size();
+	for(int cell = to; cell >= 0 && cell != from; cell = s.m_parent[cell])
+		s.m_cells.push_back(cell);
+	std::reverse(s.m_cells.begin() + oldSize, s.m_cells.end());
+	return true;
+}
+
+void NavGraph::relaxAbstract(Search& s, int node, int parent, float g, int cell, int goalCell, Uint32 id) const {
+	if(s.m_absVisited[node] == id && g >= s.m_absG[node]) return;
+	s.m_absVisited[node] = id; s.m_absG[node] = g; s.m_absParent[node] = parent;
+	Search::HeapItem item = { g + octile(goalCell % m_w - cell % m_w, goalCell / m_w - cell / m_w), g, node };
+	s.m_heap.push_back(item);
+	std::push_heap(s.m_heap.begin(), s.m_heap.end());
+}
+
+// the portals on the way are put into s.m_nodes
+bool NavGraph::searchAbstract(Search& s, int startCell, int goalCell) const {
+	const int sc = cluster(startCell), gc = cluster(goalCell);
+	const int START = (int)m_portals.size(), GOAL = START + 1;
+	int x1, y1, x2, y2;
+
+	// costs from the start to the portals of its cluster and from the portals to the goal
+	const int sFirst = m_clusterPortals[sc], sn = m_clusterPortals[sc + 1] - sFirst;
+	clusterBounds(sc, x1, y1, x2, y2);
+	searchCells(s, startCell, -1, x1, y1, x2, y2);
+	s.m_startCost.resize(sn);
+	for(int i = 0; i < sn; ++i) {
+		const int cell = m_portals[sFirst + i].cell;
+		s.m_startCost[i] = (s.m_visited[cell] == s.m_searchId) ? s.m_g[cell] : -1.0f;
+	}
+	const int gFirst = m_clusterPortals[gc], gn = m_clusterPortals[gc + 1] - gFirst;
+	clusterBounds(gc, x1, y1, x2, y2);
+	searchCells(s, goalCell, -1, x1, y1, x2, y2);
+	s.m_goalCost.resize(gn);
+	for(int i = 0; i < gn; ++i) {
+		const int cell = m_portals[gFirst + i].cell;
+		s.m_goalCost[i] = (s.m_visited[cell] == s.m_searchId) ? s.m_g[cell] : -1.0f;
+	}
+	if(s.m_aborted) return false;
+
+	const Uint32 id = nextSearchId(s.m_absVisited, s.m_absSearchId);
+	s.m_heap.clear();
+	s.m_absG[START] = 0; s.m_absParent[START] = -1; s.m_absVisited[START] = id;
+	Search::HeapItem start = { 0, 0, START };
+	s.m_heap.push_back(start);
+
+	while(!s.m_heap.empty()) {
+		std::pop_heap(s.m_heap.begin(), s.m_heap.end());
+		const Search::HeapItem cur = s.m_heap.back();
+		s.m_heap.pop_back();
+		if(cur.g > s.m_absG[cur.node]) continue;
+		if(cur.node == GOAL) {
+			s.m_nodes.clear();
+			for(int n = s.m_absParent[GOAL]; n >= 0 && n != START; n = s.m_absParent[n])
+				s.m_nodes.push_back(n);
+			std::reverse(s.m_nodes.begin(), s.m_nodes.end());
+			return true;
+		}
+		if(outOfWork(s)) return false;
+		s.m_stats.expandedPortals++;
+
+		if(cur.node == START) {
+			for(int i = 0; i < sn; ++i)
+				if(s.m_startCost[i] >= 0)
+					relaxAbstract(s, sFirst + i, START, s.m_startCost[i], m_portals[sFirst + i].cell, goalCell, id);
+			continue;
+		}
+
+		const Portal& p = m_portals[cur.node];
+		const Portal& partner = m_portals[p.partner];
+		relaxAbstract(s, p.partner, cur.node, cur.g + m_cost[partner.cell], partner.cell, goalCell, id);
+
+		const int first = m_clusterPortals[p.cluster], n = m_clusterPortals[p.cluster + 1] - first;
+		const float* costs = &m_intraCost[m_intraOffset[p.cluster] + (cur.node - first) * n];
+		for(int j = 0; j < n; ++j)
+			if(costs[j] > 0)
+				relaxAbstract(s, first + j, cur.node, cur.g + costs[j], m_portals[first + j].cell, goalCell, id);
+		if(p.cluster == gc && s.m_goalCost[cur.node - gFirst] >= 0)
+			relaxAbstract(s, GOAL, cur.node, cur.g + s.m_goalCost[cur.node - gFirst], goalCell, goalCell, id);
+	}
+
+	return false;
+}
+
+int NavGraph::nearestFreeCell(int x, int y) const {
+	x = CLAMP(x / CELL_SIZE, 0, m_w - 1);
+	y = CLAMP(y / CELL_SIZE, 0, m_h - 1);
+	if(m_cost[y * m_w + x]) return y * m_w + x;
+
+	// we are often standing close to some rock
+	int best = -1, bestDist = 0;
+	for(int r = 1; r <= 3 && best < 0; ++r)
+		for(int cy = MAX(y - r, 0); cy <= MIN(y + r, m_h - 1); ++cy)
+			for(int cx = MAX(x - r, 0); cx <= MIN(x + r, m_w - 1); ++cx) {
+				if(!m_cost[cy * m_w + cx]) continue;
+				const int dist = (cx - x) * (cx - x) + (cy - y) * (cy - y);
+				if(best < 0 || dist < bestDist) { best = cy * m_w + cx; bestDist = dist; }
+			}
+	return best;
+}
+
+// true if the straight line between the cells is free and not more expensive than maxCost
+bool NavGraph::lineFree(int a, int b, float maxCost) const {
+	const int ax = a % m_w, ay = a / m_w;
+	const int dx = b % m_w - ax, dy = b / m_w - ay;
+	const int steps = MAX(abs(dx), abs(dy));
+	if(steps == 0) return true;
+	const float stepLen = sqrtf((float)(dx * dx + dy * dy)) / steps;
+	float cost = 0;
+	int px = ax, py = ay;
+	for(int s = 1; s <= steps; ++s) {
+		const int x = ax + (dx * s + ((dx >= 0) ? steps / 2 : -steps / 2)) / steps;
+		const int y = ay + (dy * s + ((dy >= 0) ? steps / 2 : -steps / 2)) / steps;
+		const Uint8 c = m_cost[y * m_w + x];
+		if(!c) return false;
+		if(x != px && y != py && (!m_cost[py * m_w + x] || !m_cost[y * m_w + px])) return false;
+		cost += c * stepLen;
+		if(cost > maxCost) return false;
+		px = x; py = y;
+	}
+	return true;
+}
+
+// removes the cells we can skip by going straight, and converts them to pixel positions
+void NavGraph::smoothPath(const std::vector<int>& cells, std::vector< VectorD2<int> >& path) const {
+	std::vector<float> pathCost(cells.size(), 0.0f);
+	for(size_t i = 1; i < cells.size(); ++i) {
+		const int d = abs(cells[i] % m_w - cells[i - 1] % m_w) + abs(cells[i] / m_w - cells[i - 1] / m_w);
+		pathCost[i] = pathCost[i - 1] + m_cost[cells[i]] * ((d > 1) ? SQRT2 : 1.0f);
+	}
+
+	path.clear();
+	size_t anchor = 0;
+	path.push_back(VectorD2<int>((cells[0] % m_w) * CELL_SIZE + CELL_SIZE / 2, (cells[0] / m_w) * CELL_SIZE + CELL_SIZE / 2));
+	while(anchor + 1 < cells.size()) {
+		size_t j = anchor + 1;
+		while(j + 1 < cells.size() && lineFree(cells[anchor], cells[j + 1], (pathCost[j + 1] - pathCost[anchor]) * 1.05f + 0.01f))
+			j++;
+		path.push_back(VectorD2<int>((cells[j] % m_w) * CELL_SIZE + CELL_SIZE / 2, (cells[j] / m_w) * CELL_SIZE + CELL_SIZE / 2));
+		anchor = j;
+	}
+}
+
+// another search from this cluster has already found the way; we only have to get onto it
+bool NavGraph::findCached(int startCluster, int goalCell, int startCell, const VectorD2<int>& start, const VectorD2<int>& target, std::vector< VectorD2<int> >& path) const {
+	Mutex::ScopedLock lock(m_cache->mutex);
+	for(size_t e = 0; e < m_cache->entries.size(); ++e) {
+		CacheEntry& entry = m_cache->entries[e];
+		if(entry.startCluster != startCluster || entry.goalCell != goalCell || entry.topology != m_topology) continue;
+		for(int i = MIN((int)entry.path.size() - 1, 3); i >= 0; --i) {
+			const VectorD2<int>& p = entry.path[i];
+			const int cell = CLAMP(p.y / CELL_SIZE, 0, m_h - 1) * m_w + CLAMP(p.x / CELL_SIZE, 0, m_w - 1);
+			if(!lineFree(startCell, cell, 1e30f)) continue;
+			path.push_back(start);
+			path.insert(path.end(), entry.path.begin() + i, entry.path.end());
+			path.back() = target;
+			entry.lastUse = ++m_cache->useCounter;
+			return true;
+		}
+		return false;
+	}
+	return false;
+}
+
+void NavGraph::addToCache(int startCluster, int goalCell, const std::vector< VectorD2<int> >& path) const {
+	Mutex::ScopedLock lock(m_cache->mutex);
+	std::vector<CacheEntry>& entries = m_cache->entries;
+	CacheEntry* e = NULL;
+	for(size_t i = 0; i < entries.size() && !e; ++i)
+		if(entries[i].startCluster == startCluster && entries[i].goalCell == goalCell)
+			e = &entries[i];
+	if(!e) {
+		if(entries.size() < CACHE_SIZE) {
+			entries.push_back(CacheEntry());
+			e = &entries.back();
+		} else {
+			// replace the least recently used one
+			e = &entries[0];
+			for(size_t i = 1; i < entries.size(); ++i)
+				if(entries[i].topology != m_topology || entries[i].lastUse < e->lastUse)
+					e = &entries[i];
+		}
+	}
+	e->startCluster = startCluster;
+	e->goalCell = goalCell;
+	e->topology = m_topology;
+	e->lastUse = ++m_cache->useCounter;
+	e->path.assign(path.begin() + 1, path.end());
+}
+
+bool NavGraph::findPath(const VectorD2<int>& start, const VectorD2<int>& target, std::vector< VectorD2<int> >& path,
+						Search& s, Uint32 maxWork) const {
+	path.clear();
+	if(!isBuilt()) return false;
+	prepare(s);
+	s.m_stats = Stats();
+	s.m_stats.queries = 1;
+	s.m_workLimit = maxWork;
+	s.m_aborted = false;
+
+	bool found = false;
+	const int startCell = nearestFreeCell(start.x, start.y);
+	const int goalCell = nearestFreeCell(target.x, target.y);
+	if(startCell >= 0 && goalCell >= 0) {
+		const int sc = cluster(startCell), gc = cluster(goalCell);
+		if(findCached(sc, goalCell, startCell, start, target, path)) {
+			s.m_stats.cacheHits = 1;
+			found = true;
+		}
+		else {
+			s.m_cells.clear();
+			s.m_cells.push_back(startCell);
+			found = (sc == gc) && appendCellPath(s, startCell, goalCell, sc);
+			if(!found && !s.m_aborted) {
+				found = searchAbstract(s, startCell, goalCell);
+				for(size_t i = 0; found && i < s.m_nodes.size(); ++i) {
+					const Portal& p = m_portals[s.m_nodes[i]];
+					if(p.cluster == cluster(s.m_cells.back()))
+						found = appendCellPath(s, s.m_cells.back(), p.cell, p.cluster);
+					else
+						s.m_cells.push_back(p.cell); // going over to the partner
+				}
+				if(found)
+					found = appendCellPath(s, s.m_cells.back(), goalCell, gc);
+			}
+			if(found) {
+				smoothPath(s.m_cells, path);
+				path.front() = start;
+				if(path.size() == 1)
+					path.push_back(target);
+				else
+					path.back() = target;
+				addToCache(sc, goalCell, path);
+			}
+		}
+	}
+
+	if(!found) {
+		path.clear();
+		if(s.m_aborted) s.m_stats.aborted = 1;
+		else s.m_stats.failed = 1;
+	}
+	Mutex::ScopedLock lock(m_cache->mutex);
+	m_cache->stats.add(s.m_stats);
+	return found;
+}
+
+NavGraph::Stats NavGraph::stats() const {
+	Mutex::ScopedLock lock(m_cache->mutex);
+	return m_cache->stats;
+}
+
+size_t NavGraph::memorySize() const {
+	size_t res = m_cost.capacity() + m_portals.capacity() * sizeof(Portal);
+	res += (m_clusterPortals.capacity() + m_intraOffset.capacity()) * sizeof(int) + m_intraCost.capacity() * sizeof(float);
+	Mutex::ScopedLock lock(m_cache->mutex);
+	for(size_t i = 0; i < m_cache->entries.size(); ++i)
+		res += sizeof(CacheEntry) + m_cache->entries[i].path.capacity() * sizeof(VectorD2<int>);
+	return res;
+}
+
+
+///////////////////
+// Benchmark
+
+void NavGraph::benchmark(int numQueries) {
+	const int mapW = 2000, mapH = 1500;
+	numQueries = CLAMP(numQueries, 1, 100000);
+	SyncedRandom rnd(4321);
+
+	// a dirt map with rock blobs and some caves
+	std::vector<unsigned char> pixels(mapW * mapH, PIX_DIRT);
+	std::vector<unsigned char*> lines(mapH);
+	for(int y = 0; y < mapH; ++y) lines[y] = &pixels[y * mapW];
+	for(int i = 0; i < 400; ++i) {
+		const unsigned char m = (i % 4 == 0) ? PIX_ROCK : PIX_FREE;
+		const int r = ((m == PIX_ROCK) ? 10 + rnd.getInt() % 70 : 20 + rnd.getInt() % 100);
+		const int cx = rnd.getInt() % mapW, cy = rnd.getInt() % mapH;
+		for(int y = MAX(cy - r, 0); y < MIN(cy + r, mapH); ++y)
+			for(int x = MAX(cx - r, 0); x < MIN(cx + r, mapW); ++x)
+				if((x - cx) * (x - cx) + (y - cy) * (y - cy) < r * r && (m == PIX_ROCK || pixels[y * mapW + x] != PIX_ROCK))
+					pixels[y * mapW + x] = m;
+	}
+	Uint8 classes[256];
+	for(int i = 0; i < 256; ++i) classes[i] = (i < 3) ? (Uint8)i : PIX_FREE;
+
+	NavGraph graph;
+	Search search;
+	AbsTime start = GetTime();
+	graph.build(&lines[0], mapW, mapH, classes, search);
+	notes << "NavGraph: " << mapW << "x" << mapH << " map, " << graph.m_w << "x" << graph.m_h << " cells, "
+		<< graph.m_portals.size() << " portals, built in " << (GetTime() - start).milliseconds() << "ms, "
+		<< (graph.memorySize() / 1024) << " KB" << endl;
+
+	// random free positions
+	std::vector< VectorD2<int> > points;
+	while(points.size() < 256) {
+		const VectorD2<int> p(rnd.getInt() % mapW, rnd.getInt() % mapH);
+		if(pixels[p.y * mapW + p.x] == PIX_FREE) points.push_back(p);
+	}
+
+	// flat A* over all cells, as reference; its path costs are the optimal ones
+	std::vector< VectorD2<int> > path;
+	std::vector<float> flatCost(numQueries, -1.0f);
+	size_t flatFound = 0, found = 0;
+	start = GetTime();
+	for(int i = 0; i < numQueries; ++i) {
+		const VectorD2<int>& a = points[(i * 2) % points.size()];
+		const VectorD2<int>& b = points[(i * 7 + 1) % points.size()];
+		const int from = graph.nearestFreeCell(a.x, a.y), to = graph.nearestFreeCell(b.x, b.y);
+		if(from >= 0 && to >= 0 && graph.searchCells(search, from, to, 0, 0, graph.m_w - 1, graph.m_h - 1)) {
+			flatCost[i] = search.m_g[to];
+			flatFound++;
+		}
+	}
+	const TimeDiff flatTime = GetTime() - start;
+
+	// HPA* doesn't give the shortest paths, so we compare the costs of the
+	// refined cell paths (before the smoothing) with the flat ones
+	std::vector<float> hierCost(numQueries, -1.0f);
+	start = GetTime();
+	for(int i = 0; i < numQueries; ++i) {
+		graph.m_cache->entries.clear();
+		const VectorD2<int>& a = points[(i * 2) % points.size()];
+		const VectorD2<int>& b = points[(i * 7 + 1) % points.size()];
+		if(!graph.findPath(a, b, path, search)) continue;
+		found++;
+		const std::vector<int>& cells = search.m_cells;
+		float cost = 0;
+		for(size_t c = 1; c < cells.size(); ++c) {
+			const int d = abs(cells[c] % graph.m_w - cells[c - 1] % graph.m_w) + abs(cells[c] / graph.m_w - cells[c - 1] / graph.m_w);
+			cost += graph.m_cost[cells[c]] * ((d > 1) ? SQRT2 : 1.0f);
+		}
+		hierCost[i] = cost;
+	}
+	const TimeDiff hierTime = GetTime() - start;
+
+	size_t compared = 0, mismatches = 0;
+	double ratioSum = 0, ratioMax = 1;
+	for(int i = 0; i < numQueries; ++i) {
+		if((flatCost[i] < 0) != (hierCost[i] < 0)) { mismatches++; continue; }
+		if(flatCost[i] <= 0) continue;
+		const double ratio = hierCost[i] / flatCost[i];
+		ratioSum += ratio;
+		ratioMax = MAX(ratioMax, ratio);
+		compared++;
+		if(ratio < 1.0 - 1e-4)
+			errors << "NavGraph: hierarchical path of query " << i << " is cheaper than the optimal one (" << hierCost[i] << " < " << flatCost[i] << ")" << endl;
+	}
+	const double ratioMean = (compared > 0) ? ratioSum / compared : 1;
+
+	notes << "NavGraph: " << numQueries << " queries, flat A* " << flatTime.milliseconds() << "ms (" << flatFound << " found), "
+		<< "hierarchical " << hierTime.milliseconds() << "ms (" << found << " found), path cost ratio mean "
+		<< ftoa((float)ratioMean, 3) << ", max " << ftoa((float)ratioMax, 3) << endl;
+	if(mismatches > 0)
+		errors << "NavGraph: the hierarchical search doesn't find a path for the same queries as the flat one (" << mismatches << " differ)" << endl;
+	if(ratioMean > MAX_MEAN_COST_RATIO || ratioMax > MAX_COST_RATIO)
+		errors << "NavGraph: the hierarchical paths are too long (allowed: mean " << MAX_MEAN_COST_RATIO << ", max " << MAX_COST_RATIO << ")" << endl;
+
+	// 16 bots moving around and chasing 4 targets, while they carve the dirt
+	const int bots = 16, frames = MAX(numQueries / bots, 1);
+	const Stats before = graph.stats();
+	start = GetTime();
+	for(int f = 0; f < frames; ++f) {
+		for(int i = 0; i < 8; ++i) {
+			const int x = rnd.getInt() % mapW, y = rnd.getInt() % mapH;
+			for(int py = MAX(y - 5, 0); py < MIN(y + 5, mapH); ++py)
+				for(int px = MAX(x - 5, 0); px < MIN(x + 5, mapW); ++px)
+					if(pixels[py * mapW + px] == PIX_DIRT) pixels[py * mapW + px] = PIX_FREE;
+			graph.markDirty(x - 5, y - 5, 10, 10);
+		}
+		graph.update(search);
+		for(int b = 0; b < bots; ++b) {
+			const VectorD2<int>& p = points[(b * 13 + f / 10) % points.size()];
+			graph.findPath(p + VectorD2<int>((f % 10) * 3, 0), points[b % 4], path, search);
+		}
+	}
+	const TimeDiff botsTime = GetTime() - start;
+	const Stats s = graph.stats();
+	notes << "NavGraph: " << bots << " bots, " << frames << " frames with carving: " << botsTime.milliseconds() << "ms, "
+		<< (s.cacheHits - before.cacheHits) << " of " << (s.queries - before.queries) << " queries from the cache, "
+		<< (s.updatedCells - before.updatedCells) << " cells and " << (s.updatedClusters - before.updatedClusters) << " clusters updated" << endl;
+}
@@ -0,0 +1,171 @@
+/*
+ *  NavSearchPool.cpp
+ *  OpenLieroX
+ *
+ *  worker threads for the bot path searches
+ *
+ *  code under LGPL
+ *
+ */
+
+#include "NavSearchPool.h"
+#include "ThreadPool.h"
+#include "Options.h"
+#include "MathLib.h"
+#include "StringUtils.h"
+#include "Debug.h"
+
+
+NavSearchPool* navSearchPool = NULL;
+
+void InitNavSearchPool() {
+	if(!navSearchPool)
+		navSearchPool = new NavSearchPool();
+}
+
+void UnInitNavSearchPool() {
+	if(navSearchPool) {
+		delete navSearchPool;
+		navSearchPool = NULL;
+	}
+}
+
+
+struct NavSearchPool::Worker : Action {
+	NavSearchPool* pool;
+	NavGraph::Search search; // stays allocated for the next searches
+	Worker(NavSearchPool* p) : pool(p) {}
+
+	::Result handle() {
+		Mutex::ScopedLock lock(pool->m_mutex);
+		while(true) {
+			if(pool->m_quit)
+				return true;
+			if(pool->m_queue.empty()) {
+				pool->m_newJob.wait(pool->m_mutex);
+				continue;
+			}
+
+			Job job = pool->m_queue.front();
+			pool->m_queue.pop_front();
+			pool->m_running.insert(job.ticket);
+
+			NavSearchPool::Result res;
+			{
+				Mutex::ScopedUnlock unlock(pool->m_mutex);
+				run(job, search, res);
+				job.graph = NULL; // the map can update it again
+			}
+			pool->finish(job.ticket, res);
+		}
+	}
+};
+
+NavSearchPool::NavSearchPool() : m_lastTicket(0), m_quit(false), m_started(false) {}
+
+NavSearchPool::~NavSearchPool() {
+	{
+		Mutex::ScopedLock lock(m_mutex);
+		m_quit = true;
+		m_queue.clear();
+		m_newJob.broadcast();
+	}
+	for(size_t i = 0; i < m_threads.size(); ++i)
+		threadPool->wait(m_threads[i], NULL);
+	m_threads.clear();
+}
+
+void NavSearchPool::startThreads() {
+	m_started = true;
+	const int num = CLAMP(tLXOptions->iBotPathThreads, 0, (int)MAX_THREADS);
+	for(int i = 0; i < num; ++i)
+		m_threads.push_back(threadPool->start(new Worker(this), "bot path search " + itoa(i)));
+	notes << "NavSearchPool: " << num << " threads for the bot path searches" << endl;
+}
+
+void NavSearchPool::run(const Job& job, NavGraph::Search& search, Result& res) {
+	res.found = job.graph->findPath(job.start, job.target, res.path, search, job.maxWork);
+	res.aborted = search.aborted();
+	res.work = search.work();
+}
+
+// m_mutex must be locked
+void NavSearchPool::finish(Ticket ticket, Result& res) {
+	m_stats.work += res.work;
+	// it was cancelled in the meanwhile
+	if(m_running.erase(ticket) == 0)
+		return;
+	m_stats.finished++;
+	Result& done = m_done[ticket];
+	done.found = res.found;
+	done.aborted = res.aborted;
+	done.work = res.work;
+	done.path.swap(res.path);
+}
+
+NavSearchPool::Ticket NavSearchPool::submit(const SmartPointer<NavGraph>& graph, const VectorD2<int>& start, const VectorD2<int>& target, Uint32 maxWork) {
+	if(!graph.get()) return 0;
+
+	Mutex::ScopedLock lock(m_mutex);
+	if(m_quit) return 0;
+	if(!m_started) startThreads();
+	if(m_queue.size() >= MAX_QUEUED) {
+		m_stats.rejected++;
+		return 0;
+	}
+
+	if(++m_lastTicket == 0) m_lastTicket = 1;
+	Job job;
+	job.ticket = m_lastTicket;
+	job.graph = graph;
+	job.start = start;
+	job.target = target;
+	job.maxWork = maxWork;
+	m_stats.submitted++;
+
+	if(m_threads.empty()) {
+		Result res;
+		run(job, m_search, res);
+		m_running.insert(job.ticket);
+		finish(job.ticket, res);
+		return job.ticket;
+	}
+
+	m_queue.push_back(job);
+	m_newJob.signal();
+	return job.ticket;
+}
+
+bool NavSearchPool::fetch(Ticket ticket, Result& res) {
+	Mutex::ScopedLock lock(m_mutex);
+	std::map<Ticket, Result>::iterator i = m_done.find(ticket);
+	if(i == m_done.end()) return false;
+	res.found = i->second.found;
+	res.aborted = i->second.aborted;
+	res.work = i->second.work;
+	res.path.swap(i->second.path);
+	m_done.erase(i);
+	return true;
+}
+
+bool NavSearchPool::isDone(Ticket ticket) const {
+	Mutex::ScopedLock lock(m_mutex);
+	return m_done.find(ticket) != m_done.end();
+}
+
+void NavSearchPool::cancel(Ticket ticket) {
+	Mutex::ScopedLock lock(m_mutex);
+	m_stats.cancelled++;
+	if(m_running.erase(ticket) > 0) return;
+	if(m_done.erase(ticket) > 0) return;
+	for(std::list<Job>::iterator i = m_queue.begin(); i != m_queue.end(); ++i)
+		if(i->ticket == ticket) {
+			m_queue.erase(i);
+			return;
+		}
+}
+
+NavSearchPool::Stats NavSearchPool::stats() const {
+	Mutex::ScopedLock lock(m_mutex);
+	return m_stats;
+}
@@ -0,0 +1,383 @@
+/*
+ *  NetEmulator.cpp
+ *  OpenLieroX
+ *
+ *  network condition emulation and packet capture/replay for the UDP sockets
+ *
+ *  code under LGPL
+ *
+ */
+
+#include <map>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include "NetEmulator.h"
+#include "FindFile.h"
+#include "EndianSwap.h"
+#include "StringUtils.h"
+#include "MathLib.h"
+#include "Timer.h"
+#include "Mutex.h"
+#include "Debug.h"
+
+
+std::string NetConditions::toString() const {
+	return itoa(latency) + "+" + itoa(jitter) + " ms, " + ftoa(loss) + "% loss, " + ftoa(duplicate) + "% duplicated, " + ftoa(reorder) + "% reordered";
+}
+
+namespace {
+	// the capture file: "OLXNETCAP", version byte, then the records
+	const char CAPTURE_MAGIC[] = "OLXNETCAP";
+	const Uint8 CAPTURE_VERSION = 1;
+	enum { DIR_IN = 0, DIR_OUT = 1 };
+
+	struct CaptureRecord {
+		Uint32 time; // ms since the capture start
+		Uint8 dir;
+		Uint16 localPort;
+		std::string addr;
+		std::string data;
+	};
+
+	bool readRecord(FILE* f, CaptureRecord& r) {
+		Uint8 addrLen = 0;
+		Uint16 size = 0;
+		if(fread_endian<Uint32>(f, r.time) != 1) return false;
+		if(fread_endian<Uint8>(f, r.dir) != 1) return false;
+		if(fread_endian<Uint16>(f, r.localPort) != 1) return false;
+		if(fread_endian<Uint8>(f, addrLen) != 1) return false;
+		r.addr.resize(addrLen);
+		if(addrLen > 0 && fread(&r.addr[0], addrLen, 1, f) != 1) return false;
+		if(fread_endian<Uint16>(f, size) != 1) return false;
+		r.data.resize(size);
+		if(size > 0 && fread(&r.data[0], size, 1, f) != 1) return false;
+		return true;
+	}
+
+	void writeRecord(FILE* f, Uint32 time, Uint8 dir, Uint16 localPort, const std::string& addr, const void* data, int size) {
+		const size_t addrLen = MIN(addr.size(), (size_t)255);
+		fwrite_endian<Uint32>(f, time);
+		fwrite_endian<Uint8>(f, dir);
+		fwrite_endian<Uint16>(f, localPort);
+		fwrite_endian<Uint8>(f, addrLen);
+		fwrite(addr.data(), 1, addrLen, f);
+		fwrite_endian<Uint16>(f, size);
+		fwrite(data, 1, size, f);
+	}
+
+	FILE* openCapture(const std::string& filename, Result& res) {
+		FILE* f = OpenGameFile(filename, "rb");
+		if(!f) { res = "cannot open " + filename; return NULL; }
+		char magic[sizeof(CAPTURE_MAGIC) - 1];
+		Uint8 version = 0;
+		if(fread(magic, sizeof(magic), 1, f) != 1 || memcmp(magic, CAPTURE_MAGIC, sizeof(magic)) != 0
+		   || fread_endian<Uint8>(f, version) != 1 || version != CAPTURE_VERSION) {
+			fclose(f);
+			res = filename + " is not a network capture";
+			return NULL;
+		}
+		res = true;
+		return f;
+	}
+
+	struct Datagram {
+		NetworkAddr from;
+		std::string data;
+	};
+
+	struct SocketQueue {
+		std::multimap<AbsTime, Datagram> pending; // by the time they are due; equal times stay in order
+	};
+
+	struct Replay {
+		const void* sock; // the first socket which read with the port
+		NetworkSocket::Port port;
+		std::vector<CaptureRecord> in, out;
+		std::vector<NetworkAddr> inAddr;
+		size_t nextIn, nextOut;
+		size_t outEqual, outDiffering;
+		AbsTime start;
+		Replay() : sock(NULL), port(0), nextIn(0), nextOut(0), outEqual(0), outDiffering(0) {}
+	};
+
+	Mutex mutex;
+	volatile bool active = false;
+
+	std::map<std::string, NetConditions> conditions; // "" is the default
+	std::map<const void*, SocketQueue> queues;
+	size_t queuedDatagrams = 0; // in all queues
+	Uint32 randomState = 1;
+
+	FILE* captureFile = NULL;
+	AbsTime captureStart;
+	Uint64 capturedDatagrams = 0;
+
+	Replay* replay = NULL;
+
+	// We stay active until the delayed datagrams are handed out.
+	void updateActive() {
+		active = !conditions.empty() || captureFile || replay || queuedDatagrams > 0;
+	}
+
+	float randomPercent() {
+		randomState = randomState * 1103515245 + 12345;
+		return (float)((randomState >> 8) % 10000) / 100.0f;
+	}
+
+	const NetConditions* conditionsFor(const std::string& addr) {
+		std::map<std::string, NetConditions>::const_iterator i = conditions.find(addr);
+		if(i != conditions.end()) return &i->second;
+		const size_t p = addr.find_last_of(':');
+		if(p != std::string::npos) {
+			i = conditions.find(addr.substr(0, p));
+			if(i != conditions.end()) return &i->second;
+		}
+		i = conditions.find("");
+		return (i != conditions.end()) ? &i->second : NULL;
+	}
+
+	void capture(Uint8 dir, NetworkSocket::Port localPort, const NetworkAddr& addr, const void* data, int size) {
+		if(!captureFile) return;
+		const AbsTime now = GetTime();
+		writeRecord(captureFile, (Uint32)(now - captureStart).milliseconds(), dir, localPort, NetAddrToString(addr), data, size);
+		capturedDatagrams++;
+	}
+
+	void printReplayResult(const Replay& r) {
+		notes << "NetEmulator: replayed " << r.nextIn << " of " << r.in.size() << " received datagrams on port " << r.port;
+		notes << ", " << r.outEqual << " written datagrams equal to the capture, " << r.outDiffering << " differing";
+		notes << " (" << r.out.size() << " captured)" << endl;
+	}
+}
+
+
+void NetEmulator::setConditions(const std::string& addr, const NetConditions& cond) {
+	Mutex::ScopedLock lock(mutex);
+	const std::string key = (addr == "*") ? "" : addr;
+	if(cond.isNone())
+		conditions.erase(key);
+	else
+		conditions[key] = cond;
+	updateActive();
+}
+
+void NetEmulator::resetConditions() {
+	Mutex::ScopedLock lock(mutex);
+	conditions.clear();
+	// if there are delayed datagrams, we stay active until the reads got them
+	updateActive();
+}
+
+void NetEmulator::printStatus() {
+	Mutex::ScopedLock lock(mutex);
+	if(conditions.empty())
+		notes << "NetEmulator: no conditions set" << endl;
+	for(std::map<std::string, NetConditions>::const_iterator i = conditions.begin(); i != conditions.end(); ++i)
+		notes << "NetEmulator: " << (i->first.empty() ? "*" : i->first) << ": " << i->second.toString() << endl;
+	notes << "NetEmulator: " << queuedDatagrams << " datagrams delayed" << endl;
+	if(captureFile)
+		notes << "NetEmulator: capturing, " << capturedDatagrams << " datagrams so far" << endl;
+	if(replay)
+		printReplayResult(*replay);
+}
+
+Result NetEmulator::startCapture(const std::string& filename) {
+	FILE* f = OpenGameFile(filename, "wb");
+	if(!f) return "cannot open " + filename + " for writing";
+	fwrite(CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC) - 1, 1, f);
+	fwrite_endian<Uint8>(f, CAPTURE_VERSION);
+
+	Mutex::ScopedLock lock(mutex);
+	if(captureFile) fclose(captureFile);
+	captureFile = f;
+	captureStart = GetTime();
+	capturedDatagrams = 0;
+	updateActive();
+	notes << "NetEmulator: capturing to " << filename << endl;
+	return true;
+}
+
+void NetEmulator::stopCapture() {
+	Mutex::ScopedLock lock(mutex);
+	if(!captureFile) return;
+	fclose(captureFile);
+	captureFile = NULL;
+	updateActive();
+	notes << "NetEmulator: captured " << capturedDatagrams << " datagrams" << endl;
+}
+
+Result NetEmulator::startReplay(const std::string& filename, NetworkSocket::Port port) {
+	Result res = true;
+	FILE* f = openCapture(filename, res);
+	if(!f) return res;
+
+	Replay* r = new Replay();
+	r->port = port;
+	CaptureRecord rec;
+	while(readRecord(f, rec)) {
+		if(r->port == 0) r->port = rec.localPort;
+		if(rec.localPort != r->port) continue;
+		if(rec.dir == DIR_IN) {
+			r->in.push_back(rec);
+			r->inAddr.push_back(StringToNetAddr(rec.addr));
+		}
+		else
+			r->out.push_back(rec);
+	}
+	fclose(f);
+
+	if(r->in.empty()) {
+		delete r;
+		return filename + " has no received datagrams" + (port ? (" on port " + itoa(port)) : "");
+	}
+
+	Mutex::ScopedLock lock(mutex);
+	if(replay) {
+		printReplayResult(*replay);
+		delete replay;
+	}
+	replay = r;
+	updateActive();
+	notes << "NetEmulator: replaying " << r->in.size() << " datagrams of " << filename << " on port " << r->port << endl;
+	return true;
+}
+
+void NetEmulator::stopReplay() {
+	Mutex::ScopedLock lock(mutex);
+	if(!replay) return;
+	printReplayResult(*replay);
+	delete replay;
+	replay = NULL;
+	updateActive();
+}
+
+void NetEmulator::captureStats(const std::string& filename) {
+	Result res = true;
+	FILE* f = openCapture(filename, res);
+	if(!f) {
+		errors << "NetEmulator::captureStats: " << res.humanErrorMsg << endl;
+		return;
+	}
+
+	struct Stats {
+		Uint64 datagrams, bytes;
+		size_t maxSize;
+		Stats() : datagrams(0), bytes(0), maxSize(0) {}
+	};
+	std::map<std::string, Stats> stats; // by direction, local port and address
+	Uint32 duration = 0;
+	CaptureRecord rec;
+	while(readRecord(f, rec)) {
+		Stats& s = stats[std::string(rec.dir == DIR_IN ? "in  " : "out ") + itoa(rec.localPort) + " " + rec.addr];
+		s.datagrams++;
+		s.bytes += rec.data.size();
+		s.maxSize = MAX(s.maxSize, rec.data.size());
+		duration = MAX(duration, rec.time);
+	}
+	fclose(f);
+
+	const float secs = MAX(duration / 1000.0f, 0.001f);
+	notes << "capture " << filename << ": " << secs << " secs" << endl;
+	for(std::map<std::string, Stats>::const_iterator i = stats.begin(); i != stats.end(); ++i) {
+		const Stats& s = i->second;
+		notes << "  " << i->first << ": " << s.datagrams << " datagrams, " << (s.bytes / secs) << " bytes/sec, ";
+		notes << "avg size " << (s.bytes / s.datagrams) << ", max size " << s.maxSize << endl;
+	}
+}
+
+bool NetEmulator::isActive() {
+	return active;
+}
+
+void NetEmulator::incoming(const void* sock, NetworkSocket::Port localPort, const NetworkAddr& from, const char* data, int size) {
+	Mutex::ScopedLock lock(mutex);
+	if(replay && replay->port == localPort)
+		return; // only the captured data goes in there
+
+	AbsTime due = GetTime();
+	int copies = 1;
+	if(const NetConditions* c = conditionsFor(NetAddrToString(from))) {
+		if(randomPercent() < c->loss) return;
+		if(randomPercent() < c->duplicate) copies = 2;
+		int delay = MAX(c->latency, 0);
+		if(c->jitter > 0) delay += (int)(randomPercent() * c->jitter / 100.0f);
+		if(randomPercent() < c->reorder) delay += MAX(c->jitter, 50);
+		due += TimeDiff(delay);
+	}
+
+	SocketQueue& q = queues[sock];
+	Datagram d;
+	d.from = from;
+	d.data.assign(data, size);
+	for(int i = 0; i < copies; ++i)
+		q.pending.insert(std::make_pair(due, d));
+	queuedDatagrams += copies;
+}
+
+int NetEmulator::nextIncoming(const void* sock, NetworkSocket::Port localPort, NetworkAddr& from, void* buffer, int nbytes) {
+	Mutex::ScopedLock lock(mutex);
+	const AbsTime now = GetTime();
+
+	if(replay && replay->port == localPort && (replay->sock == NULL || replay->sock == sock)) {
+		if(replay->sock == NULL) {
+			replay->sock = sock;
+			replay->start = now;
+		}
+		if(replay->nextIn >= replay->in.size() || now - replay->start < TimeDiff((Uint64)replay->in[replay->nextIn].time))
+			return -1;
+		const size_t i = replay->nextIn++;
+		const std::string& data = replay->in[i].data;
+		from = replay->inAddr[i];
+		const int ret = MIN((int)data.size(), nbytes);
+		memcpy(buffer, data.data(), ret);
+		capture(DIR_IN, localPort, from, buffer, ret);
+		return ret;
+	}
+
+	std::map<const void*, SocketQueue>::iterator q = queues.find(sock);
+	if(q == queues.end() || q->second.pending.empty() || now < q->second.pending.begin()->first)
+		return -1;
+
+	std::multimap<AbsTime, Datagram>::iterator d = q->second.pending.begin();
+	from = d->second.from;
+	const int ret = MIN((int)d->second.data.size(), nbytes);
+	memcpy(buffer, d->second.data.data(), ret);
+	q->second.pending.erase(d);
+	queuedDatagrams--;
+	if(queuedDatagrams == 0) updateActive();
+	capture(DIR_IN, localPort, from, buffer, ret);
+	return ret;
+}
+
+bool NetEmulator::outgoing(const void* sock, NetworkSocket::Port localPort, const NetworkAddr& to, const void* data, int size) {
+	Mutex::ScopedLock lock(mutex);
+	capture(DIR_OUT, localPort, to, data, size);
+
+	if(replay && replay->sock == sock) {
+		if(replay->nextOut < replay->out.size()) {
+			const std::string& captured = replay->out[replay->nextOut++].data;
+			if(captured.size() == (size_t)size && memcmp(captured.data(), data, size) == 0)
+				replay->outEqual++;
+			else
+				replay->outDiffering++;
+		}
+		else
+			replay->outDiffering++;
+		return false;
+	}
+
+	return true;
+}
+
+void NetEmulator::socketClosed(const void* sock) {
+	Mutex::ScopedLock lock(mutex);
+	std::map<const void*, SocketQueue>::iterator q = queues.find(sock);
+	if(q != queues.end()) {
+		queuedDatagrams -= q->second.pending.size();
+		queues.erase(q);
+		updateActive();
+	}
+	if(replay && replay->sock == sock)
+		replay->sock = NULL; // the next socket with the port continues
+}
@@ -35,6 +35,7 @@
 #include "TaskManager.h"
 #include "ReadWriteLock.h"
 #include "Mutex.h"
+#include "NetEmulator.h"
 
 
 
@@ -50,6 +51,8 @@ static std::string GetLastErrorAndReset() {
 #endif
 
 #include <map>
+#include <vector>
+#include <ctime>
 
 #include <nl.h>
 // workaraound for bad named makros by nl.h
@@ -309,6 +312,10 @@ nlPrepareClose
 #define INADDR_NONE ((unsigned long) -1)
 #endif
 
+#ifdef __linux__
+#define HAVE_MMSG /* recvmmsg and sendmmsg */
+#endif
+
 /* SGI do not include socklen_t */
 #if defined __sgi
 typedef int socklen_t;
@@ -645,6 +652,178 @@ struct CloseSocketWorker : Task {
 
 
 
+// ---------------------------------------------------
+// ----------- batched datagram I/O -----------------
+
+// With Advanced.BatchedNetIO, unconnected UDP sockets receive and send many
+// datagrams with one syscall (recvmmsg/sendmmsg, Linux only). Read() hands out
+// the received datagrams one by one; Write() only queues them while a write
+// batch is open (see NetworkSocket::beginWriteBatch()). All other sockets and
+// systems use the normal HawkNL calls.
+
+// set if the kernel doesn't have recvmmsg/sendmmsg
+static bool bBatchedNetIOUnsupported = false;
+
+struct DatagramBatch {
+	enum { MAX_DATAGRAMS = 32, MAX_DATAGRAM_SIZE = 4096 }; // same buffer size as CBytestream::Read
+	std::vector<char> buffer; // allocated once for the lifetime of the socket
+	NLaddress addr[MAX_DATAGRAMS];
+	int size[MAX_DATAGRAMS];
+	int count, next;
+	bool writing;
+
+	DatagramBatch() : buffer(MAX_DATAGRAMS * MAX_DATAGRAM_SIZE), count(0), next(0), writing(false) {
+		memset(addr, 0, sizeof(addr));
+	}
+	char* data(int i) { return &buffer[i * MAX_DATAGRAM_SIZE]; }
+	bool full() const { return count >= MAX_DATAGRAMS; }
+};
+
+static bool batchedNetIOEnabled() {
+#ifdef HAVE_MMSG
+	return tLXOptions && tLXOptions->bBatchedNetIO && !bBatchedNetIOUnsupported;
+#else
+	return false;
+#endif
+}
+
+// returned by nlReadBatch/nlWriteBatch if we must use the HawkNL calls
+static const int NL_BATCH_UNSUPPORTED = -2;
+
+struct NlSocketLock {
+	NLsocket socket;
+	NLint which;
+	bool locked;
+	NlSocketLock(NLsocket s, NLint w) : socket(s), which(w) {
+		locked = nlIsValidSocket(socket) == NL_TRUE && nlLockSocket(socket, which) == NL_TRUE;
+	}
+	~NlSocketLock() { if(locked) nlUnlockSocket(socket, which); }
+};
+
+// same cases as the unconnected UDP path in sock_Read/sock_Write
+static bool nlIsBatchable(const nl_socket_t* sock) {
+	return sock->type == NL_UNRELIABLE && sock->connected == NL_FALSE
+		&& sock->connecting == NL_FALSE && sock->conerror == NL_FALSE;
+}
+
+// does what sock_Read does with the sender address
+static void nlSetReceivedFrom(NLsocket socket, const NLaddress& addr) {
+	NlSocketLock lock(socket, NL_READ);
+	if(lock.locked)
+		memcpy(&nlSockets[socket]->addressin, &addr, sizeof(NLaddress));
+}
+
+static bool nlGetSendAddr(NLsocket socket, NLaddress& addr) {
+	NlSocketLock lock(socket, NL_WRITE);
+	if(!lock.locked) return false;
+	memcpy(&addr, &nlSockets[socket]->addressout, sizeof(NLaddress));
+	return true;
+}
+
+#ifdef HAVE_MMSG
+
+static void setupMsgs(DatagramBatch& batch, struct mmsghdr* msgs, struct iovec* iovs, int num, bool receive) {
+	memset(msgs, 0, sizeof(struct mmsghdr) * num);
+	for(int i = 0; i < num; ++i) {
+		iovs[i].iov_base = batch.data(i);
+		iovs[i].iov_len = receive ? (size_t)DatagramBatch::MAX_DATAGRAM_SIZE : (size_t)batch.size[i];
+		msgs[i].msg_hdr.msg_iov = &iovs[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+		// like HawkNL, the NLaddress starts with the sockaddr_in
+		msgs[i].msg_hdr.msg_name = &batch.addr[i];
+		msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+	}
+}
+
+// Receives up to MAX_DATAGRAMS datagrams. Returns their number, 0 if there is
+// nothing to read, NL_INVALID on errors or NL_BATCH_UNSUPPORTED.
+static int nlReadBatch(NLsocket socket, DatagramBatch& batch) {
+	batch.count = batch.next = 0;
+	NlSocketLock lock(socket, NL_READ);
+	if(!lock.locked) return NL_INVALID;
+	nl_socket_t* sock = nlSockets[socket];
+	if(!nlIsBatchable(sock)) return NL_BATCH_UNSUPPORTED;
+
+	struct mmsghdr msgs[DatagramBatch::MAX_DATAGRAMS];
+	struct iovec iovs[DatagramBatch::MAX_DATAGRAMS];
+	setupMsgs(batch, msgs, iovs, DatagramBatch::MAX_DATAGRAMS, true);
+
+	int ret;
+	do {
+		ret = recvmmsg((SOCKET)sock->realsocket, msgs, DatagramBatch::MAX_DATAGRAMS, MSG_DONTWAIT, NULL);
+	} while(ret == SOCKET_ERROR && sockerrno == EINTR);
+
+	if(ret == SOCKET_ERROR) {
+		if(sockerrno == EWOULDBLOCK || sockerrno == EAGAIN)
+			return 0;
+		if(sockerrno == ENOSYS) {
+			warnings << "recvmmsg not supported by the kernel, batched network I/O disabled" << endl;
+			bBatchedNetIOUnsupported = true;
+			return NL_BATCH_UNSUPPORTED;
+		}
+		nlSetError(NL_SYSTEM_ERROR);
+		return NL_INVALID;
+	}
+
+	for(int i = 0; i < ret; ++i) {
+		batch.size[i] = (int)msgs[i].msg_len;
+		batch.addr[i].valid = NL_TRUE;
+	}
+	batch.count = ret;
+	return ret;
+}
+
+// Sends the queued datagrams. Returns the number of sent ones, NL_INVALID if
+// none could be sent because of an error, or NL_BATCH_UNSUPPORTED.
+// Like a single UDP write, datagrams are lost if the send buffer is full.
+static int nlWriteBatch(NLsocket socket, DatagramBatch& batch) {
+	const int count = batch.count;
+	batch.count = 0;
+	if(count == 0) return 0;
+
+	NlSocketLock lock(socket, NL_WRITE);
+	if(!lock.locked) return NL_INVALID;
+	nl_socket_t* sock = nlSockets[socket];
+	if(!nlIsBatchable(sock)) { batch.count = count; return NL_BATCH_UNSUPPORTED; }
+
+	struct mmsghdr msgs[DatagramBatch::MAX_DATAGRAMS];
+	struct iovec iovs[DatagramBatch::MAX_DATAGRAMS];
+	setupMsgs(batch, msgs, iovs, count, false);
+
+	int pos = 0, sent = 0;
+	while(pos < count) {
+		const int ret = sendmmsg((SOCKET)sock->realsocket, msgs + pos, count - pos, MSG_DONTWAIT);
+		if(ret == SOCKET_ERROR) {
+			if(sockerrno == EINTR) continue;
+			if(sockerrno == EWOULDBLOCK || sockerrno == EAGAIN) break;
+			if(sockerrno == ENOSYS && pos == 0) {
+				warnings << "sendmmsg not supported by the kernel, batched network I/O disabled" << endl;
+				bBatchedNetIOUnsupported = true;
+				batch.count = count;
+				return NL_BATCH_UNSUPPORTED;
+			}
+			// this datagram cannot be sent (e.g. unreachable address); go on with the next
+			nlSetError(NL_SYSTEM_ERROR);
+			pos++;
+			continue;
+		}
+		pos += ret;
+		sent += ret;
+	}
+	if(sent == 0 && nlGetError() == NL_SYSTEM_ERROR)
+		return NL_INVALID;
+	return sent;
+}
+
+#else
+
+static int nlReadBatch(NLsocket, DatagramBatch& batch) { batch.count = batch.next = 0; return NL_BATCH_UNSUPPORTED; }
+static int nlWriteBatch(NLsocket, DatagramBatch&) { return NL_BATCH_UNSUPPORTED; }
+
+#endif // HAVE_MMSG
+
+
+
 
 struct NetworkSocket::EventHandler {
 	struct SharedData : DontCopyTag {
@@ -684,8 +863,10 @@ struct NetworkSocket::EventHandler {
 struct NetworkSocket::InternSocket {
 	NLsocket sock;
 	SmartPointer<EventHandler> eventHandler;
+	DatagramBatch* readBatch; // created on first use, see batched datagram I/O
+	DatagramBatch* writeBatch;
 	
-	InternSocket() : sock(NL_INVALID) {}
+	InternSocket() : sock(NL_INVALID), readBatch(NULL), writeBatch(NULL) {}
 	~InternSocket() {
 		// just a double check - there really shouldn't be a case where this could be true
 		if(eventHandler.get()) {
@@ -693,6 +874,27 @@ struct NetworkSocket::InternSocket {
 			eventHandler->quit();
 			eventHandler = NULL;
 		}
+		delete readBatch; readBatch = NULL;
+		delete writeBatch; writeBatch = NULL;
+	}
+	
+	bool hasBatchedData() const { return readBatch && readBatch->next < readBatch->count; }
+	
+	// Takes the next datagram from the read batch (receives a new batch if needed).
+	// Returns false if the datagram must be read with nlRead.
+	bool readBatched(void* buffer, int nbytes, NLint& ret) {
+		if(!hasBatchedData()) {
+			if(!batchedNetIOEnabled()) return false;
+			if(!readBatch) readBatch = new DatagramBatch();
+			ret = nlReadBatch(sock, *readBatch);
+			if(ret == NL_BATCH_UNSUPPORTED) return false;
+			if(ret <= 0) return true;
+		}
+		const int i = readBatch->next++;
+		ret = MIN(readBatch->size[i], nbytes);
+		memcpy(buffer, readBatch->data(i), ret);
+		nlSetReceivedFrom(sock, readBatch->addr[i]);
+		return true;
 	}
 };
 
@@ -910,6 +1112,13 @@ void NetworkSocket::Close() {
 		return;
 	}
 	
+	if(m_socket->writeBatch && m_socket->writeBatch->writing)
+		flushWriteBatch();
+	if(m_socket->readBatch)
+		m_socket->readBatch->count = m_socket->readBatch->next = 0;
+	if(m_type == NST_UDP)
+		NetEmulator::socketClosed(m_socket);
+	
 	if(m_type != NST_TCP) {
 		nlClose(m_socket->sock);
 	}
@@ -938,6 +1147,32 @@ int NetworkSocket::Write(const void* buffer, int nbytes) {
 		return NL_INVALID;
 	}
 	
+	if(m_type == NST_UDP && NetEmulator::isActive()) {
+		NetworkAddr to;
+		nlGetSendAddr(m_socket->sock, *getNLaddr(to));
+		if(!NetEmulator::outgoing(m_socket, GetNetAddrPort(localAddress()), to, buffer, nbytes))
+			return nbytes; // replayed socket; as if it was sent
+	}
+	
+	DatagramBatch* batch = m_socket->writeBatch;
+	if(batch && batch->writing) {
+		if(nbytes <= DatagramBatch::MAX_DATAGRAM_SIZE) {
+			if(batch->full())
+				sendWriteBatch();
+			const int i = batch->count;
+			if(!nlGetSendAddr(m_socket->sock, batch->addr[i])) {
+				errors << "WriteSocket " << debugString() << ": cannot get the destination" << endl;
+				return NL_INVALID;
+			}
+			memcpy(batch->data(i), buffer, nbytes);
+			batch->size[i] = nbytes;
+			batch->count++;
+			return nbytes;
+		}
+		// too big for the batch; send the queued ones first to keep the order
+		sendWriteBatch();
+	}
+
 	ResetSocketError();
 	NLint ret = nlWrite(m_socket->sock, buffer, nbytes);
 
@@ -965,8 +1200,32 @@ int NetworkSocket::Read(void* buffer, int nbytes) {
 		return NL_INVALID;
 	}
 
+	if(m_type == NST_UDP && NetEmulator::isActive())
+		return readEmulated(buffer, nbytes);
+	return readRaw(buffer, nbytes);
+}
+
+// Everything which arrived goes into the NetEmulator, we return what it hands out.
+int NetworkSocket::readEmulated(void* buffer, int nbytes) {
+	const Port port = GetNetAddrPort(localAddress());
+	char buf[DatagramBatch::MAX_DATAGRAM_SIZE];
+	NLint ret = NL_INVALID;
+	while((ret = readRaw(buf, sizeof(buf))) > 0)
+		NetEmulator::incoming(m_socket, port, remoteAddress(), buf, ret);
+
+	NetworkAddr from;
+	ret = NetEmulator::nextIncoming(m_socket, port, from, buffer, nbytes);
+	if(ret < 0)
+		return NL_INVALID;
+	nlSetReceivedFrom(m_socket->sock, *getNLaddr(from));
+	return ret;
+}
+
+int NetworkSocket::readRaw(void* buffer, int nbytes) {
 	ResetSocketError();
-	NLint ret = nlRead(m_socket->sock, buffer, nbytes);
+	NLint ret = NL_INVALID;
+	if(m_type != NST_UDP || !m_socket->readBatched(buffer, nbytes, ret))
+		ret = nlRead(m_socket->sock, buffer, nbytes);
 	
 	// Error checking
 	if (ret == NL_INVALID)  {
@@ -988,6 +1247,45 @@ int NetworkSocket::Read(void* buffer, int nbytes) {
 
 
 
+void NetworkSocket::beginWriteBatch() {
+	if(!batchedNetIOEnabled() || m_type != NST_UDP) return;
+	if(!m_socket->writeBatch) m_socket->writeBatch = new DatagramBatch();
+	m_socket->writeBatch->writing = true;
+}
+
+void NetworkSocket::flushWriteBatch() {
+	if(!m_socket->writeBatch || !m_socket->writeBatch->writing) return;
+	sendWriteBatch();
+	m_socket->writeBatch->writing = false;
+}
+
+void NetworkSocket::sendWriteBatch() {
+	DatagramBatch& batch = *m_socket->writeBatch;
+	if(batch.count == 0) return;
+
+	ResetSocketError();
+	const int ret = nlWriteBatch(m_socket->sock, batch);
+	if(ret == NL_BATCH_UNSUPPORTED) {
+		// send them one by one; the destination is still set after that like with a single write
+		NLaddress oldAddr;
+		const bool haveOldAddr = nlGetSendAddr(m_socket->sock, oldAddr);
+		for(int i = 0; i < batch.count; ++i) {
+			nlSetRemoteAddr(m_socket->sock, &batch.addr[i]);
+			nlWrite(m_socket->sock, batch.data(i), batch.size[i]);
+		}
+		if(haveOldAddr) nlSetRemoteAddr(m_socket->sock, &oldAddr);
+		batch.count = 0;
+	}
+	
+	if (ret == NL_INVALID || nlGetError() != NL_NO_ERROR)  {
+#ifdef DEBUG
+		std::string errStr = GetLastErrorStr(); // cache errStr that debugString will not overwrite it
+		errors << "WriteSocket batch " << debugString() << ": " << errStr << endl;
+#endif
+	}
+	ResetSocketError();
+}
+
 bool NetworkSocket::isReady() const {
 	return isOpen() && nlUpdateState(m_socket->sock);
 }
@@ -1291,10 +1589,19 @@ bool AreNetAddrEqual(const NetworkAddr& addr1, const NetworkAddr& addr2) {
 		return nlAddrCompare(getNLaddr(addr1), getNLaddr(addr2)) != NL_FALSE;
 }
 
+Uint64 GetNetAddrKey(const NetworkAddr& addr) {
+	const NLaddress* nlAddr = getNLaddr(addr);
+	if(nlAddr == NULL || nlAddr->valid == NL_FALSE)
+		return 0;
+	// we only use the IP driver, so this is a sockaddr_in
+	const struct sockaddr_in* in = (const struct sockaddr_in*)nlAddr;
+	return ((Uint64)ntohl(in->sin_addr.s_addr) << 16) | ntohs(in->sin_port);
+}
+
 
 
 
-Event<> onDnsReady;
+Event<DnsEventData> onDnsReady;
 
 // copied from HawkNL sock.c and modified to not use nlStringToNetAddr
 static bool GetAddrFromNameAsync_Internal(const NLchar* name, NLaddress* address) {
@@ -1379,21 +1686,21 @@ bool GetNetAddrFromNameAsync(const std::string& name, NetworkAddr& addr)
 		NetAddrInternal::Ptr_t address;
 		
 		Result handle() {
-			if(GetAddrFromNameAsync_Internal(addr_name.c_str(), address.get())) {
+			bool success = GetAddrFromNameAsync_Internal(addr_name.c_str(), address.get());
+			if(success) {
 				// TODO: we use default DNS record expire time of 1 hour, we should include some DNS client to make it in correct way
 				AddToDnsCache(addr_name, NetworkAddr(NetAddrInternal(*address.get())));
 			}
 			
-			// TODO: handle failures here? there should be, but we only have the valid field
-			// For now, we leave it at false, so the timeout handling will just occur.
+			{
+				// before the event, so that a handler can start a new query right away
+				Mutex::ScopedLock l(PendingDnsQueriesMutex);
+				PendingDnsQueries.erase(addr_name);
+			}
 			
 			// push a net event
-			onDnsReady.pushToMainQueue(EventData());
-
-			Mutex::ScopedLock l(PendingDnsQueriesMutex);
-			PendingDnsQueries.erase(addr_name);
-			
-						return true;
+			onDnsReady.pushToMainQueue(DnsEventData(addr_name, success));
+			return true;
 		}
 	};
 	GetAddrFromNameAsync_Executer* data = new GetAddrFromNameAsync_Executer();
@@ -1408,6 +1715,7 @@ bool GetNetAddrFromNameAsync(const std::string& name, NetworkAddr& addr)
 
 
 bool NetworkSocket::isDataAvailable() {
+	if(m_socket->hasBatchedData()) return true;
 	NLint group = nlGroupCreate();
 	nlGroupAddSocket( group, m_socket->sock );
 	NLsocket sock_out[2];
@@ -1433,3 +1741,75 @@ void NetworkSocket::reapplyRemoteAddress() {
 		errors << "NetworkSocket::reapplyRemoteAddress cannot be done as " << TypeStr(m_type) << endl;
 }
 
+
+
+///////////////////
+// Loopback benchmark of the normal and the batched datagram I/O
+
+void BenchmarkNetworkIO(int packets, int packetSize) {
+	const int burst = 32; // datagrams per frame in each direction, like the server sends to 32 clients
+	packets = CLAMP(packets, burst, 10000000);
+	packetSize = CLAMP(packetSize, 1, (int)DatagramBatch::MAX_DATAGRAM_SIZE);
+	const int rounds = packets / burst;
+	notes << "BenchmarkNetworkIO: " << rounds * burst << " datagrams of " << packetSize << " bytes each way, bursts of " << burst << endl;
+#ifndef HAVE_MMSG
+	notes << "BenchmarkNetworkIO: batched I/O is not available on this system" << endl;
+#endif
+
+	if(!tLXOptions) return;
+	const bool oldBatched = tLXOptions->bBatchedNetIO;
+	std::vector<char> data(packetSize, 'x'), buf(DatagramBatch::MAX_DATAGRAM_SIZE);
+	double normalUs = 0;
+
+	for(int batched = 0; batched < 2; ++batched) {
+		tLXOptions->bBatchedNetIO = batched != 0;
+
+		NetworkSocket server, client;
+		if(!server.OpenUnreliable(0) || !client.OpenUnreliable(0)) {
+			errors << "BenchmarkNetworkIO: cannot open the sockets" << endl;
+			break;
+		}
+		const NetworkAddr serverAddr = StringToNetAddr("127.0.0.1:" + itoa(GetNetAddrPort(server.localAddress())));
+		const NetworkAddr clientAddr = StringToNetAddr("127.0.0.1:" + itoa(GetNetAddrPort(client.localAddress())));
+		client.setRemoteAddress(serverAddr);
+
+		// only the server side is measured; the clients always send and receive one by one
+		size_t serverReceived = 0, clientReceived = 0;
+		std::clock_t serverCpu = 0;
+		const AbsTime startTime = GetTime();
+		for(int r = 0; r < rounds; ++r) {
+			// the clients send their input
+			for(int i = 0; i < burst; ++i)
+				client.Write(&data[0], packetSize);
+
+			std::clock_t start = std::clock();
+			while(server.Read(&buf[0], (int)buf.size()) > 0)
+				serverReceived++;
+			// the server sends the updates
+			server.beginWriteBatch();
+			for(int i = 0; i < burst; ++i) {
+				server.setRemoteAddress(clientAddr);
+				server.Write(&data[0], packetSize);
+			}
+			server.flushWriteBatch();
+			serverCpu += std::clock() - start;
+
+			while(client.Read(&buf[0], (int)buf.size()) > 0)
+				clientReceived++;
+		}
+		const TimeDiff wallTime = GetTime() - startTime;
+
+		const size_t total = (size_t)rounds * burst * 2;
+		const double perPacketUs = (double)serverCpu * 1000000.0 / CLOCKS_PER_SEC / total;
+		notes << "BenchmarkNetworkIO: " << (batched ? "batched" : "normal") << ": "
+			<< (int)(total / MAX(wallTime.seconds(), 0.001f)) << " datagrams/s in total, "
+			<< perPacketUs << " us server CPU per datagram, "
+			<< (total - serverReceived - clientReceived) << " lost" << endl;
+		if(!batched)
+			normalUs = perPacketUs;
+		else if(normalUs > 0)
+			notes << "BenchmarkNetworkIO: batched needs " << (100.0 * perPacketUs / normalUs) << "% of the server CPU time" << endl;
+	}
+
+	tLXOptions->bBatchedNetIO = oldBatched;
+}
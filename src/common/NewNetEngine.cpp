@@ -15,64 +15,230 @@
 #include "Entity.h"
 #include "CServer.h"
 #include "game/Game.h"
+#include "GameStateArena.h"
+#include "CProjectile.h"
+#include "util/List.h"
+#include "util/macros.h"
 
 namespace NewNet
 {
 
 // -------- The stuff that interacts with OLX: save/restore game state and calculate physics ---------
 
-static std::vector<boost::shared_ptr<CWorm> > SavedWormState;
-NetSyncedRandom netRandom, netRandom_Saved;
-AbsTime cClientLastSimulationTime;
+// All the state of the last StateHistoryTicks ticks, one block per tick; the terrain is kept in CMap
+static GameStateArena StateHistory;
+static const size_t StateHistoryTicks = 64;
+NetSyncedRandom netRandom;
 
 void SaveState()
 {
-	netRandom_Saved = netRandom;
-	cClientLastSimulationTime = cClient->fLastSimulationTime;
-	game.gameMap()->NewNet_SaveToMemory();
-
-	cClient->NewNet_SaveProjectiles();
+	if( StateHistory.historyLen() == 0 )
+		StateHistory.init(StateHistoryTicks);
+	StateHistory.beginTick(cClient->fLastSimulationTime.milliseconds());
+	StateHistory.write(netRandom);
+	StateHistory.write(cClient->fLastSimulationTime);
+	game.gameMap()->NewNet_SaveToMemory(StateHistoryTicks);
+
+	cClient->NewNet_SaveProjectiles(StateHistory);
 	NewNet_SaveEntities();
 
-	SavedWormState.clear();
-	SavedWormState.resize(game.worms()->size());
-	size_t i = 0;
+	const Uint32 numWorms = (Uint32)game.worms()->size();
+	StateHistory.write(numWorms);
 	for_each_iterator(CWorm*, w, game.worms()) {
-		SavedWormState[i] = boost::shared_ptr<CWorm>(new CWorm);
-		SavedWormState[i]->setID( w->get()->getID() );
-		SavedWormState[i]->NewNet_CopyWormState( *w->get() );
+		// the size is written first so that we can skip worms which left
+		const Uint32 id = w->get()->getID();
+		Uint32 size = 0;
+		StateHistory.write(id);
+		const size_t sizePos = StateHistory.tell();
+		StateHistory.write(size);
+		w->get()->NewNet_SaveState(StateHistory);
+		size = (Uint32)(StateHistory.tell() - sizePos - sizeof(size));
+		StateHistory.patch(sizePos, &size, sizeof(size));
 	}
 };
 
-void RestoreState()
+void RestoreState( size_t ticksBack )
 {
-	assert(false); // this code here is outdated and should be checked before used!
+	if( ticksBack >= StateHistory.count() )
+	{
+		errors << "NewNet::RestoreState: only " << StateHistory.count() << " ticks saved, cannot go back " << ticksBack << endl;
+		return;
+	}
 
-	netRandom = netRandom_Saved;
-	cClient->fLastSimulationTime = cClientLastSimulationTime;
-	game.gameMap()->NewNet_RestoreFromMemory();
+	GameStateArena::Reader r = StateHistory.reader(ticksBack);
+	bool ok = r.read(netRandom) && r.read(cClient->fLastSimulationTime);
+	game.gameMap()->NewNet_RestoreFromMemory(ticksBack + 1);
 
-	cClient->NewNet_LoadProjectiles();
+	ok = ok && cClient->NewNet_LoadProjectiles(r);
 	NewNet_LoadEntities();
 
-	for_each_iterator(CWorm*, w, FullCopyIterator(game.worms()))
-		game.removeWorm(w->get());
-	
-	foreach(savedWorm, SavedWormState) {
-		SmartPointer<profile_t> profile(new profile_t);
-		profile->iTeam = (**savedWorm).getTeam();
-		profile->iType = (**savedWorm).getType()->toInt();
-		CWorm* w = game.createNewWorm
-		(
-		 (**savedWorm).getID(),
-		 (**savedWorm).getLocal(),
-		 profile,
-		 (**savedWorm).getClientVersion()
-		 );
-		w->NewNet_CopyWormState( **savedWorm );
+	Uint32 numWorms = 0;
+	ok = ok && r.read(numWorms);
+	for( Uint32 i = 0; ok && i < numWorms; i++ )
+	{
+		Uint32 id = 0, size = 0;
+		ok = r.read(id) && r.read(size);
+		if( !ok ) break;
+		CWorm* w = game.wormById(id, false);
+		if( w == NULL )
+			ok = r.skip(size);
+		else
+			ok = w->NewNet_LoadState(r);
 	}
+	if( !ok )
+		errors << "NewNet::RestoreState: saved state is invalid" << endl;
+
+	// The newer ticks are simulated again
+	StateHistory.dropNewest(ticksBack);
 };
 
+///////////////////
+// Round trip of the saved state on real game objects
+
+namespace {
+	// The attributes are the synced state of the objects. These are not changed by the
+	// simulation (or only by the server), so the rollback doesn't restore them.
+	bool isRolledBack(ClassId classId, const AttrDesc* attrDesc)
+	{
+		static const char* const wormAttrs[] = {
+			"iTeam", "sName", "cSkin", "iLives", "bCanRespawnNow", "bRespawnRequested", "bSpawnedOnce", "bSpectating",
+			"bWeaponsReady", "fSpeedFactor", "bCanUseNinja", "fDamageFactor", "fShieldFactor", "bCanAirJump", "bTagIT",
+			"iDirtCount", "bLobbyReady", "iKills", "iDeaths", "iSuicides", "iTeamkills", "fDamage", "iTotalWins",
+			"iTotalLosses", "iTotalKills", "iTotalDeaths", "iTotalSuicides", "iAFK", "sAFKMessage" };
+		if( classId == LuaID<CWorm>::value )
+		{
+			for( size_t i = 0; i < sizeof(wormAttrs) / sizeof(wormAttrs[0]); i++ )
+				if( attrDesc->attrName == wormAttrs[i] )
+					return false;
+		}
+		// The rope is not injured
+		if( classId == LuaID<CNinjaRope>::value && attrDesc->attrName == "health" )
+			return false;
+		return true;
+	}
+
+	enum WalkMode { WALK_INIT, WALK_CHANGE, WALK_COLLECT };
+	typedef std::vector< std::pair<std::string, ScriptVar_t> > StateValues;
+
+	ScriptVar_t changedValue(const ScriptVar_t& v)
+	{
+		switch( v.type )
+		{
+			case SVT_BOOL: return ScriptVar_t( !(bool)v );
+			case SVT_INT32: return ScriptVar_t( (int32_t)v + 1 );
+			case SVT_UINT64: return ScriptVar_t( (uint64_t)v + 1 );
+			case SVT_FLOAT: return ScriptVar_t( (float)v + 0.5f );
+			case SVT_VEC2: return ScriptVar_t( (CVec)v + CVec(1, 2) );
+			case SVT_STRING: return ScriptVar_t( (std::string)v + "x" );
+			default: return v;
+		}
+	}
+
+	void walkAttrs(BaseObject* obj, ClassId classId, const std::string& path, WalkMode mode, StateValues& values);
+
+	// Custom values are walked into: the rope, the weapon slots and the lists
+	void walkCustom(CustomVar* c, const std::string& path, WalkMode mode, StateValues& values)
+	{
+		if( DynamicList* l = dynamic_cast<DynamicList*>(c) )
+		{
+			if( mode == WALK_INIT && l->size() == 0 && l->canResize() )
+				l->resize(3);
+			if( mode == WALK_COLLECT )
+				values.push_back( std::make_pair( path + ".size", ScriptVar_t( (int32_t)l->size() ) ) );
+			for( size_t i = 0; i < l->size(); i++ )
+			{
+				ScriptVar_t v = l->getGeneric(i);
+				const std::string name = path + "[" + itoa(i) + "]";
+				if( v.isCustomType() )
+					walkCustom( v.customVar(), name, mode, values );
+				else if( mode == WALK_COLLECT )
+					values.push_back( std::make_pair( name, v ) );
+				else
+					l->writeGeneric( i, changedValue(v) );
+			}
+		}
+		else if( worm_state_t* s = dynamic_cast<worm_state_t*>(c) )
+		{
+			// no attributes
+			if( mode == WALK_COLLECT )
+				values.push_back( std::make_pair( path, ScriptVar_t( (int32_t)s->asInt() ) ) );
+			else
+				s->fromInt( s->asInt() ^ 0x0F );
+		}
+		else
+			walkAttrs( c, c->thisRef.classId, path, mode, values );
+	}
+
+	void walkAttrs(BaseObject* obj, ClassId classId, const std::string& path, WalkMode mode, StateValues& values)
+	{
+		std::vector<const AttrDesc*> attrDescs = getAttrDescs(classId, true);
+		foreach( a, attrDescs )
+		{
+			if( !isRolledBack(classId, *a) )
+				continue;
+			ScriptVarPtr_t p = (*a)->getValueScriptPtr(obj);
+			const std::string name = path + "." + (*a)->attrName;
+			if( isCustomType(p.type) )
+				walkCustom( p.customVar(), name, mode, values );
+			else if( mode == WALK_COLLECT )
+				values.push_back( std::make_pair( name, p.asScriptVar() ) );
+			else
+				p.fromScriptVar( changedValue( p.asScriptVar() ) );
+		}
+	}
+
+	// Changes all rolled back attributes (and fills the empty lists), saves the object,
+	// changes them again and loads it
+	template< typename T >
+	bool roundTrip(T& obj, ClassId classId, const std::string& name)
+	{
+		StateValues dummy, saved, loaded;
+		walkAttrs( &obj, classId, name, WALK_INIT, dummy );
+		walkAttrs( &obj, classId, name, WALK_COLLECT, saved );
+
+		GameStateArena arena;
+		arena.init(1);
+		arena.beginTick(0);
+		obj.NewNet_SaveState(arena);
+		walkAttrs( &obj, classId, name, WALK_CHANGE, dummy );
+		GameStateArena::Reader r = arena.reader(0);
+		if( !obj.NewNet_LoadState(r) || !r.isEmpty() )
+		{
+			errors << "NewNet::TestStateRoundTrip: " << name << " doesn't load what it saved" << endl;
+			return false;
+		}
+		walkAttrs( &obj, classId, name, WALK_COLLECT, loaded );
+
+		bool ok = saved.size() == loaded.size();
+		for( size_t i = 0; ok && i < saved.size(); i++ )
+		{
+			if( saved[i].second == loaded[i].second )
+				continue;
+			errors << "NewNet::TestStateRoundTrip: " << saved[i].first << " is not restored (saved " << saved[i].second.toString()
+				<< ", loaded " << loaded[i].second.toString() << ")" << endl;
+			ok = false;
+		}
+		if( saved.size() != loaded.size() )
+			errors << "NewNet::TestStateRoundTrip: " << name << " has other values after the load" << endl;
+		notes << "NewNet::TestStateRoundTrip: " << name << ", " << saved.size() << " values " << (ok ? "restored" : "NOT restored") << endl;
+		return ok;
+	}
+}
+
+bool TestStateRoundTrip()
+{
+	bool ok = true;
+	{
+		CWorm worm;
+		ok = roundTrip( worm, LuaID<CWorm>::value, "worm" ) && ok;
+	}
+	{
+		CProjectile prj;
+		ok = roundTrip( prj, LuaID<CGameObject>::value, "projectile" ) && ok;
+	}
+	return ok;
+}
+
 // TODO: make respawning server-sided and remove this function
 CVec NewNet_FindSpot(CWorm *Worm) // Avoid name conflict with CServer::FindSpot
 {
@@ -264,7 +430,7 @@ void StartRound( unsigned randomSeed )
 			ReCalculationNeeded = false;
 			ReCalculationTimeMs = 0;
 			NewNetActive = true;
-			SavedWormState.clear();
+			StateHistory.clear();
 
 			NumPlayers = 0;
 			netRandom.seed(randomSeed);
@@ -297,7 +463,7 @@ void EndRound()
 {
 	RestoreState();
 	game.gameMap()->NewNet_Deinit();
-	SavedWormState.clear();
+	StateHistory.clear();
 	NewNetActive = false;
 };
 
@@ -21,6 +21,8 @@
 
 #include <cmath>
 #include <typeinfo>
+#include <vector>
+#include <climits>
 
 #include "CodeAttributes.h"
 #include "ProjAction.h"
@@ -39,6 +41,8 @@
 #include <WeaponDesc.h>
 #include "sound/SoundsBase.h"
 #include "game/Game.h"
+#include "ProjTerrainCollision.h"
+#include "Options.h"
 
 #ifdef __MINGW32_VERSION
 // TODO: ugly hack, fix it - mingw stdlib seems to be broken
@@ -46,6 +50,48 @@
 #endif
 
 
+/*
+	Values which stay constant during one LX56_simulateProjectiles call.
+	They are read in the innermost loops (per checkstep, per worm), so we
+	don't want to go through the settings layers each time.
+	The values are exactly the same as the ones read directly, so the
+	simulation result doesn't change.
+*/
+struct LX56ProjSimContext {
+	CMap* map;
+	const ProjectileSimData* simData;
+	const CProjectile* slotBase;
+	TimeDiff physicsDT;
+	bool infiniteMap;
+	bool teamGame;
+	bool teamHit;
+	bool selfHit;
+	float gravityFactor;
+	float friction;
+	ProjTerrainColl::ClassTable terrainClasses;
+	// increased by everything which could make an earlier quiet check of
+	// another projectile invalid (placed dirt, changed other projectiles)
+	unsigned int worldChanges;
+
+	void init() {
+		map = game.gameMap();
+		simData = &cClient->getProjectileSimData();
+		slotBase = &cClient->getProjectiles()[0];
+		physicsDT = LX56PhysicsDT;
+		infiniteMap = cClient->getGameLobby()[FT_InfiniteMap];
+		teamGame = cClient->isTeamGame();
+		teamHit = cClient->getGameLobby()[FT_TeamHit];
+		selfHit = cClient->getGameLobby()[FT_SelfHit];
+		gravityFactor = (float)cClient->getGameLobby()[FT_ProjGravityFactor];
+		friction = cClient->getGameLobby()[FT_ProjFriction];
+		if(map) terrainClasses.build(&map->materialArray()[0]);
+		worldChanges = 0;
+	}
+	int slot(const CProjectile* prj) const { return (int)(prj - slotBase); }
+};
+static LX56ProjSimContext simCtx;
+
+
 ///////////////////
 // Lower level projectile-worm collision test
 INLINE int CProjectile::ProjWormColl(CVec pos)
@@ -73,15 +119,15 @@ INLINE int CProjectile::ProjWormColl(CVec pos)
 		if(preventSelfShooting && w == ownerWorm)
 			continue;
 
-		if(ownerWorm && cClient->isTeamGame() && !cClient->getGameLobby()[FT_TeamHit] && w != ownerWorm && w->getTeam() == ownerWorm->getTeam())
+		if(ownerWorm && simCtx.teamGame && !simCtx.teamHit && w != ownerWorm && w->getTeam() == ownerWorm->getTeam())
 			continue;
 		
-		if(ownerWorm && !cClient->getGameLobby()[FT_SelfHit] && w == ownerWorm)
+		if(ownerWorm && !simCtx.selfHit && w == ownerWorm)
 			continue;
 		
 		const static int wsize = 4;
 		Shape<int> worm;
-		worm.pos = w->posRecordings.getBest((size_t)LX56PhysicsDT.milliseconds(), (size_t)(tLX->currentTime - this->fLastSimulationTime).milliseconds());
+		worm.pos = w->posRecordings.getBest((size_t)simCtx.physicsDT.milliseconds(), (size_t)(tLX->currentTime - this->fLastSimulationTime).milliseconds());
 		worm.radius = VectorD2<int>(wsize, wsize);
 		
 		if(s.CollisionWith(worm)) {
@@ -124,13 +170,13 @@ static INLINE bool CProjectile_CollisionWith(const CProjectile* src, const CProj
 
 
 INLINE ProjCollisionType FinalWormCollisionCheck(CProjectile* proj, const CVec& vFrameOldPos, const CVec& vFrameOldVel, TimeDiff dt, ProjCollisionType curResult) {
-	CMap* map = game.gameMap();
+	CMap* map = simCtx.map;
 	
 	// do we get any worm?
 	if(proj->GetProjInfo()->PlyHit.Type != PJ_NOTHING) {
 		CVec dif = proj->getPos() - vFrameOldPos;
 		float len = NormalizeVector( &dif );
-		len = MIN(len, float(game.gameMap()->GetWidth()) + float(game.gameMap()->GetHeight()));
+		len = MIN(len, float(map->GetWidth()) + float(map->GetHeight()));
 		
 		// the worm has a size of 4*4 in ProjWormColl, so it's save to check every second pixel here
 		for (float p = 0.0f; p <= len; p += 2.0f) {
@@ -144,7 +190,7 @@ INLINE ProjCollisionType FinalWormCollisionCheck(CProjectile* proj, const CVec&
 					proj->setVelocity( vFrameOldVel ); // don't get faster
 				}
 
-				if(cClient->getGameLobby()[FT_InfiniteMap]) {
+				if(simCtx.infiniteMap) {
 					FMOD(proj->vPos.write().x, (float)map->GetWidth());
 					FMOD(proj->vPos.write().y, (float)map->GetHeight());
 					FMOD(proj->vOldPos.x, (float)map->GetWidth());
@@ -156,7 +202,7 @@ INLINE ProjCollisionType FinalWormCollisionCheck(CProjectile* proj, const CVec&
 		}
 	}
 	
-	if(cClient->getGameLobby()[FT_InfiniteMap]) {
+	if(simCtx.infiniteMap) {
 		FMOD(proj->vPos.write().x, (float)map->GetWidth());
 		FMOD(proj->vPos.write().y, (float)map->GetHeight());
 		FMOD(proj->vOldPos.x, (float)map->GetWidth());
@@ -172,9 +218,9 @@ INLINE ProjCollisionType FinalWormCollisionCheck(CProjectile* proj, const CVec&
 INLINE bool CProjectile::MapBoundsCollision(int px, int py)
 {
 	CollisionSide = 0;
-	if(cClient->getGameLobby()[FT_InfiniteMap]) return false;
+	if(simCtx.infiniteMap) return false;
 	
-	CMap* map = game.gameMap();
+	CMap* map = simCtx.map;
 	
 	if (px < 0 || px - radius.x < 0)
 		CollisionSide |= COL_LEFT;
@@ -215,23 +261,20 @@ INLINE static void handlePixelFlag(CProjectile::ColInfo& res, const Material& m,
 // WARNING: assumed to be called only from SimulateFrame
 INLINE CProjectile::ColInfo CProjectile::TerrainCollision(int px, int py)
 {
-	CMap* map = game.gameMap();
+	CMap* map = simCtx.map;
 	
 	ColInfo res = { 0, 0, 0, 0, false, true };
 
-	const bool wrapAround = cClient->getGameLobby()[FT_InfiniteMap];
+	const bool wrapAround = simCtx.infiniteMap;
 
-	// check for most common case - we do this because compiler can probably optimise this case very good
+	// check for most common case - this is done by the vectorized kernel
 	if(!wrapAround && tProjInfo->Type != PRJ_CIRCLE) {	
-		// Check for the collision
-		for(int y = py - radius.y; y <= py + radius.y; ++y) {
-			// this is safe because in SimulateFrame, we do map bound checks
-			uchar *pf = &map->material->line[y][px - radius.x];
-			
-			for(int x = px - radius.x; x <= px + radius.x; ++x, ++pf) {				
-				handlePixelFlag(res, map->materialForIndex(*pf), x, y, px, py);
-			}
-		}
+		// this is safe because in SimulateFrame, we do map bound checks
+		const ProjTerrainColl::Footprint fp = { px, py, radius.x, radius.y };
+		const ProjTerrainColl::Result r = ProjTerrainColl::checkRect(map->material->line, simCtx.terrainClasses, fp);
+		res.left = r.left; res.right = r.right; res.top = r.top; res.bottom = r.bottom;
+		res.collided = r.collided;
+		res.onlyDirt = r.onlyDirt;
 	}
 	else if(wrapAround) {
 		px %= map->GetWidth();
@@ -362,17 +405,17 @@ bool CProjectile::HandleCollision(const CProjectile::ColInfo &c, const CVec& old
 // (for example CWorm_AI also uses this to check some possible cases)
 INLINE ProjCollisionType LX56Projectile_checkCollAndMove_Frame(CProjectile* const prj, TimeDiff dt, CMap *map)
 {
+	const int slot = simCtx.slot(prj);
+	const ProjectileSimData& simData = *simCtx.simData;
+	
 	// Gravity
-	float fGravity = 100.0f; // Default
-	if (prj->getProjInfo()->UseCustomGravity)
-		fGravity = (float)prj->getProjInfo()->Gravity;
-	prj->vVelocity.write().y += (float)cClient->getGameLobby()[FT_ProjGravityFactor] * fGravity * dt.seconds();
+	prj->vVelocity.write().y += simCtx.gravityFactor * simData.gravity[slot] * dt.seconds();
 
 	{
-		const float friction = cClient->getGameLobby()[FT_ProjFriction];
+		const float friction = simCtx.friction;
 		if(friction > 0) {
-			const float projSize = (prj->getRadius().x + prj->getRadius().y) * 0.5f;
-			const float projMass = prj->getRadius().GetLength();
+			const float projSize = simData.frictionSize[slot];
+			const float projMass = simData.frictionMass[slot];
 			// A bit lower drag coefficient as for worms because normally, projectiles have better shape for less dragging.
 			static const float projDragCoeff = 0.02f; // Note: Never ever change this! (Or we have to make this configureable)
 			applyFriction(prj->vVelocity.write(), dt.seconds(), projSize, projMass, projDragCoeff, friction);
@@ -442,16 +485,16 @@ INLINE ProjCollisionType LX56Projectile_checkCollAndMove(CProjectile* const prj,
 	
 	{
 		// Dampening
-		const float dmp = prj->getProjInfo()->Dampening;
+		const float dmp = simCtx.simData->dampening[simCtx.slot(prj)];
 		if(dmp != 1.0f) {
 			// dt is not fixed (because of possible gamespeed factor)
-			if(dt == LX56PhysicsDT)
+			if(dt == simCtx.physicsDT)
 				prj->vVelocity *= dmp;
 			else if(dt > 0)
-				prj->vVelocity *= powf(dmp, dt.seconds() / LX56PhysicsDT.seconds());
+				prj->vVelocity *= powf(dmp, dt.seconds() / simCtx.physicsDT.seconds());
 			else if(dt < 0)
 				// doesn't make sense to do negative dampening...
-				prj->vVelocity *= powf(dmp, -dt.seconds() / LX56PhysicsDT.seconds());
+				prj->vVelocity *= powf(dmp, -dt.seconds() / simCtx.physicsDT.seconds());
 		}
 	}
 
@@ -829,6 +872,7 @@ void Proj_Action::applyTo(const Proj_EventOccurInfo& eventInfo, CProjectile* prj
 			break;
 			
 		case PJ_INJUREPROJ:
+			simCtx.worldChanges++;
 			for(Proj_EventOccurInfo::Targets::const_iterator p = eventInfo.targets.begin(); p != eventInfo.targets.end(); ++p) {
 				if(typeid(**p) == typeid(CProjectile))
 					(*p)->injure((float)Damage);
@@ -844,6 +888,7 @@ void Proj_Action::applyTo(const Proj_EventOccurInfo& eventInfo, CProjectile* prj
 			prj->radius += ChangeRadius;
 			if(prj->radius.x < 0) prj->radius.x = 0;
 			if(prj->radius.y < 0) prj->radius.y = 0;
+			cClient->getProjectileSimData().setRadius((int)(prj - &cClient->getProjectiles()[0]), prj->radius);
 			break;
 			
 		case PJ_OverwriteOwnSpeed:
@@ -859,18 +904,21 @@ void Proj_Action::applyTo(const Proj_EventOccurInfo& eventInfo, CProjectile* prj
 			break;
 			
 		case PJ_OverwriteTargetSpeed:
+			simCtx.worldChanges++;
 			for(Proj_EventOccurInfo::Targets::const_iterator p = eventInfo.targets.begin(); p != eventInfo.targets.end(); ++p) {
 				(*p)->setVelocity(Speed);
 			}
 			break;
 			
 		case PJ_MultiplyTargetSpeed:
+			simCtx.worldChanges++;
 			for(Proj_EventOccurInfo::Targets::const_iterator p = eventInfo.targets.begin(); p != eventInfo.targets.end(); ++p) {
 				(*p)->setVelocity( SpeedMult * (*p)->getVelocity() );
 			}
 			break;
 			
 		case PJ_DiffTargetSpeed:
+			simCtx.worldChanges++;
 			for(Proj_EventOccurInfo::Targets::const_iterator p = eventInfo.targets.begin(); p != eventInfo.targets.end(); ++p) {
 				(*p)->setVelocity( (*p)->getVelocity() + Speed );
 			}
@@ -901,6 +949,7 @@ void Proj_Action::applyTo(const Proj_EventOccurInfo& eventInfo, CProjectile* prj
 			break;
 			
 		case PJ_HeadTargetToUs:
+			simCtx.worldChanges++;
 			for(Proj_EventOccurInfo::Targets::const_iterator obj = eventInfo.targets.begin(); obj != eventInfo.targets.end(); ++obj) {
 				(*obj)->velocity() += SpeedMult * getHeadingVelTo(prj, *obj);
 			}
@@ -1004,23 +1053,22 @@ static INLINE bool checkProjHit(const Proj_ProjHitEvent& info, std::set<CGameObj
 	return true;
 }
 
-template<bool TOP, bool LEFT>
-static CClient::MapPosIndex MPI(const VectorD2<int>& p, const VectorD2<int>& r) {
-	return CClient::MapPosIndex( p + VectorD2<int>(LEFT ? -r.x : r.x, TOP ? -r.y : r.y) );
+namespace {
+struct ProjHitChecker {
+	const Proj_ProjHitEvent& info;
+	std::set<CGameObject*>& targets;
+	CProjectile* prj;
+	ProjHitChecker(const Proj_ProjHitEvent& i, std::set<CGameObject*>& t, CProjectile* p) : info(i), targets(t), prj(p) {}
+	bool operator()(ProjectileGrid::Index i) {
+		return checkProjHit(info, targets, prj, &cClient->getProjectiles()[i]);
+	}
+};
 }
 
 bool Proj_ProjHitEvent::checkEvent(Proj_EventOccurInfo& ev, CProjectile* prj, Proj_DoActionInfo*) const {
-	const VectorD2<int> vPos = prj->getPos();
-	const VectorD2<int> radius = prj->getRadius();
-	for(int x = MPI<true,true>(vPos,radius).x; x <= MPI<true,false>(vPos,radius).x; ++x)
-		for(int y = MPI<true,true>(vPos,radius).y; y <= MPI<false,true>(vPos,radius).y; ++y) {
-			CClient::ProjectileSet* projs = cClient->projPosMap[CClient::MapPosIndex(x,y).index(game.gameMap())];
-			if(projs == NULL) continue;
-			for(CClient::ProjectileSet::const_iterator p = projs->begin(); p != projs->end(); ++p)
-				if(!checkProjHit(*this, ev.targets, prj, *p)) goto finalChecks;
-		}
+	ProjHitChecker checker(*this, ev.targets, prj);
+	cClient->projPosMap.forEachInRect(prj->getPos(), prj->getRadius(), checker);
 	
-finalChecks:
 	if(ev.targets.size() >= (size_t)MinHitCount && (MaxHitCount < 0 || ev.targets.size() <= (size_t)MaxHitCount))
 		return true;
 	return false;
@@ -1117,6 +1165,7 @@ static void projectile_doTimerExplode(CProjectile* const prj, int shake) {
 }
 
 static void projectile_doMakeDirt(CProjectile* const prj) {
+	simCtx.worldChanges++;
 	const int damage = 5;
 	int d = 0;
 	d += game.gameMap()->PlaceDirt(damage,prj->getPos()-CVec(6,6));
@@ -1131,6 +1180,7 @@ static void projectile_doMakeDirt(CProjectile* const prj) {
 }
 
 static void projectile_doMakeGreenDirt(CProjectile* const prj) {
+	simCtx.worldChanges++;
 	int d = game.gameMap()->PlaceGreenDirt(prj->getPos());
 	
 	// Remove the dirt count on the worm
@@ -1362,38 +1412,271 @@ static INLINE bool LX56ProjectileHandler_doFrame(const AbsTime currentTime, Time
 }
 
 
-static void LX56_simulateProjectile(const AbsTime currentTime, CProjectile* const prj) {
+static void LX56_simulateProjectileFrames(const AbsTime currentTime, const TimeDiff orig_dt, const TimeDiff frame_dt, CProjectile* const prj) {
 	// The FPS callrate doesn't matter that much because we do our own FPS handling here.
-	
-	const TimeDiff orig_dt = LX56PhysicsDT;
-	TimeDiff frame_dt = orig_dt * (1.0f/CLAMP((float)cClient->getGameLobby()[FT_GameSpeed],0.05f,10.0f));
-	if(frame_dt <= TimeDiff(0))
-		frame_dt = TimeDiff(1);
-		
+	while(prj->fLastSimulationTime + frame_dt <= currentTime) {
+		prj->fLastSimulationTime += frame_dt;
+		if(!LX56ProjectileHandler_doFrame(currentTime, orig_dt, prj))
+			break;
+	}
+}
+
+static void LX56_simulateProjectile(const AbsTime currentTime, const TimeDiff orig_dt, const TimeDiff frame_dt, CProjectile* const prj) {
 	VectorD2<int> oldPos(prj->getPos());
 	VectorD2<int> oldRadius(prj->getRadius());
 	
-simulateProjectileStart:
-	if(prj->fLastSimulationTime + frame_dt > currentTime) goto finalMapPosIndexUpdate;
-	prj->fLastSimulationTime += frame_dt;
-	if(LX56ProjectileHandler_doFrame(currentTime, orig_dt, prj))
-		goto simulateProjectileStart;
-
-finalMapPosIndexUpdate:
+	LX56_simulateProjectileFrames(currentTime, orig_dt, frame_dt, prj);
 	prj->updateCollMapInfo(&oldPos, &oldRadius);
 }
 
 
+
+/*
+	Parallel projectile simulation
+	
+	Most projectiles just fly around in a frame without touching anything. We call
+	them quiet. A quiet projectile only changes its own state, so a run of them can
+	be simulated by several threads at once and the result is the same as in the
+	serial loop, as long as the order to all the other projectiles is kept.
+	
+	Whether a projectile is quiet is checked conservatively: it has no timer which
+	could fire, no trail, no custom actions, and the area it can reach within
+	this call (from its speed, gravity and the number of frames) contains no solid
+	pixel, no worm position and does not touch the map border.
+	This check is done for all projectiles in parallel at the beginning. Then we
+	walk through the projectiles in the normal order: quiet ones are collected in
+	a batch, and before any other projectile is simulated (serially, in this
+	thread), the batch is simulated in parallel. The collision grid updates of a
+	batch are done afterwards in this thread, in index order.
+	
+	Other projectiles can only remove terrain (which cannot make a quiet projectile
+	collide) unless they place dirt, and they can change other projectiles with
+	target actions. Both increase simCtx.worldChanges; in that case, the quiet
+	check of a projectile is redone right before it is added to a batch.
+*/
+
+namespace {
+
+// a batch smaller than this is not worth waking up other threads
+static const size_t LX56_MIN_PARALLEL_BATCH = 64;
+// if we are lagging that much behind, we just do it serially
+static const int LX56_MAX_QUIET_FRAMES = 4;
+static const int LX56_MAX_PROJ_THREADS = 16;
+
+struct QuietInfo {
+	unsigned int generation;
+	bool quiet;
+};
+
+struct WormArea {
+	int x1, y1, x2, y2;
+};
+
+struct LX56ParallelProjSim {
+	AbsTime currentTime;
+	TimeDiff orig_dt, frame_dt;
+	QuietInfo quietInfo[MAX_PROJECTILES];
+	std::vector<WormArea> wormAreas;
+	std::vector<CProjectile*> projs;
+	std::vector<CProjectile*> batch;
+	
+	void initWormAreas();
+	bool isQuiet(CProjectile* const prj) const;
+	void checkQuiet(CProjectile* const prj) {
+		const int slot = simCtx.slot(prj);
+		quietInfo[slot].generation = simCtx.simData->generation[slot];
+		quietInfo[slot].quiet = isQuiet(prj);
+	}
+	bool isQuietNow(CProjectile* const prj, unsigned int worldChangesAtCheck) {
+		const int slot = simCtx.slot(prj);
+		if(worldChangesAtCheck != simCtx.worldChanges || quietInfo[slot].generation != simCtx.simData->generation[slot])
+			checkQuiet(prj);
+		return quietInfo[slot].quiet;
+	}
+	
+	void runParallel(void (LX56ParallelProjSim::*f)(size_t, size_t), size_t num);
+	void checkQuietRange(size_t start, size_t end) {
+		for(size_t i = start; i < end; ++i) checkQuiet(projs[i]);
+	}
+	void simulateRange(size_t start, size_t end) {
+		for(size_t i = start; i < end; ++i)
+			LX56_simulateProjectileFrames(currentTime, orig_dt, frame_dt, batch[i]);
+	}
+	void flushBatch();
+	void simulate(Iterator<CProjectile*>::Ref projs);
+};
+
+struct LX56ParallelProjTask {
+	LX56ParallelProjSim* sim;
+	void (LX56ParallelProjSim::*f)(size_t, size_t);
+	size_t start, end;
+	static Result run(void* p) {
+		LX56ParallelProjTask* t = (LX56ParallelProjTask*)p;
+		(t->sim->*(t->f))(t->start, t->end);
+		return true;
+	}
+};
+
+}
+
+void LX56ParallelProjSim::initWormAreas() {
+	wormAreas.clear();
+	// ProjWormColl uses some recorded position, so just take all of them
+	const int wsize = 4 + 1;
+	for_each_iterator(CWorm*, w_, game.aliveWorms()) {
+		CWorm* w = w_->get();
+		WormArea a = { INT_MAX, INT_MAX, INT_MIN, INT_MIN };
+		for(size_t i = 0; i < VecTimeRecorder::FramesCount; ++i) {
+			const VectorD2<int> p = w->posRecordings.get(i);
+			a.x1 = MIN(a.x1, p.x - wsize); a.y1 = MIN(a.y1, p.y - wsize);
+			a.x2 = MAX(a.x2, p.x + wsize); a.y2 = MAX(a.y2, p.y + wsize);
+		}
+		wormAreas.push_back(a);
+	}
+}
+
+bool LX56ParallelProjSim::isQuiet(CProjectile* const prj) const {
+	if(simCtx.infiniteMap || !simCtx.map) return false;
+	const proj_t* pi = prj->getProjInfo();
+	if(!pi->actions.empty() || pi->Trail.Type != TRL_NONE) return false;
+	if(pi->Animating && pi->AnimType == ANI_ONCE) return false;
+	// junk projectiles get deleted in Proj_DoActionInfo::execute
+	if(!pi->Hit.hasAction() && !pi->PlyHit.hasAction() && !pi->Timer.hasAction()) return false;
+	
+	int frames = 0;
+	for(AbsTime t = prj->fLastSimulationTime + frame_dt; t <= currentTime; t += frame_dt)
+		if(++frames > LX56_MAX_QUIET_FRAMES) return false;
+	if(frames == 0) return true;
+	const float time = frames * orig_dt.seconds();
+	
+	if(pi->Timer.hasAction() && !(prj->getLife() + time + 0.05f < pi->Timer.Time + pi->Timer.TimeVar * prj->getTimeVarRandom()))
+		return false;
+	
+	// Speed limits within this call. Dampening and friction (if it does not overshoot) only slow down.
+	const int slot = simCtx.slot(prj);
+	const ProjectileSimData& simData = *simCtx.simData;
+	const float dmp = simData.dampening[slot];
+	if(!(dmp >= 0.0f && dmp <= 1.0f)) return false;
+	const CVec v = prj->getVelocity();
+	if(!(fabs(v.x) < 100000.0f && fabs(v.y) < 100000.0f)) return false; // also catches NaN
+	const float vxMax = fabs(v.x);
+	const float vyMax = fabs(v.y) + fabs(simCtx.gravityFactor * simData.gravity[slot]) * time;
+	if(simCtx.friction > 0) {
+		const float mass = simData.frictionMass[slot];
+		if(!(mass > 0.0f)) return false;
+		const float k = (vxMax + vyMax) * simData.frictionSize[slot] * 0.02f * simCtx.friction * 0.5f * orig_dt.seconds() / mass;
+		if(!(k <= 1.0f)) return false;
+	}
+	
+	// the area the projectile can touch
+	const VectorD2<int> r = prj->getRadius();
+	ProjTerrainColl::Footprint area;
+	area.px = (int)prj->getPos().x;
+	area.py = (int)prj->getPos().y;
+	area.rx = (int)ceil(vxMax * time) + r.x + 3;
+	area.ry = (int)ceil(vyMax * time) + r.y + 3;
+	if(area.px - area.rx < 0 || area.py - area.ry < 0) return false;
+	if(area.px + area.rx >= (int)simCtx.map->GetWidth() || area.py + area.ry >= (int)simCtx.map->GetHeight()) return false;
+	
+	for(size_t i = 0; i < wormAreas.size(); ++i) {
+		const WormArea& w = wormAreas[i];
+		if(area.px + area.rx >= w.x1 && area.px - area.rx <= w.x2 && area.py + area.ry >= w.y1 && area.py - area.ry <= w.y2)
+			return false;
+	}
+	
+	if(ProjTerrainColl::checkRect(simCtx.map->material->line, simCtx.terrainClasses, area).collided)
+		return false;
+	
+	return true;
+}
+
+void LX56ParallelProjSim::runParallel(void (LX56ParallelProjSim::*f)(size_t, size_t), size_t num) {
+	const size_t threads = MIN((size_t)CLAMP(tLXOptions->iProjectileThreads, 1, LX56_MAX_PROJ_THREADS), num / (LX56_MIN_PARALLEL_BATCH / 2));
+	if(threads <= 1 || !threadPool) {
+		(this->*f)(0, num);
+		return;
+	}
+	
+	LX56ParallelProjTask tasks[LX56_MAX_PROJ_THREADS];
+	ThreadPoolItem* items[LX56_MAX_PROJ_THREADS];
+	for(size_t t = 0; t < threads; ++t) {
+		tasks[t].sim = this;
+		tasks[t].f = f;
+		tasks[t].start = num * t / threads;
+		tasks[t].end = num * (t + 1) / threads;
+	}
+	// the first part is done by ourself
+	for(size_t t = 1; t < threads; ++t)
+		items[t] = threadPool->start(&LX56ParallelProjTask::run, &tasks[t], "projectile simulation");
+	LX56ParallelProjTask::run(&tasks[0]);
+	for(size_t t = 1; t < threads; ++t)
+		threadPool->wait(items[t]);
+}
+
+void LX56ParallelProjSim::flushBatch() {
+	if(batch.empty()) return;
+	
+	if(batch.size() >= LX56_MIN_PARALLEL_BATCH)
+		runParallel(&LX56ParallelProjSim::simulateRange, batch.size());
+	else
+		simulateRange(0, batch.size());
+	
+	// the grid isn't thread safe
+	for(size_t i = 0; i < batch.size(); ++i)
+		batch[i]->updateCollMapInfo();
+	batch.clear();
+}
+
+void LX56ParallelProjSim::simulate(Iterator<CProjectile*>::Ref it) {
+	projs.clear();
+	for(Iterator<CProjectile*>::Ref i = it->copy(); i->isValid(); i->next())
+		projs.push_back(i->get());
+	
+	initWormAreas();
+	const unsigned int worldChangesAtCheck = simCtx.worldChanges;
+	runParallel(&LX56ParallelProjSim::checkQuietRange, projs.size());
+	
+	for(; it->isValid(); it->next()) {
+		CProjectile* const p = it->get();
+		if(isQuietNow(p, worldChangesAtCheck))
+			batch.push_back(p);
+		else {
+			flushBatch();
+			LX56_simulateProjectile( currentTime, orig_dt, frame_dt, p );
+		}
+	}
+	flushBatch();
+}
+
+static LX56ParallelProjSim parallelSim;
+
+
 void LX56_simulateProjectiles(Iterator<CProjectile*>::Ref projs) {
 	// Note: This function can be called with any FPS -
 	// LX56_simulateProjectile will handle its own internal FPS
 	// via CProjectile::fLastSimulationTime.
 
 	AbsTime currentTime = GetPhysicsTime();
+	simCtx.init();
+	
+	const TimeDiff orig_dt = simCtx.physicsDT;
+	TimeDiff frame_dt = orig_dt * (1.0f/CLAMP((float)cClient->getGameLobby()[FT_GameSpeed],0.05f,10.0f));
+	if(frame_dt <= TimeDiff(0))
+		frame_dt = TimeDiff(1);
+	
+	// compact the collision grid if needed
+	cClient->projPosMap.rebuild();
+	
+	if(tLXOptions->bParallelProjectiles) {
+		parallelSim.currentTime = currentTime;
+		parallelSim.orig_dt = orig_dt;
+		parallelSim.frame_dt = frame_dt;
+		parallelSim.simulate(projs);
+		return;
+	}
 		
 	for(Iterator<CProjectile*>::Ref i = projs; i->isValid(); i->next()) {
 		CProjectile* const p = i->get();
-		LX56_simulateProjectile( currentTime, p );
+		LX56_simulateProjectile( currentTime, orig_dt, frame_dt, p );
 	}	
 }
-
@@ -0,0 +1,268 @@
+/*
+ *  ProjTerrainCollision.cpp
+ *  OpenLieroX
+ *
+ *  batch kernel for the projectile <-> terrain pixel check
+ *
+ *  code under LGPL
+ *
+ */
+
+#include <vector>
+#include <cstring>
+#include "ProjTerrainCollision.h"
+#include "gusanos/material.h"
+#include "CodeAttributes.h"
+#include "MathLib.h"
+#include "Timer.h"
+#include "Debug.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PTC_HAVE_SSE2
+#include <emmintrin.h>
+#endif
+
+
+namespace ProjTerrainColl {
+
+ClassTable::ClassTable() {
+	memset(cls, 0, sizeof(cls));
+}
+
+void ClassTable::build(const Material* materials) {
+	for(int i = 0; i < 256; ++i) {
+		const Material& m = materials[i];
+		cls[i] = 0;
+		if(!m.particle_pass) {
+			cls[i] |= CLS_SOLID;
+			if(!m.destroyable) cls[i] |= CLS_HARD;
+		}
+	}
+}
+
+bool haveSSE2() {
+#ifdef PTC_HAVE_SSE2
+	return true;
+#else
+	return false;
+#endif
+}
+
+// we translate the material indices in chunks of this size
+static const int CHUNK = 256;
+
+// maps n material indices to their classes; zero padded up to a multiple of 16
+static INLINE int translate(const unsigned char* src, int n, const unsigned char* cls, unsigned char* dst) {
+	int i = 0;
+	for(; i < n; ++i)
+		dst[i] = cls[src[i]];
+	const int padded = (n + 15) & ~15;
+	for(; i < padded; ++i)
+		dst[i] = 0;
+	return padded;
+}
+
+struct ScalarCounter {
+	static INLINE void count(const unsigned char* buf, int n, int& solid, unsigned char& flags) {
+		for(int i = 0; i < n; ++i) {
+			solid += buf[i] & CLS_SOLID;
+			flags |= buf[i];
+		}
+	}
+};
+
+#ifdef PTC_HAVE_SSE2
+struct SSE2Counter {
+	// n must be a multiple of 16, the padding must be zero
+	static INLINE void count(const unsigned char* buf, int n, int& solid, unsigned char& flags) {
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i solidBit = _mm_set1_epi8(CLS_SOLID);
+		__m128i sum = zero, orAcc = zero;
+		for(int i = 0; i < n; i += 16) {
+			const __m128i v = _mm_loadu_si128((const __m128i*)(buf + i));
+			orAcc = _mm_or_si128(orAcc, v);
+			sum = _mm_add_epi64(sum, _mm_sad_epu8(_mm_and_si128(v, solidBit), zero));
+		}
+		solid += _mm_cvtsi128_si32(sum) + _mm_cvtsi128_si32(_mm_srli_si128(sum, 8));
+		orAcc = _mm_or_si128(orAcc, _mm_srli_si128(orAcc, 8));
+		orAcc = _mm_or_si128(orAcc, _mm_srli_si128(orAcc, 4));
+		orAcc = _mm_or_si128(orAcc, _mm_srli_si128(orAcc, 2));
+		orAcc = _mm_or_si128(orAcc, _mm_srli_si128(orAcc, 1));
+		flags |= (unsigned char)_mm_cvtsi128_si32(orAcc);
+	}
+};
+#endif
+
+// short segments (the usual projectile sizes) are faster done directly
+static INLINE void countShortSegment(const unsigned char* src, int n, const unsigned char* cls, int& solid, unsigned char& flags) {
+	for(int i = 0; i < n; ++i) {
+		const unsigned char c = cls[src[i]];
+		solid += c & CLS_SOLID;
+		flags |= c;
+	}
+}
+
+template<typename Counter>
+static INLINE void countSegment(const unsigned char* src, int n, const unsigned char* cls, int& solid, unsigned char& flags) {
+	if(n < 16) {
+		countShortSegment(src, n, cls, solid, flags);
+		return;
+	}
+	unsigned char buf[CHUNK];
+	while(n > 0) {
+		const int c = MIN(n, CHUNK);
+		const int padded = translate(src, c, cls, buf);
+		Counter::count(buf, padded, solid, flags);
+		src += c;
+		n -= c;
+	}
+}
+
+template<typename Counter>
+static void checkRectsT(const unsigned char* const* lines, const ClassTable& table, const Footprint* fps, Result* res, size_t n) {
+	const unsigned char* cls = table.cls;
+	for(size_t i = 0; i < n; ++i) {
+		const Footprint& fp = fps[i];
+		Result r = { 0, 0, 0, 0, false, true };
+		unsigned char flags = 0;
+
+		for(int y = fp.py - fp.ry; y <= fp.py + fp.ry; ++y) {
+			const unsigned char* row = lines[y] + fp.px - fp.rx;
+			int left = 0, right = 0;
+			countSegment<Counter>(row, fp.rx, cls, left, flags);
+			const unsigned char c = cls[row[fp.rx]];
+			flags |= c;
+			countSegment<Counter>(row + fp.rx + 1, fp.rx, cls, right, flags);
+
+			const int total = left + (c & CLS_SOLID) + right;
+			if(y < fp.py)
+				r.top += total;
+			else if(y > fp.py)
+				r.bottom += total;
+			r.left += left;
+			r.right += right;
+		}
+
+		r.collided = (flags & CLS_SOLID) != 0;
+		r.onlyDirt = (flags & CLS_HARD) == 0;
+		res[i] = r;
+	}
+}
+
+void checkRects(const unsigned char* const* lines, const ClassTable& table, const Footprint* fps, Result* res, size_t n, Kernel k) {
+#ifdef PTC_HAVE_SSE2
+	if(k != K_Scalar) {
+		checkRectsT<SSE2Counter>(lines, table, fps, res, n);
+		return;
+	}
+#endif
+	checkRectsT<ScalarCounter>(lines, table, fps, res, n);
+}
+
+
+///////////////////
+// Determinism test
+
+// pixel by pixel, the same as handlePixelFlag() in PhysicsLX56_Projectiles.cpp
+static Result referenceCheck(const unsigned char* const* lines, const Material* materials, const Footprint& fp) {
+	Result res = { 0, 0, 0, 0, false, true };
+	for(int y = fp.py - fp.ry; y <= fp.py + fp.ry; ++y)
+		for(int x = fp.px - fp.rx; x <= fp.px + fp.rx; ++x) {
+			const Material& m = materials[lines[y][x]];
+			if(m.particle_pass) continue;
+			if(y < fp.py) ++res.top;
+			else if(y > fp.py) ++res.bottom;
+			if(x < fp.px) ++res.left;
+			else if(x > fp.px) ++res.right;
+			if(!m.destroyable) res.onlyDirt = false;
+			res.collided = true;
+		}
+	return res;
+}
+
+static bool operator!=(const Result& a, const Result& b) {
+	return a.left != b.left || a.right != b.right || a.top != b.top || a.bottom != b.bottom
+		|| a.collided != b.collided || a.onlyDirt != b.onlyDirt;
+}
+
+bool test(int numProjs) {
+	const int mapW = 640, mapH = 480;
+	const int steps = 100;
+	numProjs = CLAMP(numProjs, 1, 10000);
+	notes << "ProjTerrainColl test: " << numProjs << " projectiles, " << steps << " steps, SSE2 " << (haveSSE2() ? "on" : "off") << endl;
+
+	SyncedRandom rnd(1234);
+
+	// random materials; index 0 and 1 like in level.cpp
+	std::vector<Material> materials(256);
+	for(int i = 0; i < 256; ++i) {
+		materials[i].particle_pass = (rnd.getInt() % 3) == 0;
+		materials[i].destroyable = (rnd.getInt() % 2) == 0;
+	}
+	materials[0].particle_pass = false; materials[0].destroyable = false;
+	materials[1].particle_pass = true;
+	ClassTable table;
+	table.build(&materials[0]);
+
+	// random map, mostly background with some horizontal runs of material
+	std::vector<unsigned char> pixels(mapW * mapH);
+	std::vector<const unsigned char*> lines(mapH);
+	for(int y = 0; y < mapH; ++y) {
+		lines[y] = &pixels[y * mapW];
+		for(int x = 0; x < mapW; ) {
+			const int len = 1 + rnd.getInt() % 24;
+			const unsigned char m = (rnd.getInt() % 4 == 0) ? (unsigned char)(rnd.getInt() % 256) : 1;
+			for(int i = 0; i < len && x < mapW; ++i, ++x)
+				pixels[y * mapW + x] = m;
+		}
+	}
+
+	// record the traces of some flying projectiles
+	std::vector<Footprint> trace;
+	trace.reserve(numProjs * steps);
+	for(int p = 0; p < numProjs; ++p) {
+		const int rx = (rnd.getInt() % 10 == 0) ? (int)(rnd.getInt() % 40) : (int)(rnd.getInt() % 6);
+		const int ry = (rnd.getInt() % 10 == 0) ? (int)(rnd.getInt() % 40) : (int)(rnd.getInt() % 6);
+		float x = (float)(rnd.getInt() % mapW), y = (float)(rnd.getInt() % mapH);
+		float vx = rnd.getFloat() * 20.0f - 10.0f, vy = rnd.getFloat() * 20.0f - 10.0f;
+		for(int s = 0; s < steps; ++s) {
+			vy += 0.3f;
+			x += vx; y += vy;
+			if(x < rx || x >= mapW - rx) { vx = -vx; x = CLAMP(x, (float)rx, (float)(mapW - rx - 1)); }
+			if(y < ry || y >= mapH - ry) { vy = -vy * 0.8f; y = CLAMP(y, (float)ry, (float)(mapH - ry - 1)); }
+			Footprint fp = { (int)x, (int)y, rx, ry };
+			trace.push_back(fp);
+		}
+	}
+
+	std::vector<Result> ref(trace.size()), scalar(trace.size()), fast(trace.size());
+	AbsTime start = GetTime();
+	for(size_t i = 0; i < trace.size(); ++i)
+		ref[i] = referenceCheck(&lines[0], &materials[0], trace[i]);
+	const TimeDiff refTime = GetTime() - start;
+
+	start = GetTime();
+	checkRects(&lines[0], table, &trace[0], &scalar[0], trace.size(), K_Scalar);
+	const TimeDiff scalarTime = GetTime() - start;
+
+	start = GetTime();
+	checkRects(&lines[0], table, &trace[0], &fast[0], trace.size(), K_Auto);
+	const TimeDiff fastTime = GetTime() - start;
+
+	size_t scalarDiffs = 0, fastDiffs = 0;
+	for(size_t i = 0; i < trace.size(); ++i) {
+		if(scalar[i] != ref[i]) scalarDiffs++;
+		if(fast[i] != ref[i]) fastDiffs++;
+	}
+
+	notes << "ProjTerrainColl: " << trace.size() << " footprints, reference " << refTime.milliseconds() << "ms, ";
+	notes << "scalar " << scalarTime.milliseconds() << "ms, auto " << fastTime.milliseconds() << "ms" << endl;
+	if(scalarDiffs || fastDiffs) {
+		errors << "ProjTerrainColl: results differ from reference: scalar " << scalarDiffs << ", auto " << fastDiffs << endl;
+		return false;
+	}
+	notes << "ProjTerrainColl: all results identical" << endl;
+	return true;
+}
+
+}
@@ -0,0 +1,244 @@
+/*
+ *  ProjectileGrid.cpp
+ *  OpenLieroX
+ *
+ *  uniform grid broadphase for projectile-projectile hit checks
+ *
+ *  code under LGPL
+ *
+ */
+
+#include <set>
+#include <algorithm>
+#include "ProjectileGrid.h"
+#include "MathLib.h"
+#include "Timer.h"
+#include "Debug.h"
+
+
+// free slots every cell gets when the item array is rebuilt
+static const unsigned short CELL_SLACK = 2;
+
+void ProjectileGrid::reset(int mapW, int mapH, size_t maxObjs) {
+	clear();
+	if(mapW <= 0 || mapH <= 0) return;
+
+	m_gridW = mapW / GRIDW + 1;
+	m_gridH = mapH / GRIDH + 1;
+	// This is the index of the cell of the (mapW,mapH) corner. The old
+	// projPosMap had exactly that many cells, so we keep it that way.
+	m_numCells = (long)(mapH / GRIDH) * m_gridW + mapW / GRIDW;
+
+	m_objs.resize(maxObjs);
+	m_cells.resize(m_numCells);
+	m_items.reserve(m_numCells * CELL_SLACK * 2);
+	m_items.resize(m_numCells * CELL_SLACK);
+	for(long c = 0; c < m_numCells; ++c) {
+		m_cells[c].begin = c * CELL_SLACK;
+		m_cells[c].capacity = CELL_SLACK;
+	}
+}
+
+void ProjectileGrid::clear() {
+	m_gridW = m_gridH = 0;
+	m_numCells = 0;
+	m_unusedItems = 0;
+	m_objs.clear();
+	m_cells.clear();
+	m_items.clear();
+}
+
+void ProjectileGrid::insertInCells(Index obj, const CellRect& r) {
+	for(int x = r.x1; x <= r.x2; ++x)
+		for(int y = r.y1; y <= r.y2; ++y) {
+			const long c = cellIndex(x, y);
+			if(c < 0) continue;
+			Cell& cell = m_cells[c];
+
+			if(cell.count == cell.capacity) {
+				if(cell.capacity == (unsigned short)-1) continue; // cannot happen with MAX_PROJECTILES
+				// move the slice to the end with double capacity
+				const unsigned short newCap = (unsigned short)MIN(2 * (int)cell.capacity + 2, 0xffff);
+				const unsigned int newBegin = (unsigned int)m_items.size();
+				m_items.resize(m_items.size() + newCap);
+				std::copy(m_items.begin() + cell.begin, m_items.begin() + cell.begin + cell.count, m_items.begin() + newBegin);
+				m_unusedItems += cell.capacity;
+				cell.begin = newBegin;
+				cell.capacity = newCap;
+			}
+
+			Index* first = &m_items[cell.begin];
+			Index* last = first + cell.count;
+			Index* pos = std::lower_bound(first, last, obj);
+			if(pos != last && *pos == obj) continue; // already in there
+			std::copy_backward(pos, last, last + 1);
+			*pos = obj;
+			cell.count++;
+		}
+}
+
+void ProjectileGrid::removeFromCells(Index obj, const CellRect& r) {
+	for(int x = r.x1; x <= r.x2; ++x)
+		for(int y = r.y1; y <= r.y2; ++y) {
+			const long c = cellIndex(x, y);
+			if(c < 0) continue;
+			Cell& cell = m_cells[c];
+			if(cell.count == 0) continue;
+
+			Index* first = &m_items[cell.begin];
+			Index* last = first + cell.count;
+			Index* pos = std::lower_bound(first, last, obj);
+			if(pos == last || *pos != obj) continue;
+			std::copy(pos + 1, last, pos);
+			cell.count--;
+		}
+}
+
+void ProjectileGrid::update(Index obj, const VectorD2<int>& pos, const VectorD2<int>& radius) {
+	if(m_numCells == 0 || obj >= m_objs.size()) return;
+	ObjInfo& o = m_objs[obj];
+	const CellRect r(pos, radius);
+	if(o.registered) {
+		if(o.rect == r) return; // nothing has changed
+		removeFromCells(obj, o.rect);
+	}
+
+	o.registered = true;
+	o.rect = r;
+	insertInCells(obj, r);
+}
+
+void ProjectileGrid::remove(Index obj) {
+	if(obj >= m_objs.size()) return;
+	ObjInfo& o = m_objs[obj];
+	if(!o.registered) return;
+	removeFromCells(obj, o.rect);
+	o.registered = false;
+}
+
+void ProjectileGrid::rebuild() {
+	if(m_numCells == 0) return;
+	// compact only if at least half of the array is garbage
+	if(m_unusedItems * 2 < m_items.size()) return;
+
+	std::vector<Index> items;
+	items.reserve(m_items.capacity());
+	for(long c = 0; c < m_numCells; ++c) {
+		Cell& cell = m_cells[c];
+		const unsigned int newBegin = (unsigned int)items.size();
+		items.insert(items.end(), m_items.begin() + cell.begin, m_items.begin() + cell.begin + cell.count);
+		cell.capacity = (unsigned short)MIN((int)cell.count + CELL_SLACK, 0xffff);
+		items.resize(newBegin + cell.capacity);
+		cell.begin = newBegin;
+	}
+	m_items.swap(items);
+	m_unusedItems = 0;
+}
+
+
+///////////////////
+// Benchmark + consistency check against the old std::set based cells
+
+void ProjectileGrid::benchmark(int numObjs) {
+	const int mapW = 2000, mapH = 1500;
+	const int frames = 50;
+	numObjs = CLAMP(numObjs, 1, 60000);
+	notes << "ProjectileGrid benchmark: " << numObjs << " objects on " << mapW << "x" << mapH << ", " << frames << " frames" << endl;
+
+	SyncedRandom rnd(42);
+	std::vector< VectorD2<int> > pos(numObjs), vel(numObjs), radius(numObjs);
+	for(int i = 0; i < numObjs; ++i) {
+		pos[i] = VectorD2<int>(rnd.getInt() % mapW, rnd.getInt() % mapH);
+		vel[i] = VectorD2<int>((int)(rnd.getInt() % 9) - 4, (int)(rnd.getInt() % 9) - 4);
+		radius[i] = VectorD2<int>(1 + rnd.getInt() % 4, 1 + rnd.getInt() % 4);
+	}
+
+	ProjectileGrid grid;
+	grid.reset(mapW, mapH, numObjs);
+	typedef std::vector< std::set<Index> > RefCells;
+	RefCells ref(grid.m_numCells);
+
+	struct Collector {
+		std::vector<Index> list;
+		bool operator()(Index i) { list.push_back(i); return true; }
+	};
+	struct Counter {
+		size_t c;
+		Counter() : c(0) {}
+		bool operator()(Index i) { c += i; return true; }
+	};
+
+	Collector gridRes, refRes;
+	Counter counter;
+	size_t queries = 0;
+	size_t mismatches = 0;
+	TimeDiff gridTime, refTime;
+
+	for(int f = 0; f < frames; ++f) {
+		// simulate movement, updating both structures like updateCollMapInfo does
+		for(int i = 0; i < numObjs; ++i) {
+			const CellRect oldR(pos[i], radius[i]);
+			pos[i] += vel[i];
+			if(pos[i].x < 0 || pos[i].x >= mapW) { vel[i].x = -vel[i].x; pos[i].x = CLAMP(pos[i].x, 0, mapW - 1); }
+			if(pos[i].y < 0 || pos[i].y >= mapH) { vel[i].y = -vel[i].y; pos[i].y = CLAMP(pos[i].y, 0, mapH - 1); }
+			const CellRect newR(pos[i], radius[i]);
+			grid.update((Index)i, pos[i], radius[i]);
+			if(f > 0 && oldR == newR) continue;
+			if(f > 0)
+				for(int x = oldR.x1; x <= oldR.x2; ++x)
+					for(int y = oldR.y1; y <= oldR.y2; ++y) {
+						const long c = grid.cellIndex(x, y);
+						if(c >= 0) ref[c].erase((Index)i);
+					}
+			for(int x = newR.x1; x <= newR.x2; ++x)
+				for(int y = newR.y1; y <= newR.y2; ++y) {
+					const long c = grid.cellIndex(x, y);
+					if(c >= 0) ref[c].insert((Index)i);
+				}
+		}
+
+		// verify
+		grid.rebuild();
+		for(int i = 0; i < numObjs; ++i) {
+			gridRes.list.clear(); refRes.list.clear();
+			grid.forEachInRect(pos[i], radius[i], gridRes);
+			const CellRect r(pos[i], radius[i]);
+			for(int x = r.x1; x <= r.x2; ++x)
+				for(int y = r.y1; y <= r.y2; ++y) {
+					const long c = grid.cellIndex(x, y);
+					if(c < 0) continue;
+					for(std::set<Index>::iterator j = ref[c].begin(); j != ref[c].end(); ++j)
+						refRes(*j);
+				}
+			if(gridRes.list != refRes.list) mismatches++;
+		}
+
+		// time it
+		const int repeat = 10;
+		AbsTime start = GetTime();
+		for(int k = 0; k < repeat; ++k)
+			for(int i = 0; i < numObjs; ++i)
+				grid.forEachInRect(pos[i], radius[i], counter);
+		gridTime += GetTime() - start;
+
+		start = GetTime();
+		for(int k = 0; k < repeat; ++k)
+			for(int i = 0; i < numObjs; ++i) {
+				const CellRect r(pos[i], radius[i]);
+				for(int x = r.x1; x <= r.x2; ++x)
+					for(int y = r.y1; y <= r.y2; ++y) {
+						const long c = grid.cellIndex(x, y);
+						if(c < 0) continue;
+						for(std::set<Index>::iterator j = ref[c].begin(); j != ref[c].end(); ++j)
+							counter(*j);
+					}
+			}
+		refTime += GetTime() - start;
+		queries += repeat * numObjs;
+	}
+
+	if(mismatches)
+		errors << "ProjectileGrid: " << mismatches << " queries differ from std::set reference" << endl;
+	notes << "ProjectileGrid: " << (gridTime.milliseconds() * 1000000.0 / queries) << " ns per hit-check";
+	notes << " (std::set cells: " << (refTime.milliseconds() * 1000000.0 / queries) << " ns), checksum " << counter.c << endl;
+}
@@ -0,0 +1,318 @@
+/*
+ *  TerrainSnapshot.cpp
+ *  OpenLieroX
+ *
+ *  copy-on-write tiled snapshot of the map material + image
+ *
+ *  code under LGPL
+ *
+ */
+
+#include <set>
+#include <cstring>
+#include "TerrainSnapshot.h"
+#include "MathLib.h"
+#include "Timer.h"
+#include "Debug.h"
+#include "NewNetEngine.h"
+
+
+TerrainSnapshot::TerrainSnapshot() :
+m_mapW(0), m_mapH(0), m_tilesX(0), m_tilesY(0), m_imageScale(0), m_imageBpp(0),
+m_matTileBytes(0), m_imgTileBytes(0), m_active(false), m_epoch(0) {}
+
+void TerrainSnapshot::init(int mapW, int mapH, int imageScale, int imageBpp) {
+	clear();
+	if(mapW <= 0 || mapH <= 0) return;
+
+	m_mapW = mapW;
+	m_mapH = mapH;
+	m_tilesX = (mapW + TILE_SIZE - 1) / TILE_SIZE;
+	m_tilesY = (mapH + TILE_SIZE - 1) / TILE_SIZE;
+	m_imageScale = (imageBpp > 0) ? imageScale : 0;
+	m_imageBpp = (imageScale > 0) ? imageBpp : 0;
+	m_matTileBytes = TILE_SIZE * TILE_SIZE;
+	m_imgTileBytes = (size_t)(TILE_SIZE * m_imageScale) * (TILE_SIZE * m_imageScale) * m_imageBpp;
+
+	m_tileEpoch.resize(m_tilesX * m_tilesY, 0);
+	m_epoch = 0;
+}
+
+void TerrainSnapshot::clear() {
+	m_mapW = m_mapH = 0;
+	m_tilesX = m_tilesY = 0;
+	m_imageScale = m_imageBpp = 0;
+	m_matTileBytes = m_imgTileBytes = 0;
+	m_active = false;
+	m_epoch = 0;
+	m_tileEpoch.clear();
+	m_touched.clear();
+	m_matData.clear();
+	m_imgData.clear();
+}
+
+void TerrainSnapshot::begin() {
+	m_active = true;
+	m_touched.clear();
+	m_epoch++;
+	if(m_epoch == 0) { // wrapped around, we must really reset now
+		std::fill(m_tileEpoch.begin(), m_tileEpoch.end(), 0);
+		m_epoch = 1;
+	}
+}
+
+void TerrainSnapshot::tileRect(Uint32 tile, int& x, int& y, int& w, int& h) const {
+	x = (tile % m_tilesX) * TILE_SIZE;
+	y = (tile / m_tilesX) * TILE_SIZE;
+	w = MIN((int)TILE_SIZE, m_mapW - x);
+	h = MIN((int)TILE_SIZE, m_mapH - y);
+}
+
+void TerrainSnapshot::touchedTileRect(size_t i, int& x, int& y, int& w, int& h) const {
+	tileRect(m_touched[i], x, y, w, h);
+}
+
+void TerrainSnapshot::saveTile(Uint32 tile, const Planes& src) {
+	const Uint32 slot = (Uint32)m_touched.size();
+	m_tileEpoch[tile] = m_epoch;
+	m_touched.push_back(tile);
+
+	if(m_matData.size() < (slot + 1) * m_matTileBytes)
+		m_matData.resize(MAX(m_matData.size() * 2, (slot + 1) * m_matTileBytes));
+	if(src.image && m_imgData.size() < (slot + 1) * m_imgTileBytes)
+		m_imgData.resize(MAX(m_imgData.size() * 2, (slot + 1) * m_imgTileBytes));
+
+	int x, y, w, h;
+	tileRect(tile, x, y, w, h);
+
+	unsigned char* mat = &m_matData[slot * m_matTileBytes];
+	for(int i = 0; i < h; ++i)
+		memcpy(mat + i * TILE_SIZE, src.matLines[y + i] + x, w);
+
+	if(src.image && m_imgTileBytes) {
+		const int s = m_imageScale;
+		const size_t rowBytes = (size_t)w * s * m_imageBpp;
+		const size_t tileRowBytes = (size_t)TILE_SIZE * s * m_imageBpp;
+		unsigned char* img = &m_imgData[slot * m_imgTileBytes];
+		const Uint8* srcRow = src.image + (size_t)y * s * src.imagePitch + (size_t)x * s * m_imageBpp;
+		for(int i = 0; i < h * s; ++i)
+			memcpy(img + i * tileRowBytes, srcRow + (size_t)i * src.imagePitch, rowBytes);
+	}
+}
+
+void TerrainSnapshot::touch(int x, int y, int w, int h, const Planes& src) {
+	if(!m_active) return;
+
+	// Clipping
+	if(x < 0) { w += x; x = 0; }
+	if(y < 0) { h += y; y = 0; }
+	w = MIN(w, m_mapW - x);
+	h = MIN(h, m_mapH - y);
+	if(w <= 0 || h <= 0) return;
+
+	const int tx1 = x / TILE_SIZE, tx2 = (x + w - 1) / TILE_SIZE;
+	const int ty1 = y / TILE_SIZE, ty2 = (y + h - 1) / TILE_SIZE;
+	for(int ty = ty1; ty <= ty2; ++ty)
+		for(int tx = tx1; tx <= tx2; ++tx) {
+			const Uint32 tile = ty * m_tilesX + tx;
+			if(m_tileEpoch[tile] != m_epoch)
+				saveTile(tile, src);
+		}
+}
+
+void TerrainSnapshot::restore(const Planes& dst) {
+	for(size_t slot = 0; slot < m_touched.size(); ++slot) {
+		int x, y, w, h;
+		tileRect(m_touched[slot], x, y, w, h);
+
+		const unsigned char* mat = &m_matData[slot * m_matTileBytes];
+		for(int i = 0; i < h; ++i)
+			memcpy(dst.matLines[y + i] + x, mat + i * TILE_SIZE, w);
+
+		if(dst.image && m_imgTileBytes && !m_imgData.empty()) {
+			const int s = m_imageScale;
+			const size_t rowBytes = (size_t)w * s * m_imageBpp;
+			const size_t tileRowBytes = (size_t)TILE_SIZE * s * m_imageBpp;
+			const unsigned char* img = &m_imgData[slot * m_imgTileBytes];
+			Uint8* dstRow = dst.image + (size_t)y * s * dst.imagePitch + (size_t)x * s * m_imageBpp;
+			for(int i = 0; i < h * s; ++i)
+				memcpy(dstRow + (size_t)i * dst.imagePitch, img + i * tileRowBytes, rowBytes);
+		}
+	}
+
+	m_active = false;
+}
+
+size_t TerrainSnapshot::memorySize() const {
+	return
+		m_tileEpoch.capacity() * sizeof(Uint32) +
+		m_touched.capacity() * sizeof(Uint32) +
+		m_matData.capacity() + m_imgData.capacity();
+}
+
+
+void TerrainHistory::init(int mapW, int mapH, int imageScale, int imageBpp, size_t historyLen) {
+	clear();
+	m_ticks.resize(historyLen);
+	for(size_t i = 0; i < m_ticks.size(); ++i)
+		m_ticks[i].init(mapW, mapH, imageScale, imageBpp);
+}
+
+void TerrainHistory::clear() {
+	m_ticks.clear();
+	m_newest = m_count = 0;
+}
+
+void TerrainHistory::beginTick() {
+	if(m_ticks.empty()) return;
+	if(m_count > 0) {
+		m_newest = (m_newest + 1) % m_ticks.size();
+		m_count = MIN(m_count + 1, m_ticks.size());
+	}
+	else
+		m_count = 1;
+	// the oldest recording is overwritten if full
+	m_ticks[m_newest].begin();
+}
+
+void TerrainHistory::rollback(size_t n, const TerrainSnapshot::Planes& dst, std::vector<int>& updatedRects) {
+	if(m_count == 0) return;
+	n = MIN(n, m_count);
+	for(size_t i = 0; i < n; ++i) {
+		TerrainSnapshot& snap = m_ticks[m_newest];
+		snap.restore(dst);
+		for(size_t t = 0; t < snap.touchedTileCount(); ++t) {
+			int x, y, w, h;
+			snap.touchedTileRect(t, x, y, w, h);
+			updatedRects.push_back(x); updatedRects.push_back(y);
+			updatedRects.push_back(w); updatedRects.push_back(h);
+		}
+		if(i + 1 < n)
+			m_newest = (m_newest + m_ticks.size() - 1) % m_ticks.size();
+	}
+	// The oldest undone tick is the one we are in now, record its changes again
+	m_count -= n - 1;
+	m_ticks[m_newest].begin();
+}
+
+size_t TerrainHistory::memorySize() const {
+	size_t res = 0;
+	for(size_t i = 0; i < m_ticks.size(); ++i)
+		res += m_ticks[i].memorySize();
+	return res;
+}
+
+
+///////////////////
+// Benchmark against the old std::set + full map copy tracking
+
+namespace {
+	// what CMap::SaveToMemoryInternal did before
+	struct OldSnapshot {
+		typedef std::pair<int,int> Coord;
+		std::set<Coord> coords;
+		std::vector<unsigned char> mat, img;
+		int mapW, mapH, scale, bpp, imagePitch;
+
+		void touch(int x, int y, int w, int h, const TerrainSnapshot::Planes& src) {
+			const int S = TerrainSnapshot::TILE_SIZE;
+			for(int fy = MAX(y, 0) / S; fy < 1 + MIN(y + h, mapH - 1) / S; fy++)
+				for(int fx = MAX(x, 0) / S; fx < 1 + MIN(x + w, mapW - 1) / S; fx++) {
+					if(coords.count(Coord(fx, fy))) continue;
+					coords.insert(Coord(fx, fy));
+					copy(fx, fy, src, true);
+				}
+		}
+		void restore(const TerrainSnapshot::Planes& dst) {
+			for(std::set<Coord>::iterator it = coords.begin(); it != coords.end(); ++it)
+				copy(it->first, it->second, dst, false);
+			coords.clear();
+		}
+		void copy(int fx, int fy, const TerrainSnapshot::Planes& p, bool save) {
+			const int S = TerrainSnapshot::TILE_SIZE;
+			const int sx = fx * S, sy = fy * S;
+			const int w = MIN(S, mapW - sx), h = MIN(S, mapH - sy);
+			for(int y = sy; y < sy + h; ++y) {
+				if(save) memcpy(&mat[y * mapW + sx], p.matLines[y] + sx, w);
+				else memcpy(p.matLines[y] + sx, &mat[y * mapW + sx], w);
+			}
+			for(int y = sy * scale; y < (sy + h) * scale; ++y) {
+				const size_t off = (size_t)y * imagePitch + (size_t)sx * scale * bpp;
+				if(save) memcpy(&img[off], p.image + off, w * scale * bpp);
+				else memcpy(p.image + off, &img[off], w * scale * bpp);
+			}
+		}
+	};
+}
+
+void TerrainSnapshot::benchmark(int holesPerTick) {
+	const int mapW = 2000, mapH = 1500, bpp = 4, scale = 2;
+	const int ticks = 500;
+	const int holeSize = 20;
+	holesPerTick = CLAMP(holesPerTick, 1, 1000);
+	notes << "TerrainSnapshot benchmark: " << mapW << "x" << mapH << ", " << ticks << " rollbacks of "
+		<< NewNet::TICK_TIME << "ms ticks, " << holesPerTick << " holes per tick" << endl;
+
+	std::vector<unsigned char> material(mapW * mapH);
+	std::vector<unsigned char*> lines(mapH);
+	for(int y = 0; y < mapH; ++y) lines[y] = &material[y * mapW];
+	const int imagePitch = mapW * scale * bpp;
+	std::vector<Uint8> image((size_t)imagePitch * mapH * scale);
+	for(size_t i = 0; i < material.size(); ++i) material[i] = (unsigned char)(i * 7);
+	for(size_t i = 0; i < image.size(); ++i) image[i] = (Uint8)(i * 13);
+	const std::vector<unsigned char> materialOrig = material;
+	const std::vector<Uint8> imageOrig = image;
+
+	Planes planes;
+	planes.matLines = &lines[0];
+	planes.image = &image[0];
+	planes.imagePitch = imagePitch;
+
+	TerrainSnapshot snap;
+	snap.init(mapW, mapH, scale, bpp);
+	OldSnapshot old;
+	old.mapW = mapW; old.mapH = mapH; old.scale = scale; old.bpp = bpp; old.imagePitch = imagePitch;
+	old.mat.resize(material.size());
+	old.img.resize(image.size());
+
+	size_t tilesTotal = 0, checkFailures = 0;
+	TimeDiff times[2];
+	for(int impl = 0; impl < 2; ++impl) {
+		SyncedRandom rnd(7);
+		for(int t = 0; t < ticks; ++t) {
+			AbsTime start = GetTime();
+			if(impl == 0) snap.begin();
+
+			// a cluster of holes, like a cluster bomb would make
+			const int cx = rnd.getInt() % mapW, cy = rnd.getInt() % mapH;
+			for(int h = 0; h < holesPerTick; ++h) {
+				const int x = cx + (int)(rnd.getInt() % 200) - 100 - holeSize / 2;
+				const int y = cy + (int)(rnd.getInt() % 200) - 100 - holeSize / 2;
+				if(impl == 0) snap.touch(x, y, holeSize, holeSize, planes);
+				else old.touch(x, y, holeSize, holeSize, planes);
+				for(int j = MAX(y, 0); j < MIN(y + holeSize, mapH); ++j) {
+					const int i1 = MAX(x, 0), i2 = MIN(x + holeSize, mapW);
+					if(i2 <= i1) break;
+					memset(lines[j] + i1, 0, i2 - i1);
+					for(int k = 0; k < scale; ++k)
+						memset(&image[((size_t)j * scale + k) * imagePitch + (size_t)i1 * scale * bpp], 0, (i2 - i1) * scale * bpp);
+				}
+			}
+
+			if(impl == 0) { tilesTotal += snap.touchedTileCount(); snap.restore(planes); }
+			else old.restore(planes);
+			times[impl] += GetTime() - start;
+
+			if((t % 50) == 0 && (material != materialOrig || image != imageOrig))
+				checkFailures++;
+		}
+	}
+
+	if(checkFailures)
+		errors << "TerrainSnapshot: restored map differs in " << checkFailures << " checks" << endl;
+	notes << "TerrainSnapshot: " << (tilesTotal / ticks) << " tiles per tick, "
+		<< (times[0].milliseconds() * 1000.0 / ticks) << " us per tick (old std::set: "
+		<< (times[1].milliseconds() * 1000.0 / ticks) << " us), including the carving" << endl;
+	notes << "TerrainSnapshot: snapshot memory " << (snap.memorySize() / 1024) << " KB (old: "
+		<< ((old.mat.size() + old.img.size()) / 1024) << " KB)" << endl;
+}
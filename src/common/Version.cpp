@@ -19,7 +19,7 @@
 #include "Version_generated.h"
 
 #ifndef		LX_VERSION
-#	define		LX_VERSION	"0.59_beta11"
+#	define		LX_VERSION	"0.59_beta12"
 #endif
 
 #define		GAMENAME			"OpenLieroX"
@@ -46,10 +46,18 @@ struct AttrDesc {
 	bool serverside;
 	bool serverCanUpdate;
 	boost::function<void(BaseObject* base, const AttrDesc* attrDesc, ScriptVar_t oldValue)> onUpdate;
+
+	// Hints for the network encoding (see GameStateUpdates::writeToBs).
+	// Int, float and vec2 values within [netMin, netMax] only take the bits
+	// needed for that range (no range if netMin > netMax). Float values are
+	// rounded to multiples of netPrecision (0 sends them exactly).
+	float netMin, netMax;
+	float netPrecision;
 	
 	AttrDesc()
 	: objTypeId(0), attrType(SVT_INVALID), isStatic(true), attrMemOffset(0), attrExtMemOffset(0), attrId(0),
-	  serverside(true), serverCanUpdate(true) {}
+	  serverside(true), serverCanUpdate(true), netMin(1), netMax(0), netPrecision(0) {}
+	bool hasNetRange() const { return netMin <= netMax; }
 	std::string description() const;
 
 	const void* getValuePtr(const BaseObject* base) const {
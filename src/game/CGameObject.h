@@ -41,11 +41,11 @@ protected:
 	// Gusanos comment:
 	// IMPORTANT: The pos and spd vectors should be used as read only. ( Because of netplay needs )
 	// To change their values use the setters provided.
-	ATTR(CGameObject, CVec, vPos, 2, {serverside = false; serverCanUpdate = false;})
-	ATTR(CGameObject, CVec, vVelocity, 3, {serverside = false; serverCanUpdate = false;})
+	ATTR(CGameObject, CVec, vPos, 2, {serverside = false; serverCanUpdate = false; netMin = 0; netMax = 4095; netPrecision = 1.0f/32;})
+	ATTR(CGameObject, CVec, vVelocity, 3, {serverside = false; serverCanUpdate = false; netPrecision = 1.0f/64;})
 
 public:
-	ATTR(CGameObject, float, health, 4, {serverside = false; serverCanUpdate = false; defaultValue = 100.0f;})
+	ATTR(CGameObject, float, health, 4, {serverside = false; serverCanUpdate = false; defaultValue = 100.0f; netMin = 0; netMax = 100; netPrecision = 1.0f/16;})
 
 	CVec		getPos() const				{ return vPos; }
 	void		setPos(const CVec& v)		{ vPos = v; }
@@ -20,6 +20,7 @@
 #include <SDL.h>
 #include <string>
 #include <set>
+#include <vector>
 #include "ReadWriteLock.h"
 #include "SmartPointer.h"
 #include "LieroX.h" // for maprandom_t
@@ -30,6 +31,10 @@
 #include "gusanos/level.h"
 #include "level/LXMapFlags.h"
 #include "CodeAttributes.h"
+#include "TerrainSnapshot.h"
+#include "NavGraph.h"
+#include "MapRenderCache.h"
+#include "MiniMapPyramid.h"
 
 class CViewport;
 class CCache;
@@ -103,14 +108,12 @@ public:
 		Objects = NULL;
 
 		bMiniMapDirty = true;
-
+		m_dirtyRects.clear();
 		
 		AdditionalData.clear();
 		
-		bMapSavingToMemory = false;
-		bmpSavedImage = NULL;
-		savedPixelFlags = NULL;
-		savedMapCoords.clear();
+		m_terrainHistory.clear();
+		m_navGraph = NULL;
 		
 		gusInit();
    	}
@@ -153,6 +156,30 @@ private:
 
 	bool		bMiniMapDirty;
 
+public:
+	// Pixel counters of the minimap updates. requested is what we would have
+	// updated immediately for each terrain change, updated is what we actually did.
+	struct DirtyRectStats {
+		Uint64 requestedPixels, updatedPixels;
+		Uint64 requests, flushes;
+		DirtyRectStats() : requestedPixels(0), updatedPixels(0), requests(0), flushes(0) {}
+	};
+	
+private:
+	// Minimap updates from terrain changes (CarveHole, PlaceDirt, ...) are
+	// collected here during the physics and done once per drawn frame.
+	struct DirtyRect {
+		int x, y, w, h;
+	};
+	enum { MAX_DIRTY_RECTS = 32 };
+	std::vector<DirtyRect> m_dirtyRects;
+	static DirtyRectStats m_dirtyRectStats;
+	// the averaged map colors the minimap is drawn from
+	MiniMapPyramid m_miniMapPyramid;
+
+	// flattened image + foreground for the drawing (CMap::gusDraw)
+	MapRenderCache m_renderCache;
+
 	ReadWriteLock	flagsLock;
 
 	// Objects
@@ -162,28 +189,19 @@ private:
 	std::map< std::string, std::string > AdditionalData; // Not used currently, maybe will contain CTF info in Beta10
 
 	// Save/restore from memory, for commit/rollback net mechanism
-	bool		bMapSavingToMemory;
-	SmartPointer<SDL_Surface> bmpSavedImage;
-	uchar *		savedPixelFlags;
-	enum { MAP_SAVE_CHUNK = 16 };
-	struct SavedMapCoord_t {
-		int X, Y;
-		SavedMapCoord_t(int x = 0, int y = 0) : X(x), Y(y) {}
-		bool operator < (const SavedMapCoord_t & m) const
-		{
-			if( Y < m.Y ) return true;
-			else if( Y > m.Y ) return false;
-			else if( X < m.X ) return true;
-			else return false;
-		}
-	};
-	std::set< SavedMapCoord_t > savedMapCoords;
+	TerrainHistory m_terrainHistory;
+
+	// Pathfinding graph for the bots, built on first use. The bot path searches
+	// run on a reference to it; if they still hold it when it must be updated, we copy it.
+	SmartPointer<NavGraph> m_navGraph;
+	NavGraph::Search m_navUpdateSearch;
 
 private:
 	// Update functions
 	void		UpdateMiniMap(bool force = false);
 	void		UpdateMiniMapRect(int x, int y, int w, int h);
 	void		UpdateArea(int x, int y, int w, int h, bool update_image = false);
+	void		addDirtyRect(int x, int y, int w, int h);
 
 	friend class CCache;
 
@@ -262,12 +280,17 @@ private:
 	
 	// Saves region of map to savebuffer for RestoreFromMemory() - called from CarveHole()/PlaceDirt()/PlaceGreenDirt()
 	void SaveToMemoryInternal(int x, int y, int w, int h);
+	TerrainSnapshot::Planes snapshotPlanes();
 
 
 public:	
 
 	size_t GetMemorySize();
 
+	// Pathfinding graph of the bots, up to date with the map; builds it if needed.
+	// The returned graph is not changed anymore, it can be searched from any thread.
+	SmartPointer<NavGraph> navGraph();
+
 	int WrapAroundX(int x) const {
 		x %= (int)Width;
 		if(x < 0) x += Width;
@@ -308,7 +331,10 @@ public:
 	void	putColorTo(long x, long y, Color c);
 	void	putSurfaceTo(long x, long y, SDL_Surface* surf, int sx, int sy, int sw, int sh);
 	
-	SmartPointer<SDL_Surface> GetMiniMap()		{ return bmpMiniMap; }
+	SmartPointer<SDL_Surface> GetMiniMap()		{ flushDirtyRects(); return bmpMiniMap; }
+	void		flushDirtyRects();
+	static const DirtyRectStats& dirtyRectStats()	{ return m_dirtyRectStats; }
+	const MapRenderCache& renderCache() const	{ return m_renderCache; }
 #ifdef _AI_DEBUG
 	// TODO: the debug image is also usefull for other debugging things, not for AI
 	// so make it also available if DEBUG is defined
@@ -343,8 +369,10 @@ public:
 	CVec		groundPos(const CVec& pos);
 	
 	// Save/restore from memory, for commit/rollback net mechanism
-	void		NewNet_SaveToMemory();
-	void		NewNet_RestoreFromMemory();
+	// Starts saving the changes of a new tick, keeping the last historyLen ticks
+	void		NewNet_SaveToMemory(size_t historyLen = 1);
+	// Goes back to the state of the ticks-th newest save
+	void		NewNet_RestoreFromMemory(size_t ticks = 1);
 	void		NewNet_Deinit();
 
 	theme_t		*GetTheme()		{ return &Theme; }
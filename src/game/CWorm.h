@@ -95,7 +95,7 @@ struct weapon_t;
 // Weapon slot structure
 struct wpnslot_t : CustomVar {
 	ATTR(wpnslot_t, int32_t,	WeaponId,	1, { defaultValue = -1; serverside = false; })
-	ATTR(wpnslot_t, float,		Charge,		2, { defaultValue = 1.f; serverside = true; })
+	ATTR(wpnslot_t, float,		Charge,		2, { defaultValue = 1.f; serverside = true; netMin = 0; netMax = 1; netPrecision = 1.0f/256; })
 	ATTR(wpnslot_t, bool,		Reloading,	3, { defaultValue = false; serverside = true; })
 	ATTR(wpnslot_t, float,		LastFire,	4, { defaultValue = 0.f; serverside = true; })
 
@@ -193,7 +193,7 @@ protected:
 	bool            bPrepared;
 
 public:
-	ATTR(CWorm, int32_t,	iTeam, 1, {serverside = true;})
+	ATTR(CWorm, int32_t,	iTeam, 1, {serverside = true; netMin = 0; netMax = 3;})
 	ATTR(CWorm, std::string,	sName, 2, {serverside = false;})
 
 	ATTR(CWorm, CGameSkin, cSkin, 3, {serverside = false;})
@@ -209,7 +209,7 @@ public:
 
 	// Arsenal
 	ATTR(CWorm, bool,	bWeaponsReady,  20, {serverside = false; onUpdate = onWeaponsReadyUpdate; })
-	ATTR(CWorm,	int32_t,	iCurrentWeapon,	21, {serverside = false;})
+	ATTR(CWorm,	int32_t,	iCurrentWeapon,	21, {serverside = false; netMin = 0; netMax = 4;})
 	ATTR(CWorm, List<wpnslot_t>,	weaponSlots, 22, { serverside = false; defaultValue = List<wpnslot_t>(5).getRefCopy(); })
 
 	struct WeaponSlotWrapper {
@@ -243,10 +243,10 @@ protected:
 	Version		cClientVersion;
 
 	AbsTime		fTimeofDeath;
-	ATTR(CWorm, int32_t /*DIR_TYPE*/,	iFaceDirectionSide, 24, {serverside = false;})
-	ATTR(CWorm, int32_t /*DIR_TYPE*/,	iMoveDirectionSide, 25, {serverside = false;})
+	ATTR(CWorm, int32_t /*DIR_TYPE*/,	iFaceDirectionSide, 24, {serverside = false; netMin = 0; netMax = 1;})
+	ATTR(CWorm, int32_t /*DIR_TYPE*/,	iMoveDirectionSide, 25, {serverside = false; netMin = 0; netMax = 1;})
 	bool		bGotTarget;
-	ATTR(CWorm, float,	fAngle, 26, {serverside = false; serverCanUpdate = false;})
+	ATTR(CWorm, float,	fAngle, 26, {serverside = false; serverCanUpdate = false; netMin = -90; netMax = 90; netPrecision = 1.0f/128;})
     float       fAngleSpeed;
     float		fMoveSpeedX;
 	
@@ -343,6 +343,8 @@ public:
 	void		updateCheckVariables();
 	bool		checkPacketNeeded();
 	void		writePacket(CBytestream *bs, bool fromServer, CServerConnection* receiver);
+	// the written update only differs by this for the receivers, so it can be shared
+	static bool	packetHasVelocity(const Version& receiverVer)	{ return receiverVer >= OLXBetaVersion(0,57,5); }
 	void		readPacket(CBytestream *bs);
 	void		net_updatePos(const CVec& newpos);
 	bool		skipPacket(CBytestream *bs);
@@ -616,6 +618,9 @@ public:
 	
 	void NewNet_CopyWormState(const CWorm & w);
 	void NewNet_InitWormState( int seed );
+	// Same state as NewNet_CopyWormState(), without the damage report, for the rollback history
+	void NewNet_SaveState(GameStateArena& arena) const;
+	bool NewNet_LoadState(GameStateArena::Reader& r);
 	
 	NewNet::NetSyncedRandom NewNet_random;
 	
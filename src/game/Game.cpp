@@ -51,6 +51,7 @@
 #include "GameState.h"
 #include "DeprecatedGUI/CBrowser.h"
 #include "gusanos/LuaCallbacks.h"
+#include "LoadTest.h"
 
 #include <boost/shared_ptr.hpp>
 #include <boost/lambda/lambda.hpp>
@@ -512,8 +513,7 @@ Result Game::prepareGameloop() {
 	cClient->flagInfo()->reset();
 	game.teamScores.write().resize(0);
 
-	cClient->projPosMap.clear();
-	cClient->projPosMap.resize(CClient::MapPosIndex( VectorD2<int>(game.gameMap()->GetWidth(), game.gameMap()->GetHeight())).index(game.gameMap()) );
+	cClient->projPosMap.reset(game.gameMap()->GetWidth(), game.gameMap()->GetHeight(), MAX_PROJECTILES);
 	cClient->cProjectiles.clear();
 
 	cClient->SetupViewports();
@@ -664,7 +664,9 @@ void Game::frame() {
 	ProcessEvents();
 
 	// Main frame
+	LoadTest::beginFrame();
 	frameInner();
+	LoadTest::endFrame();
 
 	if(game.state <= Game::S_Lobby) {
 		DeprecatedGUI::Menu_Frame();
@@ -785,8 +787,6 @@ void Game::frameInner()
 		cClient->SimulateHud();
 
 		if(isServer() && cServer->isServerRunning()) {
-			cServer->ProcessRegister();
-			cServer->ProcessGetExternalIP();
 			cServer->ReadPackets();
 		}
 	}
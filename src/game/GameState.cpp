@@ -7,6 +7,9 @@
  *
  */
 
+#include <algorithm>
+#include <cstring>
+#include <cmath>
 #include "GameState.h"
 #include "Game.h"
 #include "Settings.h"
@@ -16,13 +19,13 @@
 #include "ProfileSystem.h"
 #include "CServerConnection.h"
 #include "game/Attr.h"
+#include "InterestManager.h"
+#include "LieroX.h"
+#include "Timer.h"
+#include "Version.h"
+#include "CClient.h"
 
-ScriptVar_t ObjectState::getValue(AttribRef a) const {
-	Attribs::const_iterator it = attribs.find(a);
-	if(it == attribs.end())
-		return a.getAttrDesc()->defaultValue;
-	return it->second.value;
-}
+GameStateUpdates::Stats GameStateUpdates::stats;
 
 GameStateUpdates::operator bool() const {
 	if(!objs.empty()) return true;
@@ -31,7 +34,282 @@ GameStateUpdates::operator bool() const {
 	return false;
 }
 
-void GameStateUpdates::writeToBs(CBytestream* bs, const GameState& oldState) const {
+
+///////////////////
+// Attribute update encoding
+
+/*
+	The object creations and deletions are written as before. For receivers
+	with at least 0.59 beta12, the attribute updates are bit-packed:
+
+	- the count and all other integers as varints: 4 bits at a time, each
+	  followed by a bit which tells if more follow
+	- the ObjAttrRef relative to the one before (the updates are sorted):
+	  one bit if it is the same object, else one bit if it is a following
+	  object of the same class (then the objId difference) or otherwise
+	  classId and objId; then one bit if it is a following attrib of the same
+	  type (then the attrId difference) or otherwise objTypeId and attrId
+	- the value with the type from its AttrDesc and the network hints there
+	  (AttrDesc::netMin/netMax/netPrecision). Strings and custom vars (and
+	  values which don't have the type of their AttrDesc) are written with
+	  writeVar() at the next byte.
+
+	After the attribute updates, we continue at the next byte.
+
+	Older versions get the count as a 4 byte int, and each update as the full
+	ObjAttrRef and the value with writeVar().
+*/
+
+static bool bitPackedAttrUpdates(const Version& v) {
+	return v >= OLXBetaVersion(0,59,12);
+}
+
+static void writeVarBits(CBytestream* bs, Uint32 v) {
+	do {
+		bs->writeBits(v & 15, 4);
+		v >>= 4;
+		bs->writeBit(v != 0);
+	} while(v != 0);
+}
+
+static Uint32 readVarBits(CBytestream* bs) {
+	Uint32 v = 0;
+	for(int shift = 0; shift < 32; shift += 4) {
+		v |= bs->readBits(4) << shift;
+		if(!bs->readBit()) break;
+	}
+	return v;
+}
+
+static Uint32 zigzag(Sint32 v) { return ((Uint32)v << 1) ^ (Uint32)(v >> 31); }
+static Sint32 unzigzag(Uint32 v) { return (Sint32)(v >> 1) ^ -(Sint32)(v & 1); }
+
+// bits needed for 0..range
+static int bitsForRange(Uint32 range) {
+	int bits = 0;
+	while(bits < 32 && ((Uint64)1 << bits) <= range) bits++;
+	return bits;
+}
+
+static bool intNetRange(const AttrDesc* attrDesc, Sint32& lo, Sint32& hi) {
+	if(!attrDesc->hasNetRange()) return false;
+	lo = (Sint32)ceil(attrDesc->netMin);
+	hi = (Sint32)floor(attrDesc->netMax);
+	return lo <= hi;
+}
+
+// in units of netPrecision
+static bool quantNetRange(const AttrDesc* attrDesc, Sint32& lo, Sint32& hi) {
+	if(!attrDesc->hasNetRange()) return false;
+	lo = (Sint32)floor(attrDesc->netMin / attrDesc->netPrecision + 0.5f);
+	hi = (Sint32)floor(attrDesc->netMax / attrDesc->netPrecision + 0.5f);
+	return lo <= hi;
+}
+
+static void writeCompactInt(CBytestream* bs, Sint32 v, Sint32 lo, Sint32 hi, bool haveRange) {
+	if(haveRange) {
+		const bool inRange = v >= lo && v <= hi;
+		bs->writeBit(inRange);
+		if(inRange) {
+			bs->writeBits((Uint32)(v - lo), bitsForRange((Uint32)(hi - lo)));
+			return;
+		}
+	}
+	writeVarBits(bs, zigzag(v));
+}
+
+static Sint32 readCompactInt(CBytestream* bs, Sint32 lo, Sint32 hi, bool haveRange) {
+	if(haveRange && bs->readBit())
+		return lo + (Sint32)bs->readBits(bitsForRange((Uint32)(hi - lo)));
+	return unzigzag(readVarBits(bs));
+}
+
+static void writeCompactFloat(CBytestream* bs, const AttrDesc* attrDesc, float f) {
+	if(attrDesc->netPrecision > 0) {
+		const float q = f / attrDesc->netPrecision;
+		const bool quantized = fabs(q) < (float)(1 << 30); // false for NaN/inf
+		bs->writeBit(quantized);
+		if(quantized) {
+			Sint32 lo = 0, hi = 0;
+			const bool haveRange = quantNetRange(attrDesc, lo, hi);
+			writeCompactInt(bs, (Sint32)floor(q + 0.5f), lo, hi, haveRange);
+			return;
+		}
+	}
+	Uint32 raw;
+	memcpy(&raw, &f, sizeof(raw));
+	bs->writeBits(raw, 32);
+}
+
+static float readCompactFloat(CBytestream* bs, const AttrDesc* attrDesc) {
+	if(attrDesc->netPrecision > 0 && bs->readBit()) {
+		Sint32 lo = 0, hi = 0;
+		const bool haveRange = quantNetRange(attrDesc, lo, hi);
+		return (float)readCompactInt(bs, lo, hi, haveRange) * attrDesc->netPrecision;
+	}
+	const Uint32 raw = bs->readBits(32);
+	float f;
+	memcpy(&f, &raw, sizeof(f));
+	return f;
+}
+
+static bool isCompactType(ScriptVarType_t type) {
+	switch(type) {
+	case SVT_BOOL: case SVT_INT32: case SVT_UINT64: case SVT_FLOAT: case SVT_VEC2: case SVT_COLOR:
+		return true;
+	default:
+		return false;
+	}
+}
+
+// returns the size with writeVar(), for the stats
+static size_t writeAttrValue(CBytestream* bs, const AttrDesc* attrDesc, const ScriptVar_t& v, const CustomVar* diffToOld, bool bitPacked) {
+	if(bitPacked && isCompactType(attrDesc->attrType)) {
+		const bool compact = v.type == attrDesc->attrType;
+		bs->writeBit(compact);
+		if(compact) {
+			switch(v.type) {
+			case SVT_BOOL:
+				bs->writeBit((bool)v);
+				return 2;
+			case SVT_INT32: {
+				Sint32 lo = 0, hi = 0;
+				const bool haveRange = intNetRange(attrDesc, lo, hi);
+				writeCompactInt(bs, (int32_t)v, lo, hi, haveRange);
+				return 5;
+			}
+			case SVT_UINT64: {
+				const uint64_t i = (uint64_t)v;
+				writeVarBits(bs, (Uint32)i);
+				writeVarBits(bs, (Uint32)(i >> 32));
+				return 9;
+			}
+			case SVT_FLOAT:
+				writeCompactFloat(bs, attrDesc, (float)v);
+				return 5;
+			case SVT_VEC2: {
+				const CVec vec = v;
+				writeCompactFloat(bs, attrDesc, vec.x);
+				writeCompactFloat(bs, attrDesc, vec.y);
+				return 9;
+			}
+			case SVT_COLOR: {
+				const Color c = v;
+				bs->writeBits(c.r, 8);
+				bs->writeBits(c.g, 8);
+				bs->writeBits(c.b, 8);
+				bs->writeBits(c.a, 8);
+				return 5;
+			}
+			default:
+				assert(false);
+			}
+		}
+	}
+
+	bs->ResetBitPos();
+	const size_t start = bs->GetLength();
+	bs->writeVar(v, diffToOld);
+	return bs->GetLength() - start;
+}
+
+// the counterpart of writeAttrValue()
+static bool readAttrValue(CBytestream* bs, const AttrDesc* attrDesc, ScriptVar_t& v, bool bitPacked) {
+	if(!bitPacked)
+		return bs->readVar(v);
+	if(isCompactType(attrDesc->attrType) && bs->readBit()) {
+		switch(attrDesc->attrType) {
+		case SVT_BOOL:
+			v = ScriptVar_t(bs->readBit());
+			return true;
+		case SVT_INT32: {
+			Sint32 lo = 0, hi = 0;
+			const bool haveRange = intNetRange(attrDesc, lo, hi);
+			v = ScriptVar_t((int32_t)readCompactInt(bs, lo, hi, haveRange));
+			return true;
+		}
+		case SVT_UINT64: {
+			const uint64_t low = readVarBits(bs);
+			const uint64_t high = readVarBits(bs);
+			v = ScriptVar_t((uint64_t)(low | (high << 32)));
+			return true;
+		}
+		case SVT_FLOAT:
+			v = ScriptVar_t(readCompactFloat(bs, attrDesc));
+			return true;
+		case SVT_VEC2: {
+			const float x = readCompactFloat(bs, attrDesc);
+			const float y = readCompactFloat(bs, attrDesc);
+			v = ScriptVar_t(CVec(x, y));
+			return true;
+		}
+		case SVT_COLOR: {
+			Color c;
+			c.r = bs->readBits(8);
+			c.g = bs->readBits(8);
+			c.b = bs->readBits(8);
+			c.a = bs->readBits(8);
+			v = ScriptVar_t(c);
+			return true;
+		}
+		default:
+			assert(false);
+		}
+	}
+
+	bs->AlignReadToByte();
+	return bs->readVar(v);
+}
+
+static void writeAttrRef(CBytestream* bs, const ObjAttrRef& r, const ObjAttrRef& last) {
+	const bool sameObj = r.obj == last.obj;
+	bs->writeBit(sameObj);
+	if(!sameObj) {
+		const bool nextInClass = r.obj.classId == last.obj.classId && r.obj.objId > last.obj.objId;
+		bs->writeBit(nextInClass);
+		if(nextInClass)
+			writeVarBits(bs, r.obj.objId - last.obj.objId - 1);
+		else {
+			writeVarBits(bs, r.obj.classId);
+			writeVarBits(bs, r.obj.objId);
+		}
+	}
+
+	const bool nextInType = sameObj && r.attr.objTypeId == last.attr.objTypeId && r.attr.attrId > last.attr.attrId;
+	bs->writeBit(nextInType);
+	if(nextInType)
+		writeVarBits(bs, r.attr.attrId - last.attr.attrId - 1);
+	else {
+		writeVarBits(bs, r.attr.objTypeId);
+		writeVarBits(bs, r.attr.attrId);
+	}
+}
+
+static void readAttrRef(CBytestream* bs, ObjAttrRef& r, const ObjAttrRef& last) {
+	r.obj = last.obj;
+	if(!bs->readBit()) {
+		if(bs->readBit())
+			r.obj.objId = (ObjId)(last.obj.objId + readVarBits(bs) + 1);
+		else {
+			r.obj.classId = (ClassId)readVarBits(bs);
+			r.obj.objId = (ObjId)readVarBits(bs);
+		}
+	}
+
+	if(bs->readBit()) {
+		r.attr.objTypeId = last.attr.objTypeId;
+		r.attr.attrId = (AttrDesc::AttrId)(last.attr.attrId + readVarBits(bs) + 1);
+	}
+	else {
+		r.attr.objTypeId = (ClassId)readVarBits(bs);
+		r.attr.attrId = (AttrDesc::AttrId)readVarBits(bs);
+	}
+}
+
+void GameStateUpdates::writeToBs(CBytestream* bs, const GameState& oldState, const Version& receiverVersion) const {
+	const bool bitPacked = bitPackedAttrUpdates(receiverVersion);
+	const size_t start = bs->GetLength();
+
 	bs->writeInt16((uint16_t)objCreations.size());
 	const_foreach(o, objCreations) {
 		o->writeToBs(bs);
@@ -42,19 +320,38 @@ void GameStateUpdates::writeToBs(CBytestream* bs, const GameState& oldState) con
 		o->writeToBs(bs);
 	}
 
-	bs->writeInt((uint32_t)objs.size(), 4);
+	const size_t attrStart = bs->GetLength();
+	size_t legacyAttrBytes = 4; // the count
+	bs->ResetBitPos();
+	if(bitPacked)
+		writeVarBits(bs, (Uint32)objs.size());
+	else
+		bs->writeInt((uint32_t)objs.size(), 4);
+	ObjAttrRef last;
 	const_foreach(a, objs) {
 		const ObjAttrRef& attr = *a;
+		const AttrDesc* attrDesc = attr.attr.getAttrDesc();
 		ScriptVar_t curValue = a->get();
-		attr.writeToBs(bs);
-		if((attr.attr.getAttrDesc()->attrType == SVT_CustomWeakRefToStatic || attr.attr.getAttrDesc()->attrType == SVT_CUSTOM) && oldState.haveObject(attr.obj)) {
+		if(bitPacked)
+			writeAttrRef(bs, attr, last);
+		else
+			attr.writeToBs(bs);
+		last = attr;
+		legacyAttrBytes += 8; // ObjAttrRef::writeToBs
+		if((attrDesc->attrType == SVT_CustomWeakRefToStatic || attrDesc->attrType == SVT_CUSTOM) && oldState.haveObject(attr.obj)) {
 			ScriptVar_t oldValue = oldState.getValue(attr);
 			assert(oldValue.isCustomType());
-			bs->writeVar(curValue, oldValue.customVar());
+			legacyAttrBytes += writeAttrValue(bs, attrDesc, curValue, oldValue.customVar(), bitPacked);
 		}
 		else
-			bs->writeVar(curValue);
+			legacyAttrBytes += writeAttrValue(bs, attrDesc, curValue, NULL, bitPacked);
 	}
+	bs->ResetBitPos();
+
+	stats.updates++;
+	stats.attrs += objs.size();
+	stats.bytes += bs->GetLength() - start;
+	stats.uncompressedBytes += attrStart - start + legacyAttrBytes;
 }
 
 static BaseObject* getObjFromRef(ObjRef r, bool alsoGameSettings = false) {
@@ -94,6 +391,7 @@ void GameStateUpdates::handleFromBs(CBytestream* bs, CServerConnection* source)
 	}
 	else
 		assert(source == NULL);
+	const bool bitPacked = bitPackedAttrUpdates(source ? source->getClientVersion() : cClient->getServerVersion());
 
 	uint16_t creationsNum = bs->readInt16();
 	for(uint16_t i = 0; i < creationsNum; ++i) {
@@ -163,10 +461,16 @@ void GameStateUpdates::handleFromBs(CBytestream* bs, CServerConnection* source)
 		}
 	}
 
-	uint32_t attrUpdatesNum = bs->readInt(4);
+	bs->ResetBitPos();
+	const uint32_t attrUpdatesNum = bitPacked ? readVarBits(bs) : bs->readInt(4);
+	ObjAttrRef last;
 	for(uint32_t i = 0; i < attrUpdatesNum; ++i) {
 		ObjAttrRef r;
-		r.readFromBs(bs);
+		if(bitPacked)
+			readAttrRef(bs, r, last);
+		else
+			r.readFromBs(bs);
+		last = r;
 
 		const AttrDesc* attrDesc = r.attr.getAttrDesc();
 		if(attrDesc == NULL) {
@@ -219,7 +523,7 @@ void GameStateUpdates::handleFromBs(CBytestream* bs, CServerConnection* source)
 			// Somewhat hacky right now. We don't really manipulate gameSettings.
 			::pushObjAttrUpdate(gameSettings, attrDesc);
 			FeatureIndex fIndex = Settings::getAttrDescs().getIndex(attrDesc);
-			bs->readVar(cClient->getGameLobby().write(fIndex));
+			readAttrValue(bs, attrDesc, cClient->getGameLobby().write(fIndex), bitPacked);
 		}
 		else {
 			BaseObject* o = getObjFromRef(r.obj);
@@ -238,14 +542,14 @@ void GameStateUpdates::handleFromBs(CBytestream* bs, CServerConnection* source)
 				CustomVar* v = (CustomVar*)attrDesc->getValuePtr(o);
 				::pushObjAttrUpdate(*o, attrDesc);
 				ScriptVar_t scriptVarRef(v->thisRef.obj);
-				bs->readVar(scriptVarRef);
+				readAttrValue(bs, attrDesc, scriptVarRef, bitPacked);
 				assert(scriptVarRef.type == SVT_CustomWeakRefToStatic);
 				//if(attrDesc->attrName == "weaponSlots")
 					//notes << "game state update: <" << r.obj.description() << "> " << attrDesc->attrName << " to " << scriptVarRef.toString() << endl;
 			}
 			else {
 				ScriptVar_t v;
-				bs->readVar(v);
+				readAttrValue(bs, attrDesc, v, bitPacked);
 
 				if(attrDesc == game.state.attrDesc()) {
 					if((int)v < Game::S_Lobby) {
@@ -271,10 +575,17 @@ void GameStateUpdates::handleFromBs(CBytestream* bs, CServerConnection* source)
 			source->gameState->setObjAttr(r, r.attr.getAttrDesc()->get(o));
 		}
 	}
+	bs->AlignReadToByte();
 }
 
 void GameStateUpdates::pushObjAttrUpdate(ObjAttrRef a) {
-	objs.insert(a);
+	if(objs.empty() || objs.back() < a) {
+		objs.push_back(a);
+		return;
+	}
+	Objs::iterator it = std::lower_bound(objs.begin(), objs.end(), a);
+	if(!(*it == a))
+		objs.insert(it, a);
 }
 
 void GameStateUpdates::pushObjCreation(ObjRef o) {
@@ -283,8 +594,8 @@ void GameStateUpdates::pushObjCreation(ObjRef o) {
 }
 
 void GameStateUpdates::pushObjDeletion(ObjRef o) {
-	Objs::iterator itStart = objs.lower_bound(ObjAttrRef::LowerLimit(o));
-	Objs::iterator itEnd = objs.upper_bound(ObjAttrRef::UpperLimit(o));
+	Objs::iterator itStart = std::lower_bound(objs.begin(), objs.end(), ObjAttrRef::LowerLimit(o));
+	Objs::iterator itEnd = std::upper_bound(itStart, objs.end(), ObjAttrRef::UpperLimit(o));
 	objs.erase(itStart, itEnd);
 	objCreations.erase(o);
 	objDeletions.insert(o);
@@ -294,9 +605,19 @@ void GameStateUpdates::reset() {
 	objs.clear();
 	objCreations.clear();
 	objDeletions.clear();
+	deferred.clear();
 }
 
-void GameStateUpdates::diffFromStateToCurrent(const GameState& s) {
+// Only the worms have a position right now. Everything else is always of interest.
+static bool interestedIn(ClientInterest* interest, ObjRef o) {
+	if(!interest) return true;
+	if(o.classId != LuaID<CWorm>::value) return true;
+	CWorm* w = game.wormById(o.objId, false);
+	if(!w) return true;
+	return interest->shouldUpdate(ClientInterest::key(ClientInterest::KEY_GAMESTATE, o.classId, o.objId), w->getPos(), tLX->currentTime);
+}
+
+void GameStateUpdates::diffFromStateToCurrent(const GameState& s, ClientInterest* interest) {
 	reset();
 	foreach(o, game.gameStateUpdates->objCreations) {
 		if(game.isClient()) continue; // none-at-all right now... worm-creation is handled independently atm
@@ -305,6 +626,9 @@ void GameStateUpdates::diffFromStateToCurrent(const GameState& s) {
 		if(!s.haveObject(*o))
 			pushObjCreation(*o);
 	}
+
+	// All of these are sorted the same way, so we just walk through them side by side.
+	size_t objIdx = 0, attrIdx = 0;
 	foreach(u, game.gameStateUpdates->objs) {
 		BaseObject* obj = u->obj.obj.get();
 		if(!obj) continue;
@@ -314,17 +638,26 @@ void GameStateUpdates::diffFromStateToCurrent(const GameState& s) {
 
 		attrDesc->getAttrExt(obj).S2CupdateNeeded = false;
 
+		while(objIdx < s.objs.size() && s.objs[objIdx] < u->obj) ++objIdx;
+		while(attrIdx < s.attribs.size() && s.attribs[attrIdx].ref < *u) ++attrIdx;
+		const bool haveObj = objIdx < s.objs.size() && s.objs[objIdx] == u->obj;
+		const bool haveAttr = haveObj && attrIdx < s.attribs.size() && s.attribs[attrIdx].ref == *u;
+
 		ScriptVar_t curValue = u->get();
-		ScriptVar_t stateValue = attrDesc->defaultValue;
-		if(s.haveObject(u->obj))
-			stateValue = s.getValue(*u);
+		const ScriptVar_t& stateValue = haveAttr ? s.attribs[attrIdx].value : attrDesc->defaultValue;
 		if(curValue == stateValue) continue;
 
+		if(!interestedIn(interest, u->obj)) {
+			deferred.push_back(std::make_pair(*u, stateValue));
+			continue;
+		}
+
 		/*if(attrDesc->attrName != "serverFrame")
 			notes << "send update " << u->description() << ": " << stateValue.toString() << " -> " << curValue.toString() << endl;*/
 
-		pushObjAttrUpdate(*u);
+		objs.push_back(*u); // keeps the order
 	}
+
 	foreach(o, game.gameStateUpdates->objDeletions) {
 		if(game.isClient()) continue; // see obj-creations
 		if(!o->obj) continue;
@@ -334,14 +667,11 @@ void GameStateUpdates::diffFromStateToCurrent(const GameState& s) {
 	}
 }
 
-static ObjectState& GameState_registerObj(GameState& s, BaseObject* obj) {
-	return s.objs[obj->thisRef] = ObjectState(obj);
-}
-
 GameState::GameState() {
 	// register singletons which are always there
-	GameState_registerObj(*this, &game);
-	GameState_registerObj(*this, &gameSettings);
+	objs.push_back(game.thisRef);
+	objs.push_back(gameSettings.thisRef);
+	std::sort(objs.begin(), objs.end());
 }
 
 GameState GameState::Current() {
@@ -358,43 +688,109 @@ void realCopyVar(ScriptVar_t& var);
 
 void GameState::updateToCurrent() {
 	reset();
+
+	const size_t numSingletons = objs.size();
 	foreach(o, game.gameStateUpdates->objCreations) {
-		addObject(*o);
+		assert(!std::binary_search(objs.begin(), objs.begin() + numSingletons, *o));
+		objs.push_back(*o);
 	}
+	std::inplace_merge(objs.begin(), objs.begin() + numSingletons, objs.end());
+
+	attribs.reserve(game.gameStateUpdates->objs.size());
 	foreach(u, game.gameStateUpdates->objs) {
-		ObjAttrRef r = *u;
-		setObjAttr(r, r.get());
+		assert(haveObject(u->obj));
+		attribs.push_back(AttrEntry(*u, u->get()));
+		realCopyVar(attribs.back().value);
+	}
+}
+
+void GameState::updateToCurrent(const GameStateUpdates::Deferred& except) {
+	updateToCurrent();
+	const_foreach(d, except) {
+		if(haveObject(d->first.obj))
+			setObjAttr(d->first, d->second);
 	}
 }
 
 void GameState::addObject(ObjRef o) {
-	assert(!haveObject(o));
-	objs[o] = ObjectState(o);
+	Objs::iterator it = std::lower_bound(objs.begin(), objs.end(), o);
+	assert(it == objs.end() || !(*it == o));
+	objs.insert(it, o);
 }
 
 void GameState::removeObject(ObjRef o) {
-	assert(haveObject(o));
-	objs.erase(o);
+	Objs::iterator it = std::lower_bound(objs.begin(), objs.end(), o);
+	assert(it != objs.end() && *it == o);
+	objs.erase(it);
+
+	Attribs::iterator first = std::lower_bound(attribs.begin(), attribs.end(), ObjAttrRef::LowerLimit(o));
+	Attribs::iterator last = first;
+	while(last != attribs.end() && last->ref.obj == o) ++last;
+	attribs.erase(first, last);
 }
 
 void GameState::setObjAttr(ObjAttrRef r, ScriptVar_t value) {
-	Objs::iterator it = objs.find(r.obj);
-	assert(it != objs.end());
-	ObjectState& s = it->second;
-	assert(s.obj == it->first);
-	s.attribs[r.attr].value = value;
-	realCopyVar(s.attribs[r.attr].value);
+	assert(haveObject(r.obj));
+	Attribs::iterator it = std::lower_bound(attribs.begin(), attribs.end(), r);
+	if(it == attribs.end() || !(it->ref == r))
+		it = attribs.insert(it, AttrEntry(r, value));
+	else
+		it->value = value;
+	realCopyVar(it->value);
 }
 
 bool GameState::haveObject(ObjRef o) const {
-	Objs::const_iterator it = objs.find(o);
-	return it != objs.end();
+	return std::binary_search(objs.begin(), objs.end(), o);
 }
 
 ScriptVar_t GameState::getValue(ObjAttrRef a) const {
-	Objs::const_iterator it = objs.find(a.obj);
-	assert(it != objs.end());
-	assert(it->second.obj == a.obj);
-	return it->second.getValue(a.attr);
+	assert(haveObject(a.obj));
+	Attribs::const_iterator it = std::lower_bound(attribs.begin(), attribs.end(), a);
+	if(it == attribs.end() || !(it->ref == a))
+		return a.attr.getAttrDesc()->defaultValue;
+	return it->value;
 }
 
+void GameState::benchmark(int iterations) {
+	iterations = MAX(iterations, 1);
+	// don't count the benchmark in the stats of the real updates
+	const GameStateUpdates::Stats realStats = GameStateUpdates::stats;
+
+	const GameState empty;
+	const GameState current = Current();
+	GameStateUpdates updates;
+	CBytestream compact, legacy;
+
+	AbsTime start = GetTime();
+	for(int i = 0; i < iterations; ++i)
+		updates.diffFromStateToCurrent(current);
+	const TimeDiff noChangeDiffTime = GetTime() - start;
+
+	start = GetTime();
+	for(int i = 0; i < iterations; ++i)
+		updates.diffFromStateToCurrent(empty);
+	const TimeDiff fullDiffTime = GetTime() - start;
+
+	start = GetTime();
+	for(int i = 0; i < iterations; ++i) {
+		compact.Clear();
+		updates.writeToBs(&compact, empty, OLXBetaVersion(0,59,12));
+	}
+	const TimeDiff compactTime = GetTime() - start;
+
+	start = GetTime();
+	for(int i = 0; i < iterations; ++i) {
+		legacy.Clear();
+		updates.writeToBs(&legacy, empty, OLXBetaVersion(0,59,11));
+	}
+	const TimeDiff legacyTime = GetTime() - start;
+
+	GameStateUpdates::stats = realStats;
+
+	const float us = 1000000.0f / iterations;
+	notes << "GameState benchmark: " << current.objs.size() << " objects, " << current.attribs.size() << " set attribs, " << iterations << " iterations" << endl;
+	notes << "  diff without changes: " << (noChangeDiffTime.seconds() * us) << " us" << endl;
+	notes << "  full diff: " << (fullDiffTime.seconds() * us) << " us, " << updates.objs.size() << " attrib updates" << endl;
+	notes << "  bit-packed: " << (compactTime.seconds() * us) << " us, " << compact.GetLength() << " bytes" << endl;
+	notes << "  byte-wise (old): " << (legacyTime.seconds() * us) << " us, " << legacy.GetLength() << " bytes" << endl;
+}
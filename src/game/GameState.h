@@ -11,7 +11,7 @@
 #define OLX_GAMESTATE_H
 
 #include <vector>
-#include <map>
+#include <set>
 #include "EngineSettings.h"
 #include "CScriptableVars.h"
 #include "Attr.h"
@@ -21,55 +21,72 @@
 struct GameState;
 class CBytestream;
 class CServerConnection;
-
-struct AttribState {
-	ScriptVar_t value;
-};
-
-struct ObjectState {
-	typedef std::map<AttribRef, AttribState> Attribs;
-
-	ObjRef obj;
-	Attribs attribs;
-
-	ObjectState() {}
-	ObjectState(ObjRef obj_) : obj(obj_) {}
-	ObjectState(BaseObject* obj_) : obj(obj_->thisRef) {}
-	ScriptVar_t getValue(AttribRef) const;
-};
+class ClientInterest;
+struct Version;
 
 struct GameStateUpdates {
-	typedef std::set<ObjAttrRef> Objs;
+	typedef std::vector<ObjAttrRef> Objs; // sorted, no duplicates
 
 	std::set<ObjRef> objDeletions;
 	std::set<ObjRef> objCreations;
 	Objs objs;
 
+	// changed attribs not sent now (see ClientInterest), with the value the receiver still has
+	typedef std::vector< std::pair<ObjAttrRef, ScriptVar_t> > Deferred;
+	Deferred deferred;
+
 	operator bool() const;
-	void writeToBs(CBytestream* bs, const GameState& oldState) const;
+	// the attrib updates are bit-packed if the receiver has at least 0.59 beta12
+	void writeToBs(CBytestream* bs, const GameState& oldState, const Version& receiverVersion) const;
 	static void handleFromBs(CBytestream* bs, CServerConnection* source);
 	void pushObjAttrUpdate(ObjAttrRef);
 	void pushObjCreation(ObjRef);
 	void pushObjDeletion(ObjRef);
 	void reset();
-	void diffFromStateToCurrent(const GameState& s);
+	void diffFromStateToCurrent(const GameState& s, ClientInterest* interest = NULL);
+
+	// written updates since the start, to compare the encoding with the old one
+	struct Stats {
+		Uint64 updates, attrs, bytes;
+		Uint64 uncompressedBytes; // with the full ObjAttrRef and writeVar() for each attrib
+		Stats() : updates(0), attrs(0), bytes(0), uncompressedBytes(0) {}
+	};
+	static Stats stats;
 };
 
+/*
+	The state of the game as the other side knows it. The objects and the set
+	attribs are kept in flat vectors, sorted like the GameStateUpdates, so
+	that the diff is a single linear scan over both.
+*/
 struct GameState {
-	typedef std::map<ObjRef, ObjectState> Objs;
+	struct AttrEntry {
+		ObjAttrRef ref;
+		ScriptVar_t value;
+		AttrEntry() {}
+		AttrEntry(const ObjAttrRef& r, const ScriptVar_t& v) : ref(r), value(v) {}
+		bool operator<(const ObjAttrRef& r) const { return ref < r; }
+	};
+	typedef std::vector<ObjRef> Objs; // sorted
+	typedef std::vector<AttrEntry> Attribs; // sorted by ref; attribs not in here have the default value
 
 	Objs objs;
+	Attribs attribs;
 
 	GameState();
 	static GameState Current();
 	void reset();
 	void updateToCurrent();
+	void updateToCurrent(const GameStateUpdates::Deferred& except);
 	void addObject(ObjRef);
 	void removeObject(ObjRef);
 	void setObjAttr(ObjAttrRef, ScriptVar_t);
 
 	bool haveObject(ObjRef) const;
 	ScriptVar_t getValue(ObjAttrRef) const;
+
+	// diff and encoding time for the current game, bytes per update
+	static void benchmark(int iterations);
 };
 
 
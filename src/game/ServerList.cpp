@@ -211,6 +211,8 @@ ServerList::Ptr ServerList::get()
 ///////////////////
 // Initialize the list
 ServerList::ServerList() {
+	onDnsReady.handler() += getEventHandler(this, &ServerList::Dns_onReady);
+	m_dnsHandlerSet = true;
     loadList("cfg/svrlist.dat", SLFT_CustomSettings);
 	loadList("cfg/favourites.dat", SLFT_Favourites);	
 }
@@ -253,6 +255,12 @@ void ServerList::clearAuto()
 // Shutdown the server list
 void ServerList::shutdown()
 {
+	if(m_dnsHandlerSet) {
+		onDnsReady.handler() -= getEventHandler(this, &ServerList::Dns_onReady);
+		m_dnsHandlerSet = false;
+	}
+	m_pendingNatRequests.clear();
+
 	SvrList::Writer l(psServerList);
 	l.get().clear();
 }
@@ -405,14 +413,7 @@ void ServerList::wantsToJoin(const std::string& Nick, server_t::Ptr svr)
 		UdpMasterserverInfo udpmasterserver = getUdpMasterserverForServer(svr->szAddress);
 		if(udpmasterserver) {
 			NetworkAddr masterserverAddr;
-			SetNetAddrValid(masterserverAddr, false);
-			if( ! GetNetAddrFromNameAsync( udpmasterserver.name, masterserverAddr ) )
-				return;
-			
-			for( int count = 0; !IsNetAddrValid(masterserverAddr) && count < 5; count++ )
-				SDL_Delay(20);
-			
-			if( !IsNetAddrValid(masterserverAddr) )
+			if( !resolveUdpMasterserver(svr, udpmasterserver.name, true, Nick, masterserverAddr) )
 				return;
 			
 			tSocket[SCK_NET]->setRemoteAddress(masterserverAddr);
@@ -429,6 +430,56 @@ void ServerList::wantsToJoin(const std::string& Nick, server_t::Ptr svr)
 	bs.Send(tSocket[SCK_NET]);
 }
 
+///////////////////
+// Get the address of the UDP masterserver of a server behind NAT
+// If the DNS lookup isn't finished yet, the request is remembered and sent again
+// when we get onDnsReady, so we don't have to wait for it here.
+bool ServerList::resolveUdpMasterserver(server_t::Ptr svr, const std::string& masterserver, bool wantsJoin, const std::string& nick, NetworkAddr& addr)
+{
+	SetNetAddrValid(addr, false);
+	if( ! GetNetAddrFromNameAsync( masterserver, addr ) )
+		return false;
+	if( IsNetAddrValid(addr) )
+		return true;
+
+	for(std::list<PendingNatRequest>::iterator it = m_pendingNatRequests.begin(); it != m_pendingNatRequests.end(); ++it)
+		if(it->server == svr && it->wantsJoin == wantsJoin) {
+			it->nick = nick;
+			return false;
+		}
+
+	PendingNatRequest r;
+	r.masterserver = masterserver;
+	r.server = svr;
+	r.wantsJoin = wantsJoin;
+	r.nick = nick;
+	m_pendingNatRequests.push_back(r);
+	return false;
+}
+
+void ServerList::Dns_onReady(DnsEventData d)
+{
+	std::list<PendingNatRequest> ready;
+	for(std::list<PendingNatRequest>::iterator it = m_pendingNatRequests.begin(); it != m_pendingNatRequests.end();) {
+		if(it->masterserver == d.name) {
+			ready.push_back(*it);
+			it = m_pendingNatRequests.erase(it);
+		}
+		else
+			++it;
+	}
+	for(std::list<PendingNatRequest>::iterator it = ready.begin(); it != ready.end(); ++it) {
+		if(!d.success) {
+			notes << "UDP masterserver failed: cannot resolve domain name " << d.name << endl;
+			continue;
+		}
+		if(it->wantsJoin)
+			wantsToJoin(it->nick, it->server);
+		else
+			getServerInfo(it->server);
+	}
+}
+
 ///////////////////
 // Get server info
 void ServerList::getServerInfo(server_t::Ptr svr)
@@ -444,14 +495,7 @@ void ServerList::getServerInfo(server_t::Ptr svr)
 		UdpMasterserverInfo udpmasterserver = getUdpMasterserverForServer(svr->szAddress);
 		if(udpmasterserver) {
 			NetworkAddr masterserverAddr;
-			SetNetAddrValid(masterserverAddr, false);
-			if( ! GetNetAddrFromNameAsync( udpmasterserver.name, masterserverAddr ) )
-				return;
-			
-			for( int count = 0; !IsNetAddrValid(masterserverAddr) && count < 5; count++ )
-				SDL_Delay(20);
-			
-			if( !IsNetAddrValid(masterserverAddr) )
+			if( !resolveUdpMasterserver(svr, udpmasterserver.name, false, "", masterserverAddr) )
 				return;
 			
 			tSocket[SCK_NET]->setRemoteAddress(masterserverAddr);
@@ -174,6 +174,18 @@ private:
 	SvrList psServerList;
 	static Ptr m_instance;
 
+	// requests to servers behind NAT which wait for the DNS lookup of the UDP masterserver
+	struct PendingNatRequest {
+		std::string masterserver;
+		server_t::Ptr server;
+		bool wantsJoin;
+		std::string nick;
+	};
+	std::list<PendingNatRequest> m_pendingNatRequests;
+	bool m_dnsHandlerSet;
+	bool resolveUdpMasterserver(server_t::Ptr svr, const std::string& masterserver, bool wantsJoin, const std::string& nick, NetworkAddr& addr);
+	void Dns_onReady(DnsEventData d);
+
 	void saveList(const std::string& szFilename, SvrListFilterType filterType, SvrListSettingsFilter::Ptr settingsFilter = SvrListSettingsFilter::Ptr((SvrListSettingsFilter*)NULL));
 	void loadList(const std::string& szFilename, SvrListFilterType filterType);
 	void mergeWithNewInfo(server_t::Ptr found, const std::string& address, const std::string & name, int udpMasterserverIndex);
@@ -190,24 +190,23 @@ int cpu_capabilities = 0;
 // NOTE: This is only for testing right now, so people with gfx problems can test it.
 // Later on, this is supposed to be removed. There is no reason why the user should
 // be able to set this. If it is available and works, it should be used - otherwise not.
-static bool cfgUseSSE = true, cfgUseMMX = true, cfgUseMMXExt = true;
+static bool cfgUseSSE = true, cfgUseAVX2 = true;
 static bool bRegisteredAllegroVars = CScriptableVars::RegisterVars("GameOptions")
 ( cfgUseSSE, "Video.UseSSE", true )
-( cfgUseMMX, "Video.UseMMX", true )
-( cfgUseMMXExt, "Video.UseMMXExt", true );
+( cfgUseAVX2, "Video.UseAVX2", true );
 
 
 bool allegro_init() {
 	cpu_capabilities = 0;
 	notes << "Allegro: ";
 	
-	if(cfgUseSSE && SDL_HasSSE()) cpu_capabilities |= CPU_SSE;
-	if(cfgUseMMX && SDL_HasMMX()) cpu_capabilities |= CPU_MMX;
-	//if(cfgUseMMXExt && SDL_HasMMXExt()) cpu_capabilities |= CPU_MMXPLUS; // TODO...?
+	if(cfgUseSSE && SDL_HasSSE2()) cpu_capabilities |= CPU_SSE2;
+#if SDL_VERSION_ATLEAST(2,0,4)
+	if(cfgUseAVX2 && SDL_HasAVX2()) cpu_capabilities |= CPU_AVX2;
+#endif
 	
-	if(cpu_capabilities & CPU_SSE) notes << "SSE, "; else notes << "no SSE, ";
-	if(cpu_capabilities & CPU_MMX) notes << "MMX, "; else notes << "no MMX, ";
-	if(cpu_capabilities & CPU_MMXPLUS) notes << "MMXExt"; else notes << "no MMXExt";
+	if(cpu_capabilities & CPU_SSE2) notes << "SSE2, "; else notes << "no SSE2, ";
+	if(cpu_capabilities & CPU_AVX2) notes << "AVX2"; else notes << "no AVX2";
 	notes << endl;
 		
 	return true;
@@ -27,9 +27,8 @@
 extern int allegro_error;
 extern int cpu_capabilities;
 enum {
-	CPU_MMX = 1,
-	CPU_SSE = 2,
-	CPU_MMXPLUS = 4,
+	CPU_SSE2 = 1,
+	CPU_AVX2 = 2,
 };
 
 bool allegro_init();
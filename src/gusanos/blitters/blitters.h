@@ -8,28 +8,30 @@
 #include <SDL.h>
 #include "gusanos/allegro.h"
 #include "gusanos/blitters/types.h"
-#include "mmx.h"
 #include "CodeAttributes.h"
 
-// TODO: correct check if we should include MMX/SSE code
-#if !defined(WIN32) && (SDL_BYTEORDER == SDL_LIL_ENDIAN)
-#define HAS_MMX (cpu_capabilities & CPU_MMX)
-#define HAS_SSE (cpu_capabilities & CPU_SSE)
-#define HAS_MMXSSE (cpu_capabilities & CPU_MMXPLUS)
-#define BUILTIN_MMXSSE
-#else  // TODO: currently buggy on Windows
-#define HAS_MMX (false)
-#define HAS_SSE (false)
-#define HAS_MMXSSE (false)
-
-#if defined(WIN32)
-// built in anyway, it is still needed for linking
-#define BUILTIN_MMXSSE
+// The SSE2 and AVX2 blitters (*_simd.cpp) are built in on x86 if the compiler
+// can build code for an instruction set per function. They are selected at
+// runtime by the CPU capabilities (see allegro_init).
+#if defined(__i386__) || defined(__x86_64__) || defined(_M_IX86) || defined(_M_X64)
+#if defined(_MSC_VER) && _MSC_VER >= 1700
+#define BUILTIN_SIMD
+#define SIMD_TARGET_sse2
+#define SIMD_TARGET_avx2
+#elif defined(__clang__) || (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)))
+#define BUILTIN_SIMD
+#define SIMD_TARGET_sse2 __attribute__((target("sse2")))
+#define SIMD_TARGET_avx2 __attribute__((target("avx2")))
 #endif
-
 #endif
 
-#define FOR_MMX(x_) if(HAS_MMX) { x_ }
+#ifdef BUILTIN_SIMD
+#define HAS_SSE2 (cpu_capabilities & CPU_SSE2)
+#define HAS_AVX2 (cpu_capabilities & CPU_AVX2)
+#else
+#define HAS_SSE2 (false)
+#define HAS_AVX2 (false)
+#endif
 
 namespace Blitters
 {
@@ -41,11 +43,13 @@ namespace Blitters
 	function [ - filter] - bitdepth [ - parallelism] [ - variant]
 	
 	e.g.:
-	rectfill_blend_32_mmx
+	rectfill_blend_32_sse2
 	
 	defaults:
 		parallelism = 1
 		variant = C
+	
+	The sse2 and avx2 variants give exactly the same pixels as the C ones.
 */
 
 INLINE Pixel getpixel_32(ALLEGRO_BITMAP* where, int x, int y)
@@ -86,12 +90,10 @@ void rectfill_add_16(ALLEGRO_BITMAP* where, int x1, int y1, int x2, int y2, Pixe
 void rectfill_blend_16(ALLEGRO_BITMAP* where, int x1, int y1, int x2, int y2, Pixel colour, int fact);
 
 void rectfill_add_32(ALLEGRO_BITMAP* where, int x1, int y1, int x2, int y2, Pixel colour, int fact);
-void rectfill_add_32_mmx(ALLEGRO_BITMAP* where, int x1, int y1, int x2, int y2, Pixel colour, int fact);
 void rectfill_blend_32(ALLEGRO_BITMAP* where, int x1, int y1, int x2, int y2, Pixel colour, int fact);
 
 void hline_add_16(ALLEGRO_BITMAP* where, int x1, int y1, int x2, Pixel colour, int fact);
 void hline_add_32(ALLEGRO_BITMAP* where, int x1, int y1, int x2, Pixel colour, int fact);
-void hline_add_32_mmx(ALLEGRO_BITMAP* where, int x1, int y1, int x2, Pixel colour, int fact);
 void hline_blend_16(ALLEGRO_BITMAP* where, int x1, int y1, int x2, Pixel colour, int fact);
 void hline_blend_32(ALLEGRO_BITMAP* where, int x1, int y1, int x2, Pixel colour, int fact);
 
@@ -102,29 +104,47 @@ void line_blend(ALLEGRO_BITMAP* where, int x, int y, int destx, int desty, Pixel
 void line_add(ALLEGRO_BITMAP* where, int x, int y, int destx, int desty, Pixel colour, int fact);
 
 void drawSprite_add_16(ALLEGRO_BITMAP* where, ALLEGRO_BITMAP* from, int x, int y, int cutl, int cutt, int cutr, int cutb, int fact);
-void drawSprite_add_16_mmx_sse(ALLEGRO_BITMAP* where, ALLEGRO_BITMAP* from, int x, int y, int cutl, int cutt, int cutr, int cutb, int fact);
 void drawSprite_blend_16(ALLEGRO_BITMAP* where, ALLEGRO_BITMAP* from, int x, int y, int cutl, int cutt, int cutr, int cutb, int fact);
-void drawSprite_blend_16_mmx_sse(ALLEGRO_BITMAP* where, ALLEGRO_BITMAP* from, int x, int y, int cutl, int cutt, int cutr, int cutb, int fact);
 void drawSprite_blendalpha_32_to_16(ALLEGRO_BITMAP* where, ALLEGRO_BITMAP* from, int x, int y, int cutl, int cutt, int cutr, int cutb, int fact);
 void drawSprite_blendtint_8_to_16(ALLEGRO_BITMAP* where, ALLEGRO_BITMAP* from, int x, int y, int cutl, int cutt, int cutr, int cutb, int fact, int color);
 void drawSprite_multsec_32_with_8(ALLEGRO_BITMAP* where, ALLEGRO_BITMAP* from, ALLEGRO_BITMAP* secondary, int x, int y, int sx, int sy, int cutl, int cutt, int cutr, int cutb);
 void drawSprite_mult_8_to_16(ALLEGRO_BITMAP* where, ALLEGRO_BITMAP* from, int x, int y, int cutl, int cutt, int cutr, int cutb);
 
 void drawSprite_add_32(ALLEGRO_BITMAP* where, ALLEGRO_BITMAP* from, int x, int y, int cutl, int cutt, int cutr, int cutb, int fact);
-void drawSprite_add_32_mmx_sse(ALLEGRO_BITMAP* where, ALLEGRO_BITMAP* from, int x, int y, int cutl, int cutt, int cutr, int cutb, int fact);
 void drawSprite_blend_32(ALLEGRO_BITMAP* where, ALLEGRO_BITMAP* from, int x, int y, int cutl, int cutt, int cutr, int cutb, int fact);
-void drawSprite_blend_32_mmx_sse(ALLEGRO_BITMAP* where, ALLEGRO_BITMAP* from, int x, int y, int cutl, int cutt, int cutr, int cutb, int fact);
 void drawSprite_blendalpha_32_to_32(ALLEGRO_BITMAP* where, ALLEGRO_BITMAP* from, int x, int y, int cutl, int cutt, int cutr, int cutb, int fact);
-void drawSprite_blendalpha_32_to_32_mmx_sse(ALLEGRO_BITMAP* where, ALLEGRO_BITMAP* from, int x, int y, int cutl, int cutt, int cutr, int cutb, int fact);
 void drawSprite_blendtint_8_to_32(ALLEGRO_BITMAP* where, ALLEGRO_BITMAP* from, int x, int y, int cutl, int cutt, int cutr, int cutb, int fact, int color);
 void drawSprite_mult_8_to_32(ALLEGRO_BITMAP* where, ALLEGRO_BITMAP* from, int x, int y, int cutl, int cutt, int cutr, int cutb);
-void drawSprite_mult_8_to_32_mmx_sse(ALLEGRO_BITMAP* where, ALLEGRO_BITMAP* from, int x, int y, int cutl, int cutt, int cutr, int cutb);
 
 void drawSpriteLine_add_32(ALLEGRO_BITMAP* where, ALLEGRO_BITMAP* from, int x, int y, int x1, int y1, int x2, int fact);
 void drawSpriteLine_add_16(ALLEGRO_BITMAP* where, ALLEGRO_BITMAP* from, int x, int y, int x1, int y1, int x2, int fact);
 void drawSpriteLine_add_8(ALLEGRO_BITMAP* where, ALLEGRO_BITMAP* from, int x, int y, int x1, int y1, int x2, int fact);
-void drawSpriteLine_add_8_mmx_sse(ALLEGRO_BITMAP* where, ALLEGRO_BITMAP* from, int x, int y, int x1, int y1, int x2, int fact);
 void drawSpriteRotate_solid_32(ALLEGRO_BITMAP* where, ALLEGRO_BITMAP* from, int x, int y, double angle);
+
+#ifdef BUILTIN_SIMD
+#define DECLARE_SIMD_BLITTERS(isa_) \
+void rectfill_add_32_##isa_(ALLEGRO_BITMAP* where, int x1, int y1, int x2, int y2, Pixel colour, int fact); \
+void rectfill_blend_32_##isa_(ALLEGRO_BITMAP* where, int x1, int y1, int x2, int y2, Pixel colour, int fact); \
+void hline_add_32_##isa_(ALLEGRO_BITMAP* where, int x1, int y1, int x2, Pixel colour, int fact); \
+void hline_blend_32_##isa_(ALLEGRO_BITMAP* where, int x1, int y1, int x2, Pixel colour, int fact); \
+void drawSprite_add_16_##isa_(ALLEGRO_BITMAP* where, ALLEGRO_BITMAP* from, int x, int y, int cutl, int cutt, int cutr, int cutb, int fact); \
+void drawSprite_add_32_##isa_(ALLEGRO_BITMAP* where, ALLEGRO_BITMAP* from, int x, int y, int cutl, int cutt, int cutr, int cutb, int fact); \
+void drawSprite_blend_16_##isa_(ALLEGRO_BITMAP* where, ALLEGRO_BITMAP* from, int x, int y, int cutl, int cutt, int cutr, int cutb, int fact); \
+void drawSprite_blend_32_##isa_(ALLEGRO_BITMAP* where, ALLEGRO_BITMAP* from, int x, int y, int cutl, int cutt, int cutr, int cutb, int fact); \
+void drawSprite_blendalpha_32_to_32_##isa_(ALLEGRO_BITMAP* where, ALLEGRO_BITMAP* from, int x, int y, int cutl, int cutt, int cutr, int cutb, int fact); \
+void drawSprite_mult_8_to_32_##isa_(ALLEGRO_BITMAP* where, ALLEGRO_BITMAP* from, int x, int y, int cutl, int cutt, int cutr, int cutb); \
+void drawSpriteLine_add_8_##isa_(ALLEGRO_BITMAP* where, ALLEGRO_BITMAP* from, int x, int y, int x1, int y1, int x2, int fact);
+
+DECLARE_SIMD_BLITTERS(sse2)
+DECLARE_SIMD_BLITTERS(avx2)
+#undef DECLARE_SIMD_BLITTERS
+#endif
+
+// Compares the SIMD blitters with the C ones on random bitmaps;
+// returns true if all pixels are identical.
+bool test(int iterations);
+// Prints the throughput of the C, SSE2 and AVX2 blitters.
+void benchmark(int iterations);
 } // namespace Blitters
 
 using Blitters::linewu_blend;
@@ -145,68 +165,31 @@ using Blitters::line_add;
 		case 32: Blitters::f_##_32 x_ ; break; \
 		case 8: Blitters::f_##_8 x_ ; break; }
 		
-#define SELECT_ALL_SSE8(f_, x_) \
-	switch(bitmap_color_depth(where)) { \
-		case 16: Blitters::f_##_16 x_ ; break; \
-		case 32: Blitters::f_##_32 x_ ; break; \
-		case 8: \
-			if(HAS_SSE) Blitters::f_##_8_sse x_ ; \
-			else Blitters::f_##_8 x_ ; \
-		break; }
-		
-#define SELECT_ALL_MMX_SSE8(f_, x_) \
+// calls the best of f_, f_##_sse2 and f_##_avx2
+#ifdef BUILTIN_SIMD
+#define SELECT_ISA(f_, x_) \
+	if(HAS_AVX2) Blitters::f_##_avx2 x_ ; \
+	else if(HAS_SSE2) Blitters::f_##_sse2 x_ ; \
+	else Blitters::f_ x_
+#else
+#define SELECT_ISA(f_, x_) Blitters::f_ x_
+#endif
+
+#define SELECT_ALL_SIMD8(f_, x_) \
 	switch(bitmap_color_depth(where)) { \
 		case 16: Blitters::f_##_16 x_ ; break; \
 		case 32: Blitters::f_##_32 x_ ; break; \
-		case 8: \
-			if(HAS_MMXSSE || HAS_SSE) Blitters::f_##_8_mmx_sse x_ ; \
-			else Blitters::f_##_8 x_ ; \
-		break; }
+		case 8: SELECT_ISA(f_##_8, x_); break; }
 		
-#define SELECT_MMX32(f_, x_) \
+#define SELECT_SIMD32(f_, x_) \
 	switch(bitmap_color_depth(where)) { \
 		case 16: Blitters::f_##_16 x_ ; break; \
-		case 32: \
-			if(HAS_MMX) Blitters::f_##_32_mmx x_ ; \
-			else Blitters::f_##_32 x_ ; \
-		break; }
-			
-#define SELECT_SSE32(f_, x_) \
-	switch(bitmap_color_depth(where)) { \
-		case 16: Blitters::f_##_16 x_ ; break; \
-		case 32: \
-			if(HAS_SSE) Blitters::f_##_32_sse x_ ; \
-			else Blitters::f_##_32 x_ ; \
-		break; }
-		
-#define SELECT_MMX_SSE_32(f_, x_) \
-	switch(bitmap_color_depth(where)) { \
-		case 16: Blitters::f_##_16 x_ ; break; \
-		case 32: \
-			if(HAS_MMXSSE || HAS_SSE) Blitters::f_##_32_mmx_sse x_ ; \
-			else Blitters::f_##_32 x_ ; \
-		break; }
-		
-#define SELECT_MMX_SSE(f_, x_) \
-	switch(bitmap_color_depth(where)) { \
-		case 16: \
-			if(HAS_MMXSSE || HAS_SSE) Blitters::f_##_16_mmx_sse x_ ; \
-			else Blitters::f_##_16 x_ ; break; \
-		case 32: \
-			if(HAS_MMXSSE || HAS_SSE) Blitters::f_##_32_mmx_sse x_ ; \
-			else Blitters::f_##_32 x_ ; \
-		break; }
+		case 32: SELECT_ISA(f_##_32, x_); break; }
 		
-#define SELECT_SSE(f_, x_) \
+#define SELECT_SIMD(f_, x_) \
 	switch(bitmap_color_depth(where)) { \
-		case 16: \
-			if(HAS_SSE) Blitters::f_##_16_sse x_ ; \
-			else Blitters::f_##_16 x_ ; \
-		break; \
-		case 32: \
-			if(HAS_SSE) Blitters::f_##_32_sse x_ ; \
-			else Blitters::f_##_32 x_ ; \
-		break; }
+		case 16: SELECT_ISA(f_##_16, x_); break; \
+		case 32: SELECT_ISA(f_##_32, x_); break; }
 		
 #define SELECT2(f_, a_, b_) \
 	switch(bitmap_color_depth(where)) { \
@@ -287,17 +270,17 @@ INLINE void putpixelwu_solid(ALLEGRO_BITMAP* where, float x, float y, Pixel colo
 
 INLINE void rectfill_add(ALLEGRO_BITMAP* where, int x1, int y1, int x2, int y2, Pixel colour, int fact)
 {
-	SELECT_MMX32(rectfill_add, (where, x1, y1, x2, y2, colour, fact));
+	SELECT_SIMD32(rectfill_add, (where, x1, y1, x2, y2, colour, fact));
 }
 
 INLINE void rectfill_blend(ALLEGRO_BITMAP* where, int x1, int y1, int x2, int y2, Pixel colour, int fact)
 {
-	SELECT(rectfill_blend, (where, x1, y1, x2, y2, colour, fact));
+	SELECT_SIMD32(rectfill_blend, (where, x1, y1, x2, y2, colour, fact));
 }
 
 INLINE void rectfill_blendalpha(ALLEGRO_BITMAP* where, int x1, int y1, int x2, int y2, Pixel colour, int fact)
 {
-	SELECT(rectfill_blend, (where, x1, y1, x2, y2, colour, fact));
+	SELECT_SIMD32(rectfill_blend, (where, x1, y1, x2, y2, colour, fact));
 }
 
 INLINE void rectfill_solid(ALLEGRO_BITMAP* where, int x1, int y1, int x2, int y2, Pixel colour)
@@ -307,17 +290,17 @@ INLINE void rectfill_solid(ALLEGRO_BITMAP* where, int x1, int y1, int x2, int y2
 
 INLINE void hline_add(ALLEGRO_BITMAP* where, int x1, int y1, int x2, Pixel colour, int fact)
 {
-	SELECT_MMX32(hline_add, (where, x1, y1, x2, colour, fact));
+	SELECT_SIMD32(hline_add, (where, x1, y1, x2, colour, fact));
 }
 
 INLINE void hline_blend(ALLEGRO_BITMAP* where, int x1, int y1, int x2, Pixel colour, int fact)
 {
-	SELECT(hline_blend, (where, x1, y1, x2, colour, fact));
+	SELECT_SIMD32(hline_blend, (where, x1, y1, x2, colour, fact));
 }
 
 INLINE void hline_blendalpha(ALLEGRO_BITMAP* where, int x1, int y1, int x2, Pixel colour, int fact)
 {
-	SELECT(hline_blend, (where, x1, y1, x2, colour, fact));
+	SELECT_SIMD32(hline_blend, (where, x1, y1, x2, colour, fact));
 }
 
 INLINE void hline_solid(ALLEGRO_BITMAP* where, int x1, int y1, int x2, Pixel colour)
@@ -347,17 +330,17 @@ INLINE void line_blendalpha(ALLEGRO_BITMAP* where, int x, int y, int destx, int
 
 INLINE void drawSprite_add(ALLEGRO_BITMAP* where, ALLEGRO_BITMAP* from, int x, int y, int fact)
 {
-	SELECT_MMX_SSE(drawSprite_add, (where, from, x, y, 0, 0, 0, 0, fact));
+	SELECT_SIMD(drawSprite_add, (where, from, x, y, 0, 0, 0, 0, fact));
 }
 
 INLINE void drawSprite_blend(ALLEGRO_BITMAP* where, ALLEGRO_BITMAP* from, int x, int y, int fact)
 {
-	SELECT_MMX_SSE(drawSprite_blend, (where, from, x, y, 0, 0, 0, 0, fact));
+	SELECT_SIMD(drawSprite_blend, (where, from, x, y, 0, 0, 0, 0, fact));
 }
 
 INLINE void drawSprite_blendalpha(ALLEGRO_BITMAP* where, ALLEGRO_BITMAP* from, int x, int y, int fact)
 {
-	SELECT_MMX_SSE_32(drawSprite_blendalpha_32_to, (where, from, x, y, 0, 0, 0, 0, fact));
+	SELECT_SIMD32(drawSprite_blendalpha_32_to, (where, from, x, y, 0, 0, 0, 0, fact));
 }
 
 INLINE void drawSprite_blendtint(ALLEGRO_BITMAP* where, ALLEGRO_BITMAP* from, int x, int y, int fact, int color)
@@ -372,22 +355,22 @@ INLINE void drawSprite_solid(ALLEGRO_BITMAP* where, ALLEGRO_BITMAP* from, int x,
 
 INLINE void drawSprite_mult_8(ALLEGRO_BITMAP* where, ALLEGRO_BITMAP* from, int x, int y)
 {
-	SELECT_MMX_SSE_32(drawSprite_mult_8_to, (where, from, x, y, 0, 0, 0, 0));
+	SELECT_SIMD32(drawSprite_mult_8_to, (where, from, x, y, 0, 0, 0, 0));
 }
 
 INLINE void drawSpriteCut_add(ALLEGRO_BITMAP* where, ALLEGRO_BITMAP* from, int x, int y, int cutl, int cutt, int cutr, int cutb, int fact)
 {
-	SELECT_MMX_SSE(drawSprite_add, (where, from, x, y, cutl, cutt, cutr, cutb, fact));
+	SELECT_SIMD(drawSprite_add, (where, from, x, y, cutl, cutt, cutr, cutb, fact));
 }
 
 INLINE void drawSpriteCut_blend(ALLEGRO_BITMAP* where, ALLEGRO_BITMAP* from, int x, int y, int cutl, int cutt, int cutr, int cutb, int fact)
 {
-	SELECT_MMX_SSE(drawSprite_blend, (where, from, x, y, cutl, cutt, cutr, cutb, fact));
+	SELECT_SIMD(drawSprite_blend, (where, from, x, y, cutl, cutt, cutr, cutb, fact));
 }
 
 INLINE void drawSpriteCut_blendalpha(ALLEGRO_BITMAP* where, ALLEGRO_BITMAP* from, int x, int y, int cutl, int cutt, int cutr, int cutb, int fact)
 {
-	SELECT_MMX_SSE_32(drawSprite_blendalpha_32_to, (where, from, x, y, cutl, cutt, cutr, cutb, fact));
+	SELECT_SIMD32(drawSprite_blendalpha_32_to, (where, from, x, y, cutl, cutt, cutr, cutb, fact));
 }
 
 INLINE void drawSpriteCut_solid(ALLEGRO_BITMAP* where, ALLEGRO_BITMAP* from, int x, int y, int cutl, int cutt, int cutr, int cutb)
@@ -399,7 +382,7 @@ INLINE void drawSpriteCut_solid(ALLEGRO_BITMAP* where, ALLEGRO_BITMAP* from, int
 
 INLINE void drawSpriteLine_add(ALLEGRO_BITMAP* where, ALLEGRO_BITMAP* from, int x, int y, int x1, int y1, int x2, int fact)
 {
-	SELECT_ALL_MMX_SSE8(drawSpriteLine_add, (where, from, x, y, x1, y1, x2, fact));
+	SELECT_ALL_SIMD8(drawSpriteLine_add, (where, from, x, y, x1, y1, x2, fact));
 }
 
 #undef SELECT
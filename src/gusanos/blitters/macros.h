@@ -130,7 +130,7 @@
 	int c_ = x2 - x1; \
 	pixel_t_1* dest_ = (pixel_t_1 *)where->line[y] + x; \
 	pixel_t_1* src_  = (pixel_t_1 *)from->line[y1] + x1; \
-	while(ptrdiff_t(dest_) & (align_ - 1)) { \
+	while(c_ >= 1 && (ptrdiff_t(dest_) & (align_ - 1))) { \
 		pixel_t_1* dest = dest_; \
 		pixel_t_1* src = src_; \
 		op_1; \
@@ -144,6 +144,30 @@
 		pixel_t_1* src = src_; \
 		op_1; ++dest_; ++src_; } }
 		
+// Like SPRITE_X_LOOP_ALIGN, but before the op_2 loop, vpar_ pixels at a time
+// are done with op_v (which gets pixel_t_1 pointers), as long as there are enough.
+// Like this, op_2 and op_1 are used for the same pixels as in SPRITE_X_LOOP_ALIGN.
+#define SPRITE_X_LOOP_ALIGN_SIMD(par_, align_, vpar_, op_1, op_2, op_v) { \
+	int c_ = x2 - x1; \
+	pixel_t_1* dest_ = (pixel_t_1 *)where->line[y] + x; \
+	pixel_t_1* src_  = (pixel_t_1 *)from->line[y1] + x1; \
+	while(c_ >= 1 && (ptrdiff_t(dest_) & (align_ - 1))) { \
+		pixel_t_1* dest = dest_; \
+		pixel_t_1* src = src_; \
+		op_1; \
+		--c_; ++dest_; ++src_; } \
+	for(; c_ >= vpar_; c_ -= vpar_, dest_ += vpar_, src_ += vpar_) { \
+		pixel_t_1* dest = dest_; \
+		pixel_t_1* src = src_; \
+		op_v; } \
+	for(; c_ >= par_; c_ -= par_, dest_ += par_, src_ += par_) { \
+		pixel_t_2* dest = (pixel_t_2 *)dest_; \
+		pixel_t_2* src = (pixel_t_2 *)src_; \
+		op_2; } \
+	while(c_-- >= 1) { \
+		pixel_t_1* dest = dest_; \
+		pixel_t_1* src = src_; \
+		op_1; ++dest_; ++src_; } }
 
 #define SPRITE_X_LOOP_NOALIGN(par_, op_1, op_2) { \
 	int c_ = x2 - x1; \
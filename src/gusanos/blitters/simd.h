@@ -0,0 +1,226 @@
+#ifndef OMFG_BLITTERS_SIMD_H
+#define OMFG_BLITTERS_SIMD_H
+
+#ifdef DEDICATED_ONLY
+#error "Can't use this in dedicated server"
+#endif //DEDICATED_ONLY
+
+#include "blitters.h"
+
+#ifdef BUILTIN_SIMD
+
+#include <emmintrin.h>
+#include <immintrin.h>
+#include "gusanos/blitters/types.h"
+#include "colors.h"
+#include "CodeAttributes.h"
+
+/*
+	The SSE2 and AVX2 versions of the color operations in colors.h.
+
+	They work on 32bit lanes and do exactly the same integer operations as
+	the scalar functions, so the SIMD blitters give the same pixels as the
+	scalar ones (Blitters::test checks that). For the 16bit and 8bit formats,
+	one lane is a Pixel16_2 or a Pixel8_4, like in the scalar code.
+
+	Naming: operation _ bitdepth [ _ parallelism ] _ isa, where isa is sse2 or
+	avx2, so that the kernel macros can paste the isa to the name. The
+	kernels themselves are compiled for their isa with SIMD_TARGET_<isa>.
+*/
+
+namespace Blitters
+{
+
+typedef __m128i vec_sse2;
+typedef __m256i vec_avx2;
+
+// pixels of 32bit per vector
+#define SIMD_N_sse2 4
+#define SIMD_N_avx2 8
+
+// SSE2
+
+SIMD_TARGET_sse2 INLINE vec_sse2 loadu_sse2(const void* p) { return _mm_loadu_si128((const __m128i*)p); }
+SIMD_TARGET_sse2 INLINE void storeu_sse2(void* p, vec_sse2 v) { _mm_storeu_si128((__m128i*)p, v); }
+SIMD_TARGET_sse2 INLINE vec_sse2 set1_32_sse2(Pixel c) { return _mm_set1_epi32((int)(Pixel32)c); }
+SIMD_TARGET_sse2 INLINE vec_sse2 and_sse2(vec_sse2 a, vec_sse2 b) { return _mm_and_si128(a, b); }
+SIMD_TARGET_sse2 INLINE vec_sse2 or_sse2(vec_sse2 a, vec_sse2 b) { return _mm_or_si128(a, b); }
+SIMD_TARGET_sse2 INLINE vec_sse2 xor_sse2(vec_sse2 a, vec_sse2 b) { return _mm_xor_si128(a, b); }
+SIMD_TARGET_sse2 INLINE vec_sse2 andnot_sse2(vec_sse2 a, vec_sse2 b) { return _mm_andnot_si128(a, b); } // ~a & b
+SIMD_TARGET_sse2 INLINE vec_sse2 add32_sse2(vec_sse2 a, vec_sse2 b) { return _mm_add_epi32(a, b); }
+SIMD_TARGET_sse2 INLINE vec_sse2 sub32_sse2(vec_sse2 a, vec_sse2 b) { return _mm_sub_epi32(a, b); }
+SIMD_TARGET_sse2 INLINE vec_sse2 srl32_sse2(vec_sse2 a, int n) { return _mm_srli_epi32(a, n); }
+SIMD_TARGET_sse2 INLINE vec_sse2 sll32_sse2(vec_sse2 a, int n) { return _mm_slli_epi32(a, n); }
+SIMD_TARGET_sse2 INLINE vec_sse2 cmpeq32_sse2(vec_sse2 a, vec_sse2 b) { return _mm_cmpeq_epi32(a, b); }
+SIMD_TARGET_sse2 INLINE vec_sse2 cmpeq16_sse2(vec_sse2 a, vec_sse2 b) { return _mm_cmpeq_epi16(a, b); }
+// mask ? a : b
+SIMD_TARGET_sse2 INLINE vec_sse2 select_sse2(vec_sse2 mask, vec_sse2 a, vec_sse2 b) { return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b)); }
+
+// The factors for mul32 (all < 2^16). SSE2 has no 32bit multiplication,
+// so mul32_sse2 puts it together from 16bit ones and wants the factor in both halfs.
+SIMD_TARGET_sse2 INLINE vec_sse2 fact_sse2(int fact) { return _mm_set1_epi16((short)fact); }
+SIMD_TARGET_sse2 INLINE vec_sse2 factLanes_sse2(vec_sse2 f) { return _mm_or_si128(f, _mm_slli_epi32(f, 16)); }
+
+// the lower 32bit of a * f for each lane
+SIMD_TARGET_sse2 INLINE vec_sse2 mul32_sse2(vec_sse2 a, vec_sse2 f)
+{
+	vec_sse2 lo = _mm_mullo_epi16(a, f); // (ahi * f) << 16 | (alo * f) & 0xFFFF
+	vec_sse2 hi = _mm_mulhi_epu16(a, f); // (alo * f) >> 16 in the lower half
+	return _mm_add_epi32(lo, _mm_slli_epi32(hi, 16));
+}
+
+// 4 Pixel8 to the 4 lanes
+SIMD_TARGET_sse2 INLINE vec_sse2 loadBytes_sse2(const Pixel8* p)
+{
+	Pixel32 v = p[0] | (p[1] << 8) | (p[2] << 16) | ((Pixel32)p[3] << 24);
+	vec_sse2 zero = _mm_setzero_si128();
+	return _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128((int)v), zero), zero);
+}
+
+// AVX2
+
+SIMD_TARGET_avx2 INLINE vec_avx2 loadu_avx2(const void* p) { return _mm256_loadu_si256((const __m256i*)p); }
+SIMD_TARGET_avx2 INLINE void storeu_avx2(void* p, vec_avx2 v) { _mm256_storeu_si256((__m256i*)p, v); }
+SIMD_TARGET_avx2 INLINE vec_avx2 set1_32_avx2(Pixel c) { return _mm256_set1_epi32((int)(Pixel32)c); }
+SIMD_TARGET_avx2 INLINE vec_avx2 and_avx2(vec_avx2 a, vec_avx2 b) { return _mm256_and_si256(a, b); }
+SIMD_TARGET_avx2 INLINE vec_avx2 or_avx2(vec_avx2 a, vec_avx2 b) { return _mm256_or_si256(a, b); }
+SIMD_TARGET_avx2 INLINE vec_avx2 xor_avx2(vec_avx2 a, vec_avx2 b) { return _mm256_xor_si256(a, b); }
+SIMD_TARGET_avx2 INLINE vec_avx2 andnot_avx2(vec_avx2 a, vec_avx2 b) { return _mm256_andnot_si256(a, b); } // ~a & b
+SIMD_TARGET_avx2 INLINE vec_avx2 add32_avx2(vec_avx2 a, vec_avx2 b) { return _mm256_add_epi32(a, b); }
+SIMD_TARGET_avx2 INLINE vec_avx2 sub32_avx2(vec_avx2 a, vec_avx2 b) { return _mm256_sub_epi32(a, b); }
+SIMD_TARGET_avx2 INLINE vec_avx2 srl32_avx2(vec_avx2 a, int n) { return _mm256_srli_epi32(a, n); }
+SIMD_TARGET_avx2 INLINE vec_avx2 sll32_avx2(vec_avx2 a, int n) { return _mm256_slli_epi32(a, n); }
+SIMD_TARGET_avx2 INLINE vec_avx2 cmpeq32_avx2(vec_avx2 a, vec_avx2 b) { return _mm256_cmpeq_epi32(a, b); }
+SIMD_TARGET_avx2 INLINE vec_avx2 cmpeq16_avx2(vec_avx2 a, vec_avx2 b) { return _mm256_cmpeq_epi16(a, b); }
+SIMD_TARGET_avx2 INLINE vec_avx2 select_avx2(vec_avx2 mask, vec_avx2 a, vec_avx2 b) { return _mm256_blendv_epi8(b, a, mask); }
+
+SIMD_TARGET_avx2 INLINE vec_avx2 fact_avx2(int fact) { return _mm256_set1_epi32(fact); }
+SIMD_TARGET_avx2 INLINE vec_avx2 factLanes_avx2(vec_avx2 f) { return f; }
+SIMD_TARGET_avx2 INLINE vec_avx2 mul32_avx2(vec_avx2 a, vec_avx2 f) { return _mm256_mullo_epi32(a, f); }
+
+// 8 Pixel8 to the 8 lanes
+SIMD_TARGET_avx2 INLINE vec_avx2 loadBytes_avx2(const Pixel8* p) { return _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)p)); }
+
+// The color operations. They are macros over the isa because they are the
+// same for both; see the scalar versions in colors.h for what they do.
+
+#define SIMD_COLOR_OPS(isa_) \
+\
+SIMD_TARGET_##isa_ INLINE vec_##isa_ scaleColor_32_##isa_(vec_##isa_ color, vec_##isa_ f) \
+{ \
+	vec_##isa_ temp1 = and_##isa_(color, set1_32_##isa_(maskcolor_32)); \
+	vec_##isa_ temp2 = and_##isa_(color, set1_32_##isa_(0x00FF00)); \
+	temp1 = and_##isa_(srl32_##isa_(mul32_##isa_(temp1, f), 8), set1_32_##isa_(maskcolor_32)); \
+	temp2 = and_##isa_(srl32_##isa_(mul32_##isa_(temp2, f), 8), set1_32_##isa_(0x00FF00)); \
+	return or_##isa_(temp1, temp2); \
+} \
+\
+SIMD_TARGET_##isa_ INLINE vec_##isa_ scaleColor_8_4_##isa_(vec_##isa_ color, vec_##isa_ f) \
+{ \
+	vec_##isa_ temp1 = and_##isa_(color, set1_32_##isa_(0x00FF00FF)); \
+	vec_##isa_ temp2 = srl32_##isa_(and_##isa_(color, set1_32_##isa_(0xFF00FF00)), 8); \
+	temp1 = and_##isa_(srl32_##isa_(mul32_##isa_(temp1, f), 8), set1_32_##isa_(0x00FF00FF)); \
+	temp2 = and_##isa_(mul32_##isa_(temp2, f), set1_32_##isa_(0xFF00FF00)); \
+	return or_##isa_(temp1, temp2); \
+} \
+\
+SIMD_TARGET_##isa_ INLINE vec_##isa_ scaleColor_16_2_##isa_(vec_##isa_ color, vec_##isa_ f) \
+{ \
+	vec_##isa_ color1 = and_##isa_(color, set1_32_##isa_(0x7E0F81F)); \
+	color1 = and_##isa_(srl32_##isa_(add32_##isa_(mul32_##isa_(color1, f), set1_32_##isa_(0x2008010)), 5), set1_32_##isa_(0x7E0F81F)); \
+	vec_##isa_ color2 = srl32_##isa_(and_##isa_(color, set1_32_##isa_(0xF81F07E0)), 5); \
+	color2 = and_##isa_(add32_##isa_(mul32_##isa_(color2, f), set1_32_##isa_(0x4008010)), set1_32_##isa_(0xF81F07E0)); \
+	return or_##isa_(color1, color2); \
+} \
+\
+SIMD_TARGET_##isa_ INLINE vec_##isa_ addColorsCrude_32_##isa_(vec_##isa_ color1, vec_##isa_ color2) \
+{ \
+	const vec_##isa_ m = set1_32_##isa_(0xFEFEFF); \
+	color1 = add32_##isa_(and_##isa_(color1, m), and_##isa_(color2, m)); \
+	vec_##isa_ temp1 = srl32_##isa_(and_##isa_(color1, set1_32_##isa_(0x01010100)), 7); \
+	color1 = or_##isa_(color1, sub32_##isa_(set1_32_##isa_(0x010101), temp1)); \
+	return and_##isa_(color1, set1_32_##isa_(0xFFFFFF)); \
+} \
+\
+SIMD_TARGET_##isa_ INLINE vec_##isa_ addColorsCrude_8_4_##isa_(vec_##isa_ color1, vec_##isa_ color2) \
+{ \
+	const vec_##isa_ m = set1_32_##isa_(0x7F7F7F7F); \
+	color1 = add32_##isa_(and_##isa_(srl32_##isa_(color1, 1), m), and_##isa_(srl32_##isa_(color2, 1), m)); \
+	vec_##isa_ temp1 = srl32_##isa_(and_##isa_(color1, set1_32_##isa_(0x80808080)), 6); \
+	color1 = or_##isa_(color1, sub32_##isa_(set1_32_##isa_(0x01010101), temp1)); \
+	return sll32_##isa_(color1, 1); \
+} \
+\
+SIMD_TARGET_##isa_ INLINE vec_##isa_ addColors_16_2_##isa_(vec_##isa_ color1, vec_##isa_ color2) \
+{ \
+	const vec_##isa_ msb = set1_32_##isa_(0x84108410); \
+	vec_##isa_ msb_x = and_##isa_(color1, msb); \
+	vec_##isa_ msb_y = and_##isa_(color2, msb); \
+	vec_##isa_ sum = add32_##isa_(andnot_##isa_(msb, color1), andnot_##isa_(msb, color2)); \
+	vec_##isa_ p = or_##isa_(msb_x, msb_y); \
+	vec_##isa_ g = and_##isa_(msb_x, msb_y); \
+	vec_##isa_ c = and_##isa_(p, sum); \
+	vec_##isa_ overflow = srl32_##isa_(or_##isa_(c, g), 4); \
+	return or_##isa_(or_##isa_(xor_##isa_(sub32_##isa_(msb, overflow), msb), sum), p); \
+} \
+\
+SIMD_TARGET_##isa_ INLINE vec_##isa_ blendColorsHalfCrude_32_##isa_(vec_##isa_ color1, vec_##isa_ color2) \
+{ \
+	const vec_##isa_ m = set1_32_##isa_(0xFEFEFE); \
+	return add32_##isa_(srl32_##isa_(and_##isa_(color1, m), 1), srl32_##isa_(and_##isa_(color2, m), 1)); \
+} \
+\
+SIMD_TARGET_##isa_ INLINE vec_##isa_ blendColorsFact_32_##isa_(vec_##isa_ color1, vec_##isa_ color2, vec_##isa_ f) \
+{ \
+	const vec_##isa_ rb = set1_32_##isa_(maskcolor_32); \
+	const vec_##isa_ gm = set1_32_##isa_(0xFF00); \
+	vec_##isa_ res = add32_##isa_(srl32_##isa_(mul32_##isa_(sub32_##isa_(and_##isa_(color2, rb), and_##isa_(color1, rb)), f), 8), color1); \
+	vec_##isa_ g1 = and_##isa_(color1, gm); \
+	vec_##isa_ g = add32_##isa_(srl32_##isa_(mul32_##isa_(sub32_##isa_(and_##isa_(color2, gm), g1), f), 8), g1); \
+	return or_##isa_(and_##isa_(res, rb), and_##isa_(g, gm)); \
+} \
+\
+SIMD_TARGET_##isa_ INLINE vec_##isa_ blendColorsHalf_16_2_##isa_(vec_##isa_ color1, vec_##isa_ color2) \
+{ \
+	const vec_##isa_ m = set1_32_##isa_(0xF7DEF7DE); \
+	return add32_##isa_(add32_##isa_(srl32_##isa_(and_##isa_(color1, m), 1), srl32_##isa_(and_##isa_(color2, m), 1)), \
+		and_##isa_(and_##isa_(color1, color2), set1_32_##isa_(0x08210821))); \
+} \
+\
+SIMD_TARGET_##isa_ INLINE vec_##isa_ blendColorsFact_16_2_##isa_(vec_##isa_ color1, vec_##isa_ color2, vec_##isa_ f) \
+{ \
+	const vec_##isa_ m1 = set1_32_##isa_(0x7E0F81F); \
+	const vec_##isa_ m2 = set1_32_##isa_(0xF81F07E0); \
+	vec_##isa_ temp2 = and_##isa_(color2, m1); \
+	color2 = and_##isa_(color2, m2); \
+	vec_##isa_ temp1 = and_##isa_(color1, m1); \
+	color1 = and_##isa_(color1, m2); \
+	color1 = and_##isa_(add32_##isa_(add32_##isa_(mul32_##isa_(sub32_##isa_(srl32_##isa_(color2, 5), srl32_##isa_(color1, 5)), f), set1_32_##isa_(0x4008010)), color1), m2); \
+	color2 = and_##isa_(add32_##isa_(srl32_##isa_(add32_##isa_(mul32_##isa_(sub32_##isa_(temp2, temp1), f), set1_32_##isa_(0x2008010)), 5), temp1), m1); \
+	return or_##isa_(color1, color2); \
+} \
+\
+/* the pixels of src which are the mask color are taken from dest */ \
+SIMD_TARGET_##isa_ INLINE vec_##isa_ blend_mask_16_2_##isa_(vec_##isa_ dest, vec_##isa_ src) \
+{ \
+	vec_##isa_ mask = cmpeq16_##isa_(src, set1_32_##isa_((maskcolor_16 << 16) | maskcolor_16)); \
+	return select_##isa_(mask, dest, src); \
+} \
+\
+/* the pixels of src which are the mask color are set to 0 */ \
+SIMD_TARGET_##isa_ INLINE vec_##isa_ add_mask_16_2_##isa_(vec_##isa_ src) \
+{ \
+	vec_##isa_ mask = cmpeq16_##isa_(src, set1_32_##isa_((maskcolor_16 << 16) | maskcolor_16)); \
+	return andnot_##isa_(mask, src); \
+}
+
+SIMD_COLOR_OPS(sse2)
+SIMD_COLOR_OPS(avx2)
+
+#undef SIMD_COLOR_OPS
+
+}
+
+#endif // BUILTIN_SIMD
+
+#endif //OMFG_BLITTERS_SIMD_H
@@ -0,0 +1,354 @@
+#ifndef DEDICATED_ONLY
+
+#include <cstring>
+#include <SDL.h>
+#include "blitters.h"
+#include "colors.h"
+#include "MathLib.h"
+#include "Timer.h"
+#include "Debug.h"
+
+namespace Blitters
+{
+
+#ifdef BUILTIN_SIMD
+
+namespace
+{
+
+// All parameters the blitters get; each kernel uses a part of them.
+struct Params
+{
+	int x, y, x1, y1, x2, y2;
+	int cutl, cutt, cutr, cutb;
+	Pixel colour;
+	int fact;
+};
+
+typedef void (*Blitter)(ALLEGRO_BITMAP* where, ALLEGRO_BITMAP* from, const Params& p);
+
+enum Shape { S_Rect, S_HLine, S_Sprite, S_SpriteLine };
+
+struct Kernel
+{
+	const char* name;
+	Shape shape;
+	int destDepth;
+	int srcDepth; // 0 if it has no source bitmap
+	Blitter variant[3]; // C, SSE2, AVX2
+};
+
+#define CALL_RECT(f_) f_(where, p.x1, p.y1, p.x2, p.y2, p.colour, p.fact)
+#define CALL_HLINE(f_) f_(where, p.x1, p.y1, p.x2, p.colour, p.fact)
+#define CALL_SPRITE(f_) f_(where, from, p.x, p.y, p.cutl, p.cutt, p.cutr, p.cutb, p.fact)
+#define CALL_SPRITE_NOFACT(f_) f_(where, from, p.x, p.y, p.cutl, p.cutt, p.cutr, p.cutb)
+#define CALL_SPRITELINE(f_) f_(where, from, p.x, p.y, p.x1, p.y1, p.x2, p.fact)
+
+#define KERNEL_VARIANTS(f_, call_) \
+	void test_##f_(ALLEGRO_BITMAP* where, ALLEGRO_BITMAP* from, const Params& p) { call_(f_); } \
+	void test_##f_##_sse2(ALLEGRO_BITMAP* where, ALLEGRO_BITMAP* from, const Params& p) { call_(f_##_sse2); } \
+	void test_##f_##_avx2(ALLEGRO_BITMAP* where, ALLEGRO_BITMAP* from, const Params& p) { call_(f_##_avx2); }
+
+KERNEL_VARIANTS(rectfill_add_32, CALL_RECT)
+KERNEL_VARIANTS(rectfill_blend_32, CALL_RECT)
+KERNEL_VARIANTS(hline_add_32, CALL_HLINE)
+KERNEL_VARIANTS(hline_blend_32, CALL_HLINE)
+KERNEL_VARIANTS(drawSprite_add_32, CALL_SPRITE)
+KERNEL_VARIANTS(drawSprite_add_16, CALL_SPRITE)
+KERNEL_VARIANTS(drawSprite_blend_32, CALL_SPRITE)
+KERNEL_VARIANTS(drawSprite_blend_16, CALL_SPRITE)
+KERNEL_VARIANTS(drawSprite_blendalpha_32_to_32, CALL_SPRITE)
+KERNEL_VARIANTS(drawSprite_mult_8_to_32, CALL_SPRITE_NOFACT)
+KERNEL_VARIANTS(drawSpriteLine_add_8, CALL_SPRITELINE)
+
+#define KERNEL(f_, shape_, destDepth_, srcDepth_) \
+	{ #f_, shape_, destDepth_, srcDepth_, { test_##f_, test_##f_##_sse2, test_##f_##_avx2 } }
+
+const Kernel kernels[] = {
+	KERNEL(rectfill_add_32, S_Rect, 32, 0),
+	KERNEL(rectfill_blend_32, S_Rect, 32, 0),
+	KERNEL(hline_add_32, S_HLine, 32, 0),
+	KERNEL(hline_blend_32, S_HLine, 32, 0),
+	KERNEL(drawSprite_add_32, S_Sprite, 32, 32),
+	KERNEL(drawSprite_add_16, S_Sprite, 16, 16),
+	KERNEL(drawSprite_blend_32, S_Sprite, 32, 32),
+	KERNEL(drawSprite_blend_16, S_Sprite, 16, 16),
+	KERNEL(drawSprite_blendalpha_32_to_32, S_Sprite, 32, 32),
+	KERNEL(drawSprite_mult_8_to_32, S_Sprite, 32, 8),
+	KERNEL(drawSpriteLine_add_8, S_SpriteLine, 8, 8),
+};
+
+#undef KERNEL
+#undef KERNEL_VARIANTS
+#undef CALL_SPRITELINE
+#undef CALL_SPRITE_NOFACT
+#undef CALL_SPRITE
+#undef CALL_HLINE
+#undef CALL_RECT
+
+const char* variantNames[3] = { "C", "SSE2", "AVX2" };
+
+bool variantAvailable(int v)
+{
+	switch(v) {
+		case 0: return true;
+		case 1: return HAS_SSE2;
+		case 2: return HAS_AVX2;
+	}
+	return false;
+}
+
+ALLEGRO_BITMAP* createTestBitmap(int depth, int w, int h)
+{
+	SmartPointer<SDL_Surface> surf;
+	switch(depth) {
+		case 32: surf = create_32bpp_sdlsurface__allegroformat(w, h); break;
+		case 16: surf = SDL_CreateRGBSurface(0, w, h, 16, 0xF800, 0x07E0, 0x001F, 0); break;
+		default: surf = SDL_CreateRGBSurface(0, w, h, 8, 0, 0, 0, 0); break;
+	}
+	if(!surf.get()) {
+		errors << "Blitters test: cannot create " << w << "x" << h << "x" << depth << " surface" << endl;
+		return NULL;
+	}
+	return create_bitmap_from_sdl(surf);
+}
+
+int lineBytes(ALLEGRO_BITMAP* bmp)
+{
+	return bmp->w * BYTES_PER_PIXEL(bitmap_color_depth(bmp));
+}
+
+// random pixels, a quarter of them is the mask color
+void fillRandom(ALLEGRO_BITMAP* bmp, SyncedRandom& rnd)
+{
+	const int depth = bitmap_color_depth(bmp);
+	for(int y = 0; y < bmp->h; ++y)
+		for(int x = 0; x < bmp->w; ++x) {
+			const bool mask = (rnd.getInt() % 4) == 0;
+			const Pixel32 c = (Pixel32)rnd.getInt();
+			switch(depth) {
+				case 32: ((Pixel32 *)bmp->line[y])[x] = mask ? (Pixel32)maskcolor_32 : c; break;
+				case 16: ((Pixel16 *)bmp->line[y])[x] = mask ? (Pixel16)maskcolor_16 : (Pixel16)c; break;
+				default: ((Pixel8 *)bmp->line[y])[x] = (Pixel8)c; break;
+			}
+		}
+}
+
+void copyPixels(ALLEGRO_BITMAP* dest, ALLEGRO_BITMAP* src)
+{
+	for(int y = 0; y < src->h; ++y)
+		memcpy(dest->line[y], src->line[y], lineBytes(src));
+	dest->cl = src->cl; dest->cr = src->cr;
+	dest->ct = src->ct; dest->cb = src->cb;
+}
+
+bool samePixels(ALLEGRO_BITMAP* a, ALLEGRO_BITMAP* b)
+{
+	for(int y = 0; y < a->h; ++y)
+		if(memcmp(a->line[y], b->line[y], lineBytes(a)) != 0)
+			return false;
+	return true;
+}
+
+int randomFact(SyncedRandom& rnd)
+{
+	switch(rnd.getInt() % 8) {
+		case 0: return 255;
+		case 1: return 256;
+		case 2: return 127 + (int)(rnd.getInt() % 2);
+		case 3: return (int)(rnd.getInt() % 40) - 8;
+		case 4: return 257 + (int)(rnd.getInt() % 300);
+		default: return (int)(rnd.getInt() % 257);
+	}
+}
+
+// Random parameters, with odd offsets and clipping. The lines are not
+// clipped by the blitters, so they are always inside of the bitmap.
+Params randomParams(SyncedRandom& rnd, Shape shape, ALLEGRO_BITMAP* where, ALLEGRO_BITMAP* from)
+{
+	const int W = where->w, H = where->h;
+	Params p;
+	memset(&p, 0, sizeof(p));
+	p.colour = (rnd.getInt() % 8 == 0) ? maskcolor_32 : (Pixel)rnd.getInt();
+	p.fact = randomFact(rnd);
+	switch(shape) {
+		case S_Rect:
+			p.x1 = (int)(rnd.getInt() % (W + 20)) - 10;
+			p.x2 = p.x1 + (int)(rnd.getInt() % (W + 10)) - 5;
+			p.y1 = (int)(rnd.getInt() % (H + 4)) - 2;
+			p.y2 = p.y1 + (int)(rnd.getInt() % (H + 2)) - 1;
+			break;
+		case S_HLine:
+			p.x1 = (int)(rnd.getInt() % W);
+			p.x2 = p.x1 + (int)(rnd.getInt() % (W - p.x1));
+			p.y1 = (int)(rnd.getInt() % H);
+			break;
+		case S_Sprite:
+			p.x = (int)(rnd.getInt() % (W + from->w)) - from->w;
+			p.y = (int)(rnd.getInt() % (H + from->h)) - from->h;
+			p.cutl = (int)(rnd.getInt() % 3); p.cutr = (int)(rnd.getInt() % 3);
+			p.cutt = (int)(rnd.getInt() % 2); p.cutb = (int)(rnd.getInt() % 2);
+			break;
+		case S_SpriteLine:
+			p.x = (int)(rnd.getInt() % (W + from->w)) - from->w;
+			p.y = (int)(rnd.getInt() % (H + 2)) - 1;
+			p.x1 = (int)(rnd.getInt() % from->w);
+			p.x2 = p.x1 + (int)(rnd.getInt() % (from->w - p.x1 + 1));
+			p.y1 = (int)(rnd.getInt() % from->h);
+			break;
+	}
+	return p;
+}
+
+} // namespace
+
+bool test(int iterations)
+{
+	SyncedRandom rnd(4321);
+	const int numKernels = sizeof(kernels) / sizeof(kernels[0]);
+	size_t tests = 0, failures = 0;
+
+	notes << "Blitters test: C";
+	for(int v = 1; v < 3; ++v)
+		if(variantAvailable(v)) notes << ", " << variantNames[v];
+	notes << endl;
+
+	for(int it = 0; it < iterations; ++it) {
+		for(int k = 0; k < numKernels; ++k) {
+			const Kernel& kernel = kernels[k];
+			const int W = 32 + (int)(rnd.getInt() % 100), H = 1 + (int)(rnd.getInt() % 20);
+
+			ALLEGRO_BITMAP* orig = createTestBitmap(kernel.destDepth, W, H);
+			ALLEGRO_BITMAP* ref = createTestBitmap(kernel.destDepth, W, H);
+			ALLEGRO_BITMAP* dest = createTestBitmap(kernel.destDepth, W, H);
+			ALLEGRO_BITMAP* from = NULL;
+			if(kernel.srcDepth)
+				from = createTestBitmap(kernel.srcDepth, 1 + (int)(rnd.getInt() % 70), 1 + (int)(rnd.getInt() % 20));
+			if(!orig || !ref || !dest || (kernel.srcDepth && !from)) {
+				destroy_bitmap(orig); destroy_bitmap(ref); destroy_bitmap(dest); destroy_bitmap(from);
+				return false;
+			}
+
+			fillRandom(orig, rnd);
+			if(from) fillRandom(from, rnd);
+			if(rnd.getInt() % 3 == 0) {
+				orig->cl = (int)(rnd.getInt() % 8); orig->cr = W - (int)(rnd.getInt() % 8);
+				orig->ct = (int)(rnd.getInt() % 4); orig->cb = H - (int)(rnd.getInt() % 4);
+			}
+			const Params p = randomParams(rnd, kernel.shape, orig, from);
+
+			copyPixels(ref, orig);
+			kernel.variant[0](ref, from, p);
+
+			for(int v = 1; v < 3; ++v) {
+				if(!variantAvailable(v)) continue;
+				copyPixels(dest, orig);
+				kernel.variant[v](dest, from, p);
+				++tests;
+				if(!samePixels(ref, dest)) {
+					if(failures < 10)
+						errors << "Blitters test: " << kernel.name << " " << variantNames[v] << " differs from C"
+							<< " (" << W << "x" << H << ", x=" << p.x << " y=" << p.y << " x1=" << p.x1 << " y1=" << p.y1
+							<< " x2=" << p.x2 << " y2=" << p.y2 << " fact=" << p.fact << ")" << endl;
+					++failures;
+				}
+			}
+
+			destroy_bitmap(orig); destroy_bitmap(ref); destroy_bitmap(dest); destroy_bitmap(from);
+		}
+	}
+
+	if(failures) {
+		errors << "Blitters test: " << failures << " of " << tests << " runs differ" << endl;
+		return false;
+	}
+	notes << "Blitters test: all " << tests << " runs identical" << endl;
+	return true;
+}
+
+void benchmark(int iterations)
+{
+	const int W = 640, H = 480;
+	const int numKernels = sizeof(kernels) / sizeof(kernels[0]);
+	SyncedRandom rnd(1234);
+
+	for(int k = 0; k < numKernels; ++k) {
+		const Kernel& kernel = kernels[k];
+		ALLEGRO_BITMAP* where = createTestBitmap(kernel.destDepth, W, H);
+		ALLEGRO_BITMAP* from = NULL;
+		if(kernel.srcDepth)
+			from = createTestBitmap(kernel.srcDepth, (kernel.shape == S_SpriteLine) ? W : 64, 64);
+		if(!where || (kernel.srcDepth && !from)) {
+			destroy_bitmap(where); destroy_bitmap(from);
+			return;
+		}
+		fillRandom(where, rnd);
+		if(from) fillRandom(from, rnd);
+
+		Params p;
+		memset(&p, 0, sizeof(p));
+		p.colour = 0x406080;
+		p.fact = 100;
+
+		int mpixs[3] = { 0, 0, 0 };
+		for(int v = 0; v < 3; ++v) {
+			if(!variantAvailable(v)) continue;
+			const AbsTime start = GetTime();
+			for(int it = 0; it < iterations; ++it) {
+				// one iteration covers the whole bitmap
+				switch(kernel.shape) {
+					case S_Rect:
+						p.x1 = 0; p.y1 = 0; p.x2 = W - 1; p.y2 = H - 1;
+						kernel.variant[v](where, from, p);
+						break;
+					case S_HLine:
+						p.x1 = 0; p.x2 = W - 1;
+						for(p.y1 = 0; p.y1 < H; ++p.y1)
+							kernel.variant[v](where, from, p);
+						break;
+					case S_Sprite:
+						for(p.y = 0; p.y < H; p.y += from->h)
+							for(p.x = 0; p.x < W; p.x += from->w)
+								kernel.variant[v](where, from, p);
+						break;
+					case S_SpriteLine:
+						p.x = 0; p.x1 = 0; p.x2 = from->w;
+						for(p.y = 0; p.y < H; ++p.y) {
+							p.y1 = p.y % from->h;
+							kernel.variant[v](where, from, p);
+						}
+						break;
+				}
+			}
+			const Uint64 ms = (GetTime() - start).milliseconds();
+			mpixs[v] = (int)((Uint64)W * H * iterations / 1000 / (ms ? ms : 1));
+		}
+
+		notes << "Blitters benchmark: " << kernel.name << ": C " << mpixs[0] << " Mpix/s";
+		for(int v = 1; v < 3; ++v)
+			if(variantAvailable(v))
+				notes << ", " << variantNames[v] << " " << mpixs[v] << " Mpix/s";
+		notes << endl;
+
+		destroy_bitmap(where); destroy_bitmap(from);
+	}
+}
+
+#else // BUILTIN_SIMD
+
+bool test(int iterations)
+{
+	notes << "Blitters test: no SIMD blitters built in" << endl;
+	return true;
+}
+
+void benchmark(int iterations)
+{
+	notes << "Blitters benchmark: no SIMD blitters built in" << endl;
+}
+
+#endif // BUILTIN_SIMD
+
+} // namespace Blitters
+
+#endif //DEDICATED_ONLY
@@ -206,6 +206,7 @@ void CMap::gusThink()
 	foreach_delete( wp, m_water ) {
 		if ( getMaterialIndex( wp->x, wp->y ) != wp->mat ) {
 			CopyPixel2x2_SameFormat(bmpDrawImage.get(), bmpBackImageHiRes.get(), wp->x*2, wp->y*2);
+			m_renderCache.invalidate(wp->x, wp->y, 1, 1);
 			m_water.erase(wp);
 		} else
 			if ( rnd() > WaterSkipFactor ) {
@@ -213,9 +214,11 @@ void CMap::gusThink()
 				if ( m_materialList[mat].particle_pass && !m_materialList[mat].flows) {
 					checkWBorders( wp->x, wp->y  );
 					CopyPixel2x2_SameFormat(bmpDrawImage.get(), bmpBackImageHiRes.get(), wp->x*2, wp->y*2);
+					m_renderCache.invalidate(wp->x, wp->y, 1, 1);
 					putMaterial( 1, wp->x, wp->y );
 					++wp->y;
 					CopyPixel2x2_SameFormat(bmpDrawImage.get(), watermap->surf.get(), wp->x*2, wp->y*2);
+					m_renderCache.invalidate(wp->x, wp->y, 1, 1);
 					putMaterial( wp->mat, wp->x, wp->y );
 					wp->count = 0; // Reset stagnation counter because it moved
 				} else {
@@ -229,9 +232,11 @@ void CMap::gusThink()
 					if ( m_materialList[mat].particle_pass && !m_materialList[mat].flows ) {
 						checkWBorders( wp->x, wp->y );
 						CopyPixel2x2_SameFormat(bmpDrawImage.get(), bmpBackImageHiRes.get(), wp->x*2, wp->y*2);
+						m_renderCache.invalidate(wp->x, wp->y, 1, 1);
 						putMaterial( 1, wp->x, wp->y );
 						wp->x += dir;
 						CopyPixel2x2_SameFormat(bmpDrawImage.get(), watermap->surf.get(), wp->x*2, wp->y*2);
+						m_renderCache.invalidate(wp->x, wp->y, 1, 1);
 						putMaterial( wp->mat, wp->x, wp->y );
 						wp->count = 0;
 						// Reset stagnation counter because it moved
@@ -243,6 +248,7 @@ void CMap::gusThink()
 							if ( !m_materialList[mat].particle_pass || m_materialList[mat].flows ) {
 								putMaterial( wp->mat+1, wp->x, wp->y );
 								CopyPixel2x2_SameFormat(bmpDrawImage.get(), watermap->surf.get(), wp->x*2, wp->y*2);
+								m_renderCache.invalidate(wp->x, wp->y, 1, 1);
 								m_water.erase(wp);
 							}
 						}
@@ -262,16 +268,20 @@ void CMap::gusDraw(ALLEGRO_BITMAP* where, float x, float y)
 		blit(bmpParallax.get(),where,int(px*2),int(py*2),0,0,where->w,where->h);
 	}
 
-	if(bmpDrawImage.get())
-		blit(bmpDrawImage.get(), where, int(x*2), int(y*2), 0, 0, where->w, where->h);
-
 	// TODO: Actually, it was correct in viewport.cpp, because it could
 	// potentially shadow objects (that was its whole purpose).
 	// Thus, move out again...
 	// However, the worm HUD (crossair) should not be covered by this
 	// (as earlier).
-	if(bmpForeground.get())
-		blit(bmpForeground.get(), where, int(x*2), int(y*2), 0, 0, where->w, where->h);
+	if(!bmpDrawImage.get() || !bmpForeground.get() ||
+	   !m_renderCache.draw(where->surf.get(), bmpDrawImage.get(), bmpForeground.get(),
+						   int(x*2), int(y*2), where->sub_x, where->sub_y, where->w, where->h)) {
+		if(bmpDrawImage.get())
+			blit(bmpDrawImage.get(), where, int(x*2), int(y*2), 0, 0, where->w, where->h);
+
+		if(bmpForeground.get())
+			blit(bmpForeground.get(), where, int(x*2), int(y*2), 0, 0, where->w, where->h);
+	}
 
 	if ( gusGame.options.showMapDebug ) {
 		foreach( s, m_config.spawnPoints ) {
@@ -394,6 +404,8 @@ bool CMap::applyEffect(LevelEffect* effect, int drawX, int drawY )
 				}
 			}
 		
+		if( returnValue && m_navGraph.get() )
+			m_navGraph->markDirty( drawX/2, drawY/2, tmpMask->m_bitmap->w/2 + 1, tmpMask->m_bitmap->h/2 + 1 );
 		UpdateArea(drawX/2, drawY/2, tmpMask->m_bitmap->w/2 + 1, tmpMask->m_bitmap->h/2 + 1, true);
 	}
 	return returnValue;
@@ -523,6 +535,15 @@ void CMap::gusUpdateMinimap(SmartPointer<SDL_Surface>& bmpMiniMap, const SmartPo
 }
 
 void CMap::gusUpdateMinimap(int x, int y, int w, int h) {
-	gusUpdateMinimap(bmpMiniMap, bmpForeground, bmpDrawImage, bmpParallax, x, y, w, h, 0.5f);
+#ifndef DEDICATED_ONLY
+	if(!bmpDrawImage.get() || !bmpMiniMap.get()) return;
+
+	// material -> image pixels
+	if(!m_miniMapPyramid.isBuiltFor(bmpDrawImage.get(), bmpForeground.get(), bmpParallax.get()))
+		m_miniMapPyramid.build(bmpDrawImage.get(), bmpForeground.get(), bmpParallax.get());
+	else
+		m_miniMapPyramid.update(x*2, y*2, w*2, h*2);
+	m_miniMapPyramid.draw(bmpMiniMap.get(), x*2, y*2, w*2, h*2);
+#endif
 }
 
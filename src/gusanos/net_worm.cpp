@@ -68,6 +68,7 @@ void CWorm::NetWorm_Init()
 
 	m_interceptor = new NetWormInterceptor( this );
 	m_node->setReplicationInterceptor(m_interceptor);
+	m_node->setInterestObject(this);
 
 	BitStream* announceData = new BitStream();
 	announceData->addInt(getID(), 8);
@@ -20,6 +20,8 @@
 #include "CClient.h"
 #include "CServerNetEngine.h"
 #include "CChannel.h"
+#include "InterestManager.h"
+#include "game/CGameObject.h"
 
 
 struct NetControlIntern {
@@ -63,6 +65,19 @@ struct NetControlIntern {
 		BitStream data;
 		eNet_SendMode sendMode;
 		Net_RepRules repRules; // if node is set, while sending, these are checked
+		// GPT_NodeUpdate while sending: the packed data of each replicator (empty if not
+		// in this update). data is composed from this. Used to merge queued updates.
+		std::vector<BitStream> replParts;
+		
+		void composeNodeUpdateData() {
+			data = BitStream();
+			for(size_t k = 0; k < replParts.size(); ++k) {
+				if(replParts[k].bitSize() > 0)
+					data.addBitStream(replParts[k]);
+				else
+					data.addBool(false);
+			}
+		}
 		
 		bool nodeMustBeSet() { return type < GPT_Direct; }
 		
@@ -94,7 +109,17 @@ struct NetControlIntern {
 		void pushUpdate(const DataPackage& p) {
 			NodeMap::iterator f = nodeMap.find(p.node.get());
 			if(f != nodeMap.end()) {
-				*f->second = p;
+				// An update only contains the changed replicators, so the replicators
+				// of the queued update which are not in the new one must be kept.
+				DataPackage& q = *f->second;
+				if(q.replParts.size() != p.replParts.size()) {
+					q = p;
+					return;
+				}
+				for(size_t k = 0; k < p.replParts.size(); ++k)
+					if(p.replParts[k].bitSize() > 0)
+						q.replParts[k] = p.replParts[k];
+				q.composeNodeUpdateData();
 			}
 			else {
 				updates.push_back(p);
@@ -174,7 +199,7 @@ struct NetNodeIntern {
 	publicOwner(NULL), control(NULL), classId(INVALID_CLASS_ID), nodeId(INVALID_NODE_ID), role(eNet_RoleUndefined),
 	eventForInit(false), eventForRemove(false),
 	ownerConn(NetConnID_server()),
-	forthcomingReplicatorInterceptID(0), interceptor(NULL) {}
+	forthcomingReplicatorInterceptID(0), interceptor(NULL), interestObj(NULL) {}
 	~NetNodeIntern() { clearReplicationSetup(); }
 
 	Net_Node* publicOwner;
@@ -190,6 +215,7 @@ struct NetNodeIntern {
 	ReplicationSetup replicationSetup;
 	Net_InterceptID forthcomingReplicatorInterceptID;
 	Net_NodeReplicationInterceptor* interceptor;
+	const CGameObject* interestObj; // reset when the Net_Node is deleted
 		
 	void clearReplicationSetup() {
 		for(ReplicationSetup::iterator i = replicationSetup.begin(); i != replicationSetup.end(); ++i)
@@ -403,7 +429,7 @@ void Net_Control::olxSend(bool /* sendPendingOnly */) {
 		if(cClient->getServerVersion() >= OLXBetaVersion(0,59,1)) {
 			CBytestream bs;
 			if(composePackagesForConn(bs, this->intern, NetConnID_server()))
-				cClient->getChannel()->AddReliablePacketToSend(bs);
+				cClient->getChannel()->AddReliablePacketToSend(std::move(bs));
 		}
 	} else {
 		// send to all except local client
@@ -422,15 +448,31 @@ bool NetControlIntern::NodeUpdateManager::send(const SmartPointer<NetControlInte
 	if(updates.size() == 0) return false;
 	CBytestream tmpbs;
 
+	// nodes far away from the client are updated less often; their update stays
+	// queued and newer updates are merged into it (see pushUpdate)
+	ClientInterest* interest = NULL;
+	if(con->isServer) {
+		CServerConnection* cl = serverConnFromNetConnID(target);
+		if(cl && !cl->isLocalClient()) interest = cl->getInterest();
+	}
+
 	size_t count = 0;
-	while(updates.size() > 0) {
+	for(Updates::iterator i = updates.begin(); i != updates.end(); ) {
+		NetNodeIntern* node = i->node.get();
+		if(interest && node && node->interestObj &&
+		   !interest->shouldUpdate(ClientInterest::key(ClientInterest::KEY_NETNODE, 0, node->nodeId), node->interestObj->getPos(), tLX->currentTime)) {
+			++i;
+			continue;
+		}
+
 		CBytestream tmpbs2;
-		updates.front().send(tmpbs2, false);
+		i->send(tmpbs2, false);
 		if(tmpbs.GetLength() + tmpbs2.GetLength() + eliasGammaEncodedByteLen(count) + 1 > maxBytes)
 			break;
 		
 		tmpbs.Append(&tmpbs2);
-		remove(updates.front().node.get());
+		++i;
+		remove(node);
 		count++;
 	}
 	if(count == 0) return false;
@@ -443,7 +485,7 @@ bool NetControlIntern::NodeUpdateManager::send(const SmartPointer<NetControlInte
 	if(con->isServer)
 		serverConnFromNetConnID(target)->getNetEngine()->SendPacket(&bs);
 	else
-		cClient->getChannel()->AddReliablePacketToSend(bs);
+		cClient->getChannel()->AddReliablePacketToSend(std::move(bs));
 	
 	return true;
 }
@@ -504,19 +546,17 @@ static void pushNodeUpdate(Net_Node* node, const std::vector<BitStream>& replDat
 	
 	size_t count = 0;
 	size_t k = 0;
+	p.replParts.resize(replData.size());
 	for(NetNodeIntern::ReplicationSetup::iterator j = node->intern->replicationSetup.begin(); j != node->intern->replicationSetup.end(); ++j, ++k) {
 		if(replData[k].bitSize() > 0) {
 			Net_ReplicatorBasic* replicator = dynamic_cast<Net_ReplicatorBasic*>(j->first);
 			if(replicator->getSetup()->repRules & rule) {
-				p.data.addBitStream(replData[k]);
+				p.replParts[k] = replData[k];
 				count++;
 			}
-			else
-				p.data.addBool(false);				
 		}
-		else
-			p.data.addBool(false);
 	}
+	p.composeNodeUpdateData();
 	
 	if(count > 0)
 		node->intern->control->pushPackageToSend() = p;
@@ -929,6 +969,7 @@ Net_Node::Net_Node() {
 Net_Node::~Net_Node() {
 	unregisterNode(this);
 	intern->publicOwner = NULL;
+	intern->interestObj = NULL;
 	intern = NULL;
 }
 
@@ -1161,6 +1202,7 @@ void Net_Node::endReplicationSetup() {}
 void Net_Node::setInterceptID(Net_InterceptID id) { intern->forthcomingReplicatorInterceptID = id; }
 
 void Net_Node::setReplicationInterceptor(Net_NodeReplicationInterceptor* inter) { intern->interceptor = inter; }
+void Net_Node::setInterestObject(const CGameObject* obj) { intern->interestObj = obj; }
 
 std::string Net_Node::debugName() {
 	return intern->debugStr();
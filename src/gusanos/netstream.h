@@ -105,6 +105,7 @@ class BitStream;
 class CBytestream;
 
 class CServerConnection;
+class CGameObject;
 Net_ConnID NetConnID_server();
 Net_ConnID NetConnID_conn(CServerConnection* cl);
 CServerConnection* serverConnFromNetConnID(Net_ConnID id);
@@ -154,6 +155,8 @@ struct Net_Node : DontCopyTag {
 
 	void setInterceptID(Net_InterceptID);
 	void setReplicationInterceptor(Net_NodeReplicationInterceptor*);
+	// the node is replicated less often to clients which are far away from it (see ClientInterest)
+	void setInterestObject(const CGameObject*);
 
 	
 	std::string debugName();
@@ -186,6 +186,7 @@ void Particle::assignNetworkRole( bool authority )
 
 	interceptor = new ParticleInterceptor( this );
 	m_node->setReplicationInterceptor(interceptor);
+	m_node->setInterestObject(this);
 
 	//DLOG("Registering node, type " << m_type->getIndex() << " of " << partTypeList.size());
 	if( authority ) {
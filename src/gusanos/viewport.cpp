@@ -103,6 +103,13 @@ void CViewport::drawLight(IVec const& v)
 
 
 void CViewport::gusRender(const SmartPointer<SDL_Surface>& bmpDest)
+{
+	gusRenderPrepare(bmpDest);
+	gusRenderMap();
+	gusRenderObjects(bmpDest);
+}
+
+void CViewport::gusRenderPrepare(const SmartPointer<SDL_Surface>& bmpDest)
 {
 	{
 		int destw = Width*2;
@@ -134,9 +141,17 @@ void CViewport::gusRender(const SmartPointer<SDL_Surface>& bmpDest)
 		if(needLightReset)
 			testLight = genLight(r);
 	}
+}
 
+// This only reads the map and writes into dest, so it can run for the
+// different viewports at the same time.
+void CViewport::gusRenderMap()
+{
 	game.gameMap()->gusDraw(dest, WorldX, WorldY);
+}
 
+void CViewport::gusRenderObjects(const SmartPointer<SDL_Surface>& bmpDest)
+{
 	if ( game.isLevelDarkMode() && game.gameMap()->lightmap )
 		blit( game.gameMap()->lightmap, fadeBuffer, WorldX*2, WorldY*2, 0, 0, fadeBuffer->w, fadeBuffer->h );
 
@@ -267,4 +282,16 @@ void CViewport::gusReset()
 void CViewport::gusRender(const SmartPointer<SDL_Surface>& bmpDest)
 {
 }
+
+void CViewport::gusRenderPrepare(const SmartPointer<SDL_Surface>& bmpDest)
+{
+}
+
+void CViewport::gusRenderMap()
+{
+}
+
+void CViewport::gusRenderObjects(const SmartPointer<SDL_Surface>& bmpDest)
+{
+}
 #endif
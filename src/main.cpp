@@ -44,6 +44,7 @@
 #include "Music.h"
 #include "Debug.h"
 #include "TaskManager.h"
+#include "NavSearchPool.h"
 #include "CGameMode.h"
 #include "ConversationLogger.h"
 #include "OLXCommand.h"
@@ -253,6 +254,7 @@ int real_main(int argc, char *argv[])
 startpoint:
 
 	InitTaskManager();
+	InitNavSearchPool();
 	
 	// Load options and other settings
 	if(!GameOptions::Init()) {
@@ -382,6 +384,7 @@ startpoint:
 	ShutdownLieroX();
 
 	notes << "waiting for all left threads and tasks" << endl;
+	UnInitNavSearchPool();
 	taskManager->finishQueuedTasks();
 	threadPool->waitAll(); // do that before uniniting task manager because some threads could access it
 
@@ -585,6 +588,7 @@ static void ParseArguments_AfterInit(int argc, char *argv[])
 		{
 			InitializeLieroX();
 			TestCChannelRobustness();
+			TestCChannelLossyLink(10, 50, 200, 5);
 			ShutdownLieroX();
      		exit(0);
 		}
@@ -64,9 +64,19 @@ GameServer::GameServer() {
 	m_flagInfo = NULL;
 	cClients = NULL;
 	Clear();
+
+	// The HTTP requests and DNS lookups run in their own threads. We get their
+	// results as events in the main thread, so we never have to poll or wait for them.
+	tHttp.onFinished.handler() = getEventHandler(this, &GameServer::Http_onFinished);
+	tHttp2.onFinished.handler() = getEventHandler(this, &GameServer::Http_onFinished);
+	onHttpFinished.handler() = getEventHandler(this, &GameServer::Http_onFinishedMainThread);
+	onDnsReady.handler() += getEventHandler(this, &GameServer::Dns_onReady);
 }
 
 GameServer::~GameServer()  {
+	onDnsReady.handler() -= getEventHandler(this, &GameServer::Dns_onReady);
+	tHttp.CancelProcessing();
+	tHttp2.CancelProcessing();
 }
 
 void GameServer::setWeaponRestFile(const std::string& fn) { gameSettings.overwrite[FT_WeaponRest] = fn; }
@@ -85,6 +95,7 @@ void GameServer::Clear()
 	//iGameType = GMT_DEATHMATCH;
 	fLastBonusTime = 0;
 	bServerRegistered = false;
+	bRegistering = false;
 	fLastRegister = AbsTime();
 	fRegisterUdpTime = AbsTime();
 	nPort = LX_PORT;
@@ -256,6 +267,7 @@ int GameServer::StartServer()
 	// Initialize the clients
 	for(int i=0;i<MAX_CLIENTS;i++)
 		cClients[i].Clear();
+	m_clientsByAddr.clear();
 
 	SetSocketWithEvents(true);
 	
@@ -308,6 +320,22 @@ void GameServer::ProcessGetExternalIP()
 	}	
 }
 
+// called in the curl thread
+void GameServer::Http_onFinished(CHttp::HttpEventData d)
+{
+	onHttpFinished.pushToMainQueue(d);
+}
+
+void GameServer::Http_onFinishedMainThread(CHttp::HttpEventData d)
+{
+	if(!isServerRunning())
+		return;
+	if(d.cHttp == &tHttp)
+		ProcessRegister();
+	else if(d.cHttp == &tHttp2)
+		ProcessGetExternalIP();
+}
+
 bool GameServer::serverChoosesWeapons() {
 	// HINT:
 	// At the moment, the only cases where we need the bServerChoosesWeapons are:
@@ -763,46 +791,67 @@ bool GameServer::ReadPacketsFromSocket(const SmartPointer<NetworkSocket>& sock)
 		// Reset the suicide packet count
 		iSuicidesInPacket = 0;
 
-		// Read packets
-		CServerConnection *cl = cClients;
-		for (int c = 0; c < MAX_CLIENTS; c++, cl++) {
-
-			// Player not connected
-			if(cl->getStatus() == NET_DISCONNECTED)
-				continue;
-
-			// Check if the packet is from this player
-			if(!AreNetAddrEqual(addrFrom, cl->getChannel()->getAddress()))
-				continue;
-
-			// Check the port
-			if (GetNetAddrPort(addrFrom) != GetNetAddrPort(cl->getChannel()->getAddress()))
-				continue;
+		// Find the player who sent the packet
+		CServerConnection *cl = clientByAddr(addrFrom);
+		if(!cl)
+			continue;
 
-			// Parse the packet - process continuously in case we've received multiple logical packets on new CChannel
-			uint n = 0;
-			while (cl->getChannel()->Process(&bs))  {
-				// Only process the actual packet for playing clients
-				if( cl->getStatus() != NET_ZOMBIE )
-					cl->getNetEngine()->ParsePacket(&bs);
-				bs.Clear();
+		// Parse the packet - process continuously in case we've received multiple logical packets on new CChannel
+		uint n = 0;
+		while (cl->getChannel()->Process(&bs))  {
+			// Only process the actual packet for playing clients
+			if( cl->getStatus() != NET_ZOMBIE )
+				cl->getNetEngine()->ParsePacket(&bs);
+			bs.Clear();
 #ifdef NETDEBUG
-				if(netError != "") {
-					warnings << "GS: " << cl->debugName(true) << " read error (" << n << ") " << netError << endl;
-					bs.Dump();
-					notes << "Original data:" << endl;
-					bsCopy.Dump();
-					netError = "";
-				}
-#endif
-				n++;
+			if(netError != "") {
+				warnings << "GS: " << cl->debugName(true) << " read error (" << n << ") " << netError << endl;
+				bs.Dump();
+				notes << "Original data:" << endl;
+				bsCopy.Dump();
+				netError = "";
 			}
+#endif
+			n++;
 		}
 	}
 
 	return anythingNew;
 }
 
+////////////////////
+// The connected clients by address, for ReadPacketsFromSocket
+void GameServer::addClientAddr(CServerConnection* cl)
+{
+	if(!cClients || !cl->getChannel()) return;
+	m_clientsByAddr[GetNetAddrKey(cl->getChannel()->getAddress())] = (int)(cl - cClients);
+}
+
+void GameServer::removeClientAddr(CServerConnection* cl)
+{
+	if(!cClients || !cl->getChannel()) return;
+	ClientAddrMap::iterator it = m_clientsByAddr.find(GetNetAddrKey(cl->getChannel()->getAddress()));
+	// another client could have connected from the same address in the meanwhile
+	if(it != m_clientsByAddr.end() && it->second == (int)(cl - cClients))
+		m_clientsByAddr.erase(it);
+}
+
+CServerConnection* GameServer::clientByAddr(const NetworkAddr& addr)
+{
+	if(!cClients) return NULL;
+	const Uint64 key = GetNetAddrKey(addr);
+	ClientAddrMap::iterator it = m_clientsByAddr.find(key);
+	if(it == m_clientsByAddr.end()) return NULL;
+
+	CServerConnection* cl = &cClients[it->second];
+	// just a double check, the entry is removed when the client disconnects
+	if(cl->getStatus() == NET_DISCONNECTED || !cl->getChannel() || GetNetAddrKey(cl->getChannel()->getAddress()) != key) {
+		m_clientsByAddr.erase(it);
+		return NULL;
+	}
+	return cl;
+}
+
 
 ///////////////////
 // Read packets
@@ -815,9 +864,10 @@ bool GameServer::ReadPackets()
 			anythingNew = true;
 
 	// Traverse sockets
-	// HINT: copy the list, because tNatClients can change during the loop (client leaves)
-	NatConnList nat_copy = tNatClients;
-	for (NatConnList::iterator it = nat_copy.begin(); it != nat_copy.end(); ++it)  {
+	// HINT: a leaving client only marks its entry as removed (see RemoveClient), so the list stays valid here
+	for (NatConnList::iterator it = tNatClients.begin(); it != tNatClients.end(); ++it)  {
+		if ((*it)->bRemoved)
+			continue;
 		if (ReadPacketsFromSocket((*it)->tTraverseSocket))  {
 			anythingNew = true;
 			if (!(*it)->bClientConnected)  {
@@ -886,6 +936,12 @@ void GameServer::SendPackets(bool sendPendingOnly)
 #endif
 	}
 	
+	// The channels of most clients send through the main sockets; collect their
+	// packets and send them together (if the batched I/O is available)
+	for(int i = 0; i < MAX_SERVER_SOCKETS; i++)
+		if(tSockets[i].get() && tSockets[i]->isOpen())
+			tSockets[i]->beginWriteBatch();
+
 	// Go through each client and send them a message
 	CServerConnection *cl = cClients;
 	for(int c=0;c<MAX_CLIENTS;c++,cl++) {
@@ -907,6 +963,10 @@ void GameServer::SendPackets(bool sendPendingOnly)
 		// Clear the unreliable bytestream
 		cl->getUnreliable()->Clear();
 	}
+
+	for(int i = 0; i < MAX_SERVER_SOCKETS; i++)
+		if(tSockets[i].get() && tSockets[i]->isOpen())
+			tSockets[i]->flushWriteBatch();
 }
 
 
@@ -933,6 +993,7 @@ void GameServer::RegisterServer()
 	sCurrentUrl = std::string(LX_SVRREG) + "?port=" + itoa(nPort) + "&addr=" + addr_name;
 
 	bServerRegistered = false;
+	bRegistering = true;
 
 	// Start with the first server
 	//notes << "Registering server at " << *tCurrentMasterServer << endl;
@@ -943,9 +1004,10 @@ void GameServer::RegisterServer()
 
 ///////////////////
 // Process the registering of the server
+// Called when tHttp has finished.
 void GameServer::ProcessRegister()
 {
-	if(!tLXOptions->bRegServer || bServerRegistered || tMasterServers.size() == 0 || game.isLocalGame())
+	if(!bRegistering || !tLXOptions->bRegServer || bServerRegistered || tMasterServers.size() == 0 || game.isLocalGame())
 		return;
 
 	int result = tHttp.ProcessRequest();
@@ -975,6 +1037,7 @@ void GameServer::ProcessRegister()
 	} else {
 		// All servers are processed
 		bServerRegistered = true;
+		bRegistering = false;
 		tCurrentMasterServer = tMasterServers.begin();
 	}
 
@@ -1010,40 +1073,88 @@ void GameServer::RegisterServerUdp()
 		if( tUdpMasterServers[f].find(":") == std::string::npos )
 			continue;
 		std::string domain = tUdpMasterServers[f].substr( 0, tUdpMasterServers[f].find(":") );
-		int port = atoi(tUdpMasterServers[f].substr( tUdpMasterServers[f].find(":") + 1 ));
 		if( !GetFromDnsCache(domain, addr) )
 		{
+			// We register there when we get onDnsReady. The retry is for the case that the lookup hangs;
+			// Dns_onReady() sets the normal period again once all names are resolved.
 			GetNetAddrFromNameAsync(domain, addr);
-			fRegisterUdpTime = tLX->currentTime + 5.0f;
+			fRegisterUdpTime = tLX->currentTime + 10.0f;
 			continue;
 		}
 
-		//notes << "Registering on UDP masterserver " << tUdpMasterServers[f] << endl;
-		SetNetAddrPort( addr, port );
-		tSockets[f]->setRemoteAddress( addr );
+		RegisterServerUdp(f, addr);
+	}
+}
 
-		CBytestream bs;
+// Sends the registration to UDP masterserver f, addr is its resolved address
+void GameServer::RegisterServerUdp(uint f, NetworkAddr addr)
+{
+	int port = atoi(tUdpMasterServers[f].substr( tUdpMasterServers[f].find(":") + 1 ));
 
-		bs.writeInt(-1,4);
-		bs.writeString("lx::dummypacket");	// So NAT/firewall will understand we really want to connect there
-		bs.Send(tSockets[f].get());
-		bs.Send(tSockets[f].get());
-		bs.Send(tSockets[f].get());
+	//notes << "Registering on UDP masterserver " << tUdpMasterServers[f] << endl;
+	SetNetAddrPort( addr, port );
+	tSockets[f]->setRemoteAddress( addr );
 
-		bs.Clear();
-		bs.writeInt(-1, 4);
-		bs.writeString("lx::register");
-		bs.writeString(OldLxCompatibleString(tLXOptions->sServerName));
-		bs.writeByte(game.worms()->size());
-		bs.writeByte(tLXOptions->iMaxPlayers);
-		bs.writeByte(oldLXStateInt());
-		// Beta8+
-		bs.writeString(GetGameVersion().asString());
-		bs.writeByte(serverAllowsConnectDuringGame());
-		
+	CBytestream bs;
 
-		bs.Send(tSockets[f].get());
+	bs.writeInt(-1,4);
+	bs.writeString("lx::dummypacket");	// So NAT/firewall will understand we really want to connect there
+	bs.Send(tSockets[f].get());
+	bs.Send(tSockets[f].get());
+	bs.Send(tSockets[f].get());
+
+	bs.Clear();
+	bs.writeInt(-1, 4);
+	bs.writeString("lx::register");
+	bs.writeString(OldLxCompatibleString(tLXOptions->sServerName));
+	bs.writeByte(game.worms()->size());
+	bs.writeByte(tLXOptions->iMaxPlayers);
+	bs.writeByte(oldLXStateInt());
+	// Beta8+
+	bs.writeString(GetGameVersion().asString());
+	bs.writeByte(serverAllowsConnectDuringGame());
+	
+
+	bs.Send(tSockets[f].get());
+}
+
+// A DNS lookup has finished; register on the UDP masterservers which were waiting for it.
+void GameServer::Dns_onReady(DnsEventData d)
+{
+	if(!isServerRunning() || !tLXOptions->bRegServer || game.isLocalGame())
+		return;
+
+	bool registered = false;
+	for( uint f=0; f<tUdpMasterServers.size() && f < MAX_SERVER_SOCKETS; f++ )
+	{
+		if( tUdpMasterServers[f].find(":") == std::string::npos )
+			continue;
+		if( tUdpMasterServers[f].substr( 0, tUdpMasterServers[f].find(":") ) != d.name )
+			continue;
+		if( !d.success )
+		{
+			notes << "UDP masterserver " << tUdpMasterServers[f] << ": cannot resolve domain name" << endl;
+			continue;
+		}
+		NetworkAddr addr;
+		if( GetFromDnsCache(d.name, addr) )
+		{
+			RegisterServerUdp(f, addr);
+			registered = true;
+		}
+	}
+	if( !registered )
+		return;
+
+	// Otherwise CheckRegister() would register again in 10 s, only because of the lookup
+	for( uint f=0; f<tUdpMasterServers.size() && f < MAX_SERVER_SOCKETS; f++ )
+	{
+		NetworkAddr addr;
+		if( tUdpMasterServers[f].find(":") != std::string::npos &&
+			!GetFromDnsCache(tUdpMasterServers[f].substr( 0, tUdpMasterServers[f].find(":") ), addr) )
+			return; // still waiting for this one
 	}
+	fRegisterUdpTime = tLX->currentTime + 40.0f;
 }
 
 void GameServer::DeRegisterServerUdp()
@@ -1126,6 +1237,7 @@ bool GameServer::DeRegisterServer()
 
 	// Initialize the request
 	bServerRegistered = false;
+	bRegistering = false;
 
 	// Start with the first server
 	notes << "De-registering server at " << *tCurrentMasterServer << endl;
@@ -1174,6 +1286,10 @@ void GameServer::CheckTimeouts()
 	
 	// Check for NAT traversal sockets that are too old
 	for (NatConnList::iterator it = tNatClients.begin(); it != tNatClients.end();)  {
+		if ((*it)->bRemoved)  {
+			it = tNatClients.erase(it);
+			continue;
+		}
 		if ((tLX->currentTime - (*it)->fLastUsed) >= 10.0f)  {
 			std::string addr;
 			NetAddrToString((*it)->tAddress, addr);
@@ -1201,6 +1317,7 @@ void GameServer::CheckTimeouts()
 
 		// Is the client out of zombie state?
 		if(cl->getStatus() == NET_ZOMBIE && tLX->currentTime > cl->getZombieTime() ) {
+			removeClientAddr(cl);
 			cl->setStatus(NET_DISCONNECTED);
 		}
 	}
@@ -1404,7 +1521,7 @@ void GameServer::DropClient(CServerConnection *cl, int reason, const std::string
 		CBytestream bs;
 		bs.writeByte(S2C_DROPPED);
 		bs.writeString(OldLxCompatibleString(cl_msg));
-		cl->getChannel()->AddReliablePacketToSend(bs);
+		cl->getChannel()->AddReliablePacketToSend(std::move(bs));
 
 		// try to transmit immediatly
 		CBytestream unreliable;
@@ -1478,15 +1595,17 @@ void GameServer::RemoveClient(CServerConnection* cl, const std::string& reason)
 	}
 
 	// Remove the socket if the client connected via NAT traversal
+	// (only marked here because we might be called from ReadPackets while it goes through the list)
 	for (NatConnList::iterator it = tNatClients.begin(); it != tNatClients.end(); it++)
-		if (cl->getChannel()->getSocket().get() == it->get()->tTraverseSocket.get() || cl->getChannel()->getSocket().get() == it->get()->tConnectHereSocket.get())  {
-			tNatClients.erase(it);
+		if (!(*it)->bRemoved && (cl->getChannel()->getSocket().get() == it->get()->tTraverseSocket.get() || cl->getChannel()->getSocket().get() == it->get()->tConnectHereSocket.get()))  {
+			(*it)->bRemoved = true;
 			break;
 		}
 	
 	network.getNetControl()->olxHandleClientDisconnect(NetConnID_conn(cl));
 
 	RemoveAllClientWorms(cl, "removed client (" + reason + ")");
+	removeClientAddr(cl);
 	cl->setStatus(NET_DISCONNECTED);
 		
 	CheckForFillWithBots();
@@ -81,6 +81,8 @@ void CServerConnection::Clear()
 
 	cShootList.Shutdown();
 	cShootList.Initialize();
+	cWormUpdates.reset();
+	cInterest.reset();
 
 	if(gameState)
 		delete gameState;
@@ -98,6 +100,8 @@ void CServerConnection::MinorClear()
 {
 	iNetStatus = NET_CONNECTED;
 	fLastReceived = AbsTime::Max();
+	cWormUpdates.reset();
+	cInterest.reset();
 
 	fLastFileRequest = fLastFileRequestPacketReceived = tLX->currentTime;
 	getUdpFileDownloader()->reset();
@@ -199,7 +203,9 @@ CChannel * CServerConnection::createChannel(const Version& v)
 {
 	if( cNetChan )
 		delete cNetChan;
-	if( v >= OLXBetaVersion(0,58,1) )
+	if( v >= OLXBetaVersion(0,59,12) )
+		cNetChan = new CChannel4();
+	else if( v >= OLXBetaVersion(0,58,1) )
 		cNetChan = new CChannel3();
 	else if( v >= OLXBetaVersion(0,57,6) )
 		cNetChan = new CChannel2();
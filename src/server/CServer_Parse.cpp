@@ -236,7 +236,7 @@ void CServerNetEngine::ParsePacket(CBytestream *bs) {
 		
 #ifdef DEBUG
 		if(!bs->isPosAtEnd())
-			bss.push_back( CBytestream( bs->getRawData(startPos, bs->GetPos()) ) );
+			bss.push_back( CBytestream( bs->getRawDataView(startPos, bs->GetPos()) ) );
 #endif
 	}
 }
@@ -1001,7 +1001,7 @@ void CServerNetEngineBeta9::ParseNewNetKeys(CBytestream *bs)
 	CBytestream send;
 	send.writeByte( S2C_NEWNET_KEYS );
 	send.writeByte( id );
-	send.writeData( bs->readData( NewNet::NetPacketSize() ) );
+	send.writeData( bs->readDataView( NewNet::NetPacketSize() ) );
 	
 	// Re-send the packet to all clients, except the sender
 	for( int i=0; i < MAX_CLIENTS; i++ )
@@ -1411,6 +1411,7 @@ void GameServer::ParseConnect(const SmartPointer<NetworkSocket>& net_socket, CBy
 
 	if( newcl->getChannel() ) {
 		// Note: do it also for reconnecting clients as reconnecting detection could be wrong
+		removeClientAddr(newcl);
 		newcl->resetChannel();
 	}
 
@@ -1427,6 +1428,7 @@ void GameServer::ParseConnect(const SmartPointer<NetworkSocket>& net_socket, CBy
 		}
 
 		newcl->getChannel()->Create(adrFrom, net_socket);
+		addClientAddr(newcl);
 	}
 	
 	newcl->setLastReceived(tLX->currentTime);
@@ -40,6 +40,7 @@
 #include "CGameScript.h"
 #include "Utils.h"
 #include "game/GameState.h"
+#include "WormUpdateScheduler.h"
 
 
 // declare them only locally here as nobody really should use them explicitly
@@ -415,6 +416,16 @@ static float maxRateForClient(CServerConnection* cl) {
 	return 0.f;
 }
 
+// the positions of the living worms of the client, i.e. where it looks at
+static void updateClientViewers(CServerConnection* cl) {
+	static std::vector<CVec> viewers;
+	viewers.clear();
+	for_each_iterator(CWorm*, w, game.wormsOfClient(cl))
+		if(w->get()->getAlive())
+			viewers.push_back(w->get()->getPos());
+	cl->getInterest()->setViewers(viewers, tLX->currentTime);
+}
+
 ///////////////////
 // Update all the client about the playing worms
 // Returns true if we sent an update
@@ -447,6 +458,15 @@ bool GameServer::SendUpdate()
 
 	size_t uploadAmount = 0;
 
+	// The worm updates are written once per frame for each kind of receiver
+	// (see CWorm::packetHasVelocity) and only copied for each client.
+	// Kept over the frames, so that we don't allocate each time.
+	static CBytestream wormUpdateData[2];
+	static std::vector<WormUpdateScheduler::Candidate> wormUpdates[2];
+	static std::vector<WormUpdateScheduler::Candidate> wormUpdateCandidates;
+	static std::vector<size_t> wormUpdatesSelected;
+	bool wormUpdatesWritten[2] = { false, false };
+
 	{
 		const int last = lastClientSendData;
 		for (int i = 0; i < MAX_CLIENTS; i++)  {
@@ -492,14 +512,31 @@ bool GameServer::SendUpdate()
 			}
 
 			if(!game.gameScript()->gusEngineUsed() && cl->getClientVersion() < OLXBetaVersion(0,59,10)) {
-				CBytestream update_packets;  // Contains all the update packets except the one from this client
-
-				byte num_worms = 0;
+				const int kind = CWorm::packetHasVelocity(cl->getClientVersion()) ? 1 : 0;
+				const CBytestream& data = wormUpdateData[kind];
+				if(!wormUpdatesWritten[kind]) {
+					wormUpdatesWritten[kind] = true;
+					wormUpdateData[kind].Clear();
+					wormUpdates[kind].clear();
+					for(std::list<CWorm*>::const_iterator w_it = worms_to_update.begin(); w_it != worms_to_update.end(); w_it++) {
+						CWorm* w = *w_it;
+						// Each worm starts at a new byte like in an own bytestream
+						wormUpdateData[kind].ResetBitPos();
+						WormUpdateScheduler::Candidate c;
+						c.wormId = w->getID();
+						c.pos = w->getPos();
+						c.offset = data.GetLength();
+						w->writePacket(&wormUpdateData[kind], true, cl);
+						c.size = data.GetLength() - c.offset;
+						wormUpdates[kind].push_back(c);
+					}
+				}
 
-				// Send all the _other_ worms details
+				// All the _other_ worms details
+				wormUpdateCandidates.clear();
 				{
 					std::list<CWorm*>::const_iterator w_it = worms_to_update.begin();
-					for(; w_it != worms_to_update.end(); w_it++) {
+					for(size_t j = 0; w_it != worms_to_update.end(); w_it++, j++) {
 						CWorm* w = *w_it;
 
 						// Check if this client owns the worm
@@ -510,25 +547,34 @@ bool GameServer::SendUpdate()
 						if(!game.gameMode()->NeedUpdate(cl, w))
 							continue;
 
-						++num_worms;
-
-						CBytestream bytes;
-						bytes.writeByte(w->getID());
-						w->writePacket(&bytes, true, cl);
-
-						// Send out the update
-						update_packets.Append(&bytes);
+						wormUpdateCandidates.push_back(wormUpdates[kind][j]);
 					}
 				}
 
+				// Only the changed and most important worms within the bandwidth of the client
+				wormUpdatesSelected.clear();
+				if(cl->isLocalClient()) {
+					for(size_t j = 0; j < wormUpdateCandidates.size(); ++j)
+						wormUpdatesSelected.push_back(j);
+				}
+				else {
+					updateClientViewers(cl);
+					cl->getWormUpdates()->select(wormUpdateCandidates, data.data().data(), cl->getInterest()->viewers(),
+												 tLX->currentTime, maxRateForClient(cl), wormUpdatesSelected);
+				}
+
 				CBytestream *bs = cl->getUnreliable();
 				size_t oldBsPos = bs->GetPos();
 
-				if(num_worms > 0) {
-					// Write the packets to the unreliable bytestream
+				if(!wormUpdatesSelected.empty()) {
+					// Write the packets directly to the unreliable bytestream
 					bs->writeByte(S2C_UPDATEWORMS);
-					bs->writeByte(num_worms);
-					bs->Append(&update_packets);
+					bs->writeByte((byte)wormUpdatesSelected.size());
+					for(size_t j = 0; j < wormUpdatesSelected.size(); ++j) {
+						const WormUpdateScheduler::Candidate& c = wormUpdateCandidates[wormUpdatesSelected[j]];
+						bs->writeByte(c.wormId);
+						bs->writeData(CBytestream::View(data.data().data() + c.offset, c.size));
+					}
 				}
 				
 				// Write out a stat packet
@@ -570,7 +616,7 @@ bool GameServer::SendUpdate()
 				if(!cl->isLocalClient())
 					uploadAmount += shootBs.GetLength();
 					
-				cl->getChannel()->AddReliablePacketToSend(shootBs);
+				cl->getChannel()->AddReliablePacketToSend(std::move(shootBs));
 			}
 			
 			// TODO: that doesn't update uploadAmount (but it also doesnt in CClient, to be fair :P)
@@ -578,6 +624,7 @@ bool GameServer::SendUpdate()
 
 			if(network.getNetControl()) {
 				const size_t maxBytes = (size_t)-1; // TODO ?
+				updateClientViewers(cl);
 				if(maxBytes > 0)
 					network.getNetControl()->olxSendNodeUpdates(NetConnID_conn(cl), maxBytes);
 			}
@@ -613,17 +660,18 @@ void GameServer::SendGameStateUpdates() {
 
 		GameState& state = *cl->gameState;
 		GameStateUpdates updates;
-		updates.diffFromStateToCurrent(state);
+		updateClientViewers(cl);
+		updates.diffFromStateToCurrent(state, cl->getInterest());
 		if(!updates) continue;
 
 		{
 			CBytestream bs;
 			bs.writeByte(S2C_GAMEATTRUPDATE);
-			updates.writeToBs(&bs, state);
-			cl->getChannel()->AddReliablePacketToSend(bs);
+			updates.writeToBs(&bs, state, cl->getClientVersion());
+			cl->getChannel()->AddReliablePacketToSend(std::move(bs));
 		}
 
-		cl->gameState->updateToCurrent();
+		cl->gameState->updateToCurrent(updates.deferred);
 
 		lastClientSendData = int(cl - cServer->getClients());
 		if(cl == firstNonlocalClientConnection()) counter.addData(1);
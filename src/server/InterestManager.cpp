@@ -0,0 +1,96 @@
+/*
+ *  InterestManager.cpp
+ *  OpenLieroX
+ *
+ *  which objects a client needs to get updates about, and how often
+ *
+ *  code under LGPL
+ *
+ */
+
+#include "InterestManager.h"
+#include "Options.h"
+#include "MathLib.h"
+
+
+bool interestManagementEnabled() {
+	return tLXOptions && tLXOptions->bInterestManagement;
+}
+
+static DistanceInterestPolicy defaultInterestPolicy;
+static InterestPolicy* currentInterestPolicy = &defaultInterestPolicy;
+
+void setInterestPolicy(InterestPolicy* policy) {
+	currentInterestPolicy = policy ? policy : &defaultInterestPolicy;
+}
+
+InterestPolicy* interestPolicy() {
+	return currentInterestPolicy;
+}
+
+
+float DistanceInterestPolicy::updateInterval(const CVec& pos, const std::vector<CVec>& viewers) const {
+	if(viewers.empty()) return 0;
+
+	float dist = farRange;
+	for(size_t i = 0; i < viewers.size(); ++i) {
+		const CVec d = pos - viewers[i];
+		if(fabs(d.x) < viewRangeX && fabs(d.y) < viewRangeY)
+			return 0;
+		dist = MIN(dist, d.GetLength());
+	}
+	return farInterval * MIN(1.0f, dist / farRange);
+}
+
+
+void ClientInterest::reset() {
+	m_viewers.clear();
+	m_lastUpdate.clear();
+	m_lastPrune = AbsTime();
+	m_stats = Stats();
+}
+
+void ClientInterest::setViewers(const std::vector<CVec>& viewers, const AbsTime& now) {
+	m_viewers = viewers;
+
+	// Forget the objects which didn't change for a while (or are gone, like
+	// most particles); they just get their next update right away.
+	if(now < m_lastPrune || now - m_lastPrune < 5.0f) return;
+	m_lastPrune = now;
+	for(std::map<Uint64, AbsTime>::iterator i = m_lastUpdate.begin(); i != m_lastUpdate.end(); ) {
+		if(now < i->second || now - i->second < 5.0f)
+			++i;
+		else
+			m_lastUpdate.erase(i++);
+	}
+}
+
+bool ClientInterest::shouldUpdate(Uint64 key, const CVec& pos, const AbsTime& now) {
+	if(!interestManagementEnabled()) {
+		m_stats.sent++;
+		return true;
+	}
+
+	const float interval = interestPolicy()->updateInterval(pos, m_viewers);
+	AbsTime& last = m_lastUpdate[key];
+	if(interval <= 0) {
+		last = now;
+		m_stats.sent++;
+		return true;
+	}
+
+	// already updated in this frame
+	if(last == now) {
+		m_stats.lowered++;
+		return true;
+	}
+
+	if(last == AbsTime() || now < last || now - last >= interval) {
+		last = now;
+		m_stats.lowered++;
+		return true;
+	}
+
+	m_stats.deferred++;
+	return false;
+}
@@ -0,0 +1,406 @@
+/*
+ *  LoadTest.cpp
+ *  OpenLieroX
+ *
+ *  headless load test clients for a local server
+ *
+ *  code under LGPL
+ *
+ */
+
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <SDL.h>
+#include "LoadTest.h"
+#include "LieroX.h"
+#include "CServer.h"
+#include "CServerConnection.h"
+#include "CChannel.h"
+#include "CBytestream.h"
+#include "Networking.h"
+#include "Protocol.h"
+#include "Version.h"
+#include "FindFile.h"
+#include "StringUtils.h"
+#include "MathLib.h"
+#include "Debug.h"
+#include "game/Game.h"
+#include "game/Level.h"
+#include "game/Mod.h"
+
+
+namespace {
+
+	struct LoadClient {
+		enum State { S_CHALLENGE, S_CONNECTING, S_CONNECTED, S_FAILED };
+
+		int id;
+		State state;
+		SmartPointer<NetworkSocket> socket;
+		NetworkAddr serverAddr;
+		CChannel* channel;
+		int challenge;
+		std::string serverVersion;
+		AbsTime lastConnectPacket;
+
+		Uint64 bytesIn, packetsIn, bytesOut;
+		// the counters when the measurement started
+		Uint64 startBytesIn, startPacketsIn, startBytesOut;
+		size_t startServerRetransmissions, startServerTimeouts;
+
+		LoadClient() : id(0), state(S_CHALLENGE), channel(NULL), challenge(0),
+		bytesIn(0), packetsIn(0), bytesOut(0),
+		startBytesIn(0), startPacketsIn(0), startBytesOut(0),
+		startServerRetransmissions(0), startServerTimeouts(0) {}
+		~LoadClient() { delete channel; channel = NULL; }
+
+		Result init(int _id, const NetworkAddr& _serverAddr) {
+			id = _id;
+			serverAddr = _serverAddr;
+			socket = new NetworkSocket();
+			if(NegResult r = socket->OpenUnreliable(0))
+				return "cannot open socket: " + r.res.humanErrorMsg;
+			return true;
+		}
+
+		NetworkSocket::Port port() const { return GetNetAddrPort(socket->localAddress()); }
+
+		void sendConnectionless(CBytestream& bs) {
+			socket->setRemoteAddress(serverAddr);
+			bs.Send(socket.get());
+			bytesOut += bs.GetLength();
+		}
+
+		void sendConnectPacket() {
+			CBytestream bs;
+			bs.writeInt(-1, 4);
+			if(state == S_CHALLENGE) {
+				bs.writeString("lx::getchallenge");
+				bs.writeString(GetFullGameName());
+			}
+			else {
+				// like CClient::Reconnect, but without worms
+				bs.writeString("lx::connect");
+				bs.writeInt(PROTOCOL_VERSION, 1);
+				bs.writeInt(challenge, 4);
+				bs.writeInt(NST_LAN, 1);
+				bs.writeInt(0, 1);
+			}
+			sendConnectionless(bs);
+			lastConnectPacket = tLX->currentTime;
+		}
+
+		void parseConnectionless(CBytestream& bs) {
+			const std::string cmd = bs.readString(128);
+			if(cmd == "lx::challenge" && state == S_CHALLENGE) {
+				challenge = bs.readInt(4);
+				if(!bs.isPosAtEnd())
+					serverVersion = bs.readString(128);
+				state = S_CONNECTING;
+				sendConnectPacket();
+			}
+			else if(cmd == "lx::goodconnection" && state == S_CONNECTING) {
+				// same choice as CClient::createChannel
+				const Version v(serverVersion);
+				if( v >= OLXBetaVersion(0,59,12) )
+					channel = new CChannel4();
+				else if( v >= OLXBetaVersion(0,58,1) )
+					channel = new CChannel3();
+				else if( v >= OLXBetaVersion(0,57,6) )
+					channel = new CChannel2();
+				else
+					channel = new CChannel_056b();
+				channel->Create(serverAddr, socket);
+				state = S_CONNECTED;
+				notes << "LoadTest: client " << id << " connected" << endl;
+			}
+			else if(cmd == "lx::badconnect") {
+				warnings << "LoadTest: client " << id << " was refused: " << bs.readString(256) << endl;
+				state = S_FAILED;
+			}
+			// anything else (pings, version infos, ...) is not of interest
+		}
+
+		void frame() {
+			if(state == S_FAILED) return;
+
+			CBytestream bs;
+			while(bs.Read(socket.get()) > 0) {
+				bytesIn += bs.GetLength();
+				packetsIn++;
+				if(bs.readInt(4) == -1) {
+					parseConnectionless(bs);
+					continue;
+				}
+				bs.ResetPosToBegin();
+				if(state != S_CONNECTED) continue;
+				// we don't look at the game data, just keep the channel going
+				while(channel->Process(&bs))
+					bs.Clear();
+			}
+
+			if(state == S_CHALLENGE || state == S_CONNECTING) {
+				if(tLX->currentTime - lastConnectPacket >= 1.0f)
+					sendConnectPacket();
+				return;
+			}
+
+			const size_t sentBefore = channel->getOutgoing();
+			CBytestream unreliable;
+			channel->Transmit(&unreliable);
+			bytesOut += channel->getOutgoing() - sentBefore;
+		}
+
+		void disconnect() {
+			if(state != S_CONNECTED) return;
+			CBytestream bs;
+			bs.writeByte(C2S_DISCONNECT);
+			channel->AddReliablePacketToSend(std::move(bs));
+			CBytestream unreliable;
+			channel->Transmit(&unreliable);
+			state = S_FAILED;
+		}
+
+		// the connection of the server to us
+		CChannel* serverChannel() const {
+			if(!cServer || !cServer->getClients()) return NULL;
+			const NetworkSocket::Port p = port();
+			for(int i = 0; i < MAX_CLIENTS; i++) {
+				CServerConnection* cl = &cServer->getClients()[i];
+				if(cl->isUnset() || !cl->getChannel()) continue;
+				const NetworkAddr addr = cl->getChannel()->getAddress();
+				if(GetNetAddrPort(addr) == p && NetAddrToString(addr).find("127.0.0.1") == 0)
+					return cl->getChannel();
+			}
+			return NULL;
+		}
+	};
+
+	size_t retransmissions(CChannel* ch) {
+		CChannel4* c4 = dynamic_cast<CChannel4*>(ch);
+		return c4 ? c4->getRetransmissions() : 0;
+	}
+
+	size_t timeouts(CChannel* ch) {
+		CChannel4* c4 = dynamic_cast<CChannel4*>(ch);
+		return c4 ? c4->getTimeouts() : 0;
+	}
+
+	struct Test {
+		std::vector< SmartPointer<LoadClient> > clients;
+		float seconds;
+		std::string reportFile;
+		bool quitWhenDone;
+		bool measuring;
+		AbsTime measureStart;
+		std::vector<float> frameTimes; // in ms
+		Uint64 frameStart;
+
+		Test() : seconds(0), quitWhenDone(false), measuring(false), frameStart(0) {}
+	};
+
+	Test* test = NULL;
+
+	double ticksToMs(Uint64 ticks) {
+		return ticks * 1000.0 / (double)SDL_GetPerformanceFrequency();
+	}
+
+	float percentile(std::vector<float>& v, int p) {
+		if(v.empty()) return 0;
+		const size_t i = MIN(v.size() - 1, v.size() * p / 100);
+		std::nth_element(v.begin(), v.begin() + i, v.end());
+		return v[i];
+	}
+
+	bool allClientsDone() {
+		for(size_t i = 0; i < test->clients.size(); ++i)
+			if(test->clients[i]->state != LoadClient::S_CONNECTED && test->clients[i]->state != LoadClient::S_FAILED)
+				return false;
+		return true;
+	}
+
+	// like the startGame command
+	void startGame() {
+		if(game.worms()->size() <= 1 && !gameSettings[FT_AllowEmptyGames]) {
+			warnings << "LoadTest: too few worms to start the game, add some bots" << endl;
+			test->quitWhenDone = false;
+			LoadTest::stop();
+			return;
+		}
+		notes << "LoadTest: all clients are connected, starting the game" << endl;
+		game.startGame();
+	}
+
+	void startMeasuring() {
+		test->measuring = true;
+		test->measureStart = tLX->currentTime;
+		test->frameTimes.clear();
+		for(size_t i = 0; i < test->clients.size(); ++i) {
+			LoadClient& c = *test->clients[i].get();
+			c.startBytesIn = c.bytesIn;
+			c.startPacketsIn = c.packetsIn;
+			c.startBytesOut = c.bytesOut;
+			CChannel* sc = c.serverChannel();
+			c.startServerRetransmissions = retransmissions(sc);
+			c.startServerTimeouts = timeouts(sc);
+		}
+		notes << "LoadTest: the game is played, measuring" << endl;
+	}
+
+	void report() {
+		const float secs = MAX((tLX->currentTime - test->measureStart).seconds(), 0.001f);
+		std::vector<std::pair<std::string, std::string> > values;
+		values.push_back(std::make_pair("clients", itoa((int)test->clients.size())));
+		values.push_back(std::make_pair("worms", itoa((int)game.worms()->size())));
+		values.push_back(std::make_pair("map", gameSettings[FT_Map].as<LevelInfo>()->path.get()));
+		values.push_back(std::make_pair("mod", gameSettings[FT_Mod].as<ModInfo>()->path.get()));
+		values.push_back(std::make_pair("seconds", ftoa(secs)));
+
+		std::vector<float>& ft = test->frameTimes;
+		values.push_back(std::make_pair("frames", itoa((int)ft.size())));
+		values.push_back(std::make_pair("frametime_p50_ms", ftoa(percentile(ft, 50))));
+		values.push_back(std::make_pair("frametime_p95_ms", ftoa(percentile(ft, 95))));
+		values.push_back(std::make_pair("frametime_p99_ms", ftoa(percentile(ft, 99))));
+		values.push_back(std::make_pair("frametime_max_ms", ftoa(ft.empty() ? 0.0f : *std::max_element(ft.begin(), ft.end()))));
+
+		int connected = 0;
+		Uint64 bytesIn = 0, packetsIn = 0, bytesOut = 0, maxBytesIn = 0;
+		size_t serverRetrans = 0, serverTimeouts = 0, clientRetrans = 0;
+		for(size_t i = 0; i < test->clients.size(); ++i) {
+			const LoadClient& c = *test->clients[i].get();
+			if(c.state != LoadClient::S_CONNECTED) continue;
+			connected++;
+			bytesIn += c.bytesIn - c.startBytesIn;
+			maxBytesIn = MAX(maxBytesIn, c.bytesIn - c.startBytesIn);
+			packetsIn += c.packetsIn - c.startPacketsIn;
+			bytesOut += c.bytesOut - c.startBytesOut;
+			CChannel* sc = c.serverChannel();
+			serverRetrans += retransmissions(sc) - MIN(retransmissions(sc), c.startServerRetransmissions);
+			serverTimeouts += timeouts(sc) - MIN(timeouts(sc), c.startServerTimeouts);
+			clientRetrans += retransmissions(c.channel);
+		}
+		const float perClient = connected > 0 ? 1.0f / (connected * secs) : 0.0f;
+		values.push_back(std::make_pair("connected_clients", itoa(connected)));
+		values.push_back(std::make_pair("client_in_bytes_per_sec", ftoa(bytesIn * perClient)));
+		values.push_back(std::make_pair("client_in_bytes_per_sec_max", ftoa(maxBytesIn / secs)));
+		values.push_back(std::make_pair("client_in_packets_per_sec", ftoa(packetsIn * perClient)));
+		values.push_back(std::make_pair("client_out_bytes_per_sec", ftoa(bytesOut * perClient)));
+		values.push_back(std::make_pair("server_retransmissions", itoa((int)serverRetrans)));
+		values.push_back(std::make_pair("server_timeouts", itoa((int)serverTimeouts)));
+		values.push_back(std::make_pair("client_retransmissions", itoa((int)clientRetrans)));
+
+		notes << "LoadTest report:" << endl;
+		for(size_t i = 0; i < values.size(); ++i)
+			notes << "  " << values[i].first << " = " << values[i].second << endl;
+
+		if(test->reportFile.empty()) return;
+		FILE* f = OpenGameFile(test->reportFile, "w");
+		if(!f) {
+			errors << "LoadTest: cannot write " << test->reportFile << endl;
+			return;
+		}
+		for(size_t i = 0; i < values.size(); ++i)
+			fprintf(f, "%s=%s\n", values[i].first.c_str(), values[i].second.c_str());
+		fclose(f);
+		notes << "LoadTest: report written to " << test->reportFile << endl;
+	}
+}
+
+
+bool LoadTest::start(int numClients, float seconds, const std::string& reportFile, bool quitWhenDone) {
+	if(test) {
+		warnings << "LoadTest: already running" << endl;
+		return false;
+	}
+	if(!game.isServer() || !cServer || !cServer->isServerRunning() || game.isLocalGame()) {
+		warnings << "LoadTest: start a network server (lobby) first" << endl;
+		return false;
+	}
+
+	NetworkAddr serverAddr;
+	StringToNetAddr("127.0.0.1", serverAddr);
+	SetNetAddrPort(serverAddr, cServer->getPort());
+
+	numClients = CLAMP(numClients, 1, MAX_CLIENTS - 1);
+	test = new Test();
+	test->seconds = MAX(seconds, 0.0f);
+	test->reportFile = reportFile;
+	test->quitWhenDone = quitWhenDone;
+	for(int i = 0; i < numClients; ++i) {
+		SmartPointer<LoadClient> c = new LoadClient();
+		Result r = c->init(i, serverAddr);
+		if(!r) {
+			errors << "LoadTest: client " << i << ": " << r.humanErrorMsg << endl;
+			break;
+		}
+		c->sendConnectPacket();
+		test->clients.push_back(c);
+	}
+	notes << "LoadTest: started " << test->clients.size() << " clients against port " << cServer->getPort() << endl;
+	return true;
+}
+
+void LoadTest::stop() {
+	if(!test) return;
+	if(test->measuring)
+		report();
+	for(size_t i = 0; i < test->clients.size(); ++i)
+		test->clients[i]->disconnect();
+	const bool quit = test->quitWhenDone;
+	delete test;
+	test = NULL;
+	notes << "LoadTest: stopped" << endl;
+	if(quit)
+		game.state = Game::S_Quit;
+}
+
+bool LoadTest::isRunning() {
+	return test != NULL;
+}
+
+void LoadTest::printStatus() {
+	if(!test) {
+		notes << "LoadTest: not running" << endl;
+		return;
+	}
+	int connected = 0, failed = 0;
+	for(size_t i = 0; i < test->clients.size(); ++i) {
+		if(test->clients[i]->state == LoadClient::S_CONNECTED) connected++;
+		if(test->clients[i]->state == LoadClient::S_FAILED) failed++;
+	}
+	notes << "LoadTest: " << connected << " of " << test->clients.size() << " clients connected, " << failed << " failed";
+	if(test->measuring)
+		notes << ", measuring since " << (tLX->currentTime - test->measureStart).seconds() << " secs, " << test->frameTimes.size() << " frames";
+	notes << endl;
+}
+
+void LoadTest::beginFrame() {
+	if(!test) return;
+	test->frameStart = SDL_GetPerformanceCounter();
+}
+
+void LoadTest::endFrame() {
+	if(!test) return;
+
+	// without the time of the load clients
+	const Uint64 frameEnd = SDL_GetPerformanceCounter();
+
+	// the load clients read what the server has sent in this frame
+	for(size_t i = 0; i < test->clients.size(); ++i)
+		test->clients[i]->frame();
+
+	if(!test->measuring) {
+		if(game.state == Game::S_Playing)
+			startMeasuring();
+		else if(game.state == Game::S_Lobby && allClientsDone())
+			startGame();
+		return;
+	}
+
+	if(game.state == Game::S_Playing)
+		test->frameTimes.push_back((float)ticksToMs(frameEnd - test->frameStart));
+
+	if(game.state < Game::S_Lobby || (test->seconds > 0 && tLX->currentTime - test->measureStart >= test->seconds))
+		stop();
+}
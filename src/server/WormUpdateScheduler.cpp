@@ -0,0 +1,291 @@
+/*
+ *  WormUpdateScheduler.cpp
+ *  OpenLieroX
+ *
+ *  per client selection of the worm updates (S2C_UPDATEWORMS)
+ *
+ *  code under LGPL
+ *
+ */
+
+#include <algorithm>
+#include <functional>
+#include <deque>
+#include <cstring>
+#include "WormUpdateScheduler.h"
+#include "CBytestream.h"
+#include "MathLib.h"
+#include "Debug.h"
+
+
+const float WormUpdateScheduler::KEYFRAME_TIME = 1.0f;
+const float WormUpdateScheduler::MAX_CREDIT_TIME = 0.25f;
+
+// the area around an own worm which is about what the client sees
+static const float NEAR_RANGE_X = 200.0f, NEAR_RANGE_Y = 150.0f;
+static const float FAR_RANGE = 1000.0f;
+
+void WormUpdateScheduler::reset() {
+	for(int i = 0; i < MAX_WORMS; ++i) {
+		m_worms[i].baseline.clear();
+		m_worms[i].sentCount = 0;
+		m_worms[i].lastSent = AbsTime();
+		m_worms[i].priority = 0;
+	}
+	m_lastTime = AbsTime();
+	m_credit = 0;
+	m_queue.clear();
+}
+
+float WormUpdateScheduler::weight(const CVec& pos, const std::vector<CVec>& viewers) {
+	if(viewers.empty()) return 2.0f; // spectator: all worms are equal
+
+	float best = 1.0f;
+	for(size_t i = 0; i < viewers.size(); ++i) {
+		const CVec d = pos - viewers[i];
+		if(fabs(d.x) < NEAR_RANGE_X && fabs(d.y) < NEAR_RANGE_Y)
+			return 8.0f;
+		best = MAX(best, 1.0f + 3.0f * MAX(0.0f, 1.0f - d.GetLength() / FAR_RANGE));
+	}
+	return best;
+}
+
+void WormUpdateScheduler::select(const std::vector<Candidate>& candidates, const char* data, const std::vector<CVec>& viewers,
+								 const AbsTime& now, float rate, std::vector<size_t>& selected) {
+	float dt = 0.0f;
+	if(m_lastTime != AbsTime() && now > m_lastTime)
+		dt = (now - m_lastTime).seconds();
+	m_lastTime = now;
+	if(rate > 0)
+		m_credit = MIN(m_credit + rate * dt, rate * MAX_CREDIT_TIME);
+
+	m_queue.clear();
+	for(size_t i = 0; i < candidates.size(); ++i) {
+		const Candidate& c = candidates[i];
+		if(c.wormId < 0 || c.wormId >= MAX_WORMS) continue;
+		WormState& w = m_worms[c.wormId];
+
+		const bool unchanged = w.baseline.size() == c.size && memcmp(w.baseline.data(), data + c.offset, c.size) == 0;
+		if(unchanged && w.sentCount >= REDUNDANCY && now - w.lastSent < KEYFRAME_TIME) {
+			w.priority = 0; // the client is up to date
+			continue;
+		}
+
+		w.priority += weight(c.pos, viewers) * MAX(dt, 0.001f);
+		m_queue.push_back(std::make_pair(w.priority, i));
+	}
+
+	std::sort(m_queue.begin(), m_queue.end(), std::greater< std::pair<float, size_t> >());
+
+	for(size_t q = 0; q < m_queue.size(); ++q) {
+		const Candidate& c = candidates[m_queue[q].second];
+		const float cost = (float)(c.size + 1); // + the worm id
+		if(rate > 0 && q > 0 && m_credit < cost) break;
+
+		WormState& w = m_worms[c.wormId];
+		if(w.baseline.size() == c.size && memcmp(w.baseline.data(), data + c.offset, c.size) == 0)
+			w.sentCount++;
+		else {
+			w.baseline.assign(data + c.offset, c.size);
+			w.sentCount = 1;
+		}
+		w.lastSent = now;
+		w.priority = 0;
+		m_credit -= cost;
+		selected.push_back(m_queue[q].second);
+	}
+
+	if(rate > 0)
+		m_credit = MAX(m_credit, -rate * MAX_CREDIT_TIME);
+}
+
+
+///////////////////
+// Bandwidth simulation
+
+namespace {
+	struct SimWorm {
+		CVec pos, vel;
+		bool moving;
+		float stateTime;
+		Uint8 angle;
+	};
+
+	struct SimClient {
+		std::string known[MAX_WORMS]; // what the client knows about the worms
+		AbsTime knownTime[MAX_WORMS];
+		std::deque< std::pair<AbsTime, size_t> > window; // the sent bytes of the last second
+		size_t windowBytes;
+		Uint64 totalBytes;
+		WormUpdateScheduler scheduler;
+		SimClient() : windowBytes(0), totalBytes(0) {}
+	};
+
+	struct SimResult {
+		Uint64 bytes;
+		std::vector<float> nearStale, farStale; // in ms
+		SimResult() : bytes(0) {}
+	};
+
+	struct SimMatch {
+		static const int W = 2000, H = 1000;
+		std::vector<SimWorm> worms;
+		Uint32 random;
+
+		Uint32 nextRandom() { random = random * 1103515245 + 12345; return random >> 8; }
+		float nextFloat() { return (float)(nextRandom() % 10000) / 10000.0f; }
+
+		void init(int numWorms) {
+			random = 1;
+			worms.resize(numWorms);
+			for(int i = 0; i < numWorms; ++i) {
+				SimWorm& w = worms[i];
+				w.pos = CVec(nextFloat() * W, nextFloat() * H);
+				w.vel = CVec();
+				w.moving = false;
+				w.stateTime = nextFloat() * 2.0f;
+				w.angle = (Uint8)nextRandom();
+			}
+		}
+
+		// the worms move for some seconds and rest (camp, aim) for some seconds
+		void tick(float dt) {
+			for(size_t i = 0; i < worms.size(); ++i) {
+				SimWorm& w = worms[i];
+				w.stateTime -= dt;
+				if(w.stateTime <= 0) {
+					w.moving = !w.moving;
+					w.stateTime = w.moving ? (1.0f + nextFloat() * 3.0f) : (0.5f + nextFloat() * 2.5f);
+					w.vel = w.moving ? CVec(nextFloat() * 300.0f - 150.0f, nextFloat() * 200.0f - 100.0f) : CVec();
+				}
+				if(!w.moving) {
+					if(nextRandom() % 100 == 0) w.angle += 4;
+					continue;
+				}
+				if(nextRandom() % 20 == 0) w.vel.y += 60.0f;
+				w.pos += w.vel * dt;
+				if(w.pos.x < 0 || w.pos.x >= W) { w.vel.x = -w.vel.x; w.pos.x = CLAMP(w.pos.x, 0.0f, (float)W - 1); }
+				if(w.pos.y < 0 || w.pos.y >= H) { w.vel.y = -w.vel.y; w.pos.y = CLAMP(w.pos.y, 0.0f, (float)H - 1); }
+				w.angle++;
+			}
+		}
+
+		// about what CWorm::writePacket writes
+		void write(size_t i, CBytestream& bs) const {
+			const SimWorm& w = worms[i];
+			bs.writeInt((int)w.pos.x, 2);
+			bs.writeInt((int)w.pos.y, 2);
+			bs.writeByte(w.angle);
+			bs.writeByte(w.moving ? 1 : 0);
+			bs.writeByte(0); // weapon
+			bs.writeInt((Sint16)w.vel.x, 2);
+			bs.writeInt((Sint16)w.vel.y, 2);
+		}
+	};
+
+	void runSim(bool scheduled, int numWorms, float rate, SimResult& res) {
+		const TimeDiff frameTime(20); // 50 updates per second
+		const int frames = 50 * 60;
+		SimMatch match;
+		match.init(numWorms);
+		std::vector<SimClient> clients(numWorms);
+		std::vector<WormUpdateScheduler::Candidate> candidates;
+		std::vector<size_t> selected;
+		std::vector<CVec> viewers(1);
+		CBytestream all;
+
+		AbsTime now(Uint64(1000));
+		for(int f = 0; f < frames; ++f, now += frameTime) {
+			match.tick(frameTime.seconds());
+
+			all.Clear();
+			std::vector<WormUpdateScheduler::Candidate> wormUpdates(numWorms);
+			for(int i = 0; i < numWorms; ++i) {
+				wormUpdates[i].wormId = i;
+				wormUpdates[i].pos = match.worms[i].pos;
+				wormUpdates[i].offset = all.GetLength();
+				match.write(i, all);
+				wormUpdates[i].size = all.GetLength() - wormUpdates[i].offset;
+			}
+			const std::string& data = all.data();
+
+			for(int c = 0; c < numWorms; ++c) {
+				SimClient& cl = clients[c];
+				while(!cl.window.empty() && now - cl.window.front().first >= 1.0f) {
+					cl.windowBytes -= cl.window.front().second;
+					cl.window.pop_front();
+				}
+
+				candidates.clear();
+				for(int i = 0; i < numWorms; ++i)
+					if(i != c) candidates.push_back(wormUpdates[i]);
+
+				selected.clear();
+				// like GameServer::checkBandwidth: nothing this frame if we are over the rate
+				if((float)cl.windowBytes <= rate) {
+					if(scheduled) {
+						viewers[0] = match.worms[c].pos;
+						cl.scheduler.select(candidates, data.data(), viewers, now, rate, selected);
+					}
+					else
+						for(size_t i = 0; i < candidates.size(); ++i)
+							selected.push_back(i);
+				}
+
+				if(!selected.empty()) {
+					size_t bytes = 2; // S2C_UPDATEWORMS + count
+					for(size_t i = 0; i < selected.size(); ++i) {
+						const WormUpdateScheduler::Candidate& u = candidates[selected[i]];
+						bytes += 1 + u.size;
+						cl.known[u.wormId].assign(data.data() + u.offset, u.size);
+						cl.knownTime[u.wormId] = now;
+					}
+					cl.window.push_back(std::make_pair(now, bytes));
+					cl.windowBytes += bytes;
+					cl.totalBytes += bytes;
+					res.bytes += bytes;
+				}
+
+				if(f % 5 != 0) continue;
+				for(size_t i = 0; i < candidates.size(); ++i) {
+					const WormUpdateScheduler::Candidate& u = candidates[i];
+					const std::string& known = cl.known[u.wormId];
+					float stale = 0;
+					if(known.size() != u.size || memcmp(known.data(), data.data() + u.offset, u.size) != 0)
+						stale = (float)(now - cl.knownTime[u.wormId]).milliseconds();
+					const CVec d = u.pos - match.worms[c].pos;
+					if(fabs(d.x) < NEAR_RANGE_X && fabs(d.y) < NEAR_RANGE_Y)
+						res.nearStale.push_back(stale);
+					else
+						res.farStale.push_back(stale);
+				}
+			}
+		}
+	}
+
+	void printStale(const std::string& name, std::vector<float>& stale) {
+		if(stale.empty()) {
+			notes << "  " << name << ": -" << endl;
+			return;
+		}
+		double sum = 0;
+		for(size_t i = 0; i < stale.size(); ++i) sum += stale[i];
+		const size_t p95 = stale.size() * 95 / 100;
+		std::nth_element(stale.begin(), stale.begin() + p95, stale.end());
+		notes << "  " << name << " worms: staleness avg " << (sum / stale.size()) << " ms, 95% " << stale[p95] << " ms" << endl;
+	}
+}
+
+void WormUpdateScheduler::simulate(int numWorms, float rate) {
+	numWorms = CLAMP(numWorms, 2, (int)MAX_WORMS);
+	notes << "WormUpdateScheduler simulation: " << numWorms << " players, one worm each, " << rate << " bytes/sec per client, 60 secs at 50 updates/sec" << endl;
+
+	for(int s = 0; s < 2; ++s) {
+		SimResult res;
+		runSim(s == 1, numWorms, rate, res);
+		notes << (s == 1 ? "scheduled:" : "all worms every frame:") << endl;
+		notes << "  " << (res.bytes / 60 / numWorms) << " bytes/client/sec" << endl;
+		printStale("near", res.nearStale);
+		printStale("far", res.farStale);
+	}
+}